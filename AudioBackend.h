@@ -0,0 +1,50 @@
+#ifndef AUDIOBACKEND_H
+#define AUDIOBACKEND_H
+
+#include "AudioTypes.h"
+
+// The device-side operations driven by AudioStream. A backend owns the
+// underlying IO unit and fires the registered render callback from its own
+// rendering thread. The calls are made in the following order:
+//   [EnableInput] -> Create -> SetStreamFormat -> SetCallback -> Init
+//   -> (Start <-> Stop) -> Uninit -> Destroy
+// SetCallback may be called again on an initialized, stopped backend, to
+// hand it over to another stream.
+class AudioBackend
+{
+public:
+  // CoreAudio's default maximum number of frames per render callback.
+  static const UInt32 DEFAULT_MAX_FRAMES = 4096;
+
+  virtual ~AudioBackend() {}
+
+  // Capture from the input device with aDesc, alongside the output. The
+  // backends without input support reject it.
+  virtual bool EnableInput(const AudioStreamBasicDescription& aDesc)
+  {
+    return false;
+  }
+  // Pull the input frames of the current render cycle into aData. It's only
+  // called from within the render callback of an input-enabled backend.
+  virtual OSStatus RenderInput(AudioUnitRenderActionFlags* aActionFlags,
+                               const AudioTimeStamp* aTimeStamp,
+                               UInt32 aNumFrames,
+                               AudioBufferList* aData)
+  {
+    return -1;
+  }
+  // The largest number of frames a render callback may ask for. Valid after
+  // Init.
+  virtual UInt32 GetMaxFramesPerBuffer() const { return DEFAULT_MAX_FRAMES; }
+
+  virtual bool Create() = 0;
+  virtual bool Destroy() = 0;
+  virtual bool Init() = 0;
+  virtual bool Uninit() = 0;
+  virtual bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) = 0;
+  virtual bool SetCallback(AURenderCallback aCallback, void* aRefCon) = 0;
+  virtual bool Start() = 0;
+  virtual bool Stop() = 0;
+};
+
+#endif // #ifndef AUDIOBACKEND_H
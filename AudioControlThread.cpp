@@ -0,0 +1,90 @@
+#include "AudioControlThread.h"
+#include <cassert>
+
+AudioControlThread::AudioControlThread()
+  : mRunning(true)
+  , mPosted(0)
+  , mExecuted(0)
+{
+  mThread = std::thread(&AudioControlThread::Run, this);
+}
+
+AudioControlThread::~AudioControlThread()
+{
+  assert(!IsCurrentThread());
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mRunning = false;
+  }
+  mCondition.notify_one();
+  mThread.join();
+}
+
+/* static */ AudioControlThread&
+AudioControlThread::Global()
+{
+  // Never destroyed, since the global streams may be destroyed after it.
+  static AudioControlThread* control = new AudioControlThread();
+  return *control;
+}
+
+std::future<bool>
+AudioControlThread::Post(Command aCommand,
+                         Completion aCompletion,
+                         void* aContext)
+{
+  assert(aCommand);
+  Task task = { std::move(aCommand), aCompletion, aContext,
+                std::make_shared<std::promise<bool>>() };
+  std::future<bool> result = task.mPromise->get_future();
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    assert(mRunning);
+    mTasks.push_back(std::move(task));
+    ++mPosted;
+  }
+  mCondition.notify_one();
+  return result;
+}
+
+bool
+AudioControlThread::IsCurrentThread() const
+{
+  return mThread.get_id() == std::this_thread::get_id();
+}
+
+AudioControlThread::Stats
+AudioControlThread::GetStats() const
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  Stats stats;
+  stats.mPosted = mPosted;
+  stats.mExecuted = mExecuted;
+  return stats;
+}
+
+void
+AudioControlThread::Run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mCondition.wait(lock, [this] { return !mRunning || !mTasks.empty(); });
+    if (mTasks.empty()) {
+      break; // Stopped, with nothing left to run.
+    }
+    Task task = std::move(mTasks.front());
+    mTasks.pop_front();
+
+    // Don't hold the lock in the command, so Post never waits for it.
+    lock.unlock();
+    bool succeeded = task.mCommand();
+    if (task.mCompletion) {
+      task.mCompletion(succeeded, task.mContext);
+    }
+    // Counted before the result is set, so the stats read by a caller done
+    // waiting for it include the command.
+    lock.lock();
+    ++mExecuted;
+    task.mPromise->set_value(succeeded);
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef AUDIOCONTROLTHREAD_H
+#define AUDIOCONTROLTHREAD_H
+
+#include <condition_variable> // std::condition_variable
+#include <deque>              // std::deque
+#include <functional>         // std::function
+#include <future>             // std::future, std::promise
+#include <memory>             // std::shared_ptr
+#include <mutex>              // std::mutex
+#include <stdint.h>           // uint64_t
+#include <thread>             // std::thread
+
+// Run the commands mutating the audio units one at a time, in the order they
+// are posted, on a single dedicated thread.
+//
+// The AudioUnit APIs take the unit's internal lock, which the render
+// callback holds while it runs (see test_deadlock.cpp), so a thread calling
+// them may wait for the callback, and for whatever the callback waits for.
+// Posting them here instead never waits: the caller gets a future, and
+// optionally a completion called on the control thread, with the result.
+class AudioControlThread
+{
+public:
+  typedef std::function<bool()> Command;
+  // Called on the control thread with the result of the command.
+  typedef void (* Completion)(bool aSucceeded, void* aContext);
+
+  struct Stats
+  {
+    uint64_t mPosted;   // Commands posted.
+    uint64_t mExecuted; // Commands run to completion.
+  };
+
+  AudioControlThread();
+  // Run the commands still queued, then stop the thread.
+  ~AudioControlThread();
+
+  // The process-wide control thread, so the commands of all the streams
+  // using it are serialized.
+  static AudioControlThread& Global();
+
+  // Queue aCommand behind the ones posted before it. It only locks the queue
+  // for the time of a push, so it's safe to call from any thread holding any
+  // lock, including the control thread itself.
+  std::future<bool> Post(Command aCommand,
+                         Completion aCompletion = nullptr,
+                         void* aContext = nullptr);
+
+  bool IsCurrentThread() const;
+
+  // It's safe to call this from any thread.
+  Stats GetStats() const;
+
+private:
+  struct Task
+  {
+    Command mCommand;
+    Completion mCompletion;
+    void* mContext;
+    std::shared_ptr<std::promise<bool>> mPromise;
+  };
+
+  void Run();
+
+  // Not copyable: the control thread runs on this object.
+  AudioControlThread(const AudioControlThread&);
+  AudioControlThread& operator=(const AudioControlThread&);
+
+  mutable std::mutex mMutex;
+  std::condition_variable mCondition;
+  std::deque<Task> mTasks;
+  bool mRunning;
+  uint64_t mPosted;
+  uint64_t mExecuted;
+  std::thread mThread;
+};
+
+#endif // #ifndef AUDIOCONTROLTHREAD_H
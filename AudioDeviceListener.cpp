@@ -1,54 +1,64 @@
 #include "AudioDeviceListener.h"
+#include "AudioObjectProperties.h"
 #include <cassert>
 
-const AudioObjectPropertyAddress kDefaultOutputDeviceChangePropertyAddress = {
-  kAudioHardwarePropertyDefaultOutputDevice,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster };
-
-const AudioObjectPropertyAddress kDefaultInputDeviceChangePropertyAddress = {
-  kAudioHardwarePropertyDefaultInputDevice,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster };
-
-const AudioObjectPropertyAddress kDevicesPropertyAddress = {
-  kAudioHardwarePropertyDevices,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster };
-
 class AudioDeviceListener::PropertyListener {
 public:
   PropertyListener(AudioObjectID aObjectId,
                    const AudioObjectPropertyAddress* aAddress,
-                   DeviceChangeCallback aCallback)
+                   AudioDeviceListener* aOwner,
+                   DeviceChange aChange)
     : mObjectId(aObjectId)
     , mAddress(aAddress)
-    , mCallback(aCallback)
+    , mOwner(aOwner)
+    , mChange(aChange)
   {}
 
   ~PropertyListener() {};
 
   AudioObjectID getObjectId() const { return mObjectId; }
   const AudioObjectPropertyAddress* getProperty() const { return mAddress; }
-  const DeviceChangeCallback& getCallback() const { return mCallback; }
+  AudioDeviceListener* getOwner() const { return mOwner; }
+  DeviceChange getChange() const { return mChange; }
 
 private:
   AudioObjectID mObjectId;
   const AudioObjectPropertyAddress* mAddress;
-  DeviceChangeCallback mCallback;
+  AudioDeviceListener* mOwner;
+  DeviceChange mChange;
 };
 
-AudioDeviceListener::AudioDeviceListener(DeviceChangeCallback aCallbck)
+AudioDeviceListener::AudioDeviceListener(DeviceChangeSetCallback aCallback,
+                                         unsigned int aCoalescingMs)
+  : mCallback(aCallback)
+  , mPlainCallback(nullptr)
+  , mDispatcher(&Dispatch, this, aCoalescingMs)
+{
+  assert(aCallback);
+  RegisterListeners();
+}
+
+AudioDeviceListener::AudioDeviceListener(DeviceChangeCallback aCallbck,
+                                         unsigned int aCoalescingMs)
+  : mCallback(nullptr)
+  , mPlainCallback(aCallbck)
+  , mDispatcher(&Dispatch, this, aCoalescingMs)
+{
+  assert(aCallbck);
+  RegisterListeners();
+}
+
+void AudioDeviceListener::RegisterListeners()
 {
   mDefaultOutputListener = std::make_unique<PropertyListener> (
-    kAudioObjectSystemObject, &kDefaultOutputDeviceChangePropertyAddress,
-    aCallbck);
+    kAudioObjectSystemObject, &DefaultOutputDeviceProperty::kAddress,
+    this, DefaultOutputChanged);
   mDefaultInputListener = std::make_unique<PropertyListener> (
-    kAudioObjectSystemObject, &kDefaultInputDeviceChangePropertyAddress,
-    aCallbck);
+    kAudioObjectSystemObject, &DefaultInputDeviceProperty::kAddress,
+    this, DefaultInputChanged);
   mDeviceListener = std::make_unique<PropertyListener> (
-    kAudioObjectSystemObject, &kDevicesPropertyAddress,
-    aCallbck);
+    kAudioObjectSystemObject, &DevicesProperty::kAddress,
+    this, DevicesChanged);
 
   if (!AddPropertyListener(mDefaultOutputListener.get())) {
     mDefaultOutputListener.reset();
@@ -65,8 +75,10 @@ AudioDeviceListener::AudioDeviceListener(DeviceChangeCallback aCallbck)
 
 AudioDeviceListener::~AudioDeviceListener()
 {
-  if (mDefaultInputListener) {
-    RemovePropertyListener(mDefaultInputListener.get());
+  // Remove the listeners before mDispatcher stops, so no notification
+  // comes in after.
+  if (mDefaultOutputListener) {
+    RemovePropertyListener(mDefaultOutputListener.get());
   }
 
   if (mDefaultInputListener) {
@@ -78,6 +90,11 @@ AudioDeviceListener::~AudioDeviceListener()
   }
 }
 
+CoalescingDispatcher::Stats AudioDeviceListener::GetStats() const
+{
+  return mDispatcher.GetStats();
+}
+
 bool AudioDeviceListener::AddPropertyListener(PropertyListener* aListener)
 {
   return AudioObjectAddPropertyListener(aListener->getObjectId(),
@@ -90,6 +107,17 @@ bool AudioDeviceListener::RemovePropertyListener(PropertyListener* aListener)
     aListener->getProperty(), &OnEvent, aListener) == noErr;
 }
 
+/* static */ void
+AudioDeviceListener::Dispatch(uint32_t aChanges, void* aContext)
+{
+  AudioDeviceListener* self = static_cast<AudioDeviceListener*>(aContext);
+  if (self->mCallback) {
+    self->mCallback(aChanges);
+  } else {
+    self->mPlainCallback();
+  }
+}
+
 /* static */ OSStatus
 AudioDeviceListener::OnEvent(AudioObjectID aObject,
                              UInt32 aNumAddresses,
@@ -105,11 +133,10 @@ AudioDeviceListener::OnEvent(AudioObjectID aObject,
     if (aAddresses[i].mSelector == listener->getProperty()->mSelector &&
         aAddresses[i].mScope == listener->getProperty()->mScope &&
         aAddresses[i].mElement == listener->getProperty()->mElement) {
-      DeviceChangeCallback callback = listener->getCallback();
-      callback();
+      listener->getOwner()->mDispatcher.Notify(listener->getChange());
       break;
     }
   }
 
   return noErr;
-}
\ No newline at end of file
+}
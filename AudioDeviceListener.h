@@ -1,30 +1,61 @@
 #ifndef AUDIODEVICELISTENER_H
 #define AUDIODEVICELISTENER_H
 
-#include <CoreAudio/AudioHardware.h>
-#include <memory> // std::unique_ptr
+#include "AudioHardwareTypes.h"
+#include "CoalescingDispatcher.h"
+#include <memory>   // std::unique_ptr
+#include <stdint.h> // uint32_t
+
+// What changed, as a set of bits.
+enum DeviceChange : uint32_t
+{
+  DefaultInputChanged = 1 << 0,
+  DefaultOutputChanged = 1 << 1,
+  DevicesChanged = 1 << 2
+};
+typedef uint32_t DeviceChangeSet;
 
 typedef void (* DeviceChangeCallback)();
+typedef void (* DeviceChangeSetCallback)(DeviceChangeSet changes);
 
+// Listen to the default device and device list changes.
+//
+// The callbacks are not fired on the HAL's notification thread. The changes
+// are handed to a CoalescingDispatcher, which fires the callback on its own
+// thread, once per coalescing window, so a burst of notifications, e.g. when
+// a USB hub is plugged in, results in a single callback with everything that
+// changed.
 class AudioDeviceListener {
 public:
-  AudioDeviceListener(DeviceChangeCallback aCallbck);
+  AudioDeviceListener(DeviceChangeSetCallback aCallback,
+                      unsigned int aCoalescingMs = 50);
+  // The callback isn't told what changed.
+  AudioDeviceListener(DeviceChangeCallback aCallbck,
+                      unsigned int aCoalescingMs = 50);
   ~AudioDeviceListener();
 
+  // The number of HAL notifications, and of callbacks fired for them.
+  CoalescingDispatcher::Stats GetStats() const;
+
 private:
   class PropertyListener;
 
   bool AddPropertyListener(PropertyListener* aListener);
   bool RemovePropertyListener(PropertyListener* aListener);
-  bool RegisterListener();
+  void RegisterListeners();
+  static void Dispatch(uint32_t aChanges, void* aContext);
   static OSStatus OnEvent(AudioObjectID aObject,
                           UInt32 aNumAddresses,
                           const AudioObjectPropertyAddress aAddresses[],
                           void* aData);
 
+  DeviceChangeSetCallback mCallback;
+  DeviceChangeCallback mPlainCallback;
+  CoalescingDispatcher mDispatcher;
+
   std::unique_ptr<PropertyListener> mDefaultOutputListener;
   std::unique_ptr<PropertyListener> mDefaultInputListener;
   std::unique_ptr<PropertyListener> mDeviceListener;
 };
 
-#endif // #ifndef AUDIODEVICELISTENER_H
\ No newline at end of file
+#endif // #ifndef AUDIODEVICELISTENER_H
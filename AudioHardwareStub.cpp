@@ -0,0 +1,406 @@
+#include "AudioHardwareTypes.h"
+#include <algorithm> // std::min, std::remove_if
+#include <atomic>    // std::atomic
+#include <cstring>   // memcpy
+#include <mutex>     // std::mutex
+#include <string>    // std::string
+#include <vector>    // std::vector
+
+// A stub of the HAL, serving a fixed set of devices from constant tables:
+// the same queries as CoreAudio's, answered without the IPC behind them, so
+// only the cost on the caller's side is measured.
+
+struct __CFString
+{
+  std::string mUtf8;
+};
+
+struct StubDevice
+{
+  AudioObjectID mId;
+  const char* mName;
+  UInt32 mInputStreams;
+  UInt32 mOutputStreams;
+  // 0 when the device has no data source in that scope.
+  UInt32 mInputSource;
+  UInt32 mOutputSource;
+};
+
+struct StubSource
+{
+  UInt32 mId;
+  const char* mName;
+};
+
+static const StubDevice DEVICES[] = {
+  { 41, "Built-in Microphone", 1, 0, 0x696D6963, 0 },   // 'imic'
+  { 48, "Built-in Output", 0, 1, 0, 0x6973706B },       // 'ispk'
+  { 55, "USB Audio CODEC", 1, 1, 0, 0 },
+  { 62, "HDMI", 0, 1, 0, 0x68646D69 },                  // 'hdmi'
+  { 69, "Multi-Output Device", 0, 2, 0, 0 },
+  { 76, "Aggregate Device", 2, 2, 0, 0 }
+};
+
+static const StubSource SOURCES[] = {
+  { 0x696D6963, "Internal Microphone" },
+  { 0x6973706B, "Internal Speakers" },
+  { 0x68646D69, "HDMI Display" }
+};
+
+static std::atomic<AudioObjectID> sDefaultInput(41);
+static std::atomic<AudioObjectID> sDefaultOutput(48);
+
+struct StubListener
+{
+  AudioObjectID mId;
+  AudioObjectPropertyAddress mAddress;
+  AudioObjectPropertyListenerProc mListener;
+  void* mClientData;
+};
+
+static std::mutex sListenersMutex;
+static std::vector<StubListener> sListeners;
+
+static const StubDevice*
+FindDevice(AudioObjectID aId)
+{
+  for (const StubDevice& d : DEVICES) {
+    if (d.mId == aId) {
+      return &d;
+    }
+  }
+  return nullptr;
+}
+
+static CFStringRef
+NewString(const char* aUtf8)
+{
+  return new __CFString{ aUtf8 };
+}
+
+// The streams of a device in aScope, numbered after the device.
+static UInt32
+StreamCount(const StubDevice& aDevice, AudioObjectPropertyScope aScope)
+{
+  return aScope == kAudioObjectPropertyScopeInput ? aDevice.mInputStreams :
+         aScope == kAudioObjectPropertyScopeOutput ? aDevice.mOutputStreams :
+         aDevice.mInputStreams + aDevice.mOutputStreams;
+}
+
+static UInt32
+SourceOf(const StubDevice& aDevice, AudioObjectPropertyScope aScope)
+{
+  return aScope == kAudioObjectPropertyScopeInput ? aDevice.mInputSource :
+         aScope == kAudioObjectPropertyScopeOutput ? aDevice.mOutputSource : 0;
+}
+
+// Copy the aCount elements of aSize bytes at aData into the ioDataSize bytes
+// at aOut, as many as fit, like the HAL does.
+static OSStatus
+CopyOut(const void* aData, UInt32 aSize, UInt32 aCount,
+        UInt32* ioDataSize, void* aOut)
+{
+  UInt32 count = std::min(aCount, *ioDataSize / aSize);
+  memcpy(aOut, aData, count * aSize);
+  *ioDataSize = count * aSize;
+  return kAudioHardwareNoError;
+}
+
+static OSStatus
+CopyValue(UInt32 aValue, UInt32* ioDataSize, void* aOut)
+{
+  if (*ioDataSize < sizeof(aValue)) {
+    return kAudioHardwareBadPropertySizeError;
+  }
+  return CopyOut(&aValue, sizeof(aValue), 1, ioDataSize, aOut);
+}
+
+void
+CFRelease(CFTypeRef aObject)
+{
+  delete static_cast<CFStringRef>(aObject);
+}
+
+CFIndex
+CFStringGetLength(CFStringRef aString)
+{
+  // The UTF-16 length. The stub names are all in the BMP.
+  CFIndex length = 0;
+  for (unsigned char c : aString->mUtf8) {
+    length += (c & 0xC0) != 0x80;
+  }
+  return length;
+}
+
+CFIndex
+CFStringGetBytes(CFStringRef aString,
+                 CFRange aRange,
+                 CFStringEncoding aEncoding,
+                 UInt8 aLossByte,
+                 Boolean aIsExternalRepresentation,
+                 UInt8* aBuffer,
+                 CFIndex aMaxBufLen,
+                 CFIndex* aUsedBufLen)
+{
+  // Only the whole strings, in UTF-8, are converted by AudioObjectUtils.
+  if (aEncoding != kCFStringEncodingUTF8 || aRange.location != 0 ||
+      aRange.length != CFStringGetLength(aString)) {
+    return 0;
+  }
+  CFIndex size = static_cast<CFIndex>(aString->mUtf8.size());
+  if (aBuffer) {
+    if (aMaxBufLen < size) {
+      return 0;
+    }
+    memcpy(aBuffer, aString->mUtf8.data(), size);
+  }
+  if (aUsedBufLen) {
+    *aUsedBufLen = size;
+  }
+  return aRange.length;
+}
+
+// Whether aSelector is a default device, the only properties to be set.
+static bool
+IsDefaultDevice(AudioObjectPropertySelector aSelector)
+{
+  return aSelector == kAudioHardwarePropertyDefaultInputDevice ||
+         aSelector == kAudioHardwarePropertyDefaultOutputDevice;
+}
+
+Boolean
+AudioObjectHasProperty(AudioObjectID inObjectID,
+                       const AudioObjectPropertyAddress* inAddress)
+{
+  const AudioObjectPropertySelector selector = inAddress->mSelector;
+  if (inObjectID == kAudioObjectSystemObject) {
+    return selector == kAudioHardwarePropertyDevices ||
+           IsDefaultDevice(selector);
+  }
+  const StubDevice* device = FindDevice(inObjectID);
+  if (!device) {
+    return false;
+  }
+  if (selector == kAudioObjectPropertyName ||
+      selector == kAudioDevicePropertyStreams) {
+    return true;
+  }
+  return (selector == kAudioDevicePropertyDataSource ||
+          selector == kAudioDevicePropertyDataSourceNameForIDCFString) &&
+         SourceOf(*device, inAddress->mScope);
+}
+
+OSStatus
+AudioObjectIsPropertySettable(AudioObjectID inObjectID,
+                              const AudioObjectPropertyAddress* inAddress,
+                              Boolean* outIsSettable)
+{
+  if (!AudioObjectHasProperty(inObjectID, inAddress)) {
+    return kAudioHardwareUnknownPropertyError;
+  }
+  *outIsSettable = inObjectID == kAudioObjectSystemObject &&
+                   IsDefaultDevice(inAddress->mSelector);
+  return kAudioHardwareNoError;
+}
+
+OSStatus
+AudioObjectGetPropertyDataSize(AudioObjectID inObjectID,
+                               const AudioObjectPropertyAddress* inAddress,
+                               UInt32 inQualifierDataSize,
+                               const void* inQualifierData,
+                               UInt32* outDataSize)
+{
+  if (inObjectID == kAudioObjectSystemObject &&
+      inAddress->mSelector == kAudioHardwarePropertyDevices) {
+    *outDataSize = sizeof(DEVICES) / sizeof(DEVICES[0]) *
+                   sizeof(AudioObjectID);
+    return kAudioHardwareNoError;
+  }
+  const StubDevice* device = FindDevice(inObjectID);
+  if (!device) {
+    return kAudioHardwareBadObjectError;
+  }
+  if (inAddress->mSelector == kAudioDevicePropertyStreams) {
+    *outDataSize = StreamCount(*device, inAddress->mScope) *
+                   sizeof(AudioStreamID);
+    return kAudioHardwareNoError;
+  }
+  return kAudioHardwareUnknownPropertyError;
+}
+
+OSStatus
+AudioObjectGetPropertyData(AudioObjectID inObjectID,
+                           const AudioObjectPropertyAddress* inAddress,
+                           UInt32 inQualifierDataSize,
+                           const void* inQualifierData,
+                           UInt32* ioDataSize,
+                           void* outData)
+{
+  const AudioObjectPropertySelector selector = inAddress->mSelector;
+  if (inObjectID == kAudioObjectSystemObject) {
+    if (selector == kAudioHardwarePropertyDevices) {
+      AudioObjectID ids[sizeof(DEVICES) / sizeof(DEVICES[0])];
+      for (size_t i = 0; i < sizeof(DEVICES) / sizeof(DEVICES[0]); ++i) {
+        ids[i] = DEVICES[i].mId;
+      }
+      return CopyOut(ids, sizeof(ids[0]), sizeof(ids) / sizeof(ids[0]),
+                     ioDataSize, outData);
+    }
+    if (selector == kAudioHardwarePropertyDefaultInputDevice) {
+      return CopyValue(sDefaultInput, ioDataSize, outData);
+    }
+    if (selector == kAudioHardwarePropertyDefaultOutputDevice) {
+      return CopyValue(sDefaultOutput, ioDataSize, outData);
+    }
+    return kAudioHardwareUnknownPropertyError;
+  }
+
+  const StubDevice* device = FindDevice(inObjectID);
+  if (!device) {
+    return kAudioHardwareBadObjectError;
+  }
+  if (selector == kAudioObjectPropertyName) {
+    if (*ioDataSize < sizeof(CFStringRef)) {
+      return kAudioHardwareBadPropertySizeError;
+    }
+    // A new reference, which the caller releases.
+    CFStringRef name = NewString(device->mName);
+    return CopyOut(&name, sizeof(name), 1, ioDataSize, outData);
+  }
+  if (selector == kAudioDevicePropertyStreams) {
+    AudioStreamID streams[4];
+    UInt32 count = std::min<UInt32>(StreamCount(*device, inAddress->mScope),
+                                    sizeof(streams) / sizeof(streams[0]));
+    for (UInt32 i = 0; i < count; ++i) {
+      streams[i] = device->mId + 1 + i;
+    }
+    return CopyOut(streams, sizeof(streams[0]), count, ioDataSize, outData);
+  }
+  UInt32 source = SourceOf(*device, inAddress->mScope);
+  if (!source) {
+    return kAudioHardwareUnknownPropertyError;
+  }
+  if (selector == kAudioDevicePropertyDataSource) {
+    return CopyValue(source, ioDataSize, outData);
+  }
+  if (selector == kAudioDevicePropertyDataSourceNameForIDCFString) {
+    if (*ioDataSize != sizeof(AudioValueTranslation)) {
+      return kAudioHardwareBadPropertySizeError;
+    }
+    AudioValueTranslation* translation =
+      static_cast<AudioValueTranslation*>(outData);
+    if (translation->mInputDataSize != sizeof(UInt32) ||
+        translation->mOutputDataSize != sizeof(CFStringRef)) {
+      return kAudioHardwareBadPropertySizeError;
+    }
+    UInt32 id = *static_cast<const UInt32*>(translation->mInputData);
+    for (const StubSource& s : SOURCES) {
+      if (s.mId == id) {
+        *static_cast<CFStringRef*>(translation->mOutputData) =
+          NewString(s.mName);
+        return kAudioHardwareNoError;
+      }
+    }
+    return kAudioHardwareIllegalOperationError;
+  }
+  return kAudioHardwareUnknownPropertyError;
+}
+
+OSStatus
+AudioObjectSetPropertyData(AudioObjectID inObjectID,
+                           const AudioObjectPropertyAddress* inAddress,
+                           UInt32 inQualifierDataSize,
+                           const void* inQualifierData,
+                           UInt32 inDataSize,
+                           const void* inData)
+{
+  if (inObjectID != kAudioObjectSystemObject ||
+      !IsDefaultDevice(inAddress->mSelector)) {
+    return kAudioHardwareUnknownPropertyError;
+  }
+  if (inDataSize != sizeof(AudioObjectID)) {
+    return kAudioHardwareBadPropertySizeError;
+  }
+  AudioObjectID id = *static_cast<const AudioObjectID*>(inData);
+  if (!FindDevice(id)) {
+    return kAudioHardwareBadObjectError;
+  }
+  (inAddress->mSelector == kAudioHardwarePropertyDefaultInputDevice
+     ? sDefaultInput : sDefaultOutput) = id;
+
+  // Fired on the calling thread, without the lock, as the HAL fires them on
+  // its own.
+  std::vector<StubListener> listeners;
+  {
+    std::lock_guard<std::mutex> guard(sListenersMutex);
+    for (const StubListener& l : sListeners) {
+      if (l.mId == inObjectID &&
+          l.mAddress.mSelector == inAddress->mSelector) {
+        listeners.push_back(l);
+      }
+    }
+  }
+  AudioObjectPropertyAddress address = *inAddress;
+  address.mElement = kAudioObjectPropertyElementMaster;
+  for (const StubListener& l : listeners) {
+    l.mListener(inObjectID, 1, &address, l.mClientData);
+  }
+  return kAudioHardwareNoError;
+}
+
+OSStatus
+AudioObjectAddPropertyListener(AudioObjectID inObjectID,
+                               const AudioObjectPropertyAddress* inAddress,
+                               AudioObjectPropertyListenerProc inListener,
+                               void* inClientData)
+{
+  if (inObjectID != kAudioObjectSystemObject && !FindDevice(inObjectID)) {
+    return kAudioHardwareBadObjectError;
+  }
+  std::lock_guard<std::mutex> guard(sListenersMutex);
+  sListeners.push_back({ inObjectID, *inAddress, inListener, inClientData });
+  return kAudioHardwareNoError;
+}
+
+OSStatus
+AudioObjectRemovePropertyListener(AudioObjectID inObjectID,
+                                  const AudioObjectPropertyAddress* inAddress,
+                                  AudioObjectPropertyListenerProc inListener,
+                                  void* inClientData)
+{
+  std::lock_guard<std::mutex> guard(sListenersMutex);
+  size_t count = sListeners.size();
+  sListeners.erase(
+    std::remove_if(sListeners.begin(), sListeners.end(),
+                   [&](const StubListener& l) {
+                     return l.mId == inObjectID &&
+                            l.mAddress.mSelector == inAddress->mSelector &&
+                            l.mAddress.mScope == inAddress->mScope &&
+                            l.mAddress.mElement == inAddress->mElement &&
+                            l.mListener == inListener &&
+                            l.mClientData == inClientData;
+                   }),
+    sListeners.end());
+  return sListeners.size() < count ? kAudioHardwareNoError
+                                   : kAudioHardwareUnknownPropertyError;
+}
+
+bool
+AudioHardwareStubFindListener(AudioObjectID aObjectID,
+                              const AudioObjectPropertyAddress* aAddress,
+                              AudioObjectPropertyListenerProc* aListener,
+                              void** aClientData)
+{
+  std::lock_guard<std::mutex> guard(sListenersMutex);
+  for (const StubListener& l : sListeners) {
+    if (l.mId == aObjectID &&
+        l.mAddress.mSelector == aAddress->mSelector &&
+        l.mAddress.mScope == aAddress->mScope &&
+        l.mAddress.mElement == aAddress->mElement) {
+      *aListener = l.mListener;
+      *aClientData = l.mClientData;
+      return true;
+    }
+  }
+  return false;
+}
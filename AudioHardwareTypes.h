@@ -0,0 +1,179 @@
+#ifndef AUDIOHARDWARETYPES_H
+#define AUDIOHARDWARETYPES_H
+
+// The HAL and CFString subset used by AudioObject, AudioDeviceListener,
+// AudioObjectUtils and its property cache. On Apple platforms it comes from the SDK. Elsewhere, like
+// the types of AudioTypes.h, the same subset is declared here, and
+// implemented by the stub HAL of AudioHardwareStub.cpp, serving a fixed set
+// of devices, so the device queries can be built and measured without
+// CoreAudio.
+#if defined(__APPLE__)
+
+#include <CoreAudio/AudioHardware.h>
+#include <CoreAudio/AudioHardwareBase.h>
+#include <CoreFoundation/CFString.h>
+
+#else // #if defined(__APPLE__)
+
+#include "AudioTypes.h"
+
+// CoreFoundation.
+
+typedef const void* CFTypeRef;
+typedef const struct __CFString* CFStringRef;
+typedef long CFIndex;
+typedef UInt32 CFStringEncoding;
+
+struct CFRange
+{
+  CFIndex location;
+  CFIndex length;
+};
+
+enum {
+  kCFStringEncodingUTF8 = 0x08000100
+};
+
+inline CFRange
+CFRangeMake(CFIndex aLocation, CFIndex aLength)
+{
+  CFRange range = { aLocation, aLength };
+  return range;
+}
+
+// The stub only makes strings, so only strings can be released.
+void CFRelease(CFTypeRef aObject);
+CFIndex CFStringGetLength(CFStringRef aString);
+CFIndex CFStringGetBytes(CFStringRef aString,
+                         CFRange aRange,
+                         CFStringEncoding aEncoding,
+                         UInt8 aLossByte,
+                         Boolean aIsExternalRepresentation,
+                         UInt8* aBuffer,
+                         CFIndex aMaxBufLen,
+                         CFIndex* aUsedBufLen);
+
+// CoreAudio.
+
+typedef UInt32 AudioObjectID;
+typedef UInt32 AudioClassID;
+typedef AudioObjectID AudioStreamID;
+typedef UInt32 AudioObjectPropertySelector;
+typedef UInt32 AudioObjectPropertyScope;
+typedef UInt32 AudioObjectPropertyElement;
+
+struct AudioObjectPropertyAddress
+{
+  AudioObjectPropertySelector mSelector;
+  AudioObjectPropertyScope mScope;
+  AudioObjectPropertyElement mElement;
+};
+
+struct AudioValueTranslation
+{
+  void* mInputData;
+  UInt32 mInputDataSize;
+  void* mOutputData;
+  UInt32 mOutputDataSize;
+};
+
+typedef OSStatus (* AudioObjectPropertyListenerProc)(
+  AudioObjectID inObjectID,
+  UInt32 inNumberAddresses,
+  const AudioObjectPropertyAddress* inAddresses,
+  void* inClientData);
+
+enum {
+  kAudioObjectUnknown = 0,
+  kAudioObjectSystemObject = 1
+};
+
+enum {
+  kAudioSystemObjectClassID = 0x61737973, // 'asys'
+  kAudioDeviceClassID = 0x61646576        // 'adev'
+};
+
+enum {
+  kAudioHardwareNoError = 0,
+  kAudioHardwareUnspecifiedError = 0x77686174,     // 'what'
+  kAudioHardwareUnknownPropertyError = 0x77686F3F, // 'who?'
+  kAudioHardwareBadPropertySizeError = 0x2173697A, // '!siz'
+  kAudioHardwareBadObjectError = 0x216F626A,       // '!obj'
+  kAudioHardwareIllegalOperationError = 0x6E6F7065 // 'nope'
+};
+
+enum {
+  kAudioObjectPropertySelectorWildcard = 0x2A2A2A2A, // '****'
+  kAudioObjectPropertyScopeWildcard = 0x2A2A2A2A,    // '****'
+  kAudioObjectPropertyElementWildcard = 0xFFFFFFFF,
+  kAudioObjectPropertyElementMaster = 0,
+
+  kAudioObjectPropertyScopeGlobal = 0x676C6F62, // 'glob'
+  kAudioObjectPropertyScopeInput = 0x696E7074,  // 'inpt'
+  kAudioObjectPropertyScopeOutput = 0x6F757470, // 'outp'
+
+  kAudioObjectPropertyName = 0x6C6E616D,                        // 'lnam'
+  kAudioHardwarePropertyDevices = 0x64657623,                   // 'dev#'
+  kAudioHardwarePropertyDefaultInputDevice = 0x64496E20,        // 'dIn '
+  kAudioHardwarePropertyDefaultOutputDevice = 0x644F7574,       // 'dOut'
+  kAudioDevicePropertyStreams = 0x73746D23,                     // 'stm#'
+  kAudioDevicePropertyDataSource = 0x73737263,                  // 'ssrc'
+  kAudioDevicePropertyDataSourceNameForIDCFString = 0x6C73636E  // 'lscn'
+};
+
+Boolean AudioObjectHasProperty(AudioObjectID inObjectID,
+                               const AudioObjectPropertyAddress* inAddress);
+
+OSStatus AudioObjectIsPropertySettable(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  Boolean* outIsSettable);
+
+OSStatus AudioObjectGetPropertyDataSize(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  UInt32 inQualifierDataSize,
+  const void* inQualifierData,
+  UInt32* outDataSize);
+
+OSStatus AudioObjectGetPropertyData(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  UInt32 inQualifierDataSize,
+  const void* inQualifierData,
+  UInt32* ioDataSize,
+  void* outData);
+
+OSStatus AudioObjectSetPropertyData(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  UInt32 inQualifierDataSize,
+  const void* inQualifierData,
+  UInt32 inDataSize,
+  const void* inData);
+
+// The stub devices never change on their own, so the listeners are only
+// fired for the default devices set through AudioObjectSetPropertyData.
+OSStatus AudioObjectAddPropertyListener(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  AudioObjectPropertyListenerProc inListener,
+  void* inClientData);
+
+OSStatus AudioObjectRemovePropertyListener(
+  AudioObjectID inObjectID,
+  const AudioObjectPropertyAddress* inAddress,
+  AudioObjectPropertyListenerProc inListener,
+  void* inClientData);
+
+// The stub's own: the first listener added for aAddress of aObjectID, if
+// any, so it can be called as the HAL calls it, e.g. by bench_hot_paths.
+bool AudioHardwareStubFindListener(
+  AudioObjectID aObjectID,
+  const AudioObjectPropertyAddress* aAddress,
+  AudioObjectPropertyListenerProc* aListener,
+  void** aClientData);
+
+#endif // #if defined(__APPLE__)
+
+#endif // #ifndef AUDIOHARDWARETYPES_H
@@ -0,0 +1,378 @@
+#include "AudioMixer.h"
+#include "Host.h"
+#include "LockOrderValidator.h"
+#include "SampleConverter.h"
+#include <algorithm> // std::min
+#include <cassert>
+#include <cstring>   // memset
+
+// The slot index takes the low bits of an InputId, its generation the rest.
+const unsigned int INDEX_BITS = 16;
+const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+const uint32_t GENERATION_MASK = (1u << (32 - INDEX_BITS)) - 1;
+
+static bool
+IsFloat(AudioStream::Format aFormat)
+{
+  return aFormat == AudioStream::F32LE || aFormat == AudioStream::F32BE;
+}
+
+static bool
+IsSwapped(AudioStream::Format aFormat)
+{
+  bool bigEndian = aFormat == AudioStream::S16BE ||
+                   aFormat == AudioStream::F32BE;
+  return bigEndian != HOST_BIG_ENDIAN;
+}
+
+AudioMixer::AudioMixer(AudioStream::Format aFormat,
+                       unsigned int aChannels,
+                       double aRate,
+                       size_t aMaxInputs,
+                       std::unique_ptr<AudioBackend> aBackend)
+  : mBackend(aBackend ? std::move(aBackend)
+                      : AudioStream::CreateDefaultBackend())
+  , mReady(false)
+  , mRunning(false)
+  , mMaxInputs(aMaxInputs)
+  , mInputs(new Input[aMaxInputs])
+  , mSlotsInUse(0)
+  , mMaxFrames(0)
+{
+  assert(aMaxInputs && aMaxInputs <= INDEX_MASK + 1);
+  for (size_t i = 0; i < mMaxInputs; ++i) {
+    mInputs[i].mState.store(Pack(0, FREE), std::memory_order_relaxed);
+    mInputs[i].mGain.store(0.0f, std::memory_order_relaxed);
+    mInputs[i].mCallback = nullptr;
+    mInputs[i].mContextCallback = nullptr;
+    mInputs[i].mContext = nullptr;
+    mInputs[i].mFormat = AudioStream::F32LE;
+  }
+
+  mParams = { aFormat, static_cast<UInt32>(aChannels),
+              static_cast<Float64>(aRate), false };
+  if (!mBackend->Create()) {
+    return;
+  }
+  AudioStreamBasicDescription desc = mParams.GetFormatDescription();
+  if (!mBackend->SetStreamFormat(desc) ||
+      !mBackend->SetCallback(MixCallback, this) || !mBackend->Init()) {
+    mBackend->Destroy();
+    return;
+  }
+  // Allocate everything the render thread needs once, for the largest
+  // render cycle.
+  mMaxFrames = mBackend->GetMaxFramesPerBuffer();
+  size_t samples = mMaxFrames * mParams.mChannels;
+  mMixBuffer.assign(samples, 0.0f);
+  mInputBuffer.assign(samples, 0.0f);
+  mFloatBuffer.assign(samples, 0.0f);
+  mReady = true;
+}
+
+AudioMixer::~AudioMixer()
+{
+  if (!mReady) {
+    return;
+  }
+  bool r = Stop();
+  r = mBackend->Uninit() && r;
+  r = mBackend->Destroy() && r;
+  assert(r);
+  (void) r;
+}
+
+bool
+AudioMixer::Start()
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  if (!mReady) {
+    return false;
+  }
+  if (mRunning) {
+    return true;
+  }
+  mTiming.Restart();
+  mRunning = mBackend->Start();
+  return mRunning;
+}
+
+bool
+AudioMixer::Stop()
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  if (mRunning) {
+    if (!mBackend->Stop()) {
+      return false;
+    }
+    mRunning = false;
+  }
+  // The render thread is gone, so the removed slots are reclaimed here.
+  size_t used = mSlotsInUse.load(std::memory_order_acquire);
+  for (size_t i = 0; i < used; ++i) {
+    uint32_t packed = mInputs[i].mState.load(std::memory_order_acquire);
+    if (StateOf(packed) == REMOVING) {
+      Reclaim(mInputs[i], packed);
+    }
+  }
+  mReclaimed.Post();
+  return true;
+}
+
+AudioMixer::InputId
+AudioMixer::Add(AudioStream::Format aFormat,
+                ContextAudioCallback aCallback,
+                void* aContext,
+                float aGain)
+{
+  assert(aCallback);
+  return Claim(aFormat, nullptr, aCallback, aContext, aGain);
+}
+
+AudioMixer::InputId
+AudioMixer::Add(AudioStream::Format aFormat,
+                AudioCallback aCallback,
+                float aGain)
+{
+  assert(aCallback);
+  return Claim(aFormat, aCallback, nullptr, nullptr, aGain);
+}
+
+AudioMixer::InputId
+AudioMixer::Claim(AudioStream::Format aFormat,
+                  AudioCallback aCallback,
+                  ContextAudioCallback aContextCallback,
+                  void* aContext,
+                  float aGain)
+{
+  for (size_t i = 0; i < mMaxInputs; ++i) {
+    Input& input = mInputs[i];
+    uint32_t packed = input.mState.load(std::memory_order_relaxed);
+    if (StateOf(packed) != FREE) {
+      continue;
+    }
+    // Skip the generation 0, so no id is 0.
+    uint32_t generation = (GenerationOf(packed) + 1) & GENERATION_MASK;
+    if (!generation) {
+      generation = 1;
+    }
+    if (!input.mState.compare_exchange_strong(packed,
+                                              Pack(generation, CLAIMED),
+                                              std::memory_order_acquire)) {
+      continue;
+    }
+
+    input.mCallback = aCallback;
+    input.mContextCallback = aContextCallback;
+    input.mContext = aContext;
+    input.mFormat = aFormat;
+    input.mGain.store(aGain, std::memory_order_relaxed);
+    size_t used = mSlotsInUse.load(std::memory_order_relaxed);
+    while (used < i + 1 &&
+           !mSlotsInUse.compare_exchange_weak(used, i + 1,
+                                              std::memory_order_release)) {
+    }
+    input.mState.store(Pack(generation, ACTIVE), std::memory_order_release);
+    return (generation << INDEX_BITS) | static_cast<uint32_t>(i);
+  }
+  return INVALID_INPUT;
+}
+
+bool
+AudioMixer::Remove(InputId aId)
+{
+  uint32_t packed;
+  Input* input = Find(aId, ACTIVE, packed);
+  return input &&
+         input->mState.compare_exchange_strong(
+           packed, Pack(GenerationOf(packed), REMOVING),
+           std::memory_order_acq_rel);
+}
+
+bool
+AudioMixer::RemoveAndWait(InputId aId)
+{
+  uint32_t packed;
+  Input* input = Find(aId, ACTIVE, packed);
+  uint32_t removing = Pack(GenerationOf(packed), REMOVING);
+  if (!input ||
+      !input->mState.compare_exchange_strong(packed, removing,
+                                             std::memory_order_acq_rel)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> removal(mRemoveMutex);
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(mMutex);
+      if (!mRunning) {
+        // No render thread to reclaim it. Stop did, or it's done here.
+        packed = input->mState.load(std::memory_order_acquire);
+        if (packed == removing) {
+          Reclaim(*input, packed);
+        }
+        return true;
+      }
+    }
+    // Reclaimed, and maybe even reused, by the render thread. A reclaim made
+    // after this check posted the signal, so the wait returns.
+    if (input->mState.load(std::memory_order_acquire) != removing) {
+      return true;
+    }
+    mReclaimed.Wait();
+  }
+}
+
+bool
+AudioMixer::SetGain(InputId aId, float aGain)
+{
+  uint32_t packed;
+  Input* input = Find(aId, ACTIVE, packed);
+  if (!input) {
+    return false;
+  }
+  input->mGain.store(aGain, std::memory_order_relaxed);
+  return true;
+}
+
+size_t
+AudioMixer::GetInputCount() const
+{
+  size_t count = 0;
+  size_t used = mSlotsInUse.load(std::memory_order_acquire);
+  for (size_t i = 0; i < used; ++i) {
+    if (StateOf(mInputs[i].mState.load(std::memory_order_relaxed)) ==
+        ACTIVE) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+CallbackTiming::Snapshot
+AudioMixer::GetCallbackTiming() const
+{
+  return mTiming.GetSnapshot();
+}
+
+AudioMixer::Input*
+AudioMixer::Find(InputId aId, SlotState aState, uint32_t& aPacked) const
+{
+  size_t index = aId & INDEX_MASK;
+  uint32_t generation = aId >> INDEX_BITS;
+  if (aId == INVALID_INPUT || index >= mMaxInputs) {
+    return nullptr;
+  }
+  aPacked = Pack(generation, aState);
+  Input* input = &mInputs[index];
+  return input->mState.load(std::memory_order_acquire) == aPacked ? input
+                                                                  : nullptr;
+}
+
+void
+AudioMixer::Reclaim(Input& aInput, uint32_t aPacked)
+{
+  // Only this thread moves a slot out of REMOVING, so no CAS is needed.
+  aInput.mState.store(Pack(GenerationOf(aPacked), FREE),
+                      std::memory_order_release);
+}
+
+const float*
+AudioMixer::Pull(Input& aInput, UInt32 aFrames)
+{
+  size_t samples = aFrames * mParams.mChannels;
+  if (aInput.mContextCallback) {
+    aInput.mContextCallback(aInput.mContext, mInputBuffer.data(), aFrames);
+  } else {
+    aInput.mCallback(mInputBuffer.data(), aFrames);
+  }
+  if (IsFloat(aInput.mFormat)) {
+    if (!IsSwapped(aInput.mFormat)) {
+      return mInputBuffer.data();
+    }
+    SampleConverter::SwapBytes32(mInputBuffer.data(), mFloatBuffer.data(),
+                                 samples);
+  } else {
+    SampleConverter::S16ToFloat(
+      reinterpret_cast<const int16_t*>(mInputBuffer.data()),
+      mFloatBuffer.data(), samples, IsSwapped(aInput.mFormat));
+  }
+  return mFloatBuffer.data();
+}
+
+void
+AudioMixer::Mix(void* aOut, UInt32 aFrames)
+{
+  assert(aFrames <= mMaxFrames);
+  size_t samples = aFrames * mParams.mChannels;
+  AudioStream::Format format = mParams.mFormat;
+  // The native floats are summed right into the device buffer.
+  float* mix = IsFloat(format) && !IsSwapped(format)
+                 ? static_cast<float*>(aOut)
+                 : mMixBuffer.data();
+  memset(mix, 0, samples * sizeof(float));
+
+  size_t used = mSlotsInUse.load(std::memory_order_acquire);
+  bool reclaimed = false;
+  for (size_t i = 0; i < used; ++i) {
+    Input& input = mInputs[i];
+    uint32_t packed = input.mState.load(std::memory_order_acquire);
+    switch (StateOf(packed)) {
+      case ACTIVE:
+        SampleConverter::MixFloat(
+          Pull(input, aFrames), input.mGain.load(std::memory_order_relaxed),
+          mix, samples);
+        break;
+      case REMOVING:
+        // Its callback isn't running: it's only fired from here.
+        Reclaim(input, packed);
+        reclaimed = true;
+        break;
+      default:
+        break;
+    }
+  }
+  if (reclaimed) {
+    // Wait-free, so it's safe here.
+    mReclaimed.Post();
+  }
+
+  if (mix == aOut) {
+    return;
+  }
+  if (IsFloat(format)) {
+    SampleConverter::SwapBytes32(mix, aOut, samples);
+  } else {
+    SampleConverter::FloatToS16(mix, static_cast<int16_t*>(aOut), samples,
+                                IsSwapped(format));
+  }
+}
+
+/* static */ OSStatus
+AudioMixer::MixCallback(void* aRefCon,
+                        AudioUnitRenderActionFlags* aActionFlags,
+                        const AudioTimeStamp* aTimeStamp,
+                        UInt32 aBusNumber,
+                        UInt32 aNumFrames,
+                        AudioBufferList* aData)
+{
+  // Any lock taken from here on is a potential deadlock with the AudioUnit.
+  LockOrderValidator::RenderThreadScope render;
+
+  AudioMixer* mixer = static_cast<AudioMixer*>(aRefCon);
+  uint64_t start = NowNs();
+  assert(aData->mNumberBuffers == 1);
+  uint8_t* out = static_cast<uint8_t*>(aData->mBuffers[0].mData);
+  size_t bytesPerFrame = mixer->mParams.GetFormatByteSize() *
+                         mixer->mParams.mChannels;
+  // Only a misbehaving device asks for more than its maximum.
+  for (UInt32 done = 0; done < aNumFrames;) {
+    UInt32 frames = std::min(aNumFrames - done, mixer->mMaxFrames);
+    mixer->Mix(out + done * bytesPerFrame, frames);
+    done += frames;
+  }
+  uint64_t period = static_cast<uint64_t>(aNumFrames * 1e9 /
+                                          mixer->mParams.mRate);
+  mixer->mTiming.Record(start, NowNs(), period);
+  return noErr;
+}
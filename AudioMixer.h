@@ -0,0 +1,167 @@
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include "AudioBackend.h"
+#include "AudioStream.h"
+#include "CallbackTiming.h"
+#include "WakeSignal.h"
+#include <atomic>   // std::atomic
+#include <memory>   // std::unique_ptr
+#include <mutex>    // std::mutex
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+#include <vector>   // std::vector
+
+// Play many logical output streams through one backend. Each input has its
+// own callback, with its own context, sample format and gain, and the render callback of the
+// backend fires them one after another, converts their samples to float and
+// sums them with SampleConverter::MixFloat into the device format. So N
+// streams cost one AudioUnit, one render thread and one set of buffers, not
+// N of each.
+//
+// The inputs are kept in a fixed array of slots, allocated up front. Add,
+// Remove and SetGain are lock-free and never allocate, so they're safe to
+// call from any thread, the render thread included. The inputs have the
+// channels and the rate of the mixer: only their sample formats may differ.
+class AudioMixer
+{
+public:
+  // Never 0, so INVALID_INPUT can't name an input.
+  typedef uint32_t InputId;
+  static const InputId INVALID_INPUT = 0;
+  static const size_t DEFAULT_MAX_INPUTS = 64;
+
+  // Mix into a device stream of aFormat, aChannels and aRate, through the
+  // AudioStream's default backend when none is given. Up to aMaxInputs
+  // inputs can be added at once.
+  AudioMixer(AudioStream::Format aFormat,
+             unsigned int aChannels,
+             double aRate,
+             size_t aMaxInputs = DEFAULT_MAX_INPUTS,
+             std::unique_ptr<AudioBackend> aBackend = nullptr);
+  ~AudioMixer();
+
+  // Whether the backend was set up.
+  bool IsReady() const { return mReady; }
+
+  // The device stream keeps running, rendering silence, without inputs.
+  bool Start();
+  bool Stop();
+
+  // Add an input rendering aFormat samples. Its callback is fired, with
+  // aContext, from the next render cycle on. Return INVALID_INPUT when all
+  // the slots are taken.
+  InputId Add(AudioStream::Format aFormat,
+              ContextAudioCallback aCallback,
+              void* aContext,
+              float aGain = 1.0f);
+  InputId Add(AudioStream::Format aFormat,
+              AudioCallback aCallback,
+              float aGain = 1.0f);
+  // Stop firing the input's callback. It may still be running when Remove
+  // returns, but it's never fired once the render thread reclaims the slot,
+  // at the start of the next render cycle, or at Stop.
+  bool Remove(InputId aId);
+  // Remove the input, and wait for the slot to be reclaimed: once it
+  // returns, the callback is neither running nor will run again, so its
+  // context can be freed. It must not be called on the render thread, nor
+  // while the device is stalled.
+  bool RemoveAndWait(InputId aId);
+  // Take effect from the next render cycle.
+  bool SetGain(InputId aId, float aGain);
+  size_t GetInputCount() const;
+
+  // The timing of the render callbacks, which fire all the inputs. It's safe
+  // to call this from any thread.
+  CallbackTiming::Snapshot GetCallbackTiming() const;
+
+private:
+  // The life of a slot: FREE -> CLAIMED (by Add, while it's filled in) ->
+  // ACTIVE -> REMOVING (by Remove) -> FREE (by the render thread, or Stop).
+  enum SlotState
+  {
+    FREE,
+    CLAIMED,
+    ACTIVE,
+    REMOVING
+  };
+
+  struct Input
+  {
+    // Packs the generation of the slot with its state, as
+    // (generation << 8) | state, so a stale id never matches a reused slot.
+    std::atomic<uint32_t> mState;
+    std::atomic<float> mGain;
+    // Written while CLAIMED, and published by the move to ACTIVE. Only one
+    // of the callbacks is set.
+    AudioCallback mCallback;
+    ContextAudioCallback mContextCallback;
+    void* mContext;
+    AudioStream::Format mFormat;
+  };
+
+  static uint32_t Pack(uint32_t aGeneration, SlotState aState)
+  {
+    return (aGeneration << 8) | aState;
+  }
+  static SlotState StateOf(uint32_t aPacked)
+  {
+    return static_cast<SlotState>(aPacked & 0xFF);
+  }
+  static uint32_t GenerationOf(uint32_t aPacked) { return aPacked >> 8; }
+
+  InputId Claim(AudioStream::Format aFormat,
+                AudioCallback aCallback,
+                ContextAudioCallback aContextCallback,
+                void* aContext,
+                float aGain);
+  // The slot aId names, if any, and its expected packed state in aPacked.
+  Input* Find(InputId aId, SlotState aState, uint32_t& aPacked) const;
+  // Free the removed slots. Only called on the render thread, or while it's
+  // stopped. The waiters of RemoveAndWait are woken up by the caller.
+  void Reclaim(Input& aInput, uint32_t aPacked);
+
+  // Mix aFrames frames, up to mMaxFrames, into aOut, in the device format.
+  void Mix(void* aOut, UInt32 aFrames);
+  // Fire aInput's callback, and return its samples in float.
+  const float* Pull(Input& aInput, UInt32 aFrames);
+  static OSStatus MixCallback(void* aRefCon,
+                              AudioUnitRenderActionFlags* aActionFlags,
+                              const AudioTimeStamp* aTimeStamp,
+                              UInt32 aBusNumber,
+                              UInt32 aNumFrames,
+                              AudioBufferList* aData);
+
+  // Not copyable: the backend points back at it.
+  AudioMixer(const AudioMixer&);
+  AudioMixer& operator=(const AudioMixer&);
+
+  AudioStream::Parameters mParams;
+  std::unique_ptr<AudioBackend> mBackend;
+  bool mReady;
+
+  // Serializes Start, Stop and the destructor.
+  std::mutex mMutex;
+  bool mRunning;
+
+  const size_t mMaxInputs;
+  std::unique_ptr<Input[]> mInputs;
+  // One past the highest slot ever claimed, so the render thread doesn't
+  // scan the slots that were never used.
+  std::atomic<size_t> mSlotsInUse;
+
+  // Posted once removed slots are reclaimed. Its single waiter is the
+  // RemoveAndWait call holding mRemoveMutex.
+  WakeSignal mReclaimed;
+  std::mutex mRemoveMutex;
+
+  // Only touched by the render thread. Each holds mMaxFrames frames.
+  UInt32 mMaxFrames;
+  std::vector<float> mMixBuffer;
+  std::vector<float> mInputBuffer;   // The samples of an input, as rendered.
+  std::vector<float> mFloatBuffer;   // Those samples converted to float.
+
+  CallbackTiming mTiming;
+};
+
+#endif // #ifndef AUDIOMIXER_H
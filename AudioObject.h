@@ -1,8 +1,8 @@
 #ifndef AUDIOOBJECT_H
 #define AUDIOOBJECT_H
 
-#include <CoreAudio/AudioHardware.h>
-#include <CoreAudio/AudioHardwareBase.h>
+#include "AudioHardwareTypes.h"
+#include "AudioObjectProperties.h"
 #include <vector>
 
 using std::vector;
@@ -16,6 +16,24 @@ public:
   bool HasProperty(const AudioObjectPropertyAddress* address) const;
   bool IsPropertySettable(const AudioObjectPropertyAddress* address) const;
 
+  // The typed accessors of the properties described in
+  // AudioObjectProperties.h.
+  template<typename P>
+  OSStatus Get(typename P::Type* data) const {
+    return GetProperty<P>(_id, data);
+  }
+
+  // The free function: the GetPropertyArray members below hide it.
+  template<typename P>
+  OSStatus GetArray(vector<typename P::Type>* array) const {
+    return ::GetPropertyArray<P>(_id, array);
+  }
+
+  template<typename P>
+  OSStatus Set(const typename P::Type& data) const {
+    return SetProperty<P>(_id, data);
+  }
+
   template<typename T>
   OSStatus GetPropertyData(const AudioObjectPropertyAddress* address, T* data) const {
     return GetPropertyData(_id, address, data);
@@ -26,10 +44,17 @@ public:
     return GetPropertyDataSize(_id, address, size);
   }
 
+  // See ReadPropertyArray: the array's capacity is reused.
   template<typename T>
   OSStatus GetPropertyArray(const AudioObjectPropertyAddress* address,
                             vector<T>* array) const {
-    return GetPropertyDataSize(_id, address, array);
+    return ReadPropertyArray(_id, address, array);
+  }
+
+  template<typename T>
+  OSStatus GetPropertyArray(const AudioObjectPropertyAddress* address,
+                            T* buffer, UInt32 capacity, UInt32* count) const {
+    return ReadPropertyArray(_id, address, buffer, capacity, count);
   }
 
   template<typename T>
@@ -63,27 +88,6 @@ private:
     return AudioObjectGetPropertyDataSize(id, address, 0, nullptr, size);
   }
 
-  template<typename T>
-  static OSStatus GetPropertyArray(AudioObjectID id,
-                                   const AudioObjectPropertyAddress* address,
-                                   vector<T>* array) {
-    UInt32 size = 0;
-    OSStatus s = GetPropertyDataSize(id, address, &size);
-    if (s != STATUS_OK) {
-      return s;
-    }
-    if (!size) {
-      return s; // TODO: Maybe throw an error instead.
-    }
-    vector<T> data(size / sizeof(T));
-    s = AudioObjectGetPropertyData(id, address, 0, nullptr, &size,
-                                   static_cast<void*>(data.data()));
-    if (s == STATUS_OK) {
-      *array = data;
-    }
-    return s;
-  }
-
   template<typename T>
   static OSStatus SetPropertyData(AudioObjectID id,
                                   const AudioObjectPropertyAddress *address,
@@ -0,0 +1,218 @@
+#ifndef AUDIOOBJECTPROPERTIES_H
+#define AUDIOOBJECTPROPERTIES_H
+
+#include "AudioHardwareTypes.h"
+#include <stddef.h> // size_t
+#include <vector>   // std::vector
+
+// Compile-time descriptors of the HAL properties: each one binds a selector
+// and a scope to the type of the property's value, and tells whether the
+// value has a fixed size or is an array whose size must be queried.
+//
+// The accessors below take the descriptor as their template argument, so
+// reading a property with the wrong type, or a fixed-size one as an array,
+// doesn't compile. The fixed-size values are read with a single call, with
+// no size query.
+template<AudioObjectPropertySelector aSelector,
+         AudioObjectPropertyScope aScope,
+         typename T,
+         bool aVariableSize = false>
+struct PropertyDescriptor
+{
+  typedef T Type;
+  static constexpr AudioObjectPropertySelector kSelector = aSelector;
+  static constexpr AudioObjectPropertyScope kScope = aScope;
+  static constexpr bool kVariableSize = aVariableSize;
+  static constexpr AudioObjectPropertyAddress kAddress = {
+    aSelector,
+    aScope,
+    kAudioObjectPropertyElementMaster
+  };
+};
+
+template<AudioObjectPropertySelector aSelector,
+         AudioObjectPropertyScope aScope,
+         typename T,
+         bool aVariableSize>
+constexpr AudioObjectPropertyAddress
+PropertyDescriptor<aSelector, aScope, T, aVariableSize>::kAddress;
+
+// The properties of the system object.
+
+typedef PropertyDescriptor<kAudioHardwarePropertyDevices,
+                           kAudioObjectPropertyScopeGlobal,
+                           AudioObjectID,
+                           true> DevicesProperty;
+
+typedef PropertyDescriptor<kAudioHardwarePropertyDefaultInputDevice,
+                           kAudioObjectPropertyScopeGlobal,
+                           AudioObjectID> DefaultInputDeviceProperty;
+
+typedef PropertyDescriptor<kAudioHardwarePropertyDefaultOutputDevice,
+                           kAudioObjectPropertyScopeGlobal,
+                           AudioObjectID> DefaultOutputDeviceProperty;
+
+// The properties of the devices. The scoped ones are instantiated with
+// kAudioObjectPropertyScopeInput or kAudioObjectPropertyScopeOutput.
+
+// The caller owns the returned string and must CFRelease it.
+typedef PropertyDescriptor<kAudioObjectPropertyName,
+                           kAudioObjectPropertyScopeGlobal,
+                           CFStringRef> DeviceNameProperty;
+
+template<AudioObjectPropertyScope aScope>
+using StreamsProperty = PropertyDescriptor<kAudioDevicePropertyStreams,
+                                           aScope,
+                                           AudioStreamID,
+                                           true>;
+
+template<AudioObjectPropertyScope aScope>
+using DataSourceProperty = PropertyDescriptor<kAudioDevicePropertyDataSource,
+                                              aScope,
+                                              UInt32>;
+
+// Translate the data source id in mInputData into the CFString name in
+// mOutputData, which the caller must CFRelease.
+template<AudioObjectPropertyScope aScope>
+using DataSourceNameProperty =
+  PropertyDescriptor<kAudioDevicePropertyDataSourceNameForIDCFString,
+                     aScope,
+                     AudioValueTranslation>;
+
+// The accessors.
+
+template<typename P>
+OSStatus
+GetProperty(AudioObjectID aId, typename P::Type* aData)
+{
+  static_assert(!P::kVariableSize, "Read the arrays with GetPropertyArray!");
+  UInt32 size = sizeof(typename P::Type);
+  return AudioObjectGetPropertyData(aId, &P::kAddress, 0, nullptr, &size,
+                                    static_cast<void*>(aData));
+}
+
+// The number of elements of an array property.
+template<typename P>
+OSStatus
+GetPropertyCount(AudioObjectID aId, UInt32* aCount)
+{
+  static_assert(P::kVariableSize, "Only the arrays have a count!");
+  UInt32 size = 0;
+  OSStatus r = AudioObjectGetPropertyDataSize(aId, &P::kAddress, 0, nullptr,
+                                              &size);
+  if (r == kAudioHardwareNoError) {
+    *aCount = size / sizeof(typename P::Type);
+  }
+  return r;
+}
+
+// Read an array property into the aCapacity elements at aBuffer, with no
+// allocation. On success, aCount is the number of elements read. If the array
+// doesn't fit, kAudioHardwareBadPropertySizeError is returned with aCount set
+// to the number of elements it has, so the caller can grow its buffer and
+// retry.
+//
+// The data is read first, and the size only queried when the buffer came back
+// full, since that's the only case where the array may have been truncated: a
+// buffer with room to spare costs a single HAL call.
+template<typename T>
+OSStatus
+ReadPropertyArray(AudioObjectID aId,
+                  const AudioObjectPropertyAddress* aAddress,
+                  T* aBuffer,
+                  UInt32 aCapacity,
+                  UInt32* aCount)
+{
+  const UInt32 capacity = aCapacity * sizeof(T);
+  bool read = false;
+  if (aCapacity) {
+    UInt32 size = capacity;
+    OSStatus r = AudioObjectGetPropertyData(aId, aAddress, 0, nullptr, &size,
+                                            static_cast<void*>(aBuffer));
+    if (r == kAudioHardwareNoError && size < capacity) {
+      *aCount = size / sizeof(T);
+      return r;
+    }
+    if (r != kAudioHardwareNoError && r != kAudioHardwareBadPropertySizeError) {
+      return r;
+    }
+    read = r == kAudioHardwareNoError;
+  }
+
+  UInt32 size = 0;
+  OSStatus r = AudioObjectGetPropertyDataSize(aId, aAddress, 0, nullptr, &size);
+  if (r != kAudioHardwareNoError) {
+    return r;
+  }
+  if (read && size <= capacity) {
+    // It exactly filled the buffer.
+    *aCount = aCapacity;
+    return r;
+  }
+  if (!size) {
+    *aCount = 0;
+    return r;
+  }
+  *aCount = size / sizeof(T);
+  return kAudioHardwareBadPropertySizeError;
+}
+
+// Read an array property into aArray, reusing its capacity: once the vector
+// is large enough, polling the property allocates nothing. It's grown, with
+// one element to spare, and read again only when the array grew in between.
+template<typename T>
+OSStatus
+ReadPropertyArray(AudioObjectID aId,
+                  const AudioObjectPropertyAddress* aAddress,
+                  std::vector<T>* aArray)
+{
+  const size_t MIN_CAPACITY = 16;
+  const int ATTEMPTS = 4;
+  // Use all the storage already there.
+  aArray->resize(aArray->capacity() < MIN_CAPACITY ? MIN_CAPACITY
+                                                   : aArray->capacity());
+  OSStatus r = kAudioHardwareBadPropertySizeError;
+  UInt32 count = 0;
+  for (int i = 0; i < ATTEMPTS && r == kAudioHardwareBadPropertySizeError;
+       ++i) {
+    r = ReadPropertyArray(aId, aAddress, aArray->data(),
+                          static_cast<UInt32>(aArray->size()), &count);
+    if (r == kAudioHardwareBadPropertySizeError) {
+      aArray->resize(count + 1);
+    }
+  }
+  // Shrinking keeps the capacity for the next read.
+  aArray->resize(r == kAudioHardwareNoError ? count : 0);
+  return r;
+}
+
+template<typename P>
+OSStatus
+GetPropertyArray(AudioObjectID aId,
+                 typename P::Type* aBuffer,
+                 UInt32 aCapacity,
+                 UInt32* aCount)
+{
+  static_assert(P::kVariableSize, "Read the fixed-size values with GetProperty!");
+  return ReadPropertyArray(aId, &P::kAddress, aBuffer, aCapacity, aCount);
+}
+
+template<typename P>
+OSStatus
+GetPropertyArray(AudioObjectID aId, std::vector<typename P::Type>* aArray)
+{
+  static_assert(P::kVariableSize, "Read the fixed-size values with GetProperty!");
+  return ReadPropertyArray(aId, &P::kAddress, aArray);
+}
+
+template<typename P>
+OSStatus
+SetProperty(AudioObjectID aId, const typename P::Type& aData)
+{
+  static_assert(!P::kVariableSize, "Only the fixed-size values can be set!");
+  return AudioObjectSetPropertyData(aId, &P::kAddress, 0, nullptr,
+                                    sizeof(typename P::Type),
+                                    static_cast<const void*>(&aData));
+}
+
+#endif // #ifndef AUDIOOBJECTPROPERTIES_H
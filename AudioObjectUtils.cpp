@@ -1,73 +1,40 @@
 #include "AudioObjectUtils.h"
-#include <CoreFoundation/CFString.h> // for CFStringXXX
-
-const AudioObjectPropertyAddress kDevicesPropertyAddress = {
-  kAudioHardwarePropertyDevices,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kDeviceNamePropertyAddress = {
-  kAudioObjectPropertyName,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kDefaultInputDevicePropertyAddress = {
-  kAudioHardwarePropertyDefaultInputDevice,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kDefaultOutputDevicePropertyAddress = {
-  kAudioHardwarePropertyDefaultOutputDevice,
-  kAudioObjectPropertyScopeGlobal,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kInputDeviceStreamsPropertyAddress = {
-  kAudioDevicePropertyStreams,
-  kAudioObjectPropertyScopeInput,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kOutputDeviceStreamsPropertyAddress = {
-  kAudioDevicePropertyStreams,
-  kAudioObjectPropertyScopeOutput,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kInputDeviceSourcePropertyAddress = {
-  kAudioDevicePropertyDataSource,
-  kAudioObjectPropertyScopeInput,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kOutputDeviceSourcePropertyAddress = {
-  kAudioDevicePropertyDataSource,
-  kAudioObjectPropertyScopeOutput,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kInputDeviceSourceNamePropertyAddress = {
-  kAudioDevicePropertyDataSourceNameForIDCFString,
-  kAudioObjectPropertyScopeInput,
-  kAudioObjectPropertyElementMaster
-};
-
-const AudioObjectPropertyAddress kOutputDeviceSourceNamePropertyAddress = {
-  kAudioDevicePropertyDataSourceNameForIDCFString,
-  kAudioObjectPropertyScopeOutput,
-  kAudioObjectPropertyElementMaster
-};
+#include <algorithm> // for std::remove_if
+
+/* static */ AudioPropertyCache&
+AudioObjectUtils::Cache()
+{
+  static AudioPropertyCache cache;
+  return cache;
+}
+
+/* static */ AudioPropertyCache::Stats
+AudioObjectUtils::GetCacheStats()
+{
+  return Cache().GetStats();
+}
+
+/* static */ void
+AudioObjectUtils::ResetCacheStats()
+{
+  Cache().ResetStats();
+}
+
+/* static */ void
+AudioObjectUtils::ClearCache()
+{
+  Cache().Clear();
+}
 
 /* static */ AudioObjectID
 AudioObjectUtils::GetDefaultDeviceId(Scope scope)
 {
   AudioObjectID id = kAudioObjectUnknown;
-  const AudioObjectPropertyAddress* address = scope == Input?
-    &kDefaultInputDevicePropertyAddress : &kDefaultOutputDevicePropertyAddress;
-  OSStatus status = GetPropertyData(kAudioObjectSystemObject, address, &id);
+  OSStatus status = scope == Input
+    ? GetCachedProperty<DefaultInputDeviceProperty>(kAudioObjectSystemObject,
+                                                    &id)
+    : GetCachedProperty<DefaultOutputDeviceProperty>(kAudioObjectSystemObject,
+                                                     &id);
   if (status != kAudioHardwareNoError) {
     return kAudioObjectUnknown; // TODO: Maybe throw an error instead.
   }
@@ -77,12 +44,13 @@ AudioObjectUtils::GetDefaultDeviceId(Scope scope)
 /* static */ UInt32
 AudioObjectUtils::GetNumberOfStreams(AudioObjectID id, Scope scope)
 {
-  const AudioObjectPropertyAddress* address = scope == Input ?
-    &kInputDeviceStreamsPropertyAddress : &kOutputDeviceStreamsPropertyAddress;
-  UInt32 size = 0;
-  OSStatus status = GetPropertyDataSize(id, address, &size);
-  return status == kAudioHardwareNoError ?
-    static_cast<UInt32>(size / sizeof(AudioStreamID)) : 0;
+  UInt32 count = 0;
+  OSStatus status = scope == Input
+    ? GetCachedPropertyCount<StreamsProperty<kAudioObjectPropertyScopeInput>>(
+        id, &count)
+    : GetCachedPropertyCount<StreamsProperty<kAudioObjectPropertyScopeOutput>>(
+        id, &count);
+  return status == kAudioHardwareNoError ? count : 0;
 }
 
 /* static */ bool
@@ -160,14 +128,26 @@ AudioObjectUtils::CFStringRefToUTF8(CFStringRef stringRef)
 /* static */ string
 AudioObjectUtils::GetDeviceName(AudioObjectID id)
 {
-  CFStringRef data = nullptr;
-  OSStatus status = GetPropertyData(id, &kDeviceNamePropertyAddress, &data);
-  if (status != kAudioHardwareNoError || !data) {
+  string s;
+  OSStatus status = Cache().Get(id, &DeviceNameProperty::kAddress,
+                                AudioPropertyCache::String, 0, &s,
+    [id](string* value) {
+      CFStringRef data = nullptr;
+      OSStatus r = GetProperty<DeviceNameProperty>(id, &data);
+      if (r == kAudioHardwareNoError && !data) {
+        r = kAudioHardwareUnspecifiedError;
+      }
+      if (r != kAudioHardwareNoError) {
+        return r;
+      }
+      *value = CFStringRefToUTF8(data);
+      CFRelease(data);
+      return r;
+    });
+  if (status != kAudioHardwareNoError) {
     return ""; // TODO: Maybe throw an error instead.
   }
 
-  string s = CFStringRefToUTF8(data);
-  CFRelease(data);
   return s;
 }
 
@@ -175,9 +155,11 @@ AudioObjectUtils::GetDeviceName(AudioObjectID id)
 AudioObjectUtils::GetDeviceSource(AudioObjectID id, Scope scope)
 {
   UInt32 data = 0;
-  const AudioObjectPropertyAddress* address = scope == Input ?
-    &kInputDeviceSourcePropertyAddress : &kOutputDeviceSourcePropertyAddress;
-  OSStatus status = GetPropertyData(id, address, &data);
+  OSStatus status = scope == Input
+    ? GetCachedProperty<DataSourceProperty<kAudioObjectPropertyScopeInput>>(
+        id, &data)
+    : GetCachedProperty<DataSourceProperty<kAudioObjectPropertyScopeOutput>>(
+        id, &data);
   if (status != kAudioHardwareNoError) {
     return 0; // TODO: Maybe throw an error instead.
   }
@@ -189,22 +171,38 @@ AudioObjectUtils::GetDeviceSource(AudioObjectID id, Scope scope)
 AudioObjectUtils::GetDeviceSourceName(AudioObjectID id, Scope scope,
                                       UInt32 aSource)
 {
-  CFStringRef source = nullptr;
-  AudioValueTranslation translation;
-  translation.mInputData = &aSource;
-  translation.mInputDataSize = sizeof(aSource);
-  translation.mOutputData = &source;
-  translation.mOutputDataSize = sizeof(source);
-
+  typedef DataSourceNameProperty<kAudioObjectPropertyScopeInput> InputName;
+  typedef DataSourceNameProperty<kAudioObjectPropertyScopeOutput> OutputName;
   const AudioObjectPropertyAddress* address = scope == Input
-    ? &kInputDeviceSourceNamePropertyAddress
-    : &kOutputDeviceSourceNamePropertyAddress;
-  OSStatus status = GetPropertyData(id, address, &translation);
+    ? &InputName::kAddress : &OutputName::kAddress;
+  // The name depends on the translated source, so it's cached per source.
+  string name;
+  OSStatus status = Cache().Get(id, address, AudioPropertyCache::String,
+                                aSource, &name,
+    [id, scope, aSource](string* value) {
+      UInt32 input = aSource;
+      CFStringRef source = nullptr;
+      AudioValueTranslation translation;
+      translation.mInputData = &input;
+      translation.mInputDataSize = sizeof(input);
+      translation.mOutputData = &source;
+      translation.mOutputDataSize = sizeof(source);
+      OSStatus r = scope == Input
+        ? GetProperty<InputName>(id, &translation)
+        : GetProperty<OutputName>(id, &translation);
+      if (r == kAudioHardwareNoError) {
+        *value = CFStringRefToUTF8(source);
+        if (source) {
+          CFRelease(source);
+        }
+      }
+      return r;
+    });
   if (status != kAudioHardwareNoError) {
     return ""; // TODO: Maybe throw an error instead.
   }
 
-  return CFStringRefToUTF8(source);
+  return name;
 }
 
 /* static */ bool
@@ -222,37 +220,60 @@ AudioObjectUtils::SetDefaultDevice(AudioObjectID id, Scope scope)
     return false;
   }
 
-  const AudioObjectPropertyAddress* address = scope == Input ?
-    &kDefaultInputDevicePropertyAddress : &kDefaultOutputDevicePropertyAddress;
-  return SetPropertyData(kAudioObjectSystemObject, address, &id)
-         == kAudioHardwareNoError;
+  OSStatus status = scope == Input
+    ? SetProperty<DefaultInputDeviceProperty>(kAudioObjectSystemObject, id)
+    : SetProperty<DefaultOutputDeviceProperty>(kAudioObjectSystemObject, id);
+  if (status != kAudioHardwareNoError) {
+    return false;
+  }
+  // Don't wait for the listener to drop the old default device.
+  Cache().Invalidate(kAudioObjectSystemObject, scope == Input
+    ? &DefaultInputDeviceProperty::kAddress
+    : &DefaultOutputDeviceProperty::kAddress);
+  return true;
 }
 
 /* static */ vector<AudioObjectID>
 AudioObjectUtils::GetAllDeviceIds()
 {
   vector<AudioObjectID> ids;
-  OSStatus status = GetPropertyArray(kAudioObjectSystemObject,
-                                     &kDevicesPropertyAddress, &ids);
+  GetAllDeviceIds(&ids);
+  return ids;
+}
+
+/* static */ bool
+AudioObjectUtils::GetAllDeviceIds(vector<AudioObjectID>* aIds)
+{
+  OSStatus status =
+    GetCachedPropertyArray<DevicesProperty>(kAudioObjectSystemObject, aIds);
   if (status != kAudioHardwareNoError) {
-    return {};
+    aIds->clear();
+    return false;
   }
 
-  return ids;
+  return true;
 }
 
 /* static */ vector<AudioObjectID>
 AudioObjectUtils::GetDeviceIds(Scope scope) {
   vector<AudioObjectID> ids;
+  GetDeviceIds(scope, &ids);
+  return ids;
+}
 
-  vector<AudioObjectID> all = AudioObjectUtils::GetAllDeviceIds();
-  for (AudioObjectID id : all) {
-    if (InScope(id, scope)) {
-      ids.push_back(id);
-    }
+/* static */ bool
+AudioObjectUtils::GetDeviceIds(Scope scope, vector<AudioObjectID>* aIds) {
+  if (!GetAllDeviceIds(aIds)) {
+    return false;
   }
 
-  return ids;
+  // Filter in place, so no other list is needed.
+  aIds->erase(std::remove_if(aIds->begin(), aIds->end(),
+                             [scope](AudioObjectID id) {
+                               return !InScope(id, scope);
+                             }),
+              aIds->end());
+  return true;
 }
 
 /* static */ string
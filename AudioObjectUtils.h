@@ -1,9 +1,13 @@
 #ifndef AUDIOOBJECTUTILS_H
 #define AUDIOOBJECTUTILS_H
 
-#include <CoreAudio/AudioHardware.h>
-#include <CoreAudio/AudioHardwareBase.h>
+#include "AudioHardwareTypes.h"
+#include "AudioObjectProperties.h"
+#include "AudioPropertyCache.h"
+#include <cassert>
+#include <cstring>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 using std::vector;
@@ -11,6 +15,10 @@ using std::string;
 
 // Provide low-level APIs to get device-related information or set
 // default input or output devices.
+//
+// The property values are cached by a process-wide AudioPropertyCache, whose
+// entries are invalidated by the HAL's property listeners, so the repeated
+// queries don't go to the HAL until the properties change.
 class AudioObjectUtils
 {
 public:
@@ -30,6 +38,10 @@ public:
                                     UInt32 source);
   static bool SetDefaultDevice(AudioObjectID id, Scope scope);
   static vector<AudioObjectID> GetAllDeviceIds();
+  // The same, into the caller's storage, which is reused: once it has grown
+  // to the number of devices, a cached read allocates nothing. Return false,
+  // with aIds emptied, if the list can't be read.
+  static bool GetAllDeviceIds(vector<AudioObjectID>* aIds);
   // NOTE: The following two APIs are rather higher level. They are implemented
   //       based on the above APIs.
 
@@ -37,55 +49,94 @@ public:
   //       that, we need to get all the devices first ans then check if they
   //       are input or output ony by one.
   static vector<AudioObjectID> GetDeviceIds(Scope scope);
+  static bool GetDeviceIds(Scope scope, vector<AudioObjectID>* aIds);
   static string GetDeviceLabel(AudioObjectID id, Scope scope);
 
-private:
-  static UInt32 GetNumberOfStreams(AudioObjectID id, Scope scope);
+  // The hit/miss counters of the property cache show how many HAL calls are
+  // avoided.
+  static AudioPropertyCache::Stats GetCacheStats();
+  static void ResetCacheStats();
+  // Drop all the cached values. The next queries go to the HAL.
+  static void ClearCache();
+
+  // The caller keeps its reference to stringRef.
   static string CFStringRefToUTF8(CFStringRef stringRef);
 
-  template<typename T>
-  static OSStatus GetPropertyData(AudioObjectID id,
-                                  const AudioObjectPropertyAddress* address,
-                                  T* data) {
-    UInt32 size = sizeof(T);
-    return AudioObjectGetPropertyData(id, address, 0, nullptr, &size,
-                                      static_cast<void*>(data));
+private:
+  static AudioPropertyCache& Cache();
+
+  // The cached versions of the accessors of AudioObjectProperties.h. The
+  // CFString-valued properties must not be read with GetCachedProperty, since
+  // every read hands over a reference to release. They're cached as UTF-8
+  // strings instead.
+  template<typename P>
+  static OSStatus GetCachedProperty(AudioObjectID id,
+                                    typename P::Type* data) {
+    typedef typename P::Type T;
+    static_assert(std::is_trivially_copyable<T>::value &&
+                  !std::is_pointer<T>::value,
+                  "Only the plain values can be cached!");
+    return Cache().Get(id, &P::kAddress, AudioPropertyCache::Data, 0,
+                       &CopyValue<T>, data,
+      [id, data](string* value) {
+        OSStatus r = GetProperty<P>(id, data);
+        if (r == kAudioHardwareNoError) {
+          value->assign(reinterpret_cast<const char*>(data), sizeof(T));
+        }
+        return r;
+      });
   }
 
-  template<typename T>
-  static OSStatus GetPropertyArray(AudioObjectID id,
-                                   const AudioObjectPropertyAddress* address,
-                                   vector<T>* array) {
-    UInt32 size = 0;
-    OSStatus r = GetPropertyDataSize(id, address, &size);
-    if (r != kAudioHardwareNoError) {
-      return r;
-    }
-    if (!size) {
-      return r; // TODO: Maybe throw an error instead.
-    }
-    vector<T> data(size / sizeof(T));
-    r = AudioObjectGetPropertyData(id, address, 0, nullptr, &size,
-                                   static_cast<void*>(data.data()));
-    if (r == kAudioHardwareNoError) {
-      *array = data;
-    }
-    return r;
+  // The array is read into the caller's storage, by ReadPropertyArray on a
+  // miss, and copied from the cached bytes on a hit.
+  template<typename P>
+  static OSStatus GetCachedPropertyArray(AudioObjectID id,
+                                         vector<typename P::Type>* array) {
+    typedef typename P::Type T;
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "Only the plain values can be cached!");
+    return Cache().Get(id, &P::kAddress, AudioPropertyCache::Data, 0,
+                       &CopyArray<T>, array,
+      [id, array](string* value) {
+        OSStatus r = GetPropertyArray<P>(id, array);
+        if (r == kAudioHardwareNoError) {
+          value->assign(reinterpret_cast<const char*>(array->data()),
+                        array->size() * sizeof(T));
+        }
+        return r;
+      });
+  }
+
+  template<typename P>
+  static OSStatus GetCachedPropertyCount(AudioObjectID id, UInt32* count) {
+    return Cache().Get(id, &P::kAddress, AudioPropertyCache::Size, 0,
+                       &CopyValue<UInt32>, count,
+      [id, count](string* value) {
+        OSStatus r = GetPropertyCount<P>(id, count);
+        if (r == kAudioHardwareNoError) {
+          value->assign(reinterpret_cast<const char*>(count), sizeof(*count));
+        }
+        return r;
+      });
   }
 
-  static OSStatus GetPropertyDataSize(AudioObjectID id,
-                                      const AudioObjectPropertyAddress* address,
-                                      UInt32 *size) {
-    return AudioObjectGetPropertyDataSize(id, address, 0, nullptr, size);
+  /* AudioPropertyCache::CopyOut */
+  template<typename T>
+  static void CopyValue(const string& bytes, void* target) {
+    assert(bytes.size() == sizeof(T));
+    memcpy(target, bytes.data(), sizeof(T));
   }
 
+  /* AudioPropertyCache::CopyOut */
   template<typename T>
-  static OSStatus SetPropertyData(AudioObjectID id,
-                                  const AudioObjectPropertyAddress *address,
-                                  const T* data) {
-    return AudioObjectSetPropertyData(id, address, 0, nullptr, sizeof(T),
-                                      static_cast<const void*>(data));
+  static void CopyArray(const string& bytes, void* target) {
+    vector<T>* array = static_cast<vector<T>*>(target);
+    // Shrinking or growing within the capacity allocates nothing.
+    array->resize(bytes.size() / sizeof(T));
+    memcpy(array->data(), bytes.data(), array->size() * sizeof(T));
   }
+
+  static UInt32 GetNumberOfStreams(AudioObjectID id, Scope scope);
 };
 
 #endif // #ifndef AUDIOOBJECTUTILS_H
\ No newline at end of file
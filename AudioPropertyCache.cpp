@@ -0,0 +1,282 @@
+#include "AudioPropertyCache.h"
+#include "AudioObjectProperties.h"
+#include <algorithm> // std::find
+#include <cassert>
+
+static bool
+Matches(UInt32 aValue, UInt32 aPattern, UInt32 aWildcard)
+{
+  return aPattern == aWildcard || aValue == aPattern;
+}
+
+// Whether aPattern, which may hold wildcards, matches aAddress.
+static bool
+Matches(const AudioObjectPropertyAddress& aAddress,
+        const AudioObjectPropertyAddress& aPattern)
+{
+  return Matches(aAddress.mSelector, aPattern.mSelector,
+                 kAudioObjectPropertySelectorWildcard) &&
+         Matches(aAddress.mScope, aPattern.mScope,
+                 kAudioObjectPropertyScopeWildcard) &&
+         Matches(aAddress.mElement, aPattern.mElement,
+                 kAudioObjectPropertyElementWildcard);
+}
+
+static bool
+Less(const AudioObjectPropertyAddress& aA,
+     const AudioObjectPropertyAddress& aB)
+{
+  if (aA.mSelector != aB.mSelector) {
+    return aA.mSelector < aB.mSelector;
+  }
+  if (aA.mScope != aB.mScope) {
+    return aA.mScope < aB.mScope;
+  }
+  return aA.mElement < aB.mElement;
+}
+
+bool
+AudioPropertyCache::Key::operator<(const Key& aOther) const
+{
+  if (mId != aOther.mId) {
+    return mId < aOther.mId;
+  }
+  if (Less(mAddress, aOther.mAddress) || Less(aOther.mAddress, mAddress)) {
+    return Less(mAddress, aOther.mAddress);
+  }
+  if (mKind != aOther.mKind) {
+    return mKind < aOther.mKind;
+  }
+  return mQualifier < aOther.mQualifier;
+}
+
+bool
+AudioPropertyCache::Target::operator<(const Target& aOther) const
+{
+  if (mId != aOther.mId) {
+    return mId < aOther.mId;
+  }
+  return Less(mAddress, aOther.mAddress);
+}
+
+AudioPropertyCache::AudioPropertyCache()
+  : mGeneration(0)
+  , mHits(0)
+  , mMisses(0)
+  , mInvalidations(0)
+{}
+
+AudioPropertyCache::~AudioPropertyCache()
+{
+  Clear();
+}
+
+bool
+AudioPropertyCache::Lookup(const Key& aKey, CopyOut aCopy, void* aTarget,
+                           uint64_t* aGeneration)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  std::map<Key, std::string>::const_iterator it = mEntries.find(aKey);
+  if (it != mEntries.end()) {
+    ++mHits;
+    aCopy(it->second, aTarget);
+    return true;
+  }
+  ++mMisses;
+  *aGeneration = mGeneration;
+  return false;
+}
+
+/* static */ void
+AudioPropertyCache::CopyString(const std::string& aValue, void* aTarget)
+{
+  // Reuse the storage of the target.
+  static_cast<std::string*>(aTarget)->assign(aValue);
+}
+
+void
+AudioPropertyCache::Insert(const Key& aKey, const std::string& aValue,
+                           uint64_t aGeneration)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  if (aGeneration != mGeneration) {
+    return; // Something changed while the value was read.
+  }
+  mEntries[aKey] = aValue;
+}
+
+bool
+AudioPropertyCache::Listen(AudioObjectID aId,
+                           const AudioObjectPropertyAddress* aAddress)
+{
+  Target target = { aId, *aAddress };
+  Target devices = { kAudioObjectSystemObject, DevicesProperty::kAddress };
+  std::vector<Target> pending;
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    std::map<Target, bool>::const_iterator it = mListeners.find(target);
+    if (it != mListeners.end()) {
+      // Not cacheable yet if another thread is still registering it.
+      return it->second;
+    }
+    // Claim the registrations so no other thread makes them.
+    pending.push_back(target);
+    mListeners[target] = false;
+    if (!mListeners.count(devices)) {
+      pending.push_back(devices);
+      mListeners[devices] = false;
+    }
+  }
+
+  bool ok = true;
+  for (const Target& t : pending) {
+    bool added = AddListener(t);
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (added) {
+      mListeners[t] = true;
+    } else {
+      mListeners.erase(t);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+bool
+AudioPropertyCache::AddListener(const Target& aTarget)
+{
+  return AudioObjectAddPropertyListener(aTarget.mId, &aTarget.mAddress,
+                                        &OnPropertyChanged, this) == noErr;
+}
+
+void
+AudioPropertyCache::RemoveListeners(const std::vector<Target>& aTargets)
+{
+  for (const Target& t : aTargets) {
+    // It fails for the removed devices, which is fine.
+    AudioObjectRemovePropertyListener(t.mId, &t.mAddress, &OnPropertyChanged,
+                                      this);
+  }
+}
+
+void
+AudioPropertyCache::Invalidate(AudioObjectID aId,
+                               const AudioObjectPropertyAddress* aAddress)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  ++mGeneration;
+  std::map<Key, std::string>::iterator it = mEntries.begin();
+  while (it != mEntries.end()) {
+    if (it->first.mId == aId && Matches(it->first.mAddress, *aAddress)) {
+      it = mEntries.erase(it);
+      ++mInvalidations;
+    } else {
+      ++it;
+    }
+  }
+}
+
+void
+AudioPropertyCache::PurgeRemovedDevices()
+{
+  // Ask the HAL directly, without the lock.
+  std::vector<AudioObjectID> devices;
+  GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, &devices);
+
+  std::vector<Target> removed;
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    ++mGeneration;
+    std::map<Key, std::string>::iterator entry = mEntries.begin();
+    while (entry != mEntries.end()) {
+      AudioObjectID id = entry->first.mId;
+      if (id != kAudioObjectSystemObject &&
+          std::find(devices.begin(), devices.end(), id) == devices.end()) {
+        entry = mEntries.erase(entry);
+        ++mInvalidations;
+      } else {
+        ++entry;
+      }
+    }
+    std::map<Target, bool>::iterator listener = mListeners.begin();
+    while (listener != mListeners.end()) {
+      AudioObjectID id = listener->first.mId;
+      if (listener->second && id != kAudioObjectSystemObject &&
+          std::find(devices.begin(), devices.end(), id) == devices.end()) {
+        removed.push_back(listener->first);
+        listener = mListeners.erase(listener);
+      } else {
+        ++listener;
+      }
+    }
+  }
+  RemoveListeners(removed);
+}
+
+void
+AudioPropertyCache::Clear()
+{
+  std::vector<Target> removed;
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    ++mGeneration;
+    mEntries.clear();
+    std::map<Target, bool>::iterator it = mListeners.begin();
+    while (it != mListeners.end()) {
+      // Leave the ones being registered to their registering thread.
+      if (it->second) {
+        removed.push_back(it->first);
+        it = mListeners.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  RemoveListeners(removed);
+}
+
+AudioPropertyCache::Stats
+AudioPropertyCache::GetStats() const
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  Stats stats;
+  stats.mHits = mHits;
+  stats.mMisses = mMisses;
+  stats.mInvalidations = mInvalidations;
+  stats.mEntries = mEntries.size();
+  stats.mListeners = 0;
+  for (const auto& listener : mListeners) {
+    stats.mListeners += listener.second;
+  }
+  return stats;
+}
+
+void
+AudioPropertyCache::ResetStats()
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  mHits = 0;
+  mMisses = 0;
+  mInvalidations = 0;
+}
+
+/* static */ OSStatus
+AudioPropertyCache::OnPropertyChanged(
+  AudioObjectID aId,
+  UInt32 aNumAddresses,
+  const AudioObjectPropertyAddress aAddresses[],
+  void* aData)
+{
+  AudioPropertyCache* cache = static_cast<AudioPropertyCache*>(aData);
+  assert(cache);
+  bool devicesChanged = false;
+  for (UInt32 i = 0; i < aNumAddresses; ++i) {
+    cache->Invalidate(aId, &aAddresses[i]);
+    devicesChanged |= aId == kAudioObjectSystemObject &&
+                      Matches(DevicesProperty::kAddress, aAddresses[i]);
+  }
+  if (devicesChanged) {
+    cache->PurgeRemovedDevices();
+  }
+  return noErr;
+}
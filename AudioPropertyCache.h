@@ -0,0 +1,165 @@
+#ifndef AUDIOPROPERTYCACHE_H
+#define AUDIOPROPERTYCACHE_H
+
+#include "AudioHardwareTypes.h"
+#include <map>      // std::map
+#include <mutex>    // std::mutex
+#include <stdint.h> // uint64_t
+#include <string>   // std::string
+#include <vector>   // std::vector
+
+// A cache of the HAL property values, keyed by (object id, selector, scope,
+// element), plus a qualifier for the properties read with one (e.g. the
+// data source id whose name is translated).
+//
+// An entry is only kept while a property listener is registered on its
+// address, the same way AudioDeviceListener listens to the device changes,
+// so it's dropped as soon as the HAL reports the property changed. The
+// entries of a device are also dropped once it leaves the device list.
+//
+// The HAL is never called with the cache's lock held, since the listeners
+// are fired on a HAL thread that may hold the HAL's own lock (see
+// test_deadlock.cpp). A value read while an invalidation happened is
+// returned but not cached.
+class AudioPropertyCache
+{
+public:
+  // The same property can be cached as its data, its data size, or a string
+  // converted from its CFString data.
+  enum Kind
+  {
+    Data,
+    Size,
+    String
+  };
+
+  struct Stats
+  {
+    uint64_t mHits;          // Reads served without a HAL call.
+    uint64_t mMisses;        // Reads going to the HAL.
+    uint64_t mInvalidations; // Entries dropped by the listeners.
+    uint64_t mEntries;
+    uint64_t mListeners;     // Property listeners currently registered.
+  };
+
+  AudioPropertyCache();
+  ~AudioPropertyCache();
+
+  // Copy a cached value out to the caller's storage at aTarget. It's called
+  // with the cache's lock held, so it must not call the HAL.
+  typedef void (*CopyOut)(const std::string& aValue, void* aTarget);
+
+  // Copy the cached value out with aCopy(value, aTarget), or call
+  // aFetch(aValue), which returns the OSStatus of its HAL call and fills
+  // aTarget as well as aValue, and cache aValue if it succeeded. A hit
+  // allocates nothing once aTarget has grown to the size of the value.
+  template<typename Fetch>
+  OSStatus Get(AudioObjectID aId,
+               const AudioObjectPropertyAddress* aAddress,
+               Kind aKind,
+               UInt32 aQualifier,
+               CopyOut aCopy,
+               void* aTarget,
+               Fetch aFetch)
+  {
+    Key key = { aId, *aAddress, aKind, aQualifier };
+    uint64_t generation = 0;
+    if (Lookup(key, aCopy, aTarget, &generation)) {
+      return kAudioHardwareNoError;
+    }
+    bool listening = Listen(aId, aAddress);
+    std::string value;
+    OSStatus r = aFetch(&value);
+    if (r == kAudioHardwareNoError && listening) {
+      Insert(key, value, generation);
+    }
+    return r;
+  }
+
+  // The same, for a value read as a string: return the cached value in
+  // aValue, or call aFetch(aValue) and cache its value if it succeeded.
+  template<typename Fetch>
+  OSStatus Get(AudioObjectID aId,
+               const AudioObjectPropertyAddress* aAddress,
+               Kind aKind,
+               UInt32 aQualifier,
+               std::string* aValue,
+               Fetch aFetch)
+  {
+    return Get(aId, aAddress, aKind, aQualifier, &CopyString, aValue,
+      [aValue, &aFetch](std::string* aEntry) {
+        OSStatus r = aFetch(aValue);
+        if (r == kAudioHardwareNoError) {
+          *aEntry = *aValue;
+        }
+        return r;
+      });
+  }
+
+  // Drop the entries at aAddress of aId, e.g. after writing the property.
+  // Wildcards match anything.
+  void Invalidate(AudioObjectID aId,
+                  const AudioObjectPropertyAddress* aAddress);
+  // Drop all the entries and unregister all the listeners.
+  void Clear();
+
+  // It's safe to call this from any thread.
+  Stats GetStats() const;
+  void ResetStats();
+
+private:
+  struct Key
+  {
+    AudioObjectID mId;
+    AudioObjectPropertyAddress mAddress;
+    Kind mKind;
+    UInt32 mQualifier;
+
+    bool operator<(const Key& aOther) const;
+  };
+  // A property address on an object, the unit of a listener.
+  struct Target
+  {
+    AudioObjectID mId;
+    AudioObjectPropertyAddress mAddress;
+
+    bool operator<(const Target& aOther) const;
+  };
+
+  // Return true and copy the value out with aCopy on a hit. On a miss,
+  // aGeneration is set to what Insert must find for the fetched value to be
+  // cached.
+  bool Lookup(const Key& aKey, CopyOut aCopy, void* aTarget,
+              uint64_t* aGeneration);
+  static void CopyString(const std::string& aValue, void* aTarget);
+  void Insert(const Key& aKey, const std::string& aValue,
+              uint64_t aGeneration);
+  // Make sure the changes of aAddress on aId, and of the device list, are
+  // listened to. Return false if they can't be.
+  bool Listen(AudioObjectID aId, const AudioObjectPropertyAddress* aAddress);
+  bool AddListener(const Target& aTarget);
+  // Drop the entries and the listeners of the devices no longer present.
+  void PurgeRemovedDevices();
+  void RemoveListeners(const std::vector<Target>& aTargets);
+
+  static OSStatus OnPropertyChanged(AudioObjectID aId,
+                                    UInt32 aNumAddresses,
+                                    const AudioObjectPropertyAddress aAddresses[],
+                                    void* aData);
+
+  // Not copyable: the listeners point to this cache.
+  AudioPropertyCache(const AudioPropertyCache&);
+  AudioPropertyCache& operator=(const AudioPropertyCache&);
+
+  mutable std::mutex mMutex;
+  std::map<Key, std::string> mEntries;
+  // The listened targets, mapped to false while being registered.
+  std::map<Target, bool> mListeners;
+  // Bumped by every invalidation, so a value fetched across one isn't cached.
+  uint64_t mGeneration;
+  uint64_t mHits;
+  uint64_t mMisses;
+  uint64_t mInvalidations;
+};
+
+#endif // #ifndef AUDIOPROPERTYCACHE_H
@@ -1,9 +1,25 @@
 #include "AudioStream.h"
-#include <CoreAudio/CoreAudio.h>
+#include "Host.h"
+#include "LockOrderValidator.h"
 #include <cassert>
+#include <chrono>   // std::chrono
+#include <cstring>
+
+#if defined(__APPLE__)
+#include "AudioUnitBackend.h"
+typedef AudioUnitBackend DefaultBackend;
+#else
+#include "VirtualDeviceBackend.h"
+typedef VirtualDeviceBackend DefaultBackend;
+#endif
 
 const unsigned int FORMAT_LEN = AudioStream::F32BE + 1;
 
+// The number of frames converted at once in the float-source mode.
+const unsigned long FLOAT_SOURCE_FRAMES = 1024;
+// The number of device frames resampled at once.
+const unsigned long RESAMPLER_FRAMES = 1024;
+
 AudioStreamBasicDescription
 AudioStream::Parameters::GetFormatDescription()
 {
@@ -14,7 +30,10 @@ AudioStream::Parameters::GetFormatDescription()
   desc.mFormatID = kAudioFormatLinearPCM;
   desc.mFormatFlags = GetFormatFlags();
   desc.mFramesPerPacket = 1;
-  desc.mBytesPerFrame = GetFormatByteSize() * desc.mChannelsPerFrame;
+  // Each channel of a non-interleaved stream is in its own buffer, so a frame
+  // in that buffer only holds one sample.
+  desc.mBytesPerFrame = GetFormatByteSize() *
+                        (mNonInterleaved ? 1 : desc.mChannelsPerFrame);
   desc.mBytesPerPacket = desc.mBytesPerFrame * desc.mFramesPerPacket;
   desc.mBitsPerChannel = GetFormatByteSize() * 8;
   desc.mReserved = 0;
@@ -46,111 +65,856 @@ AudioStream::Parameters::GetFormatFlags()
   };
 
   AudioFormatFlags defaultFlags = kLinearPCMFormatFlagIsPacked;
+  if (mNonInterleaved) {
+    defaultFlags |= kAudioFormatFlagIsNonInterleaved;
+  }
   return defaultFlags | formatFlags[mFormat];
 }
 
 AudioStream::AudioStream(Format aFormat,
                          unsigned int aChannels,
                          double aRate,
-                         AudioCallback aCallback)
-  : mUnit(nullptr)
-  , mCallback(aCallback)
-  , mParams({ aFormat,
-              static_cast<UInt32>(aChannels),
-              static_cast<Float64>(aRate) })
+                         AudioCallback aCallback,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : AudioStream({ aFormat,
+                  static_cast<UInt32>(aChannels),
+                  static_cast<Float64>(aRate),
+                  false },
+                0,
+                std::move(aBackend),
+                aControl)
+{
+  mCallback = aCallback;
+  Setup();
+}
+
+AudioStream::AudioStream(Format aFormat,
+                         unsigned int aChannels,
+                         double aRate,
+                         ContextAudioCallback aCallback,
+                         void* aContext,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : AudioStream(aFormat, aChannels, aRate, aCallback, aContext, DataCallback,
+                std::move(aBackend), aControl)
+{}
+
+AudioStream::AudioStream(Format aFormat,
+                         unsigned int aChannels,
+                         double aRate,
+                         ContextAudioCallback aCallback,
+                         void* aContext,
+                         AURenderCallback aDataCallback,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : AudioStream({ aFormat,
+                  static_cast<UInt32>(aChannels),
+                  static_cast<Float64>(aRate),
+                  false },
+                0,
+                std::move(aBackend),
+                aControl)
+{
+  mDataCallback = aDataCallback;
+  mContextCallback = aCallback;
+  mCallbackContext = aContext;
+  Setup();
+}
+
+AudioStream::AudioStream(Format aFormat,
+                         unsigned int aChannels,
+                         double aRate,
+                         PlanarAudioCallback aCallback,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : AudioStream({ aFormat,
+                  static_cast<UInt32>(aChannels),
+                  static_cast<Float64>(aRate),
+                  true },
+                0,
+                std::move(aBackend),
+                aControl)
+{
+  mPlanarCallback = aCallback;
+  Setup();
+}
+
+AudioStream::AudioStream(Format aFormat,
+                         unsigned int aInputChannels,
+                         unsigned int aOutputChannels,
+                         double aRate,
+                         DuplexAudioCallback aCallback,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : AudioStream({ aFormat,
+                  static_cast<UInt32>(aOutputChannels),
+                  static_cast<Float64>(aRate),
+                  false },
+                static_cast<UInt32>(aInputChannels),
+                std::move(aBackend),
+                aControl)
 {
-  assert(CreateAudioUnit());
-  assert(SetStreamFormat());
-  assert(SetCallback());
-  assert(InitAudioUnit());
+  mDuplexCallback = aCallback;
+  Setup();
+}
+
+AudioStream::AudioStream(const Parameters& aParams,
+                         UInt32 aInputChannels,
+                         std::unique_ptr<AudioBackend> aBackend,
+                         AudioControlThread* aControl)
+  : mBackend(aBackend ? std::move(aBackend) : CreateDefaultBackend())
+  , mControl(aControl)
+  , mCreated(false)
+  , mInitialized(false)
+  , mDataCallback(DataCallback)
+  , mCallback(nullptr)
+  , mContextCallback(nullptr)
+  , mCallbackContext(nullptr)
+  , mPlanarCallback(nullptr)
+  , mDuplexCallback(nullptr)
+  , mParams(aParams)
+  , mChannelData(aParams.mNonInterleaved ? aParams.mChannels : 0, nullptr)
+  , mInputChannels(aInputChannels)
+  , mMaxInputFrames(0)
+  , mPrefillFrames(0)
+  , mProducing(false)
+  , mUnderruns(0)
+  , mUnderrunFrames(0)
+  , mRingCapacity(0)
+  , mRingPrefill(0)
+  , mRingBuffered(0)
+  , mFloatSource(false)
+  , mDitherEnabled(false)
+  , mDeviceRate(0.0)
+  , mResamplerQuality(Resampler::MEDIUM)
+  , mState(CREATED)
+  , mDrained(false)
+  , mNotifier(nullptr)
+  , mNotifierClient(nullptr)
+  , mStateCallback(nullptr)
+  , mStateContext(nullptr)
+  , mDelivered(0)
+{
+  memset(&mInputBufferList, 0, sizeof(mInputBufferList));
+  for (std::atomic<uint64_t>& entry : mStateHistory) {
+    entry.store(CREATED, std::memory_order_relaxed);
+  }
+}
+
+/* static */ std::unique_ptr<AudioBackend>
+AudioStream::CreateDefaultBackend()
+{
+  return std::unique_ptr<AudioBackend>(new DefaultBackend());
+}
+
+/* static */ std::unique_ptr<AudioStream>
+AudioStream::Adopt(const Parameters& aParams,
+                   AudioCallback aCallback,
+                   std::unique_ptr<AudioBackend> aBackend)
+{
+  assert(aBackend && !aParams.mNonInterleaved);
+  std::unique_ptr<AudioStream> stream(
+    new AudioStream(aParams, 0, std::move(aBackend), nullptr));
+  stream->mCallback = aCallback;
+  stream->mCreated = true;
+  stream->mInitialized = true;
+  stream->Setup();
+  return stream;
+}
+
+std::unique_ptr<AudioBackend>
+AudioStream::DetachBackend()
+{
+  bool stopped = Run([this] {
+    if (!mInitialized || !StopBackend()) {
+      return false;
+    }
+    mCreated = false;
+    mInitialized = false;
+    return true;
+  });
+  return stopped ? std::move(mBackend) : nullptr;
+}
+
+void
+AudioStream::Setup()
+{
+  assert(!!mCallback + !!mContextCallback + !!mPlanarCallback +
+         !!mDuplexCallback == 1);
+  mNotifier = &NotifierThread::Global();
+  mNotifierClient = mNotifier->Add(&AudioStream::Notify, this);
+  mSetup = Post([this] {
+    if (SetupBackend()) {
+      return true;
+    }
+    if (Transition(Bit(CREATED), ERROR)) {
+      WakeNotifier();
+    }
+    return false;
+  }).share();
+  if (!mControl) {
+    bool ready = mSetup.get();
+    assert(ready);
+    (void) ready;
+  }
+}
+
+bool
+AudioStream::SetupBackend()
+{
+  if (mInitialized) {
+    return SetCallback(); // Adopted.
+  }
+
+  Parameters input = mParams;
+  input.mChannels = mInputChannels;
+  if (mInputChannels && !mBackend->EnableInput(input.GetFormatDescription())) {
+    return false;
+  }
+
+  if (!mBackend->Create()) {
+    return false;
+  }
+  mCreated = true;
+  if (!SetStreamFormat() || !SetCallback() || !mBackend->Init()) {
+    return false;
+  }
+  mInitialized = true;
+
+  if (mInputChannels) {
+    // Allocate the input buffer once, for the largest render cycle.
+    mMaxInputFrames = mBackend->GetMaxFramesPerBuffer();
+    size_t bytesPerFrame = input.GetFormatByteSize() * mInputChannels;
+    mInputBuffer.assign(mMaxInputFrames * bytesPerFrame, 0);
+    mInputBufferList.mNumberBuffers = 1;
+    mInputBufferList.mBuffers[0].mNumberChannels = mInputChannels;
+    mInputBufferList.mBuffers[0].mData = mInputBuffer.data();
+  }
+  return true;
 }
 
 AudioStream::~AudioStream()
 {
-  Stop();
-  assert(UninitAudioUnit());
-  assert(DestroyAudioUnit());
+  // The notification thread is waited for below, and may be in Run.
+  assert(!mControl || !mControl->IsCurrentThread());
+  bool destroyed = Run([this] { return TeardownBackend(); });
+  assert(destroyed);
+  (void) destroyed;
+
+  // Deliver the last transitions, then leave the notification thread.
+  mNotifier->Remove(mNotifierClient);
+}
+
+bool
+AudioStream::TeardownBackend()
+{
+  bool r = !mInitialized || StopBackend();
+  if (mInitialized) {
+    r = mBackend->Uninit() && r;
+    mInitialized = false;
+  }
+  if (mCreated) {
+    r = mBackend->Destroy() && r;
+    mCreated = false;
+  }
+  return r;
+}
+
+std::future<bool>
+AudioStream::Post(AudioControlThread::Command aCommand,
+                  AudioControlThread::Completion aCompletion,
+                  void* aContext)
+{
+  if (mControl) {
+    return mControl->Post(std::move(aCommand), aCompletion, aContext);
+  }
+  std::promise<bool> result;
+  bool succeeded = false;
+  {
+    std::lock_guard<std::mutex> guard(mCommandMutex);
+    succeeded = aCommand();
+  }
+  if (aCompletion) {
+    aCompletion(succeeded, aContext);
+  }
+  result.set_value(succeeded);
+  return result.get_future();
+}
+
+bool
+AudioStream::Run(AudioControlThread::Command aCommand)
+{
+  // A command waiting for another command on the control thread would wait
+  // forever.
+  if (mControl && mControl->IsCurrentThread()) {
+    return aCommand();
+  }
+  return Post(std::move(aCommand)).get();
 }
 
 bool
 AudioStream::Start()
 {
-  assert(mUnit);
-  return AudioOutputUnitStart(mUnit) == noErr;
+  return Run([this] { return StartBackend(); });
 }
 
 bool
 AudioStream::Stop()
 {
-  assert(mUnit);
-  return AudioOutputUnitStop(mUnit) == noErr;
+  return Run([this] { return StopBackend(); });
 }
 
 bool
-AudioStream::CreateAudioUnit()
+AudioStream::SetFormat(Format aFormat, double aRate)
 {
-  assert(!mUnit); // mUnit should be nullptr before initializing.
+  return Run([this, aFormat, aRate] { return ApplyFormat(aFormat, aRate); });
+}
 
-  AudioComponentDescription desc;
-  desc.componentType = kAudioUnitType_Output;
-  desc.componentSubType = kAudioUnitSubType_DefaultOutput;
-  desc.componentManufacturer = kAudioUnitManufacturer_Apple;
-  desc.componentFlags = 0;
-  desc.componentFlagsMask = 0;
+std::future<bool>
+AudioStream::StartAsync(AudioControlThread::Completion aCompletion,
+                        void* aContext)
+{
+  return Post([this] { return StartBackend(); }, aCompletion, aContext);
+}
 
-  AudioComponent comp = AudioComponentFindNext(NULL, &desc);
-  // comp will be nullptr if there is no matching audio hardware.
+std::future<bool>
+AudioStream::StopAsync(AudioControlThread::Completion aCompletion,
+                       void* aContext)
+{
+  return Post([this] { return StopBackend(); }, aCompletion, aContext);
+}
 
-  return comp && AudioComponentInstanceNew(comp, &mUnit) == noErr;
+std::future<bool>
+AudioStream::SetFormatAsync(Format aFormat,
+                            double aRate,
+                            AudioControlThread::Completion aCompletion,
+                            void* aContext)
+{
+  return Post([this, aFormat, aRate] { return ApplyFormat(aFormat, aRate); },
+              aCompletion, aContext);
 }
 
 bool
-AudioStream::DestroyAudioUnit()
+AudioStream::StartBackend()
 {
-  assert(mUnit);
-  return AudioComponentInstanceDispose(mUnit) == noErr;
+  State state = GetState();
+  if (state == STARTING || state == STARTED) {
+    return true; // Same as AudioOutputUnitStart on a running unit.
+  }
+  if (state == DRAINING || !mInitialized) {
+    return false;
+  }
+
+  // The pause before this start isn't a callback interval.
+  mTiming.Restart();
+
+  // Restart from silence, so the conversion latency is always the same.
+  if (mResampler) {
+    mResampler->Reset();
+  }
+
+  if (mRing && !mProducing) {
+    // Drop what the last run left, then prefill the ring before the device
+    // asks for any data.
+    mRing->Reset();
+    FillRing();
+    mProducing = true;
+    mProducer = std::thread(&AudioStream::RunProducer, this);
+  }
+
+  // Before the backend starts, so the first callback finds it STARTING.
+  Transition(Bit(CREATED) | Bit(STOPPED) | Bit(ERROR), STARTING);
+  bool started = mBackend->Start();
+  if (!started) {
+    StopProducer();
+    Transition(Bit(STARTING) | Bit(STARTED), ERROR);
+  }
+  WakeNotifier();
+  return started;
 }
 
 bool
-AudioStream::InitAudioUnit()
+AudioStream::StopBackend()
 {
-  assert(mUnit);
-  return AudioUnitInitialize(mUnit) == noErr;
+  if (!mInitialized) {
+    return false;
+  }
+  bool stopped = mBackend->Stop();
+  StopProducer();
+  mDrained = false;
+  if (Transition(Bit(STARTING) | Bit(STARTED) | Bit(DRAINING),
+                 stopped ? STOPPED : ERROR)) {
+    WakeNotifier();
+  }
+  return stopped;
 }
 
 bool
-AudioStream::UninitAudioUnit()
+AudioStream::ApplyFormat(Format aFormat, double aRate)
 {
-  assert(mUnit);
-  return AudioUnitUninitialize(mUnit) == noErr;
+  // The input format of a duplex stream is set before the unit is created.
+  if (IsRunning() || !mInitialized || mInputChannels) {
+    return false;
+  }
+
+  if (!mBackend->Uninit()) {
+    return false;
+  }
+  mInitialized = false;
+  Parameters previous = mParams;
+  mParams.mFormat = aFormat;
+  mParams.mRate = static_cast<Float64>(aRate);
+  MakeResampler();
+  bool applied = SetStreamFormat();
+  if (!applied) {
+    // Keep the stream usable in its previous format.
+    mParams = previous;
+    MakeResampler();
+    SetStreamFormat();
+  }
+  if (!mBackend->Init()) {
+    return false;
+  }
+  mInitialized = true;
+  if (!applied) {
+    return false;
+  }
+
+  // Reallocate what depends on the sample size.
+  if (mRing) {
+    size_t bytesPerFrame = mParams.GetFormatByteSize() * mParams.mChannels;
+    mRing.reset(new RingBuffer(mRing->Capacity(), bytesPerFrame));
+    mRingBuffered.store(0, std::memory_order_relaxed);
+  }
+  if (mFloatSource) {
+    if (mParams.mFormat == S16LE || mParams.mFormat == S16BE) {
+      mFloatBuffer.assign(FLOAT_SOURCE_FRAMES * mParams.mChannels, 0.0f);
+    } else {
+      mFloatBuffer.clear();
+    }
+  }
+  return true;
+}
+
+AudioStream::State
+AudioStream::GetState() const
+{
+  return static_cast<State>(mState.load(std::memory_order_acquire) & 0xff);
+}
+
+bool
+AudioStream::IsRunning() const
+{
+  return Bit(GetState()) & (Bit(STARTING) | Bit(STARTED) | Bit(DRAINING));
+}
+
+bool
+AudioStream::Transition(unsigned int aFrom, State aTo)
+{
+  uint64_t current = mState.load(std::memory_order_acquire);
+  uint64_t next = 0;
+  do {
+    if (!(Bit(static_cast<State>(current & 0xff)) & aFrom)) {
+      return false;
+    }
+    next = (((current >> 8) + 1) << 8) | aTo;
+  } while (!mState.compare_exchange_weak(current, next,
+                                         std::memory_order_acq_rel,
+                                         std::memory_order_acquire));
+  mStateHistory[(next >> 8) % STATE_HISTORY].store(next,
+                                                   std::memory_order_release);
+  return true;
+}
+
+void
+AudioStream::SetStateCallback(StateCallback aCallback, void* aContext)
+{
+  std::lock_guard<std::mutex> guard(mStateMutex);
+  mStateCallback = aCallback;
+  mStateContext = aContext;
+}
+
+bool
+AudioStream::Drain()
+{
+  if (!Transition(Bit(STARTING) | Bit(STARTED), DRAINING)) {
+    return false;
+  }
+  WakeNotifier();
+  return true;
+}
+
+bool
+AudioStream::WaitForState(State aState, unsigned int aTimeoutMs)
+{
+  std::unique_lock<std::mutex> lock(mStateMutex);
+  return mStateCondition.wait_for(lock,
+                                  std::chrono::milliseconds(aTimeoutMs),
+                                  [this, aState] {
+                                    return GetState() == aState;
+                                  });
+}
+
+void
+AudioStream::WakeNotifier()
+{
+  mNotifier->Post(mNotifierClient);
+}
+
+/* static */ void
+AudioStream::Notify(void* aContext)
+{
+  AudioStream* as = static_cast<AudioStream*>(aContext);
+  if (as->mDrained.exchange(false, std::memory_order_acq_rel)) {
+    // Unless it was stopped, or even restarted, in the meantime.
+    as->Run([as] { return as->GetState() != DRAINING || as->StopBackend(); });
+  }
+  as->DeliverStates();
+
+  std::lock_guard<std::mutex> guard(as->mStateMutex);
+  as->mStateCondition.notify_all();
+}
+
+void
+AudioStream::DeliverStates()
+{
+  StateCallback callback = nullptr;
+  void* context = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(mStateMutex);
+    callback = mStateCallback;
+    context = mStateContext;
+  }
+
+  uint64_t last = mState.load(std::memory_order_acquire) >> 8;
+  while (mDelivered < last) {
+    uint64_t entry =
+      mStateHistory[(mDelivered + 1) % STATE_HISTORY].load(
+        std::memory_order_acquire);
+    uint64_t number = entry >> 8;
+    if (number <= mDelivered) {
+      break; // Counted, but not written yet. Next time.
+    }
+    // Past mDelivered + 1 when the thread fell behind by a whole history:
+    // the transitions in between are lost.
+    mDelivered = number;
+    if (callback) {
+      callback(static_cast<State>(entry & 0xff), context);
+    }
+  }
+}
+
+bool
+AudioStream::SetRingBuffer(unsigned long aPrefillFrames,
+                           unsigned long aCapacityFrames)
+{
+  if (!aPrefillFrames || !HasCallback()) {
+    return false;
+  }
+  if (!aCapacityFrames) {
+    aCapacityFrames = 2 * aPrefillFrames;
+  }
+  if (aCapacityFrames < aPrefillFrames) {
+    return false;
+  }
+
+  // In order with the commands reading the ring.
+  return Run([this, aPrefillFrames, aCapacityFrames] {
+    // The render thread reads mRing.
+    if (IsRunning() || mProducing) {
+      return false;
+    }
+    size_t bytesPerFrame = mParams.GetFormatByteSize() * mParams.mChannels;
+    mRing.reset(new RingBuffer(aCapacityFrames, bytesPerFrame));
+    mPrefillFrames = aPrefillFrames;
+    mRingCapacity.store(mRing->Capacity(), std::memory_order_relaxed);
+    mRingPrefill.store(aPrefillFrames, std::memory_order_relaxed);
+    mRingBuffered.store(0, std::memory_order_relaxed);
+    return true;
+  });
+}
+
+AudioStream::RingStats
+AudioStream::GetRingStats() const
+{
+  RingStats stats;
+  stats.mCapacityFrames = mRingCapacity.load(std::memory_order_relaxed);
+  stats.mPrefillFrames = mRingPrefill.load(std::memory_order_relaxed);
+  stats.mBufferedFrames = mRingBuffered.load(std::memory_order_relaxed);
+  stats.mUnderruns = mUnderruns.load(std::memory_order_relaxed);
+  stats.mUnderrunFrames = mUnderrunFrames.load(std::memory_order_relaxed);
+  return stats;
+}
+
+CallbackTiming::Snapshot
+AudioStream::GetCallbackTiming() const
+{
+  return mTiming.GetSnapshot();
+}
+
+bool
+AudioStream::ResetCallbackTiming()
+{
+  return Run([this] {
+    if (IsRunning()) {
+      return false;
+    }
+    mTiming.Reset();
+    return true;
+  });
+}
+
+bool
+AudioStream::SetFloatSource(bool aDither)
+{
+  if (!HasCallback()) {
+    return false;
+  }
+
+  return Run([this, aDither] {
+    // The render thread reads mFloatBuffer.
+    if (IsRunning() || mProducing) {
+      return false;
+    }
+    mFloatSource = true;
+    mDitherEnabled = aDither;
+    // Only the 16-bit formats need a separate float buffer.
+    if (mParams.mFormat == S16LE || mParams.mFormat == S16BE) {
+      mFloatBuffer.assign(FLOAT_SOURCE_FRAMES * mParams.mChannels, 0.0f);
+    }
+    return true;
+  });
+}
+
+bool
+AudioStream::SetResampler(double aDeviceRate, Resampler::Quality aQuality)
+{
+  if (!HasCallback() || aDeviceRate <= 0.0) {
+    return false;
+  }
+
+  return Run([this, aDeviceRate, aQuality] {
+    if (IsRunning() || mProducing || !mInitialized) {
+      return false;
+    }
+    if (!mBackend->Uninit()) {
+      return false;
+    }
+    mInitialized = false;
+    double previousRate = mDeviceRate;
+    Resampler::Quality previousQuality = mResamplerQuality;
+    mDeviceRate = aDeviceRate;
+    mResamplerQuality = aQuality;
+    MakeResampler();
+    bool applied = SetStreamFormat();
+    if (!applied) {
+      // Keep the stream usable at its previous device rate.
+      mDeviceRate = previousRate;
+      mResamplerQuality = previousQuality;
+      MakeResampler();
+      SetStreamFormat();
+    }
+    if (!mBackend->Init()) {
+      return false;
+    }
+    mInitialized = true;
+    return applied;
+  });
+}
+
+size_t
+AudioStream::GetResamplerLatencyFrames() const
+{
+  return mResampler ? mResampler->GetLatencyFrames() : 0;
+}
+
+void
+AudioStream::MakeResampler()
+{
+  if (!mDeviceRate || mDeviceRate == mParams.mRate) {
+    mResampler.reset();
+    mSourceBuffer.clear();
+    mResampledBuffer.clear();
+    return;
+  }
+  UInt32 channels = mParams.mChannels;
+  mResampler.reset(new Resampler(channels, mParams.mRate, mDeviceRate,
+                                 mResamplerQuality, RESAMPLER_FRAMES,
+                                 PullFloat, this));
+  // Everything the render path needs, allocated once.
+  if (mParams.mFormat == S16LE || mParams.mFormat == S16BE) {
+    mSourceBuffer.assign(mResampler->GetMaxInputFrames() * channels, 0);
+  } else {
+    mSourceBuffer.clear();
+  }
+  mResampledBuffer.assign(RESAMPLER_FRAMES * channels, 0.0f);
+}
+
+double
+AudioStream::GetDeviceRate() const
+{
+  return mResampler ? mDeviceRate : mParams.mRate;
+}
+
+void
+AudioStream::WriteFloat(const float* aIn, void* aOut, size_t aSamples)
+{
+  bool swap = (mParams.mFormat == S16BE || mParams.mFormat == F32BE) !=
+              HOST_BIG_ENDIAN;
+  if (mParams.mFormat == F32LE || mParams.mFormat == F32BE) {
+    if (swap) {
+      SampleConverter::SwapBytes32(aIn, aOut, aSamples);
+    } else if (aIn != aOut) {
+      memcpy(aOut, aIn, aSamples * sizeof(float));
+    }
+    return;
+  }
+  int16_t* out = static_cast<int16_t*>(aOut);
+  if (mDitherEnabled) {
+    SampleConverter::FloatToS16(aIn, out, aSamples, mDither, swap);
+  } else {
+    SampleConverter::FloatToS16(aIn, out, aSamples, swap);
+  }
+}
+
+void
+AudioStream::Resample(void* aBuffer, unsigned long aFrames)
+{
+  UInt32 channels = mParams.mChannels;
+  size_t bytesPerFrame = mParams.GetFormatByteSize() * channels;
+  // The native floats are resampled right into the device buffer.
+  bool nativeFloat = mParams.mFormat == (HOST_BIG_ENDIAN ? F32BE : F32LE);
+  uint8_t* out = static_cast<uint8_t*>(aBuffer);
+  while (aFrames) {
+    unsigned long frames =
+      aFrames < RESAMPLER_FRAMES ? aFrames : RESAMPLER_FRAMES;
+    float* data = nativeFloat ? reinterpret_cast<float*>(out)
+                              : mResampledBuffer.data();
+    mResampler->Process(data, frames);
+    WriteFloat(data, out, frames * channels);
+    out += frames * bytesPerFrame;
+    aFrames -= frames;
+  }
+}
+
+/* static */ void
+AudioStream::PullFloat(void* aContext, float* aBuffer, unsigned long aFrames)
+{
+  AudioStream* as = static_cast<AudioStream*>(aContext);
+  Format format = as->mParams.mFormat;
+  size_t samples = aFrames * as->mParams.mChannels;
+  bool swap = (format == S16BE || format == F32BE) != HOST_BIG_ENDIAN;
+  if (as->mFloatSource) {
+    as->InvokeCallback(aBuffer, aFrames);
+  } else if (format == F32LE || format == F32BE) {
+    as->InvokeCallback(aBuffer, aFrames);
+    if (swap) {
+      SampleConverter::SwapBytes32(aBuffer, aBuffer, samples);
+    }
+  } else {
+    as->InvokeCallback(as->mSourceBuffer.data(), aFrames);
+    SampleConverter::S16ToFloat(as->mSourceBuffer.data(), aBuffer, samples,
+                                swap);
+  }
+}
+
+void
+AudioStream::FireCallback(void* aBuffer, unsigned long aFrames)
+{
+  if (mResampler) {
+    Resample(aBuffer, aFrames);
+    return;
+  }
+  if (!mFloatSource) {
+    InvokeCallback(aBuffer, aFrames);
+    return;
+  }
+
+  UInt32 channels = mParams.mChannels;
+  if (mParams.mFormat == F32LE || mParams.mFormat == F32BE) {
+    // Same sample size, so render in place and fix the byte order if needed.
+    InvokeCallback(aBuffer, aFrames);
+    WriteFloat(static_cast<float*>(aBuffer), aBuffer, aFrames * channels);
+    return;
+  }
+
+  int16_t* out = static_cast<int16_t*>(aBuffer);
+  unsigned long maxFrames = mFloatBuffer.size() / channels;
+  while (aFrames) {
+    unsigned long frames = aFrames < maxFrames ? aFrames : maxFrames;
+    float* data = mFloatBuffer.data();
+    InvokeCallback(data, frames);
+    WriteFloat(data, out, frames * channels);
+    out += frames * channels;
+    aFrames -= frames;
+  }
+}
+
+void
+AudioStream::FillRing()
+{
+  assert(mRing);
+  size_t buffered = mRing->AvailableRead();
+  while (buffered < mPrefillFrames) {
+    void* region = nullptr;
+    size_t frames = mRing->GetWritableRegion(&region);
+    if (!frames) {
+      break;
+    }
+    if (frames > mPrefillFrames - buffered) {
+      frames = mPrefillFrames - buffered;
+    }
+    // Render straight into the ring so the producer never copies.
+    FireCallback(region, frames);
+    mRing->CommitWrite(frames);
+    buffered = mRing->AvailableRead();
+  }
+  mRingBuffered.store(buffered, std::memory_order_relaxed);
+}
+
+void
+AudioStream::RunProducer()
+{
+  // Top the ring up about four times per prefill period.
+  std::chrono::microseconds interval(
+    static_cast<long long>(mPrefillFrames * 1e6 / GetDeviceRate() / 4));
+  if (interval < std::chrono::microseconds(500)) {
+    interval = std::chrono::microseconds(500);
+  }
+
+  while (mProducing.load(std::memory_order_acquire)) {
+    // A draining stream only plays out what is already in the ring.
+    if (GetState() != DRAINING) {
+      FillRing();
+    }
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+void
+AudioStream::StopProducer()
+{
+  if (!mProducing) {
+    return;
+  }
+  mProducing = false;
+  mProducer.join();
 }
 
 bool
 AudioStream::SetStreamFormat()
 {
   AudioStreamBasicDescription desc = mParams.GetFormatDescription();
-  return AudioUnitSetProperty(mUnit,
-                              kAudioUnitProperty_StreamFormat,
-                              kAudioUnitScope_Input,
-                              OutputBus,
-                              &desc,
-                              sizeof(desc)) == noErr;
+  desc.mSampleRate = GetDeviceRate();
+  return mBackend->SetStreamFormat(desc);
 }
 
 bool
 AudioStream::SetCallback()
 {
-  AURenderCallbackStruct aurcbs;
-  memset(&aurcbs, 0, sizeof(aurcbs));
-  aurcbs.inputProc = DataCallback;
-  aurcbs.inputProcRefCon = this; // Set the callback target to `this`.
-
-  return AudioUnitSetProperty(mUnit,
-                              kAudioUnitProperty_SetRenderCallback,
-                              kAudioUnitScope_Input,
-                              OutputBus,
-                              &aurcbs,
-                              sizeof(aurcbs)) == noErr;
+  // Set the callback target to `this`.
+  return mBackend->SetCallback(mDataCallback, this);
 }
 
 OSStatus
@@ -161,13 +925,90 @@ AudioStream::Render(AudioUnitRenderActionFlags* aActionFlags,
                     AudioBufferList* aData)
 {
   assert(aBusNumber == OutputBus);
+
+  State state = GetState();
+  if (state == STARTING) {
+    if (Transition(Bit(STARTING), STARTED)) {
+      WakeNotifier();
+    }
+  } else if (state == DRAINING) {
+    RenderDrain(aNumFrames, aData);
+    return noErr;
+  }
+
+  if (mPlanarCallback) {
+    // Hand the channel buffers over as they are. No interleaving pass.
+    assert(aData->mNumberBuffers == mParams.mChannels);
+    for (UInt32 i = 0; i < aData->mNumberBuffers; ++i) {
+      mChannelData[i] = aData->mBuffers[i].mData;
+    }
+    mPlanarCallback(mChannelData.data(), aNumFrames);
+    return noErr;
+  }
+
   assert(aData->mNumberBuffers == 1);
 
   void* buffer = aData->mBuffers[0].mData;
-  mCallback(buffer, aNumFrames);
+  if (mDuplexCallback) {
+    if (aNumFrames > mMaxInputFrames) {
+      // Larger than the backend announced. Play silence rather than overflow.
+      memset(buffer, 0, aData->mBuffers[0].mDataByteSize);
+      return noErr;
+    }
+    size_t inputBytes = mInputBuffer.size() / mMaxInputFrames * aNumFrames;
+    mInputBufferList.mBuffers[0].mDataByteSize = inputBytes;
+    if (mBackend->RenderInput(aActionFlags, aTimeStamp, aNumFrames,
+                              &mInputBufferList) != noErr) {
+      // Deliver silence rather than stale data.
+      memset(mInputBuffer.data(), 0, inputBytes);
+    }
+    mDuplexCallback(mInputBuffer.data(), buffer, aNumFrames);
+    return noErr;
+  }
+
+  if (mRing) {
+    // Never wait for the producer here. Play silence for what is missing.
+    size_t read = mRing->Read(buffer, aNumFrames);
+    mRingBuffered.store(mRing->AvailableRead(), std::memory_order_relaxed);
+    if (read < aNumFrames) {
+      size_t bytesPerFrame = mRing->BytesPerFrame();
+      memset(static_cast<uint8_t*>(buffer) + read * bytesPerFrame, 0,
+             (aNumFrames - read) * bytesPerFrame);
+      mUnderruns.fetch_add(1, std::memory_order_relaxed);
+      mUnderrunFrames.fetch_add(aNumFrames - read, std::memory_order_relaxed);
+    }
+    return noErr;
+  }
+
+  FireCallback(buffer, aNumFrames);
   return noErr;
 }
 
+void
+AudioStream::RenderDrain(UInt32 aNumFrames, AudioBufferList* aData)
+{
+  size_t read = 0;
+  if (mRing) {
+    read = mRing->Read(aData->mBuffers[0].mData, aNumFrames);
+    mRingBuffered.store(mRing->AvailableRead(), std::memory_order_relaxed);
+    size_t bytesPerFrame = mRing->BytesPerFrame();
+    memset(static_cast<uint8_t*>(aData->mBuffers[0].mData) +
+             read * bytesPerFrame,
+           0, (aNumFrames - read) * bytesPerFrame);
+  } else {
+    // Nothing is buffered ahead of the device in the other modes.
+    for (UInt32 i = 0; i < aData->mNumberBuffers; ++i) {
+      memset(aData->mBuffers[i].mData, 0, aData->mBuffers[i].mDataByteSize);
+    }
+  }
+  if (read < aNumFrames) {
+    // The notification thread stops the stream: it can't be done from here.
+    if (!mDrained.exchange(true, std::memory_order_acq_rel)) {
+      WakeNotifier();
+    }
+  }
+}
+
 /* static */ OSStatus
 AudioStream::DataCallback(void* aRefCon,
                           AudioUnitRenderActionFlags* aActionFlags,
@@ -177,8 +1018,34 @@ AudioStream::DataCallback(void* aRefCon,
                           AudioBufferList* aData)
 {
   assert(aBusNumber == OutputBus);
-  assert(aData->mNumberBuffers == 1);
+
+  // Any lock taken from here on is a potential deadlock with the AudioUnit.
+  LockOrderValidator::RenderThreadScope render;
 
   AudioStream* as = static_cast<AudioStream*>(aRefCon);
-  return as->Render(aActionFlags, aTimeStamp, aBusNumber, aNumFrames, aData);
+  uint64_t start = NowNs();
+  OSStatus r = as->Render(aActionFlags, aTimeStamp, aBusNumber, aNumFrames,
+                          aData);
+  as->RecordTiming(start, aNumFrames);
+  return r;
+}
+
+bool
+AudioStream::BeginDirectRender()
+{
+  if (mRing || mResampler || mFloatSource) {
+    return false;
+  }
+  State state = GetState();
+  if (state == STARTING && Transition(Bit(STARTING), STARTED)) {
+    WakeNotifier();
+  }
+  return state != DRAINING;
+}
+
+void
+AudioStream::RecordTiming(uint64_t aStartNs, UInt32 aNumFrames)
+{
+  uint64_t period = static_cast<uint64_t>(aNumFrames * 1e9 / GetDeviceRate());
+  mTiming.Record(aStartNs, NowNs(), period);
 }
@@ -1,20 +1,44 @@
 #ifndef AUDIOSTREAM_H
 #define AUDIOSTREAM_H
 
-#include <AudioUnit/AudioUnit.h>
+#include "AudioBackend.h"
+#include "AudioControlThread.h"
+#include "AudioTypes.h"
+#include "CallbackTiming.h"
+#include "Host.h"
+#include "LockOrderValidator.h"
+#include "NotifierThread.h"
+#include "Resampler.h"
+#include "RingBuffer.h"
+#include "SampleConverter.h"
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <future>             // std::future, std::shared_future
+#include <memory>             // std::unique_ptr
+#include <mutex>              // std::mutex
+#include <stdint.h>           // uint64_t
+#include <thread>             // std::thread
+#include <vector>             // std::vector
 
 typedef void (* AudioCallback)(void* buffer, unsigned long frames);
+// The AudioCallback with a context: `context` is the pointer given to the
+// stream, handed back as it is, so the callback's state needs no globals.
+typedef void (* ContextAudioCallback)(void* context,
+                                      void* buffer,
+                                      unsigned long frames);
+// The callback for the planar streams. `channels` holds one buffer per
+// channel, each mapped onto its own buffer of the underlying AudioBufferList.
+typedef void (* PlanarAudioCallback)(void** channels, unsigned long frames);
+// The callback for the duplex streams. `input` holds the frames captured in
+// the same render cycle as the `output` frames to be filled. Both are
+// interleaved and in the stream format.
+typedef void (* DuplexAudioCallback)(const void* input,
+                                     void* output,
+                                     unsigned long frames);
 
 class AudioStream
 {
 public:
-  // We only support output for now.
-  // enum Scope
-  // {
-  //   OUTPUT,
-  //   INPUT
-  // }
-
   enum Format
   {
     S16LE, // PCM signed 16-bit little-endian
@@ -23,40 +47,272 @@ public:
     F32BE  // PCM 32-bit floating-point big-endian
   };
 
+  // CREATED -> STARTING -> STARTED -> [DRAINING] -> STOPPED -> STARTING ...
+  // A stream is STARTING from Start until its first render callback, and
+  // ends up in ERROR when its backend fails to set up, start or stop.
+  enum State
+  {
+    CREATED,
+    STARTING,
+    STARTED,
+    DRAINING,
+    STOPPED,
+    ERROR
+  };
+
+  // Called on the notification thread the streams share, never on the render
+  // thread, with every state the stream goes through, in order.
+  typedef void (* StateCallback)(State aState, void* aContext);
+
   struct Parameters
   {
     Format mFormat;
     UInt32 mChannels;
     Float64 mRate;
+    bool mNonInterleaved;
 
     AudioStreamBasicDescription GetFormatDescription();
     size_t GetFormatByteSize();
     AudioFormatFlags GetFormatFlags();
   };
 
+  struct RingStats
+  {
+    unsigned long mCapacityFrames;
+    unsigned long mPrefillFrames;
+    unsigned long mBufferedFrames;
+    uint64_t mUnderruns;      // Render callbacks not fully served by the ring.
+    uint64_t mUnderrunFrames; // Frames filled with silence by the underruns.
+  };
+
+  // The stream plays through the default output device when no backend is
+  // given. On the platforms without CoreAudio, it's a VirtualDeviceBackend.
+  //
+  // With a control thread, the stream is in the control-plane mode: the
+  // backend is created, set up, started, stopped, reconfigured and destroyed
+  // by commands posted to aControl, so the constructor and the *Async calls
+  // return without ever touching the backend. The other calls post their
+  // command and wait for it, unless they're made on the control thread
+  // itself. The destructor waits for the backend to be torn down, so it must
+  // not be called while holding a lock the render callback takes.
+  AudioStream(Format aFormat,
+              unsigned int aChannels,
+              double aRate,
+              AudioCallback aCallback,
+              std::unique_ptr<AudioBackend> aBackend = nullptr,
+              AudioControlThread* aControl = nullptr);
+  // Create a stream whose callback gets aContext back on every call.
   AudioStream(Format aFormat,
               unsigned int aChannels,
               double aRate,
-              AudioCallback aCallback);
+              ContextAudioCallback aCallback,
+              void* aContext,
+              std::unique_ptr<AudioBackend> aBackend = nullptr,
+              AudioControlThread* aControl = nullptr);
+  // Create a planar (non-interleaved) stream.
+  AudioStream(Format aFormat,
+              unsigned int aChannels,
+              double aRate,
+              PlanarAudioCallback aCallback,
+              std::unique_ptr<AudioBackend> aBackend = nullptr,
+              AudioControlThread* aControl = nullptr);
+  // Create a full-duplex stream capturing aInputChannels channels. The input
+  // is pulled into a preallocated buffer on the render thread, right before
+  // the callback is fired, so there is no extra thread hop or copy.
+  AudioStream(Format aFormat,
+              unsigned int aInputChannels,
+              unsigned int aOutputChannels,
+              double aRate,
+              DuplexAudioCallback aCallback,
+              std::unique_ptr<AudioBackend> aBackend = nullptr,
+              AudioControlThread* aControl = nullptr);
 
+  // Never destroy a stream on its control thread, e.g. from a completion:
+  // the notification thread may be waiting there for the stop of a drained
+  // stream, which it can't get before the destructor returns.
   ~AudioStream();
 
+  // The backend used when none is given.
+  static std::unique_ptr<AudioBackend> CreateDefaultBackend();
+
   bool Start();
   bool Stop();
 
+  // Change the sample format and rate of an output stream. It must be
+  // called while the stream is stopped.
+  bool SetFormat(Format aFormat, double aRate);
+
+  // Post the command and return right away, in the control-plane mode. The
+  // future, and aCompletion if any, called on the control thread, get the
+  // result. Without a control thread, they run the command before returning.
+  std::future<bool> StartAsync(AudioControlThread::Completion aCompletion =
+                                 nullptr,
+                               void* aContext = nullptr);
+  std::future<bool> StopAsync(AudioControlThread::Completion aCompletion =
+                                nullptr,
+                              void* aContext = nullptr);
+  std::future<bool> SetFormatAsync(Format aFormat,
+                                   double aRate,
+                                   AudioControlThread::Completion aCompletion =
+                                     nullptr,
+                                   void* aContext = nullptr);
+
+  // It's safe to call this from any thread, including the render thread.
+  State GetState() const;
+  // The callback is called for the transitions made after it's set. It must
+  // not destroy the stream.
+  void SetStateCallback(StateCallback aCallback, void* aContext = nullptr);
+  // Stop firing the callback, play out the frames already buffered, then
+  // stop. It doesn't wait: the stream goes DRAINING, then STOPPED once the
+  // frames are out. It's lock-free, so it's safe to call from the callback.
+  bool Drain();
+  // Wait for the stream to be in aState, for up to aTimeoutMs ms.
+  bool WaitForState(State aState, unsigned int aTimeoutMs);
+
+  // Whether the backend is set up. In the control-plane mode, it's ready
+  // once the setup command posted by the constructor has run.
+  std::shared_future<bool> GetSetupResult() const { return mSetup; }
+
+  // Switch to the pull-from-ring mode. The AudioCallback is then fired on a
+  // producer thread keeping aPrefillFrames frames buffered ahead of the
+  // device, and the render callback only copies the frames out of a
+  // wait-free ring. A deeper prefill trades latency for fewer underruns.
+  // The capacity defaults to twice the prefill. It must be called while the
+  // stream is stopped, and it's only available for the interleaved output
+  // streams.
+  bool SetRingBuffer(unsigned long aPrefillFrames,
+                     unsigned long aCapacityFrames = 0);
+  // It's safe to call this from any thread, even while a command replaces
+  // the ring: the stats are read from the counters the stream publishes, not
+  // through the ring.
+  RingStats GetRingStats() const;
+
+  // The timing of the render callbacks since the stream was created or the
+  // timing was reset. A callback overruns when it takes longer than the
+  // period of the frames it renders. It's safe to call this from any thread.
+  CallbackTiming::Snapshot GetCallbackTiming() const;
+  // It must be called while the stream is stopped.
+  bool ResetCallbackTiming();
+
+  // Let the AudioCallback render native 32-bit float samples whatever the
+  // stream format is. The stream converts them into its format, clipping
+  // them, and dithering them if aDither is true, for the 16-bit formats. It
+  // must be called while the stream is stopped, and it's only available for
+  // the interleaved output streams.
+  bool SetFloatSource(bool aDither = false);
+
+  // Run the device at aDeviceRate, and convert the frames the AudioCallback
+  // renders at the stream's rate to it in the render path, with aQuality,
+  // rather than leaving that to the OS. The device rate is kept across
+  // SetFormat, and the stream's rate turns the conversion off. The frames of
+  // the ring are then device frames. It must be called while the stream is
+  // stopped, and it's only available for the interleaved output streams.
+  bool SetResampler(double aDeviceRate,
+                    Resampler::Quality aQuality = Resampler::MEDIUM);
+  // How far ahead of the device the callback renders because of the
+  // conversion, in frames at the stream's rate. It must not be called while
+  // the resampler is being set.
+  size_t GetResamplerLatencyFrames() const;
+
 private:
+  friend class AudioStreamPool;
+  template<typename Callable> friend class CallableStream;
+
   enum Element
   {
     OutputBus = 0,
     InputBus = 1
   };
 
-  bool CreateAudioUnit();
-  bool DestroyAudioUnit();
-  bool InitAudioUnit();
-  bool UninitAudioUnit();
+  AudioStream(const Parameters& aParams,
+              UInt32 aInputChannels,
+              std::unique_ptr<AudioBackend> aBackend,
+              AudioControlThread* aControl);
+  // For the CallableStream. A ContextAudioCallback stream rendering with
+  // aDataCallback.
+  AudioStream(Format aFormat,
+              unsigned int aChannels,
+              double aRate,
+              ContextAudioCallback aCallback,
+              void* aContext,
+              AURenderCallback aDataCallback,
+              std::unique_ptr<AudioBackend> aBackend,
+              AudioControlThread* aControl);
+
+  // For the AudioStreamPool. Adopt aBackend, already created, set to the
+  // aParams format and initialized, so only the callback is set on it.
+  static std::unique_ptr<AudioStream> Adopt(
+    const Parameters& aParams,
+    AudioCallback aCallback,
+    std::unique_ptr<AudioBackend> aBackend);
+  // Stop the stream and hand its backend over, still initialized, in the
+  // current format. The stream is unusable afterwards.
+  std::unique_ptr<AudioBackend> DetachBackend();
+
+  // Set the backend up once the callback is set.
+  void Setup();
+  // Post aCommand to the control thread, or run it right away without one.
+  std::future<bool> Post(AudioControlThread::Command aCommand,
+                         AudioControlThread::Completion aCompletion = nullptr,
+                         void* aContext = nullptr);
+  // Run aCommand and wait for its result.
+  bool Run(AudioControlThread::Command aCommand);
+  // The commands. They're only run on the control thread in the
+  // control-plane mode.
+  bool SetupBackend();
+  bool TeardownBackend();
+  bool StartBackend();
+  bool StopBackend();
+  bool ApplyFormat(Format aFormat, double aRate);
   bool SetStreamFormat();
   bool SetCallback();
+  // Create the resampler for the current rates, or drop it when they match.
+  void MakeResampler();
+  double GetDeviceRate() const;
+
+  // The number of the transitions kept for the notification thread, which
+  // only falls behind when a state callback blocks.
+  static const size_t STATE_HISTORY = 16;
+
+  static unsigned int Bit(State aState) { return 1u << aState; }
+  // Move to aTo if the current state is in the aFrom set of Bits. It's
+  // lock-free, so the render thread can make transitions too.
+  bool Transition(unsigned int aFrom, State aTo);
+  bool IsRunning() const;
+  // Render the frames left in the ring, if any, then silence.
+  void RenderDrain(UInt32 aNumFrames, AudioBufferList* aData);
+  // Have the notification thread deliver the transitions. It's wait-free, so
+  // the render thread wakes it up too.
+  void WakeNotifier();
+  // The NotifierThread::Callback.
+  static void Notify(void* aContext);
+  void DeliverStates();
+
+  // Whether the stream has an interleaved callback, with a context or not.
+  bool HasCallback() const { return mCallback || mContextCallback; }
+  // Fire the interleaved callback, whichever kind it is, for aFrames frames.
+  void InvokeCallback(void* aBuffer, unsigned long aFrames)
+  {
+    if (mContextCallback) {
+      mContextCallback(mCallbackContext, aBuffer, aFrames);
+    } else {
+      mCallback(aBuffer, aFrames);
+    }
+  }
+  // Fire the AudioCallback for aFrames frames of the stream format, at the
+  // device rate.
+  void FireCallback(void* aBuffer, unsigned long aFrames);
+  // Write aSamples float samples in the stream format.
+  void WriteFloat(const float* aIn, void* aOut, size_t aSamples);
+  // Render aFrames frames through the resampler.
+  void Resample(void* aBuffer, unsigned long aFrames);
+  // The Resampler::Source, firing the AudioCallback at the stream's rate and
+  // converting its samples to float.
+  static void PullFloat(void* aContext, float* aBuffer, unsigned long aFrames);
+  // Fire the AudioCallback until the ring holds the prefill frames.
+  void FillRing();
+  void RunProducer();
+  void StopProducer();
   // Render the callback from underlying OS to the callback passed to the stream.
   OSStatus Render(AudioUnitRenderActionFlags* aActionFlags,
                   const AudioTimeStamp* aTimeStamp,
@@ -73,10 +329,111 @@ private:
                                UInt32 aBusNumber,
                                UInt32 aNumFrames,
                                AudioBufferList* aData);
+  // The DataCallback of a CallableStream, whose context is a Callable. With
+  // nothing between the device and the callback, it calls the callable right
+  // here, inlined, rather than through the ContextAudioCallback.
+  template<typename Callable>
+  static OSStatus CallableDataCallback(void* aRefCon,
+                                       AudioUnitRenderActionFlags* aActionFlags,
+                                       const AudioTimeStamp* aTimeStamp,
+                                       UInt32 aBusNumber,
+                                       UInt32 aNumFrames,
+                                       AudioBufferList* aData)
+  {
+    AudioStream* as = static_cast<AudioStream*>(aRefCon);
+    LockOrderValidator::RenderThreadScope render;
+    if (!as->BeginDirectRender()) {
+      return DataCallback(aRefCon, aActionFlags, aTimeStamp, aBusNumber,
+                          aNumFrames, aData);
+    }
+    uint64_t start = NowNs();
+    (*static_cast<Callable*>(as->mCallbackContext))(aData->mBuffers[0].mData,
+                                                    aNumFrames);
+    as->RecordTiming(start, aNumFrames);
+    return noErr;
+  }
+  // Whether the render can go straight to the interleaved callback: no ring,
+  // resampler, float conversion or drain in between. It moves a STARTING
+  // stream to STARTED, as Render does.
+  bool BeginDirectRender();
+  void RecordTiming(uint64_t aStartNs, UInt32 aNumFrames);
 
-  AudioUnit mUnit;
+  std::unique_ptr<AudioBackend> mBackend;
+  AudioControlThread* mControl;
+  std::shared_future<bool> mSetup;
+  // Only touched by the commands.
+  bool mCreated;
+  bool mInitialized;
+  // DataCallback, or the CallableDataCallback of a CallableStream.
+  AURenderCallback mDataCallback;
   AudioCallback mCallback;
+  ContextAudioCallback mContextCallback;
+  void* mCallbackContext;
+  PlanarAudioCallback mPlanarCallback;
+  DuplexAudioCallback mDuplexCallback;
   Parameters mParams;
+  // The channel pointers handed to mPlanarCallback. They're allocated once
+  // and refreshed from the AudioBufferList on every render.
+  std::vector<void*> mChannelData;
+
+  // The duplex mode. The input buffer holds the largest render cycle.
+  UInt32 mInputChannels;
+  UInt32 mMaxInputFrames;
+  std::vector<uint8_t> mInputBuffer;
+  AudioBufferList mInputBufferList;
+
+  // The pull-from-ring mode.
+  std::unique_ptr<RingBuffer> mRing;
+  unsigned long mPrefillFrames;
+  std::thread mProducer;
+  std::atomic<bool> mProducing;
+  std::atomic<uint64_t> mUnderruns;
+  std::atomic<uint64_t> mUnderrunFrames;
+  // Published for GetRingStats by the threads using mRing.
+  std::atomic<unsigned long> mRingCapacity;
+  std::atomic<unsigned long> mRingPrefill;
+  std::atomic<unsigned long> mRingBuffered;
+
+  // The float-source mode. The callback renders into mFloatBuffer when the
+  // samples can't be converted in place.
+  bool mFloatSource;
+  bool mDitherEnabled;
+  std::vector<float> mFloatBuffer;
+  SampleConverter::Dither mDither;
+
+  // The resampling mode. The device runs at mDeviceRate when there is a
+  // mResampler. The callback renders into mSourceBuffer when its samples
+  // aren't floats, and the resampler into mResampledBuffer when the device's
+  // aren't native floats.
+  double mDeviceRate;
+  Resampler::Quality mResamplerQuality;
+  std::unique_ptr<Resampler> mResampler;
+  std::vector<int16_t> mSourceBuffer;
+  std::vector<float> mResampledBuffer;
+
+  // Written by the render thread in DataCallback.
+  CallbackTiming mTiming;
+
+  // The commands run inline, without a control thread, are serialized by
+  // this, since the notification thread stops the drained streams.
+  std::mutex mCommandMutex;
+
+  // The state machine. mState packs the number of transitions so far with
+  // the current state, as (count << 8) | state, so each transition has its
+  // own number, under which it's also written into mStateHistory.
+  std::atomic<uint64_t> mState;
+  std::atomic<uint64_t> mStateHistory[STATE_HISTORY];
+  std::atomic<bool> mDrained; // Set by the render thread.
+
+  // Every transition wakes the shared notification thread up, which
+  // delivers it, stops the drained stream, and wakes WaitForState up.
+  NotifierThread* mNotifier;
+  NotifierThread::Client* mNotifierClient;
+  std::mutex mStateMutex;
+  std::condition_variable mStateCondition; // For WaitForState.
+  StateCallback mStateCallback;
+  void* mStateContext;
+  uint64_t mDelivered; // Only touched by the notification thread.
 };
 
 #endif // AUDIOSTREAM_H
@@ -0,0 +1,217 @@
+#include "AudioStreamPool.h"
+#include "Host.h"
+#include <cassert>
+#include <cstring>   // memset
+
+// The callback of the idle backends, which are never started: it's only
+// there because a backend is initialized with one.
+static OSStatus
+SilenceCallback(void* aRefCon,
+                AudioUnitRenderActionFlags* aActionFlags,
+                const AudioTimeStamp* aTimeStamp,
+                UInt32 aBusNumber,
+                UInt32 aNumFrames,
+                AudioBufferList* aData)
+{
+  for (UInt32 i = 0; i < aData->mNumberBuffers; ++i) {
+    memset(aData->mBuffers[i].mData, 0, aData->mBuffers[i].mDataByteSize);
+  }
+  return noErr;
+}
+
+void
+AudioStreamPool::Releaser::operator()(AudioStream* aStream) const
+{
+  if (mPool) {
+    mPool->Release(aStream);
+  } else {
+    delete aStream;
+  }
+}
+
+AudioStreamPool::AudioStreamPool(size_t aMaxIdle, BackendFactory aFactory)
+  : mMaxIdle(aMaxIdle)
+  , mFactory(aFactory)
+{
+  memset(&mPooled, 0, sizeof(mPooled));
+  memset(&mCold, 0, sizeof(mCold));
+}
+
+AudioStreamPool::~AudioStreamPool()
+{
+  for (Idle& idle : mIdle) {
+    Teardown(std::move(idle.mBackend));
+  }
+}
+
+size_t
+AudioStreamPool::Prewarm(AudioStream::Format aFormat,
+                         unsigned int aChannels,
+                         double aRate,
+                         size_t aCount)
+{
+  AudioStream::Parameters params = { aFormat,
+                                     static_cast<UInt32>(aChannels),
+                                     static_cast<Float64>(aRate),
+                                     false };
+  AudioStreamBasicDescription desc = params.GetFormatDescription();
+  size_t ready = 0;
+  for (; ready < aCount; ++ready) {
+    std::unique_ptr<AudioBackend> backend = NewBackend();
+    if (!backend->Create()) {
+      break;
+    }
+    if (!backend->SetStreamFormat(desc) ||
+        !backend->SetCallback(SilenceCallback, nullptr) ||
+        !backend->Init()) {
+      backend->Destroy();
+      break;
+    }
+    Keep(params, std::move(backend));
+  }
+  return ready;
+}
+
+AudioStreamPool::Stream
+AudioStreamPool::Open(AudioStream::Format aFormat,
+                      unsigned int aChannels,
+                      double aRate,
+                      AudioCallback aCallback)
+{
+  uint64_t start = NowNs();
+  AudioStream::Parameters params = { aFormat,
+                                     static_cast<UInt32>(aChannels),
+                                     static_cast<Float64>(aRate),
+                                     false };
+  std::unique_ptr<AudioBackend> backend = TakeIdle(params);
+  bool pooled = !!backend;
+  std::unique_ptr<AudioStream> stream =
+    pooled ? AudioStream::Adopt(params, aCallback, std::move(backend))
+           : std::unique_ptr<AudioStream>(
+               new AudioStream(aFormat, aChannels, aRate, aCallback,
+                               NewBackend()));
+  Record(pooled, NowNs() - start);
+  return Stream(stream.release(), Releaser(this));
+}
+
+AudioStreamPool::Stats
+AudioStreamPool::GetStats() const
+{
+  Stats stats;
+  std::lock_guard<std::mutex> guard(mMutex);
+  stats.mPooled = Summarize(mPooled);
+  stats.mCold = Summarize(mCold);
+  stats.mIdle = mIdle.size();
+  return stats;
+}
+
+std::unique_ptr<AudioBackend>
+AudioStreamPool::NewBackend() const
+{
+  return mFactory ? mFactory() : AudioStream::CreateDefaultBackend();
+}
+
+std::unique_ptr<AudioBackend>
+AudioStreamPool::TakeIdle(const AudioStream::Parameters& aParams)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  for (std::vector<Idle>::iterator it = mIdle.begin(); it != mIdle.end();
+       ++it) {
+    if (SameFormat(it->mParams, aParams)) {
+      std::unique_ptr<AudioBackend> backend = std::move(it->mBackend);
+      mIdle.erase(it);
+      return backend;
+    }
+  }
+  return nullptr;
+}
+
+void
+AudioStreamPool::Keep(const AudioStream::Parameters& aParams,
+                      std::unique_ptr<AudioBackend> aBackend)
+{
+  // Don't keep the callback of a released stream, which is deleted.
+  if (!aBackend->SetCallback(SilenceCallback, nullptr)) {
+    Teardown(std::move(aBackend));
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    if (mIdle.size() < mMaxIdle) {
+      mIdle.push_back({ aParams, std::move(aBackend) });
+      return;
+    }
+  }
+  Teardown(std::move(aBackend));
+}
+
+void
+AudioStreamPool::Release(AudioStream* aStream)
+{
+  AudioStream::Parameters params = aStream->mParams;
+  // The backends of the resampling streams don't run at the stream's rate.
+  bool poolable = !params.mNonInterleaved && !aStream->mInputChannels &&
+                  !aStream->mResampler;
+  std::unique_ptr<AudioBackend> backend;
+  if (poolable) {
+    backend = aStream->DetachBackend();
+  }
+  delete aStream;
+  if (backend) {
+    Keep(params, std::move(backend));
+  }
+}
+
+void
+AudioStreamPool::Record(bool aPooled, uint64_t aNs)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  Histogram& histogram = aPooled ? mPooled : mCold;
+  ++histogram.mCount;
+  ++histogram.mBuckets[CallbackTiming::Bucket(aNs)];
+  if (aNs > histogram.mMaxNs) {
+    histogram.mMaxNs = aNs;
+  }
+}
+
+/* static */ bool
+AudioStreamPool::SameFormat(const AudioStream::Parameters& aA,
+                            const AudioStream::Parameters& aB)
+{
+  return aA.mFormat == aB.mFormat && aA.mChannels == aB.mChannels &&
+         aA.mRate == aB.mRate && aA.mNonInterleaved == aB.mNonInterleaved;
+}
+
+/* static */ void
+AudioStreamPool::Teardown(std::unique_ptr<AudioBackend> aBackend)
+{
+  bool r = aBackend->Uninit();
+  r = aBackend->Destroy() && r;
+  assert(r);
+  (void) r;
+}
+
+/* static */ AudioStreamPool::Latency
+AudioStreamPool::Summarize(const Histogram& aHistogram)
+{
+  Latency latency;
+  memset(&latency, 0, sizeof(latency));
+  latency.mOpens = aHistogram.mCount;
+  latency.mMaxNs = aHistogram.mMaxNs;
+  // The nearest-rank percentiles, at the lower bounds of their buckets.
+  auto percentile = [&aHistogram](unsigned int aPercent) {
+    uint64_t rank = (aHistogram.mCount * aPercent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < CallbackTiming::BUCKETS; ++i) {
+      seen += aHistogram.mBuckets[i];
+      if (seen && seen >= rank) {
+        return CallbackTiming::Snapshot::BucketLowerBoundNs(i);
+      }
+    }
+    return uint64_t(0);
+  };
+  latency.mP50Ns = percentile(50);
+  latency.mP90Ns = percentile(90);
+  latency.mP99Ns = percentile(99);
+  return latency;
+}
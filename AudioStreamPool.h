@@ -0,0 +1,124 @@
+#ifndef AUDIOSTREAMPOOL_H
+#define AUDIOSTREAMPOOL_H
+
+#include "AudioStream.h"
+#include "CallbackTiming.h" // CallbackTiming::Bucket
+#include <memory>   // std::unique_ptr
+#include <mutex>    // std::mutex
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+#include <vector>   // std::vector
+
+// Open the streams on backends kept ready for reuse. A backend is created,
+// set to its format and initialized once, and when its stream is closed,
+// it's only stopped and kept, still initialized, for the next stream of the
+// same format, rate and channels. Opening that stream then only sets its
+// callback. The others are opened cold, as any AudioStream.
+//
+// Only the interleaved output streams are pooled. The pool must outlive the
+// streams it opens. It's safe to call from any thread.
+class AudioStreamPool
+{
+public:
+  typedef std::unique_ptr<AudioBackend> (* BackendFactory)();
+
+  // The latency of the opens, from the call to Open until the stream is set
+  // up, in ns. The percentiles are the lower bounds of the log-scale buckets
+  // of CallbackTiming they fall in, so they're within a factor of 2.
+  struct Latency
+  {
+    uint64_t mOpens;
+    uint64_t mP50Ns;
+    uint64_t mP90Ns;
+    uint64_t mP99Ns;
+    uint64_t mMaxNs;
+  };
+
+  struct Stats
+  {
+    Latency mPooled;
+    Latency mCold;
+    size_t mIdle; // The backends ready for reuse.
+  };
+
+  // Close the stream into the pool.
+  class Releaser
+  {
+  public:
+    explicit Releaser(AudioStreamPool* aPool = nullptr)
+      : mPool(aPool)
+    {}
+    void operator()(AudioStream* aStream) const;
+
+  private:
+    AudioStreamPool* mPool;
+  };
+
+  typedef std::unique_ptr<AudioStream, Releaser> Stream;
+
+  // Keep up to aMaxIdle idle backends, made by aFactory, or the
+  // AudioStream's default backend when it's nullptr.
+  explicit AudioStreamPool(size_t aMaxIdle = 4,
+                           BackendFactory aFactory = nullptr);
+  // Destroy the idle backends.
+  ~AudioStreamPool();
+
+  // Set up backends for aCount more streams of this format ahead of time.
+  // Return the number of backends that are ready.
+  size_t Prewarm(AudioStream::Format aFormat,
+                 unsigned int aChannels,
+                 double aRate,
+                 size_t aCount);
+
+  // Open a stream, on an idle backend if there is one for its format.
+  Stream Open(AudioStream::Format aFormat,
+              unsigned int aChannels,
+              double aRate,
+              AudioCallback aCallback);
+
+  Stats GetStats() const;
+
+private:
+  struct Idle
+  {
+    AudioStream::Parameters mParams;
+    std::unique_ptr<AudioBackend> mBackend;
+  };
+
+  // A fixed-size histogram of the open latencies, however many there are.
+  struct Histogram
+  {
+    uint64_t mCount;
+    uint64_t mMaxNs;
+    uint64_t mBuckets[CallbackTiming::BUCKETS];
+  };
+
+  std::unique_ptr<AudioBackend> NewBackend() const;
+  // Take an idle backend set to aParams, or return nullptr.
+  std::unique_ptr<AudioBackend> TakeIdle(
+    const AudioStream::Parameters& aParams);
+  // Keep aBackend, or destroy it when the pool is full.
+  void Keep(const AudioStream::Parameters& aParams,
+            std::unique_ptr<AudioBackend> aBackend);
+  void Release(AudioStream* aStream);
+  void Record(bool aPooled, uint64_t aNs);
+
+  static bool SameFormat(const AudioStream::Parameters& aA,
+                         const AudioStream::Parameters& aB);
+  static void Teardown(std::unique_ptr<AudioBackend> aBackend);
+  static Latency Summarize(const Histogram& aHistogram);
+
+  // Not copyable: the streams point back at it.
+  AudioStreamPool(const AudioStreamPool&);
+  AudioStreamPool& operator=(const AudioStreamPool&);
+
+  const size_t mMaxIdle;
+  const BackendFactory mFactory;
+
+  mutable std::mutex mMutex;
+  std::vector<Idle> mIdle;
+  Histogram mPooled;
+  Histogram mCold;
+};
+
+#endif // #ifndef AUDIOSTREAMPOOL_H
@@ -0,0 +1,133 @@
+#ifndef AUDIOTYPES_H
+#define AUDIOTYPES_H
+
+// The stream core only relies on a small subset of the CoreAudio types. On
+// Apple platforms they come from the SDK. Elsewhere we declare the same subset
+// with the same layout so the render path can be built and measured without
+// CoreAudio (see VirtualDeviceBackend).
+#if defined(__APPLE__)
+
+#include <AudioUnit/AudioUnit.h>
+
+#else // #if defined(__APPLE__)
+
+#include <stdint.h>
+
+typedef uint8_t   UInt8;
+typedef int16_t   SInt16;
+typedef uint16_t  UInt16;
+typedef int32_t   SInt32;
+typedef uint32_t  UInt32;
+typedef int64_t   SInt64;
+typedef uint64_t  UInt64;
+typedef float     Float32;
+typedef double    Float64;
+typedef uint8_t   Boolean;
+typedef SInt32    OSStatus;
+
+enum {
+  noErr = 0
+};
+
+typedef UInt32 AudioFormatID;
+typedef UInt32 AudioFormatFlags;
+
+enum {
+  kAudioFormatLinearPCM = 0x6C70636D // 'lpcm'
+};
+
+enum {
+  kAudioFormatFlagIsFloat           = (1U << 0),
+  kAudioFormatFlagIsBigEndian       = (1U << 1),
+  kAudioFormatFlagIsSignedInteger   = (1U << 2),
+  kAudioFormatFlagIsPacked          = (1U << 3),
+  kAudioFormatFlagIsAlignedHigh     = (1U << 4),
+  kAudioFormatFlagIsNonInterleaved  = (1U << 5),
+  kAudioFormatFlagIsNonMixable      = (1U << 6),
+
+  kLinearPCMFormatFlagIsFloat           = kAudioFormatFlagIsFloat,
+  kLinearPCMFormatFlagIsBigEndian       = kAudioFormatFlagIsBigEndian,
+  kLinearPCMFormatFlagIsSignedInteger   = kAudioFormatFlagIsSignedInteger,
+  kLinearPCMFormatFlagIsPacked          = kAudioFormatFlagIsPacked,
+  kLinearPCMFormatFlagIsNonInterleaved  = kAudioFormatFlagIsNonInterleaved
+};
+
+struct AudioStreamBasicDescription
+{
+  Float64 mSampleRate;
+  AudioFormatID mFormatID;
+  AudioFormatFlags mFormatFlags;
+  UInt32 mBytesPerPacket;
+  UInt32 mFramesPerPacket;
+  UInt32 mBytesPerFrame;
+  UInt32 mChannelsPerFrame;
+  UInt32 mBitsPerChannel;
+  UInt32 mReserved;
+};
+
+struct AudioBuffer
+{
+  UInt32 mNumberChannels;
+  UInt32 mDataByteSize;
+  void* mData;
+};
+
+struct AudioBufferList
+{
+  UInt32 mNumberBuffers;
+  AudioBuffer mBuffers[1]; // This is a variable length array.
+};
+
+struct SMPTETime
+{
+  SInt16 mSubframes;
+  SInt16 mSubframeDivisor;
+  UInt32 mCounter;
+  UInt32 mType;
+  UInt32 mFlags;
+  SInt16 mHours;
+  SInt16 mMinutes;
+  SInt16 mSeconds;
+  SInt16 mFrames;
+};
+
+struct AudioTimeStamp
+{
+  Float64 mSampleTime;
+  UInt64 mHostTime;
+  Float64 mRateScalar;
+  UInt64 mWordClockTime;
+  SMPTETime mSMPTETime;
+  UInt32 mFlags;
+  UInt32 mReserved;
+};
+
+enum {
+  kAudioTimeStampSampleTimeValid    = (1U << 0),
+  kAudioTimeStampHostTimeValid      = (1U << 1),
+  kAudioTimeStampRateScalarValid    = (1U << 2),
+  kAudioTimeStampWordClockTimeValid = (1U << 3),
+  kAudioTimeStampSMPTETimeValid     = (1U << 4),
+
+  kAudioTimeStampSampleHostTimeValid = (kAudioTimeStampSampleTimeValid |
+                                        kAudioTimeStampHostTimeValid)
+};
+
+typedef UInt32 AudioUnitRenderActionFlags;
+
+enum {
+  kAudioUnitRenderAction_PreRender      = (1U << 2),
+  kAudioUnitRenderAction_PostRender     = (1U << 3),
+  kAudioUnitRenderAction_OutputIsSilence = (1U << 4)
+};
+
+typedef OSStatus (* AURenderCallback)(void* inRefCon,
+                                      AudioUnitRenderActionFlags* ioActionFlags,
+                                      const AudioTimeStamp* inTimeStamp,
+                                      UInt32 inBusNumber,
+                                      UInt32 inNumberFrames,
+                                      AudioBufferList* ioData);
+
+#endif // #if defined(__APPLE__)
+
+#endif // #ifndef AUDIOTYPES_H
@@ -0,0 +1,233 @@
+#include "AudioUnitBackend.h"
+#include "AudioObjectProperties.h"
+#include <cassert>
+#include <cstring>
+
+AudioUnitBackend::AudioUnitBackend()
+  : mUnit(nullptr)
+  , mInputEnabled(false)
+{
+  memset(&mInputDesc, 0, sizeof(mInputDesc));
+}
+
+AudioUnitBackend::~AudioUnitBackend()
+{
+  assert(!mUnit); // The unit should be destroyed by its AudioStream.
+}
+
+static AudioComponent
+FindComponent(OSType aSubType)
+{
+  AudioComponentDescription desc;
+  desc.componentType = kAudioUnitType_Output;
+  desc.componentSubType = aSubType;
+  desc.componentManufacturer = kAudioUnitManufacturer_Apple;
+  desc.componentFlags = 0;
+  desc.componentFlagsMask = 0;
+  // nullptr if there is no matching audio hardware.
+  return AudioComponentFindNext(NULL, &desc);
+}
+
+// The device a HAL output unit captures from and plays to in the duplex
+// mode. It's the default output device when that one can capture too, as a
+// headset or an aggregate device can, and kAudioObjectUnknown otherwise.
+static AudioObjectID
+GetDuplexDevice(AudioObjectID aInput, AudioObjectID aOutput)
+{
+  UInt32 streams = 0;
+  if (aOutput == aInput ||
+      (GetPropertyCount<StreamsProperty<kAudioObjectPropertyScopeInput>>(
+         aOutput, &streams) == noErr && streams)) {
+    return aOutput;
+  }
+  return kAudioObjectUnknown;
+}
+
+bool
+AudioUnitBackend::Create()
+{
+  assert(!mUnit); // mUnit should be nullptr before initializing.
+
+  // AudioComponentFindNext searches the registry of all the components, so
+  // it's only done once per process for each unit type. The default output
+  // unit has no input bus.
+  static const AudioComponent defaultOutput =
+    FindComponent(kAudioUnitSubType_DefaultOutput);
+  static const AudioComponent halOutput =
+    FindComponent(kAudioUnitSubType_HALOutput);
+  static const AudioComponent voiceProcessing =
+    FindComponent(kAudioUnitSubType_VoiceProcessingIO);
+
+  AudioComponent comp = defaultOutput;
+  AudioObjectID device = kAudioObjectUnknown;
+  if (mInputEnabled) {
+    AudioObjectID input = kAudioObjectUnknown;
+    AudioObjectID output = kAudioObjectUnknown;
+    if (GetProperty<DefaultInputDeviceProperty>(kAudioObjectSystemObject,
+                                                &input) != noErr ||
+        GetProperty<DefaultOutputDeviceProperty>(kAudioObjectSystemObject,
+                                                 &output) != noErr ||
+        input == kAudioObjectUnknown || output == kAudioObjectUnknown) {
+      return false; // Nothing to capture from or to play to.
+    }
+    // A HAL output unit runs a single device. When the microphone and the
+    // speakers are separate devices, the voice-processing unit pairs the
+    // default input and output devices itself.
+    device = GetDuplexDevice(input, output);
+    comp = device != kAudioObjectUnknown ? halOutput : voiceProcessing;
+  }
+
+  if (!comp || AudioComponentInstanceNew(comp, &mUnit) != noErr) {
+    mUnit = nullptr;
+    return false;
+  }
+  if (!mInputEnabled) {
+    return true;
+  }
+
+  // The input bus of a HAL output unit is disabled by default, and it uses
+  // the default output device unless told otherwise.
+  if (!EnableIO(kAudioUnitScope_Input, InputBus, 1) ||
+      !EnableIO(kAudioUnitScope_Output, OutputBus, 1) ||
+      (device != kAudioObjectUnknown &&
+       AudioUnitSetProperty(mUnit,
+                            kAudioOutputUnitProperty_CurrentDevice,
+                            kAudioUnitScope_Global,
+                            0,
+                            &device,
+                            sizeof(device)) != noErr)) {
+    // Not created, so it won't be destroyed by its AudioStream.
+    AudioComponentInstanceDispose(mUnit);
+    mUnit = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool
+AudioUnitBackend::Destroy()
+{
+  assert(mUnit);
+  bool ok = AudioComponentInstanceDispose(mUnit) == noErr;
+  mUnit = nullptr;
+  return ok;
+}
+
+bool
+AudioUnitBackend::Init()
+{
+  assert(mUnit);
+  return AudioUnitInitialize(mUnit) == noErr;
+}
+
+bool
+AudioUnitBackend::Uninit()
+{
+  assert(mUnit);
+  return AudioUnitUninitialize(mUnit) == noErr;
+}
+
+bool
+AudioUnitBackend::SetStreamFormat(const AudioStreamBasicDescription& aDesc)
+{
+  assert(mUnit);
+  // The captured data leaves the unit from the output scope of the input bus.
+  if (mInputEnabled &&
+      AudioUnitSetProperty(mUnit,
+                           kAudioUnitProperty_StreamFormat,
+                           kAudioUnitScope_Output,
+                           InputBus,
+                           &mInputDesc,
+                           sizeof(mInputDesc)) != noErr) {
+    return false;
+  }
+
+  return AudioUnitSetProperty(mUnit,
+                              kAudioUnitProperty_StreamFormat,
+                              kAudioUnitScope_Input,
+                              OutputBus,
+                              &aDesc,
+                              sizeof(aDesc)) == noErr;
+}
+
+bool
+AudioUnitBackend::SetCallback(AURenderCallback aCallback, void* aRefCon)
+{
+  assert(mUnit);
+  AURenderCallbackStruct aurcbs;
+  memset(&aurcbs, 0, sizeof(aurcbs));
+  aurcbs.inputProc = aCallback;
+  aurcbs.inputProcRefCon = aRefCon;
+
+  return AudioUnitSetProperty(mUnit,
+                              kAudioUnitProperty_SetRenderCallback,
+                              kAudioUnitScope_Input,
+                              OutputBus,
+                              &aurcbs,
+                              sizeof(aurcbs)) == noErr;
+}
+
+bool
+AudioUnitBackend::Start()
+{
+  assert(mUnit);
+  return AudioOutputUnitStart(mUnit) == noErr;
+}
+
+bool
+AudioUnitBackend::Stop()
+{
+  assert(mUnit);
+  return AudioOutputUnitStop(mUnit) == noErr;
+}
+
+bool
+AudioUnitBackend::EnableInput(const AudioStreamBasicDescription& aDesc)
+{
+  assert(!mUnit); // The unit type depends on it.
+  mInputEnabled = true;
+  mInputDesc = aDesc;
+  return true;
+}
+
+OSStatus
+AudioUnitBackend::RenderInput(AudioUnitRenderActionFlags* aActionFlags,
+                              const AudioTimeStamp* aTimeStamp,
+                              UInt32 aNumFrames,
+                              AudioBufferList* aData)
+{
+  assert(mUnit && mInputEnabled);
+  return AudioUnitRender(mUnit, aActionFlags, aTimeStamp, InputBus,
+                         aNumFrames, aData);
+}
+
+UInt32
+AudioUnitBackend::GetMaxFramesPerBuffer() const
+{
+  assert(mUnit);
+  UInt32 frames = 0;
+  UInt32 size = sizeof(frames);
+  OSStatus r = AudioUnitGetProperty(mUnit,
+                                    kAudioUnitProperty_MaximumFramesPerSlice,
+                                    kAudioUnitScope_Global,
+                                    0,
+                                    &frames,
+                                    &size);
+  if (r != noErr || !frames) {
+    return DEFAULT_MAX_FRAMES;
+  }
+  return frames;
+}
+
+bool
+AudioUnitBackend::EnableIO(AudioUnitScope aScope,
+                           AudioUnitElement aBus,
+                           UInt32 aEnable)
+{
+  return AudioUnitSetProperty(mUnit,
+                              kAudioOutputUnitProperty_EnableIO,
+                              aScope,
+                              aBus,
+                              &aEnable,
+                              sizeof(aEnable)) == noErr;
+}
@@ -0,0 +1,50 @@
+#ifndef AUDIOUNITBACKEND_H
+#define AUDIOUNITBACKEND_H
+
+#include "AudioBackend.h"
+#include <AudioUnit/AudioUnit.h>
+
+// The backend playing through the default output device with an AudioUnit.
+// With input enabled, it switches to a HAL output unit bound to the default
+// output device when that device can capture too (or is an aggregate
+// device). When the default input and output devices are separate, as the
+// built-in microphone and speakers are, it uses the voice-processing unit,
+// which runs both and cancels the echo of the output in the input. Create
+// fails when there is no default input or output device.
+class AudioUnitBackend: public AudioBackend
+{
+public:
+  AudioUnitBackend();
+  ~AudioUnitBackend();
+
+  bool EnableInput(const AudioStreamBasicDescription& aDesc) override;
+  OSStatus RenderInput(AudioUnitRenderActionFlags* aActionFlags,
+                       const AudioTimeStamp* aTimeStamp,
+                       UInt32 aNumFrames,
+                       AudioBufferList* aData) override;
+  UInt32 GetMaxFramesPerBuffer() const override;
+
+  bool Create() override;
+  bool Destroy() override;
+  bool Init() override;
+  bool Uninit() override;
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override;
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override;
+  bool Start() override;
+  bool Stop() override;
+
+private:
+  enum Element
+  {
+    OutputBus = 0,
+    InputBus = 1
+  };
+
+  bool EnableIO(AudioUnitScope aScope, AudioUnitElement aBus, UInt32 aEnable);
+
+  AudioUnit mUnit;
+  bool mInputEnabled;
+  AudioStreamBasicDescription mInputDesc;
+};
+
+#endif // #ifndef AUDIOUNITBACKEND_H
@@ -0,0 +1,131 @@
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+#include <algorithm> // std::sort
+#include <cassert>
+#include <chrono>    // std::chrono
+#include <cstdio>    // FILE, fprintf
+#include <stddef.h>  // size_t
+#include <stdint.h>  // uint64_t
+#include <string>    // std::string
+#include <vector>    // std::vector
+
+// The timings of a set of benchmarks, written out as JSON, so the results of
+// two builds can be compared by a script rather than by eye.
+//
+// A benchmark is a list of samples. Each sample is the time per operation
+// of a batch of operations, which can be a single one when it's long enough
+// for the clock. The report keeps their mean and nearest-rank percentiles.
+class BenchReport
+{
+public:
+  struct Result
+  {
+    std::string mName;
+    uint64_t mSamples;
+    uint64_t mOpsPerSample;
+    double mMeanNs;
+    double mMinNs;
+    double mP50Ns;
+    double mP90Ns;
+    double mP99Ns;
+    double mP999Ns;
+    double mMaxNs;
+  };
+
+  // Add the benchmark aName, from its samples in ns per operation. The name
+  // is written out as it is: no quotes or backslashes.
+  const Result& Add(const std::string& aName,
+                    std::vector<double> aSamplesNs,
+                    uint64_t aOpsPerSample)
+  {
+    assert(!aSamplesNs.empty());
+    assert(aName.find_first_of("\"\\") == std::string::npos);
+    std::sort(aSamplesNs.begin(), aSamplesNs.end());
+    auto percentile = [&aSamplesNs](double aPercent) {
+      size_t rank = static_cast<size_t>(aSamplesNs.size() * aPercent / 100.0
+                                        + 0.999999);
+      return aSamplesNs[rank ? rank - 1 : 0];
+    };
+    double sum = 0.0;
+    for (double s : aSamplesNs) {
+      sum += s;
+    }
+
+    Result r;
+    r.mName = aName;
+    r.mSamples = aSamplesNs.size();
+    r.mOpsPerSample = aOpsPerSample;
+    r.mMeanNs = sum / aSamplesNs.size();
+    r.mMinNs = aSamplesNs.front();
+    r.mP50Ns = percentile(50.0);
+    r.mP90Ns = percentile(90.0);
+    r.mP99Ns = percentile(99.0);
+    r.mP999Ns = percentile(99.9);
+    r.mMaxNs = aSamplesNs.back();
+    mResults.push_back(r);
+    return mResults.back();
+  }
+
+  // Time aSamples batches of aBatch calls to aOperation, after a warm-up of
+  // one batch, and add them as the benchmark aName.
+  template<typename Operation>
+  const Result& Measure(const std::string& aName,
+                        size_t aSamples,
+                        size_t aBatch,
+                        Operation aOperation)
+  {
+    typedef std::chrono::steady_clock Clock;
+    for (size_t i = 0; i < aBatch; ++i) {
+      aOperation();
+    }
+    std::vector<double> samples(aSamples);
+    for (size_t s = 0; s < aSamples; ++s) {
+      Clock::time_point start = Clock::now();
+      for (size_t i = 0; i < aBatch; ++i) {
+        aOperation();
+      }
+      std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+      samples[s] = elapsed.count() / aBatch;
+    }
+    return Add(aName, samples, aBatch);
+  }
+
+  const std::vector<Result>& GetResults() const { return mResults; }
+
+  // Write { "platform": ..., "unit": "ns", "benchmarks": [ ... ] } to aOut.
+  void Write(FILE* aOut) const
+  {
+    fprintf(aOut, "{\n  \"platform\": \"%s\",\n  \"unit\": \"ns\",\n"
+                  "  \"benchmarks\": [", Platform());
+    for (size_t i = 0; i < mResults.size(); ++i) {
+      const Result& r = mResults[i];
+      fprintf(aOut, "%s\n    {\"name\": \"%s\", \"samples\": %llu, "
+                    "\"ops_per_sample\": %llu, \"mean\": %.2f, "
+                    "\"min\": %.2f, \"p50\": %.2f, \"p90\": %.2f, "
+                    "\"p99\": %.2f, \"p99.9\": %.2f, \"max\": %.2f}",
+              i ? "," : "", r.mName.c_str(),
+              static_cast<unsigned long long>(r.mSamples),
+              static_cast<unsigned long long>(r.mOpsPerSample),
+              r.mMeanNs, r.mMinNs, r.mP50Ns, r.mP90Ns, r.mP99Ns, r.mP999Ns,
+              r.mMaxNs);
+    }
+    fprintf(aOut, "\n  ]\n}\n");
+  }
+
+private:
+  static const char* Platform()
+  {
+#if defined(__APPLE__)
+    return "darwin";
+#elif defined(__linux__)
+    return "linux";
+#else
+    return "unknown";
+#endif
+  }
+
+  std::vector<Result> mResults;
+};
+
+#endif // #ifndef BENCHREPORT_H
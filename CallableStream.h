@@ -0,0 +1,69 @@
+#ifndef CALLABLESTREAM_H
+#define CALLABLESTREAM_H
+
+#include "AudioStream.h"
+#include <memory>  // std::unique_ptr
+#include <utility> // std::move
+
+// An interleaved AudioStream rendering with any callable, such as a lambda,
+// capturing or not, or a functor with its own state. It's called as
+// aCallable(void* aBuffer, unsigned long aFrames) on the render thread.
+//
+// The callable lives in the CallableStream, so its state needs no globals.
+// The stream registers AudioStream::CallableDataCallback<Callable> with its
+// backend, which the compiler inlines the callable into: when the device
+// renders straight into the callback, the only indirect call is the
+// backend's. Through a ring, the resampler or the float conversion, the
+// callable is called by the Trampoline, a ContextAudioCallback with the
+// callable as its context. The stream is destroyed, so stopped, before the
+// callable.
+template<typename Callable>
+class CallableStream
+{
+public:
+  CallableStream(AudioStream::Format aFormat,
+                 unsigned int aChannels,
+                 double aRate,
+                 Callable aCallable,
+                 std::unique_ptr<AudioBackend> aBackend = nullptr,
+                 AudioControlThread* aControl = nullptr)
+    : mCallable(std::move(aCallable))
+    , mStream(aFormat, aChannels, aRate, &Trampoline, &mCallable,
+              &AudioStream::CallableDataCallback<Callable>,
+              std::move(aBackend), aControl)
+  {}
+
+  AudioStream& GetStream() { return mStream; }
+  AudioStream* operator->() { return &mStream; }
+  // Only touch its state while the stream is stopped.
+  Callable& GetCallable() { return mCallable; }
+
+private:
+  /* ContextAudioCallback */
+  static void Trampoline(void* aContext, void* aBuffer, unsigned long aFrames)
+  {
+    (*static_cast<Callable*>(aContext))(aBuffer, aFrames);
+  }
+
+  // Declared first, so it outlives the stream.
+  Callable mCallable;
+  AudioStream mStream;
+};
+
+// Make a CallableStream for the type of aCallable.
+template<typename Callable>
+std::unique_ptr<CallableStream<Callable>>
+MakeCallableStream(AudioStream::Format aFormat,
+                   unsigned int aChannels,
+                   double aRate,
+                   Callable aCallable,
+                   std::unique_ptr<AudioBackend> aBackend = nullptr,
+                   AudioControlThread* aControl = nullptr)
+{
+  return std::unique_ptr<CallableStream<Callable>>(
+    new CallableStream<Callable>(aFormat, aChannels, aRate,
+                                 std::move(aCallable), std::move(aBackend),
+                                 aControl));
+}
+
+#endif // #ifndef CALLABLESTREAM_H
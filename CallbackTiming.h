@@ -0,0 +1,165 @@
+#ifndef CALLBACKTIMING_H
+#define CALLBACKTIMING_H
+
+#include <atomic>   // std::atomic, std::atomic_thread_fence
+#include <stddef.h> // size_t
+#include <stdint.h> // uint64_t
+
+// The timing of the render callbacks: log-scale histograms of how long the
+// callbacks take and of the interval between them, and the number of
+// overruns, where a callback takes longer than the period of the buffer it
+// renders.
+//
+// The render thread is the only writer. Record never locks, allocates or
+// waits. The counters are published under a sequence number, so a reader on
+// any other thread gets a consistent Snapshot by retrying while a Record is
+// in progress.
+class CallbackTiming
+{
+public:
+  // Bucket i counts the values in [2^i, 2^(i+1)) ns. Bucket 0 also counts 0,
+  // and the last bucket everything from 2^(BUCKETS-1) ns (about 2 s) up.
+  static const size_t BUCKETS = 32;
+
+  struct Snapshot
+  {
+    uint64_t mCallbacks;
+    uint64_t mOverruns;
+    uint64_t mTotalDurationNs;
+    uint64_t mMaxDurationNs;
+    uint64_t mMaxIntervalNs;
+    uint64_t mDuration[BUCKETS];
+    uint64_t mInterval[BUCKETS]; // No interval for the first callback.
+
+    // The smallest value counted by aBucket.
+    static uint64_t BucketLowerBoundNs(size_t aBucket)
+    {
+      return aBucket ? uint64_t(1) << aBucket : 0;
+    }
+  };
+
+  CallbackTiming()
+    : mSequence(0)
+    , mLastStartNs(0)
+    , mHasLastStart(false)
+  {
+    Reset();
+  }
+
+  // Record a callback running from aStartNs to aEndNs, on a monotonic clock,
+  // for a buffer lasting aPeriodNs. Only called on the render thread.
+  void Record(uint64_t aStartNs, uint64_t aEndNs, uint64_t aPeriodNs)
+  {
+    uint64_t duration = aEndNs > aStartNs ? aEndNs - aStartNs : 0;
+    uint64_t sequence = mSequence.load(std::memory_order_relaxed);
+    mSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    Increment(mCallbacks);
+    Increment(mDuration[Bucket(duration)]);
+    Add(mTotalDurationNs, duration);
+    Max(mMaxDurationNs, duration);
+    if (duration > aPeriodNs) {
+      Increment(mOverruns);
+    }
+    if (mHasLastStart) {
+      uint64_t interval = aStartNs > mLastStartNs ? aStartNs - mLastStartNs : 0;
+      Increment(mInterval[Bucket(interval)]);
+      Max(mMaxIntervalNs, interval);
+    }
+    mLastStartNs = aStartNs;
+    mHasLastStart = true;
+
+    mSequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Forget the last callback, so the gap across a stop and a restart isn't
+  // counted as an interval. Only called while the render thread is stopped.
+  void Restart() { mHasLastStart = false; }
+
+  // Clear the counters. Only called while the render thread is stopped.
+  void Reset()
+  {
+    mCallbacks = 0;
+    mOverruns = 0;
+    mTotalDurationNs = 0;
+    mMaxDurationNs = 0;
+    mMaxIntervalNs = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      mDuration[i] = 0;
+      mInterval[i] = 0;
+    }
+    Restart();
+  }
+
+  // It's safe to call this from any thread but the render thread.
+  Snapshot GetSnapshot() const
+  {
+    Snapshot snapshot;
+    uint64_t before, after;
+    do {
+      before = mSequence.load(std::memory_order_acquire);
+      snapshot.mCallbacks = Load(mCallbacks);
+      snapshot.mOverruns = Load(mOverruns);
+      snapshot.mTotalDurationNs = Load(mTotalDurationNs);
+      snapshot.mMaxDurationNs = Load(mMaxDurationNs);
+      snapshot.mMaxIntervalNs = Load(mMaxIntervalNs);
+      for (size_t i = 0; i < BUCKETS; ++i) {
+        snapshot.mDuration[i] = Load(mDuration[i]);
+        snapshot.mInterval[i] = Load(mInterval[i]);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = mSequence.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return snapshot;
+  }
+
+  static size_t Bucket(uint64_t aNs)
+  {
+    size_t bucket = 0;
+    while (aNs > 1 && bucket < BUCKETS - 1) {
+      aNs >>= 1;
+      ++bucket;
+    }
+    return bucket;
+  }
+
+private:
+  typedef std::atomic<uint64_t> Counter;
+
+  // The counters only have one writer, so a plain load and store is enough
+  // for them, without a locked read-modify-write.
+  static uint64_t Load(const Counter& aCounter)
+  {
+    return aCounter.load(std::memory_order_relaxed);
+  }
+  static void Add(Counter& aCounter, uint64_t aValue)
+  {
+    aCounter.store(Load(aCounter) + aValue, std::memory_order_relaxed);
+  }
+  static void Increment(Counter& aCounter) { Add(aCounter, 1); }
+  static void Max(Counter& aCounter, uint64_t aValue)
+  {
+    if (aValue > Load(aCounter)) {
+      aCounter.store(aValue, std::memory_order_relaxed);
+    }
+  }
+
+  // Not copyable: the counters are shared with the render thread.
+  CallbackTiming(const CallbackTiming&);
+  CallbackTiming& operator=(const CallbackTiming&);
+
+  std::atomic<uint64_t> mSequence; // Odd while a Record is in progress.
+  Counter mCallbacks;
+  Counter mOverruns;
+  Counter mTotalDurationNs;
+  Counter mMaxDurationNs;
+  Counter mMaxIntervalNs;
+  Counter mDuration[BUCKETS];
+  Counter mInterval[BUCKETS];
+  // Only touched by the render thread.
+  uint64_t mLastStartNs;
+  bool mHasLastStart;
+};
+
+#endif // #ifndef CALLBACKTIMING_H
@@ -0,0 +1,81 @@
+#include "CoalescingDispatcher.h"
+#include <cassert>
+
+CoalescingDispatcher::CoalescingDispatcher(Callback aCallback,
+                                           void* aContext,
+                                           unsigned int aWindowMs)
+  : mCallback(aCallback)
+  , mContext(aContext)
+  , mWindow(aWindowMs)
+  , mPending(0)
+  , mNotifications(0)
+  , mDispatches(0)
+  , mRunning(true)
+{
+  assert(aCallback);
+  mThread = std::thread(&CoalescingDispatcher::Run, this);
+}
+
+CoalescingDispatcher::~CoalescingDispatcher()
+{
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mRunning = false;
+  }
+  mCondition.notify_one();
+  mThread.join();
+}
+
+void
+CoalescingDispatcher::Notify(uint32_t aChanges)
+{
+  if (!aChanges) {
+    return;
+  }
+  mNotifications.fetch_add(1, std::memory_order_relaxed);
+  uint32_t previous = mPending.fetch_or(aChanges, std::memory_order_release);
+  if (!previous) {
+    // Only the first change of a burst wakes the dispatcher up. The others
+    // just join the pending set.
+    std::lock_guard<std::mutex> guard(mMutex);
+    mCondition.notify_one();
+  }
+}
+
+CoalescingDispatcher::Stats
+CoalescingDispatcher::GetStats() const
+{
+  Stats stats;
+  stats.mNotifications = mNotifications.load(std::memory_order_relaxed);
+  stats.mDispatches = mDispatches.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void
+CoalescingDispatcher::Run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (true) {
+    mCondition.wait(lock, [this] {
+      return !mRunning || mPending.load(std::memory_order_acquire);
+    });
+    if (!mRunning) {
+      break;
+    }
+
+    // Let the rest of the burst come in.
+    if (mCondition.wait_for(lock, mWindow, [this] { return !mRunning; })) {
+      break;
+    }
+
+    uint32_t changes = mPending.exchange(0, std::memory_order_acquire);
+    if (!changes) {
+      continue;
+    }
+    mDispatches.fetch_add(1, std::memory_order_relaxed);
+    // Don't hold the lock in the callback, so Notify never waits for it.
+    lock.unlock();
+    mCallback(changes, mContext);
+    lock.lock();
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef COALESCINGDISPATCHER_H
+#define COALESCINGDISPATCHER_H
+
+#include <atomic>             // std::atomic
+#include <chrono>             // std::chrono
+#include <condition_variable> // std::condition_variable
+#include <mutex>              // std::mutex
+#include <stdint.h>           // uint32_t, uint64_t
+#include <thread>             // std::thread
+
+// Deliver sets of change bits on a dedicated thread, coalescing bursts.
+//
+// Notify only ORs the bits into a lock-free pending set; the first bit of a
+// burst also wakes the dispatcher thread up. The dispatcher then waits for
+// the coalescing window, takes the whole pending set at once, and fires the
+// callback with it, so any number of notifications within a window result
+// in a single callback.
+class CoalescingDispatcher
+{
+public:
+  typedef void (* Callback)(uint32_t aChanges, void* aContext);
+
+  struct Stats
+  {
+    uint64_t mNotifications; // Notify calls.
+    uint64_t mDispatches;    // Callbacks fired.
+  };
+
+  CoalescingDispatcher(Callback aCallback, void* aContext,
+                       unsigned int aWindowMs);
+  // Stop the dispatcher. The changes still pending are dropped.
+  ~CoalescingDispatcher();
+
+  // It's safe to call this from any thread but the dispatcher's.
+  void Notify(uint32_t aChanges);
+
+  // It's safe to call this from any thread.
+  Stats GetStats() const;
+
+private:
+  void Run();
+
+  // Not copyable: the dispatcher thread runs on this object.
+  CoalescingDispatcher(const CoalescingDispatcher&);
+  CoalescingDispatcher& operator=(const CoalescingDispatcher&);
+
+  Callback mCallback;
+  void* mContext;
+  std::chrono::milliseconds mWindow;
+
+  std::atomic<uint32_t> mPending; // The changes not dispatched yet.
+  std::atomic<uint64_t> mNotifications;
+  std::atomic<uint64_t> mDispatches;
+
+  // Only used to put the dispatcher to sleep and wake it up.
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  bool mRunning;
+  std::thread mThread;
+};
+
+#endif // #ifndef COALESCINGDISPATCHER_H
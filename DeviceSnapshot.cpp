@@ -0,0 +1,173 @@
+#include "DeviceSnapshot.h"
+#include <CoreFoundation/CFString.h> // for CFStringXXX
+#include <cassert>
+#include <cstring> // strcmp
+
+// The offset of the empty string, which the arena always starts with.
+const UInt32 EMPTY = 0;
+
+typedef StreamsProperty<kAudioObjectPropertyScopeInput> InputStreams;
+typedef StreamsProperty<kAudioObjectPropertyScopeOutput> OutputStreams;
+typedef DataSourceProperty<kAudioObjectPropertyScopeInput> InputSource;
+typedef DataSourceProperty<kAudioObjectPropertyScopeOutput> OutputSource;
+typedef DataSourceNameProperty<kAudioObjectPropertyScopeInput> InputSourceName;
+typedef DataSourceNameProperty<kAudioObjectPropertyScopeOutput>
+  OutputSourceName;
+
+DeviceSnapshot::DeviceSnapshot()
+  : mArena(1, '\0')
+  , mDefaultInput(kAudioObjectUnknown)
+  , mDefaultOutput(kAudioObjectUnknown)
+{}
+
+bool
+DeviceSnapshot::Update()
+{
+  // clear() keeps the capacities.
+  mDevices.clear();
+  mArena.assign(1, '\0');
+  mDefaultInput = kAudioObjectUnknown;
+  mDefaultOutput = kAudioObjectUnknown;
+
+  if (GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, &mIds) !=
+        kAudioHardwareNoError) {
+    return false;
+  }
+
+  GetProperty<DefaultInputDeviceProperty>(kAudioObjectSystemObject,
+                                          &mDefaultInput);
+  GetProperty<DefaultOutputDeviceProperty>(kAudioObjectSystemObject,
+                                           &mDefaultOutput);
+
+  mDevices.reserve(mIds.size());
+  for (AudioObjectID id : mIds) {
+    Device device;
+    device.mId = id;
+    device.mInputStreams = ReadStreamCount(id, AudioObjectUtils::Input);
+    device.mOutputStreams = ReadStreamCount(id, AudioObjectUtils::Output);
+    device.mDefaultInput = id == mDefaultInput;
+    device.mDefaultOutput = id == mDefaultOutput;
+
+    CFStringRef name = nullptr;
+    device.mName = EMPTY;
+    if (GetProperty<DeviceNameProperty>(id, &name) == kAudioHardwareNoError &&
+        name) {
+      device.mName = Intern(name);
+      CFRelease(name);
+    }
+
+    device.mInputLabel = device.mInputStreams
+      ? ReadLabel(id, AudioObjectUtils::Input, device.mName) : EMPTY;
+    device.mOutputLabel = device.mOutputStreams
+      ? ReadLabel(id, AudioObjectUtils::Output, device.mName) : EMPTY;
+    mDevices.push_back(device);
+  }
+  return true;
+}
+
+const DeviceSnapshot::Device*
+DeviceSnapshot::Find(AudioObjectID aId) const
+{
+  for (const Device& device : mDevices) {
+    if (device.mId == aId) {
+      return &device;
+    }
+  }
+  return nullptr;
+}
+
+const char*
+DeviceSnapshot::GetName(const Device& aDevice) const
+{
+  assert(aDevice.mName < mArena.size());
+  return &mArena[aDevice.mName];
+}
+
+const char*
+DeviceSnapshot::GetLabel(const Device& aDevice, Scope aScope) const
+{
+  UInt32 label = aScope == AudioObjectUtils::Input ? aDevice.mInputLabel
+                                                   : aDevice.mOutputLabel;
+  assert(label < mArena.size());
+  return &mArena[label];
+}
+
+AudioObjectID
+DeviceSnapshot::GetDefaultDeviceId(Scope aScope) const
+{
+  return aScope == AudioObjectUtils::Input ? mDefaultInput : mDefaultOutput;
+}
+
+UInt32
+DeviceSnapshot::Intern(CFStringRef aString)
+{
+  CFIndex length = CFStringGetLength(aString);
+  if (!length) {
+    return EMPTY;
+  }
+
+  CFRange range = CFRangeMake(0, length);
+  CFIndex size = 0;
+  if (!CFStringGetBytes(aString, range, kCFStringEncodingUTF8, 0, false,
+                        nullptr, 0, &size) || !size) {
+    return EMPTY;
+  }
+
+  // Convert straight into the arena, with no intermediate string.
+  size_t offset = mArena.size();
+  mArena.resize(offset + size + 1);
+  if (!CFStringGetBytes(aString, range, kCFStringEncodingUTF8, 0, false,
+                        reinterpret_cast<UInt8*>(&mArena[offset]), size,
+                        nullptr)) {
+    mArena.resize(offset);
+    return EMPTY;
+  }
+  mArena[offset + size] = '\0';
+  return static_cast<UInt32>(offset);
+}
+
+UInt32
+DeviceSnapshot::ReadLabel(AudioObjectID aId, Scope aScope, UInt32 aName)
+{
+  bool input = aScope == AudioObjectUtils::Input;
+  UInt32 source = 0;
+  if ((input ? GetProperty<InputSource>(aId, &source)
+             : GetProperty<OutputSource>(aId, &source)) !=
+        kAudioHardwareNoError) {
+    return aName; // No data source: labelled by its name, shared in the arena.
+  }
+
+  CFStringRef sourceName = nullptr;
+  AudioValueTranslation translation;
+  translation.mInputData = &source;
+  translation.mInputDataSize = sizeof(source);
+  translation.mOutputData = &sourceName;
+  translation.mOutputDataSize = sizeof(sourceName);
+  if ((input ? GetProperty<InputSourceName>(aId, &translation)
+             : GetProperty<OutputSourceName>(aId, &translation)) !=
+        kAudioHardwareNoError || !sourceName) {
+    return aName;
+  }
+
+  UInt32 label = Intern(sourceName);
+  CFRelease(sourceName);
+  if (label == EMPTY) {
+    return aName;
+  }
+  if (!strcmp(&mArena[label], &mArena[aName])) {
+    // Same as the name: drop the copy and share the name.
+    mArena.resize(label);
+    return aName;
+  }
+  return label;
+}
+
+UInt32
+DeviceSnapshot::ReadStreamCount(AudioObjectID aId, Scope aScope) const
+{
+  UInt32 count = 0;
+  OSStatus r = aScope == AudioObjectUtils::Input
+    ? GetPropertyCount<InputStreams>(aId, &count)
+    : GetPropertyCount<OutputStreams>(aId, &count);
+  return r == kAudioHardwareNoError ? count : 0;
+}
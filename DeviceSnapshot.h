@@ -0,0 +1,74 @@
+#ifndef DEVICESNAPSHOT_H
+#define DEVICESNAPSHOT_H
+
+#include "AudioObjectUtils.h"
+#include <CoreAudio/AudioHardware.h>
+#include <stddef.h> // size_t
+#include <vector>   // std::vector
+
+// The metadata of all the devices, read in a single pass into a flat array
+// of records. The strings are interned in one arena the records point into
+// by offset, so a snapshot holds three buffers however many devices there
+// are, and an Update reuses them: once they're large enough, refreshing the
+// device list allocates nothing.
+//
+// Each device costs a fixed number of HAL calls: the stream counts of both
+// scopes, the name, and the data source and its name for each scope the
+// device has.
+class DeviceSnapshot
+{
+public:
+  typedef AudioObjectUtils::Scope Scope;
+
+  struct Device
+  {
+    AudioObjectID mId;
+    UInt32 mInputStreams;
+    UInt32 mOutputStreams;
+    bool mDefaultInput;
+    bool mDefaultOutput;
+    // Offsets of the NUL-terminated strings in the arena. Read them with
+    // GetName and GetLabel.
+    UInt32 mName;
+    UInt32 mInputLabel;
+    UInt32 mOutputLabel;
+  };
+
+  DeviceSnapshot();
+
+  // Read all the devices again. Return false if the device list can't be
+  // read, leaving the snapshot empty.
+  bool Update();
+
+  size_t Count() const { return mDevices.size(); }
+  const Device& operator[](size_t aIndex) const { return mDevices[aIndex]; }
+  const Device* begin() const { return mDevices.data(); }
+  const Device* end() const { return mDevices.data() + mDevices.size(); }
+
+  // Return nullptr if there is no such device.
+  const Device* Find(AudioObjectID aId) const;
+
+  // The strings are valid until the next Update. They are empty when the
+  // device doesn't have them, e.g. the label of a scope it isn't in.
+  const char* GetName(const Device& aDevice) const;
+  const char* GetLabel(const Device& aDevice, Scope aScope) const;
+
+  AudioObjectID GetDefaultDeviceId(Scope aScope) const;
+
+private:
+  // Append the UTF-8 string into the arena. Return its offset, which is the
+  // empty string's if the conversion fails.
+  UInt32 Intern(CFStringRef aString);
+  // The label of aId in aScope: the name of its data source if it has one,
+  // or its name, at aName, otherwise.
+  UInt32 ReadLabel(AudioObjectID aId, Scope aScope, UInt32 aName);
+  UInt32 ReadStreamCount(AudioObjectID aId, Scope aScope) const;
+
+  std::vector<Device> mDevices;
+  std::vector<char> mArena;
+  std::vector<AudioObjectID> mIds; // Scratch for the device list.
+  AudioObjectID mDefaultInput;
+  AudioObjectID mDefaultOutput;
+};
+
+#endif // #ifndef DEVICESNAPSHOT_H
@@ -0,0 +1,23 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <chrono>   // std::chrono
+#include <stdint.h> // uint64_t
+
+// What the streams need to know of the host they run on.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+const bool HOST_BIG_ENDIAN = true;
+#else
+const bool HOST_BIG_ENDIAN = false;
+#endif
+
+// The time on the monotonic clock, in ns. It's real-time safe.
+inline uint64_t
+NowNs()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // #ifndef HOST_H
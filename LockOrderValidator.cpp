@@ -0,0 +1,198 @@
+#include "LockOrderValidator.h"
+#include <algorithm> // std::find
+#include <cstdio>    // snprintf, fprintf
+#include <cstdlib>   // abort
+#include <iterator>  // std::next
+
+/* static */ thread_local bool LockOrderValidator::sRenderThread = false;
+
+LockOrderValidator::RenderThreadScope::RenderThreadScope()
+  : mWasRenderThread(sRenderThread)
+{
+  sRenderThread = true;
+}
+
+LockOrderValidator::RenderThreadScope::~RenderThreadScope()
+{
+  sRenderThread = mWasRenderThread;
+}
+
+/* static */ LockOrderValidator&
+LockOrderValidator::Global()
+{
+  // Never destroyed, since the global locks may be destroyed after it.
+  static LockOrderValidator* validator = new LockOrderValidator();
+  return *validator;
+}
+
+/* static */ bool
+LockOrderValidator::IsRenderThread()
+{
+  return sRenderThread;
+}
+
+/* static */ std::vector<const void*>&
+LockOrderValidator::Held()
+{
+  static thread_local std::vector<const void*> held;
+  return held;
+}
+
+LockOrderValidator::LockOrderValidator()
+  : mReporter(&Abort)
+  , mViolations(0)
+{}
+
+LockOrderValidator::Reporter
+LockOrderValidator::SetReporter(Reporter aReporter)
+{
+  return mReporter.exchange(aReporter ? aReporter : &Abort);
+}
+
+void
+LockOrderValidator::WillLock(const void* aLock, const char* aName)
+{
+  std::vector<Violation> violations;
+  const std::vector<const void*>& held = Held();
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    mGraph[aLock].mName = aName;
+    if (sRenderThread) {
+      violations.push_back({ LockOnRenderThread,
+                             Describe(aLock) + " is taken on a render thread" });
+    }
+    for (const void* lock : held) {
+      if (lock == aLock) {
+        violations.push_back({ RecursiveLock,
+                               Describe(aLock) + " is already held" });
+        continue;
+      }
+      if (!mGraph[lock].mAfter.insert(aLock).second) {
+        continue; // A known order, already checked.
+      }
+      // The new edge lock -> aLock closes a cycle if lock can already be
+      // taken after aLock.
+      std::vector<const void*> path;
+      if (FindPath(aLock, lock, &path)) {
+        std::string message = "Lock order cycle: ";
+        for (const void* node : path) {
+          message += Describe(node) + " -> ";
+        }
+        message += Describe(aLock);
+        violations.push_back({ LockOrderCycle, message });
+      }
+    }
+  }
+
+  // Out of the lock, since the reporter may do anything.
+  for (const Violation& violation : violations) {
+    Report(violation);
+  }
+}
+
+void
+LockOrderValidator::DidLock(const void* aLock)
+{
+  Held().push_back(aLock);
+}
+
+void
+LockOrderValidator::DidUnlock(const void* aLock)
+{
+  // The locks aren't always released in the reverse order. A lock released
+  // by another thread than its owner isn't in this thread's stack at all.
+  std::vector<const void*>& held = Held();
+  std::vector<const void*>::reverse_iterator it =
+    std::find(held.rbegin(), held.rend(), aLock);
+  if (it != held.rend()) {
+    held.erase(std::next(it).base());
+  }
+}
+
+void
+LockOrderValidator::Forget(const void* aLock)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  mGraph.erase(aLock);
+  for (auto& entry : mGraph) {
+    entry.second.mAfter.erase(aLock);
+  }
+}
+
+void
+LockOrderValidator::Reset()
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  mGraph.clear();
+}
+
+uint64_t
+LockOrderValidator::GetViolationCount() const
+{
+  return mViolations.load(std::memory_order_relaxed);
+}
+
+bool
+LockOrderValidator::FindPath(const void* aFrom, const void* aTo,
+                             std::vector<const void*>* aPath) const
+{
+  // A depth-first search. The path is the stack of the nodes being visited.
+  std::set<const void*> visited;
+  std::vector<std::pair<const void*, std::set<const void*>::const_iterator>>
+    stack;
+  aPath->clear();
+
+  std::map<const void*, Node>::const_iterator node = mGraph.find(aFrom);
+  if (node == mGraph.end()) {
+    return false;
+  }
+  visited.insert(aFrom);
+  stack.push_back({ aFrom, node->second.mAfter.begin() });
+  while (!stack.empty()) {
+    const void* current = stack.back().first;
+    const std::set<const void*>& after = mGraph.find(current)->second.mAfter;
+    if (stack.back().second == after.end()) {
+      stack.pop_back();
+      continue;
+    }
+    const void* next = *stack.back().second++;
+    if (next == aTo) {
+      for (const auto& entry : stack) {
+        aPath->push_back(entry.first);
+      }
+      aPath->push_back(aTo);
+      return true;
+    }
+    node = mGraph.find(next);
+    if (node != mGraph.end() && visited.insert(next).second) {
+      stack.push_back({ next, node->second.mAfter.begin() });
+    }
+  }
+  return false;
+}
+
+std::string
+LockOrderValidator::Describe(const void* aLock) const
+{
+  std::map<const void*, Node>::const_iterator node = mGraph.find(aLock);
+  if (node != mGraph.end() && node->second.mName) {
+    return node->second.mName;
+  }
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "lock %p", aLock);
+  return buffer;
+}
+
+void
+LockOrderValidator::Report(const Violation& aViolation)
+{
+  mViolations.fetch_add(1, std::memory_order_relaxed);
+  mReporter.load()(aViolation);
+}
+
+/* static */ void
+LockOrderValidator::Abort(const Violation& aViolation)
+{
+  fprintf(stderr, "LockOrderValidator: %s\n", aViolation.mMessage.c_str());
+  abort();
+}
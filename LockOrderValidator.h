@@ -0,0 +1,121 @@
+#ifndef LOCKORDERVALIDATOR_H
+#define LOCKORDERVALIDATOR_H
+
+#include <atomic>   // std::atomic
+#include <map>      // std::map
+#include <mutex>    // std::mutex
+#include <set>      // std::set
+#include <stdint.h> // uint64_t
+#include <string>   // std::string
+#include <vector>   // std::vector
+
+// The validation is on in the debug builds.
+#ifndef VALIDATE_LOCK_ORDER
+#ifdef NDEBUG
+#define VALIDATE_LOCK_ORDER false
+#else
+#define VALIDATE_LOCK_ORDER true
+#endif
+#endif
+
+// Catch the potential deadlocks the moment they become possible, instead of
+// waiting for the interleaving that actually deadlocks (see
+// test_deadlock.cpp).
+//
+// Each thread keeps the stack of the locks it holds. Taking a lock while
+// holding others adds the edges "held -> taken" to a process-wide lock-order
+// graph, and the first edge closing a cycle is reported: some two threads
+// may take those locks in opposite orders. Taking any lock on a render
+// thread is reported too, since the render callback runs with the
+// AudioUnit's own lock held, so a thread holding that lock and waiting for
+// the AudioUnit deadlocks with it.
+//
+// The bookkeeping locks and allocates. It's a debug tool, not meant to be
+// enabled in the release builds.
+class LockOrderValidator
+{
+public:
+  enum Kind
+  {
+    LockOrderCycle,
+    RecursiveLock,
+    LockOnRenderThread
+  };
+
+  struct Violation
+  {
+    Kind mKind;
+    std::string mMessage;
+  };
+
+  typedef void (*Reporter)(const Violation& aViolation);
+
+  // Mark the calling thread as a render thread while in scope. It's cheap and
+  // real-time safe, so the render callbacks always use it.
+  class RenderThreadScope
+  {
+  public:
+    RenderThreadScope();
+    ~RenderThreadScope();
+
+  private:
+    bool mWasRenderThread;
+  };
+
+  static LockOrderValidator& Global();
+
+  static bool IsRenderThread();
+
+  // The reporter is called on the thread taking the lock, before it blocks.
+  // The default one prints the violation and aborts. Return the previous one.
+  Reporter SetReporter(Reporter aReporter);
+
+  // Call WillLock before blocking on aLock, then DidLock once it's taken, and
+  // DidUnlock after releasing it. aName, which must outlive the lock, names
+  // it in the reports.
+  void WillLock(const void* aLock, const char* aName);
+  void DidLock(const void* aLock);
+  void DidUnlock(const void* aLock);
+  // Drop aLock from the graph once it's destroyed, since its address may be
+  // reused by another lock.
+  void Forget(const void* aLock);
+
+  // Drop the whole graph, e.g. between tests.
+  void Reset();
+
+  uint64_t GetViolationCount() const;
+
+private:
+  struct Node
+  {
+    const char* mName;
+    // The locks taken while holding this one.
+    std::set<const void*> mAfter;
+  };
+
+  LockOrderValidator();
+
+  // Fill aPath with the locks from aFrom to aTo if aTo can be taken after
+  // aFrom. It needs mMutex held.
+  bool FindPath(const void* aFrom, const void* aTo,
+                std::vector<const void*>* aPath) const;
+  std::string Describe(const void* aLock) const;
+  void Report(const Violation& aViolation);
+
+  static void Abort(const Violation& aViolation);
+  // The locks held by the calling thread, in the order they were taken.
+  static std::vector<const void*>& Held();
+
+  // Not copyable: it's a process-wide singleton.
+  LockOrderValidator(const LockOrderValidator&);
+  LockOrderValidator& operator=(const LockOrderValidator&);
+
+  mutable std::mutex mMutex;
+  std::map<const void*, Node> mGraph;
+  std::atomic<Reporter> mReporter;
+  std::atomic<uint64_t> mViolations;
+
+  static thread_local bool sRenderThread;
+};
+
+#endif // #ifndef LOCKORDERVALIDATOR_H
@@ -0,0 +1,302 @@
+#include "LockProfiler.h"
+#include <algorithm>  // std::find, std::sort
+#include <cassert>
+#include <chrono>     // std::chrono
+#include <functional> // std::hash
+
+static thread_local const char* sThreadName = nullptr;
+
+LockProfile::LockProfile(const char* aName)
+  : mName(aName)
+  , mAcquisitions(0)
+  , mContended(0)
+  , mTotalWaitNs(0)
+  , mMaxWaitNs(0)
+  , mTotalHoldNs(0)
+  , mMaxHoldNs(0)
+  , mAcquiredNs(0)
+{
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    mWait[i].store(0, std::memory_order_relaxed);
+    mHold[i].store(0, std::memory_order_relaxed);
+  }
+  for (HolderSlot& slot : mHolders) {
+    slot.mThread.store(0, std::memory_order_relaxed);
+    slot.mName.store(nullptr, std::memory_order_relaxed);
+    slot.mAcquisitions.store(0, std::memory_order_relaxed);
+    slot.mHoldNs.store(0, std::memory_order_relaxed);
+  }
+  LockProfiler::Global().Register(this);
+}
+
+LockProfile::~LockProfile()
+{
+  LockProfiler::Global().Unregister(this);
+}
+
+void
+LockProfile::Acquired(bool aContended, uint64_t aWaitNs)
+{
+  mAcquiredNs = NowNs();
+  Add(mAcquisitions, 1);
+  if (aContended) {
+    Add(mContended, 1);
+    Add(mTotalWaitNs, aWaitNs);
+    Max(mMaxWaitNs, aWaitNs);
+    Add(mWait[CallbackTiming::Bucket(aWaitNs)], 1);
+  }
+}
+
+void
+LockProfile::Released()
+{
+  uint64_t now = NowNs();
+  uint64_t hold = now > mAcquiredNs ? now - mAcquiredNs : 0;
+  Add(mTotalHoldNs, hold);
+  Max(mMaxHoldNs, hold);
+  Add(mHold[CallbackTiming::Bucket(hold)], 1);
+  RecordHolder(hold);
+}
+
+void
+LockProfile::RecordHolder(uint64_t aHoldNs)
+{
+  uint64_t thread = LockProfiler::GetThreadId();
+  HolderSlot* free = nullptr;
+  HolderSlot* shortest = &mHolders[0];
+  for (HolderSlot& slot : mHolders) {
+    uint64_t id = Load(slot.mThread);
+    if (id == thread) {
+      Add(slot.mAcquisitions, 1);
+      Add(slot.mHoldNs, aHoldNs);
+      return;
+    }
+    if (!id && !free) {
+      free = &slot;
+    }
+    if (Load(slot.mHoldNs) < Load(shortest->mHoldNs)) {
+      shortest = &slot;
+    }
+  }
+
+  HolderSlot* slot = free ? free : shortest;
+  // A replaced thread's time is inherited, so the new one can't be evicted
+  // right away by the next thread taking the lock.
+  uint64_t inherited = free ? 0 : Load(slot->mHoldNs);
+  slot->mThread.store(thread, std::memory_order_relaxed);
+  slot->mName.store(LockProfiler::GetThreadName(), std::memory_order_relaxed);
+  slot->mAcquisitions.store(1, std::memory_order_relaxed);
+  slot->mHoldNs.store(inherited + aHoldNs, std::memory_order_relaxed);
+}
+
+LockProfile::Snapshot
+LockProfile::GetSnapshot() const
+{
+  Snapshot snapshot;
+  snapshot.mName = mName;
+  snapshot.mAcquisitions = Load(mAcquisitions);
+  snapshot.mContended = Load(mContended);
+  snapshot.mTotalWaitNs = Load(mTotalWaitNs);
+  snapshot.mMaxWaitNs = Load(mMaxWaitNs);
+  snapshot.mTotalHoldNs = Load(mTotalHoldNs);
+  snapshot.mMaxHoldNs = Load(mMaxHoldNs);
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    snapshot.mWait[i] = Load(mWait[i]);
+    snapshot.mHold[i] = Load(mHold[i]);
+  }
+  snapshot.mHolderCount = 0;
+  for (const HolderSlot& slot : mHolders) {
+    Holder holder;
+    holder.mThread = Load(slot.mThread);
+    if (!holder.mThread) {
+      continue;
+    }
+    holder.mName = slot.mName.load(std::memory_order_relaxed);
+    holder.mAcquisitions = Load(slot.mAcquisitions);
+    holder.mHoldNs = Load(slot.mHoldNs);
+    snapshot.mHolders[snapshot.mHolderCount++] = holder;
+  }
+  std::sort(snapshot.mHolders, snapshot.mHolders + snapshot.mHolderCount,
+            [](const Holder& aA, const Holder& aB) {
+              return aA.mHoldNs > aB.mHoldNs;
+            });
+  return snapshot;
+}
+
+/* static */ LockProfiler&
+LockProfiler::Global()
+{
+  // Never destroyed, since the global locks may be destroyed after it.
+  static LockProfiler* profiler = new LockProfiler();
+  return *profiler;
+}
+
+/* static */ void
+LockProfiler::SetThreadName(const char* aName)
+{
+  sThreadName = aName;
+}
+
+/* static */ const char*
+LockProfiler::GetThreadName()
+{
+  return sThreadName;
+}
+
+/* static */ uint64_t
+LockProfiler::GetThreadId()
+{
+  static thread_local uint64_t id = 0;
+  if (!id) {
+    id = std::hash<std::thread::id>()(std::this_thread::get_id());
+    if (!id) {
+      id = 1;
+    }
+  }
+  return id;
+}
+
+LockProfiler::LockProfiler()
+  : mReporting(false)
+{}
+
+void
+LockProfiler::Register(LockProfile* aProfile)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  mProfiles.push_back(aProfile);
+}
+
+void
+LockProfiler::Unregister(LockProfile* aProfile)
+{
+  std::lock_guard<std::mutex> guard(mMutex);
+  std::vector<LockProfile*>::iterator it =
+    std::find(mProfiles.begin(), mProfiles.end(), aProfile);
+  assert(it != mProfiles.end());
+  mProfiles.erase(it);
+}
+
+std::vector<LockProfile::Snapshot>
+LockProfiler::GetSnapshots() const
+{
+  std::vector<LockProfile::Snapshot> snapshots;
+  {
+    // The profiles can't be destroyed while being read.
+    std::lock_guard<std::mutex> guard(mMutex);
+    snapshots.reserve(mProfiles.size());
+    for (const LockProfile* profile : mProfiles) {
+      snapshots.push_back(profile->GetSnapshot());
+    }
+  }
+  std::sort(snapshots.begin(), snapshots.end(),
+            [](const LockProfile::Snapshot& aA,
+               const LockProfile::Snapshot& aB) {
+              return aA.mTotalWaitNs > aB.mTotalWaitNs;
+            });
+  return snapshots;
+}
+
+// The lower bound of the bucket holding the aPercent-th percentile of a
+// histogram of aCount values.
+static uint64_t
+PercentileNs(const uint64_t* aHistogram, uint64_t aCount, unsigned int aPercent)
+{
+  uint64_t rank = (aCount * aPercent + 99) / 100;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LockProfile::BUCKETS; ++i) {
+    seen += aHistogram[i];
+    if (seen >= rank) {
+      return CallbackTiming::Snapshot::BucketLowerBoundNs(i);
+    }
+  }
+  return 0;
+}
+
+static void
+ReportTimes(FILE* aOutput, const char* aLabel, const uint64_t* aHistogram,
+            uint64_t aCount, uint64_t aTotalNs, uint64_t aMaxNs)
+{
+  fprintf(aOutput,
+          "    %s: total %.1f us, mean %.1f us, p50 >= %.1f us, "
+          "p99 >= %.1f us, max %.1f us\n",
+          aLabel, aTotalNs / 1e3, aCount ? aTotalNs / 1e3 / aCount : 0.0,
+          PercentileNs(aHistogram, aCount, 50) / 1e3,
+          PercentileNs(aHistogram, aCount, 99) / 1e3, aMaxNs / 1e3);
+}
+
+void
+LockProfiler::Report(FILE* aOutput) const
+{
+  std::vector<LockProfile::Snapshot> snapshots = GetSnapshots();
+  fprintf(aOutput, "Lock contention: %zu locks\n", snapshots.size());
+  for (const LockProfile::Snapshot& lock : snapshots) {
+    fprintf(aOutput, "  %s: %llu acquisitions, %llu contended (%.2f%%)\n",
+            lock.mName ? lock.mName : "(unnamed)",
+            (unsigned long long) lock.mAcquisitions,
+            (unsigned long long) lock.mContended,
+            lock.mAcquisitions ? 100.0 * lock.mContended / lock.mAcquisitions
+                               : 0.0);
+    if (lock.mContended) {
+      ReportTimes(aOutput, "wait", lock.mWait, lock.mContended,
+                  lock.mTotalWaitNs, lock.mMaxWaitNs);
+    }
+    ReportTimes(aOutput, "hold", lock.mHold, lock.mAcquisitions,
+                lock.mTotalHoldNs, lock.mMaxHoldNs);
+    for (size_t i = 0; i < lock.mHolderCount; ++i) {
+      const LockProfile::Holder& holder = lock.mHolders[i];
+      if (holder.mName) {
+        fprintf(aOutput, "    holder %s", holder.mName);
+      } else {
+        fprintf(aOutput, "    holder thread %016llx",
+                (unsigned long long) holder.mThread);
+      }
+      fprintf(aOutput, ": %llu acquisitions, %.1f us held\n",
+              (unsigned long long) holder.mAcquisitions,
+              holder.mHoldNs / 1e3);
+    }
+  }
+  fflush(aOutput);
+}
+
+void
+LockProfiler::Start(FILE* aOutput, unsigned int aIntervalMs)
+{
+  std::lock_guard<std::mutex> guard(mReportMutex);
+  if (mReporting) {
+    return;
+  }
+  mReporting = true;
+  mReportThread = std::thread(&LockProfiler::RunReport, this, aOutput,
+                              aIntervalMs);
+}
+
+void
+LockProfiler::Stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(mReportMutex);
+    if (!mReporting) {
+      return;
+    }
+    mReporting = false;
+  }
+  mReportCondition.notify_one();
+  mReportThread.join();
+}
+
+void
+LockProfiler::RunReport(FILE* aOutput, unsigned int aIntervalMs)
+{
+  std::unique_lock<std::mutex> lock(mReportMutex);
+  while (mReporting) {
+    if (mReportCondition.wait_for(lock,
+                                  std::chrono::milliseconds(aIntervalMs),
+                                  [this] { return !mReporting; })) {
+      break;
+    }
+    lock.unlock();
+    Report(aOutput);
+    lock.lock();
+  }
+}
@@ -0,0 +1,161 @@
+#ifndef LOCKPROFILER_H
+#define LOCKPROFILER_H
+
+#include "CallbackTiming.h"   // CallbackTiming::Bucket
+#include "Host.h"             // NowNs
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <mutex>              // std::mutex
+#include <stddef.h>           // size_t
+#include <stdint.h>           // uint64_t
+#include <stdio.h>            // FILE
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+// The contention profile of one lock: how many times it's taken, how many of
+// those had to wait for another thread, log-scale histograms of the wait and
+// hold times, and the threads holding it the longest.
+//
+// Acquired and Released are only called with the lock held, so the lock
+// itself serializes the writers: the counters are updated with plain relaxed
+// loads and stores, without any locked read-modify-write, and the clock is
+// only read once more per acquisition for the hold time, and twice more when
+// it has to wait. That keeps it cheap enough to leave on in production.
+//
+// The readers, e.g. the report thread, read the counters without the lock, so
+// a snapshot taken while the lock is busy may be off by the acquisition in
+// progress.
+class LockProfile
+{
+public:
+  static const size_t BUCKETS = CallbackTiming::BUCKETS;
+  // The threads with the longest total hold times are kept. Once the table is
+  // full, a new thread replaces the one with the shortest, inheriting its
+  // time, so a thread holding the lock for long enough always shows up.
+  static const size_t HOLDERS = 8;
+
+  struct Holder
+  {
+    uint64_t mThread;     // A hash of the thread's id.
+    const char* mName;    // Set by LockProfiler::SetThreadName, or nullptr.
+    uint64_t mAcquisitions;
+    uint64_t mHoldNs;
+  };
+
+  struct Snapshot
+  {
+    const char* mName;
+    uint64_t mAcquisitions;
+    uint64_t mContended; // The acquisitions that had to wait.
+    uint64_t mTotalWaitNs;
+    uint64_t mMaxWaitNs;
+    uint64_t mTotalHoldNs;
+    uint64_t mMaxHoldNs;
+    uint64_t mWait[BUCKETS]; // Only the contended acquisitions.
+    uint64_t mHold[BUCKETS];
+    Holder mHolders[HOLDERS]; // By decreasing hold time.
+    size_t mHolderCount;
+  };
+
+  // Register the profile to LockProfiler::Global(). aName must outlive it.
+  explicit LockProfile(const char* aName);
+  ~LockProfile();
+
+  // The lock was just taken, after waiting aWaitNs if aContended.
+  void Acquired(bool aContended, uint64_t aWaitNs);
+  // The lock is about to be released.
+  void Released();
+
+  Snapshot GetSnapshot() const;
+
+private:
+  typedef std::atomic<uint64_t> Counter;
+
+  struct HolderSlot
+  {
+    Counter mThread; // 0 when free.
+    std::atomic<const char*> mName;
+    Counter mAcquisitions;
+    Counter mHoldNs;
+  };
+
+  static uint64_t Load(const Counter& aCounter)
+  {
+    return aCounter.load(std::memory_order_relaxed);
+  }
+  static void Add(Counter& aCounter, uint64_t aValue)
+  {
+    aCounter.store(Load(aCounter) + aValue, std::memory_order_relaxed);
+  }
+  static void Max(Counter& aCounter, uint64_t aValue)
+  {
+    if (aValue > Load(aCounter)) {
+      aCounter.store(aValue, std::memory_order_relaxed);
+    }
+  }
+
+  void RecordHolder(uint64_t aHoldNs);
+
+  // Not copyable: the profile is registered by address.
+  LockProfile(const LockProfile&);
+  LockProfile& operator=(const LockProfile&);
+
+  const char* mName;
+  Counter mAcquisitions;
+  Counter mContended;
+  Counter mTotalWaitNs;
+  Counter mMaxWaitNs;
+  Counter mTotalHoldNs;
+  Counter mMaxHoldNs;
+  Counter mWait[BUCKETS];
+  Counter mHold[BUCKETS];
+  HolderSlot mHolders[HOLDERS];
+  // Only touched by the holder of the lock.
+  uint64_t mAcquiredNs;
+};
+
+// The registry of the LockProfiles, which writes their report out, on
+// demand or periodically.
+class LockProfiler
+{
+public:
+  static LockProfiler& Global();
+
+  // Name the calling thread in the holder tables. aName must outlive the
+  // thread's locking.
+  static void SetThreadName(const char* aName);
+  static const char* GetThreadName();
+  // A hash of the calling thread's id, never 0.
+  static uint64_t GetThreadId();
+
+  void Register(LockProfile* aProfile);
+  void Unregister(LockProfile* aProfile);
+
+  std::vector<LockProfile::Snapshot> GetSnapshots() const;
+
+  // Write the report of all the registered locks, the most contended first.
+  void Report(FILE* aOutput) const;
+
+  // Write the report every aIntervalMs ms on a separate thread, until Stop.
+  void Start(FILE* aOutput = stderr, unsigned int aIntervalMs = 1000);
+  void Stop();
+
+private:
+  LockProfiler();
+
+  void RunReport(FILE* aOutput, unsigned int aIntervalMs);
+
+  // Not copyable: it's a process-wide singleton.
+  LockProfiler(const LockProfiler&);
+  LockProfiler& operator=(const LockProfiler&);
+
+  mutable std::mutex mMutex;
+  std::vector<LockProfile*> mProfiles;
+
+  std::mutex mReportMutex;
+  std::condition_variable mReportCondition; // Wakes the thread up to stop.
+  std::thread mReportThread;
+  bool mReporting; // Guarded by mReportMutex.
+};
+
+#endif // #ifndef LOCKPROFILER_H
@@ -0,0 +1,97 @@
+#include "NotifierThread.h"
+#include <cassert>
+
+NotifierThread::NotifierThread()
+  : mRunning(true)
+{
+  mThread = std::thread(&NotifierThread::Run, this);
+}
+
+NotifierThread::~NotifierThread()
+{
+  assert(!IsCurrentThread());
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    assert(mClients.empty());
+    mRunning = false;
+  }
+  mSignal.Post();
+  mThread.join();
+}
+
+/* static */ NotifierThread&
+NotifierThread::Global()
+{
+  // Never destroyed, since the global streams may be destroyed after it.
+  static NotifierThread* notifier = new NotifierThread();
+  return *notifier;
+}
+
+NotifierThread::Client*
+NotifierThread::Add(Callback aCallback, void* aContext)
+{
+  assert(aCallback);
+  std::lock_guard<std::mutex> guard(mMutex);
+  mClients.emplace_back(aCallback, aContext);
+  return &mClients.back();
+}
+
+void
+NotifierThread::Post(Client* aClient)
+{
+  // Only the first post since the last call wakes the thread up.
+  if (!aClient->mPending.exchange(true, std::memory_order_acq_rel)) {
+    mSignal.Post();
+  }
+}
+
+void
+NotifierThread::Remove(Client* aClient)
+{
+  assert(!IsCurrentThread());
+  std::unique_lock<std::mutex> lock(mMutex);
+  aClient->mRemoved = true;
+  lock.unlock();
+  Post(aClient);
+  lock.lock();
+  mRemovedCondition.wait(lock, [aClient] { return aClient->mDone; });
+  for (auto it = mClients.begin(); it != mClients.end(); ++it) {
+    if (&*it == aClient) {
+      mClients.erase(it);
+      break;
+    }
+  }
+}
+
+bool
+NotifierThread::IsCurrentThread() const
+{
+  return mThread.get_id() == std::this_thread::get_id();
+}
+
+void
+NotifierThread::Run()
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  while (mRunning) {
+    lock.unlock();
+    mSignal.Wait();
+    lock.lock();
+
+    // The clients can be added and removed while a callback runs, but not
+    // the one running, so the iterator stays valid.
+    for (Client& client : mClients) {
+      if (client.mPending.exchange(false, std::memory_order_acq_rel)) {
+        lock.unlock();
+        client.mCallback(client.mContext);
+        lock.lock();
+      }
+      // Done once a callback ran after the removal, with no post since.
+      if (client.mRemoved && !client.mDone &&
+          !client.mPending.load(std::memory_order_acquire)) {
+        client.mDone = true;
+        mRemovedCondition.notify_all();
+      }
+    }
+  }
+}
@@ -0,0 +1,78 @@
+#ifndef NOTIFIERTHREAD_H
+#define NOTIFIERTHREAD_H
+
+#include "WakeSignal.h"
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <list>               // std::list
+#include <mutex>              // std::mutex
+#include <thread>             // std::thread
+
+// Run, on a single thread, the work the real-time threads of many clients
+// hand over.
+//
+// A client is flagged by Post, which only sets its pending flag and posts a
+// WakeSignal, so it's wait-free and safe to call from the render thread. The
+// thread then runs the callbacks of the flagged clients, one at a time, and
+// sleeps in between: nothing is polled, and the clients cost no thread of
+// their own.
+class NotifierThread
+{
+public:
+  typedef void (* Callback)(void* aContext);
+
+  // Opaque to the clients, which only hold a pointer to theirs.
+  struct Client
+  {
+    Client(Callback aCallback, void* aContext)
+      : mCallback(aCallback)
+      , mContext(aContext)
+      , mPending(false)
+      , mRemoved(false)
+      , mDone(false)
+    {}
+
+    Callback mCallback;
+    void* mContext;
+    std::atomic<bool> mPending;
+    // Guarded by mMutex.
+    bool mRemoved;
+    bool mDone; // Removed, with its last callback run.
+  };
+
+  NotifierThread();
+  // All the clients must be removed first.
+  ~NotifierThread();
+
+  // The process-wide notifier, shared by all the streams. Its thread starts
+  // with the first call.
+  static NotifierThread& Global();
+
+  Client* Add(Callback aCallback, void* aContext);
+  // Have aClient's callback run. The posts made before it runs are coalesced
+  // into one call. It's safe to call this from any thread.
+  void Post(Client* aClient);
+  // Run aClient's callback a last time, then remove it. Once it returns, the
+  // callback is neither running nor will run again, so it must not be called
+  // from a callback.
+  void Remove(Client* aClient);
+
+  bool IsCurrentThread() const;
+
+private:
+  void Run();
+
+  // Not copyable: the thread runs on this object.
+  NotifierThread(const NotifierThread&);
+  NotifierThread& operator=(const NotifierThread&);
+
+  WakeSignal mSignal;
+  // Guards the clients, not the callbacks, which run without it.
+  std::mutex mMutex;
+  std::condition_variable mRemovedCondition;
+  std::list<Client> mClients;
+  bool mRunning;
+  std::thread mThread;
+};
+
+#endif // #ifndef NOTIFIERTHREAD_H
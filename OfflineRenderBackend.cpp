@@ -0,0 +1,312 @@
+#include "OfflineRenderBackend.h"
+#include <cassert>
+#include <chrono>     // std::chrono
+#include <cstring>    // memcpy, memset
+#include <fcntl.h>    // open
+#include <stdint.h>   // UINT32_MAX
+#include <sys/mman.h> // mmap, msync, munmap
+#include <unistd.h>   // close, ftruncate
+
+using Clock = std::chrono::steady_clock;
+
+// The RIFF header, the fmt chunk and the data chunk header.
+const size_t WAV_HEADER_BYTES = 44;
+const uint16_t WAVE_FORMAT_PCM = 1;
+const uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+
+static void
+PutLE16(uint8_t* aOut, uint16_t aValue)
+{
+  aOut[0] = static_cast<uint8_t>(aValue);
+  aOut[1] = static_cast<uint8_t>(aValue >> 8);
+}
+
+static void
+PutLE32(uint8_t* aOut, uint32_t aValue)
+{
+  PutLE16(aOut, static_cast<uint16_t>(aValue));
+  PutLE16(aOut + 2, static_cast<uint16_t>(aValue >> 16));
+}
+
+OfflineRenderBackend::OfflineRenderBackend(uint64_t aTotalFrames,
+                                           UInt32 aFramesPerBuffer)
+  : OfflineRenderBackend(std::string(), aTotalFrames, aFramesPerBuffer)
+{}
+
+OfflineRenderBackend::OfflineRenderBackend(const std::string& aPath,
+                                           uint64_t aTotalFrames,
+                                           UInt32 aFramesPerBuffer)
+  : mPath(aPath)
+  , mTotalFrames(aTotalFrames)
+  , mFramesPerBuffer(aFramesPerBuffer)
+  , mCallback(nullptr)
+  , mRefCon(nullptr)
+  , mCreated(false)
+  , mInitialized(false)
+  , mMapping(nullptr)
+  , mMappingSize(0)
+  , mData(nullptr)
+  , mRunning(false)
+  , mDone(false)
+  , mCallbacks(0)
+  , mFrames(0)
+  , mRenderNs(0)
+{
+  assert(mFramesPerBuffer);
+  memset(&mDesc, 0, sizeof(mDesc));
+}
+
+OfflineRenderBackend::~OfflineRenderBackend()
+{
+  assert(!mRunning && !mMapping);
+}
+
+bool
+OfflineRenderBackend::Create()
+{
+  assert(!mCreated);
+  mCreated = true;
+  return true;
+}
+
+bool
+OfflineRenderBackend::Destroy()
+{
+  assert(mCreated && !mInitialized);
+  mCreated = false;
+  return true;
+}
+
+bool
+OfflineRenderBackend::Init()
+{
+  assert(mCreated && !mInitialized);
+  if (!mDesc.mBytesPerFrame || !mCallback) {
+    return false;
+  }
+  if (mPath.empty()) {
+    mMemory.assign(mTotalFrames * mDesc.mBytesPerFrame, 0);
+    mData = mMemory.data();
+  } else if (!MapFile()) {
+    return false;
+  }
+  mFrames = 0;
+  mCallbacks = 0;
+  mRenderNs = 0;
+  mDone = !mTotalFrames;
+  mInitialized = true;
+  return true;
+}
+
+bool
+OfflineRenderBackend::Uninit()
+{
+  assert(mInitialized && !mRunning);
+  if (mMapping) {
+    UnmapFile();
+  }
+  mData = nullptr;
+  mInitialized = false;
+  return true;
+}
+
+bool
+OfflineRenderBackend::SetStreamFormat(const AudioStreamBasicDescription& aDesc)
+{
+  assert(mCreated && !mInitialized);
+  if (aDesc.mFormatID != kAudioFormatLinearPCM ||
+      (aDesc.mFormatFlags & kAudioFormatFlagIsNonInterleaved) ||
+      !aDesc.mSampleRate || !aDesc.mBytesPerFrame) {
+    return false;
+  }
+  if (!mPath.empty()) {
+    bool isFloat = aDesc.mFormatFlags & kAudioFormatFlagIsFloat;
+    bool bigEndian = aDesc.mFormatFlags & kAudioFormatFlagIsBigEndian;
+    if (bigEndian || aDesc.mBitsPerChannel != (isFloat ? 32u : 16u)) {
+      return false; // Not a WAV format.
+    }
+  }
+  mDesc = aDesc;
+  return true;
+}
+
+bool
+OfflineRenderBackend::SetCallback(AURenderCallback aCallback, void* aRefCon)
+{
+  assert(mCreated && !mRunning);
+  mCallback = aCallback;
+  mRefCon = aRefCon;
+  return true;
+}
+
+bool
+OfflineRenderBackend::Start()
+{
+  assert(mInitialized);
+  if (mRunning) {
+    return true; // Same as AudioOutputUnitStart on a running unit.
+  }
+  // Joined here rather than in Stop when the frames ran out.
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+  mRunning = true;
+  mThread = std::thread(&OfflineRenderBackend::Run, this);
+  return true;
+}
+
+bool
+OfflineRenderBackend::Stop()
+{
+  // This must not be called on the rendering thread, or it will wait forever.
+  assert(mThread.get_id() != std::this_thread::get_id());
+  mRunning = false;
+  if (mThread.joinable()) {
+    mThread.join();
+  }
+  return true;
+}
+
+bool
+OfflineRenderBackend::WaitUntilDone(unsigned int aTimeoutMs)
+{
+  std::unique_lock<std::mutex> lock(mMutex);
+  return mDoneCondition.wait_for(lock, std::chrono::milliseconds(aTimeoutMs),
+                                 [this] { return mDone; });
+}
+
+OfflineRenderBackend::Stats
+OfflineRenderBackend::GetStats() const
+{
+  Stats s;
+  s.mCallbacks = mCallbacks.load(std::memory_order_relaxed);
+  s.mFrames = mFrames.load(std::memory_order_acquire);
+  s.mRenderNs = mRenderNs.load(std::memory_order_relaxed);
+  return s;
+}
+
+size_t
+OfflineRenderBackend::GetDataSize() const
+{
+  return mFrames.load(std::memory_order_acquire) * mDesc.mBytesPerFrame;
+}
+
+void
+OfflineRenderBackend::Run()
+{
+  AudioBufferList list;
+  list.mNumberBuffers = 1;
+  list.mBuffers[0].mNumberChannels = mDesc.mChannelsPerFrame;
+
+  const Clock::time_point begin = Clock::now();
+  uint64_t frame = mFrames.load(std::memory_order_relaxed);
+  uint64_t callbacks = mCallbacks.load(std::memory_order_relaxed);
+  uint64_t renderNs = mRenderNs.load(std::memory_order_relaxed);
+  while (frame < mTotalFrames && mRunning.load(std::memory_order_acquire)) {
+    UInt32 frames = mTotalFrames - frame < mFramesPerBuffer ?
+      static_cast<UInt32>(mTotalFrames - frame) : mFramesPerBuffer;
+    // Render in place: the output is never copied.
+    list.mBuffers[0].mData = mData + frame * mDesc.mBytesPerFrame;
+    list.mBuffers[0].mDataByteSize = frames * mDesc.mBytesPerFrame;
+
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    // The sample time on the simulated timeline, whatever the wall clock.
+    timeStamp.mSampleTime = static_cast<Float64>(frame);
+    timeStamp.mHostTime = static_cast<UInt64>(
+      static_cast<double>(frame) * 1e9 / mDesc.mSampleRate);
+    timeStamp.mRateScalar = 1.0;
+    timeStamp.mFlags = kAudioTimeStampSampleHostTimeValid |
+                       kAudioTimeStampRateScalarValid;
+
+    AudioUnitRenderActionFlags flags = 0;
+    mCallback(mRefCon, &flags, &timeStamp, 0, frames, &list);
+
+    frame += frames;
+    mFrames.store(frame, std::memory_order_release);
+    mCallbacks.store(++callbacks, std::memory_order_relaxed);
+  }
+  renderNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - begin).count();
+  mRenderNs.store(renderNs, std::memory_order_relaxed);
+
+  if (frame == mTotalFrames) {
+    {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mDone = true;
+    }
+    mDoneCondition.notify_all();
+  }
+}
+
+bool
+OfflineRenderBackend::MapFile()
+{
+  // The RIFF sizes are 32-bit, and RF64 isn't supported.
+  if (mTotalFrames > (UINT32_MAX - WAV_HEADER_BYTES) / mDesc.mBytesPerFrame) {
+    return false;
+  }
+  int fd = open(mPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  size_t size = WAV_HEADER_BYTES + mTotalFrames * mDesc.mBytesPerFrame;
+  void* mapping = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  // The mapping keeps the file open.
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+  mMapping = static_cast<uint8_t*>(mapping);
+  mMappingSize = size;
+  mData = mMapping + WAV_HEADER_BYTES;
+  return true;
+}
+
+void
+OfflineRenderBackend::UnmapFile()
+{
+  uint64_t frames = mFrames.load(std::memory_order_acquire);
+  WriteWavHeader(frames);
+  msync(mMapping, mMappingSize, MS_SYNC);
+  munmap(mMapping, mMappingSize);
+  mMapping = nullptr;
+  mMappingSize = 0;
+
+  // Drop what wasn't rendered, if it was stopped early.
+  size_t size = WAV_HEADER_BYTES + frames * mDesc.mBytesPerFrame;
+  int fd = open(mPath.c_str(), O_RDWR);
+  if (fd >= 0) {
+    int r = ftruncate(fd, static_cast<off_t>(size));
+    assert(r == 0);
+    (void) r;
+    close(fd);
+  }
+}
+
+void
+OfflineRenderBackend::WriteWavHeader(uint64_t aFrames)
+{
+  bool isFloat = mDesc.mFormatFlags & kAudioFormatFlagIsFloat;
+  // No more than MapFile let through.
+  assert(aFrames <= mTotalFrames);
+  uint32_t dataBytes = static_cast<uint32_t>(aFrames * mDesc.mBytesPerFrame);
+  uint8_t* h = mMapping;
+  memcpy(h, "RIFF", 4);
+  PutLE32(h + 4, static_cast<uint32_t>(WAV_HEADER_BYTES - 8 + dataBytes));
+  memcpy(h + 8, "WAVE", 4);
+  memcpy(h + 12, "fmt ", 4);
+  PutLE32(h + 16, 16);
+  PutLE16(h + 20, isFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+  PutLE16(h + 22, static_cast<uint16_t>(mDesc.mChannelsPerFrame));
+  PutLE32(h + 24, static_cast<uint32_t>(mDesc.mSampleRate));
+  PutLE32(h + 28, static_cast<uint32_t>(mDesc.mSampleRate *
+                                        mDesc.mBytesPerFrame));
+  PutLE16(h + 32, static_cast<uint16_t>(mDesc.mBytesPerFrame));
+  PutLE16(h + 34, static_cast<uint16_t>(mDesc.mBitsPerChannel));
+  memcpy(h + 36, "data", 4);
+  PutLE32(h + 40, dataBytes);
+}
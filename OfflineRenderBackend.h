@@ -0,0 +1,99 @@
+#ifndef OFFLINERENDERBACKEND_H
+#define OFFLINERENDERBACKEND_H
+
+#include "AudioBackend.h"
+#include <atomic>             // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <mutex>              // std::mutex
+#include <stdint.h>           // uint8_t, uint64_t
+#include <string>             // std::string
+#include <thread>             // std::thread
+#include <vector>             // std::vector
+
+// A backend without a device or a clock, rendering a fixed number of frames
+// as fast as the CPU allows. Its thread fires the render callback back to
+// back, straight into the output: an in-memory buffer, or a WAV file mapped
+// in memory. The N-th callback carries a sample time of exactly
+// N * aFramesPerBuffer, and a host time of the same instant on the
+// simulated timeline, in ns, so the output only depends on the callback and
+// can be diffed bit-exactly. The last callback may ask for fewer frames.
+//
+// The frames must be interleaved. The WAV output takes the little-endian
+// formats: 16-bit PCM, or 32-bit float. The output is sized when the backend
+// is initialized, and the file is completed when it's uninitialized, with
+// the frames rendered so far. A WAV file holds up to 4 GiB, so Init fails
+// when the total frames don't fit.
+class OfflineRenderBackend: public AudioBackend
+{
+public:
+  struct Stats
+  {
+    uint64_t mCallbacks;
+    uint64_t mFrames;    // The frames rendered so far.
+    uint64_t mRenderNs;  // The wall-clock time spent rendering them.
+  };
+
+  // Render aTotalFrames frames into memory.
+  explicit OfflineRenderBackend(uint64_t aTotalFrames,
+                                UInt32 aFramesPerBuffer = 512);
+  // Render aTotalFrames frames into the WAV file at aPath.
+  OfflineRenderBackend(const std::string& aPath,
+                       uint64_t aTotalFrames,
+                       UInt32 aFramesPerBuffer = 512);
+  ~OfflineRenderBackend();
+
+  UInt32 GetMaxFramesPerBuffer() const override { return mFramesPerBuffer; }
+
+  bool Create() override;
+  bool Destroy() override;
+  bool Init() override;
+  bool Uninit() override;
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override;
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override;
+  bool Start() override;
+  bool Stop() override;
+
+  // Wait for all the frames to be rendered, for up to aTimeoutMs ms.
+  bool WaitUntilDone(unsigned int aTimeoutMs);
+  // It's safe to call this from any thread.
+  Stats GetStats() const;
+  // The frames rendered so far, in the stream format. Only valid while the
+  // backend is initialized and not rendering.
+  const uint8_t* GetData() const { return mData; }
+  size_t GetDataSize() const;
+
+private:
+  void Run();
+  bool MapFile();
+  void UnmapFile();
+  void WriteWavHeader(uint64_t aFrames);
+
+  const std::string mPath; // Empty for the in-memory output.
+  const uint64_t mTotalFrames;
+  const UInt32 mFramesPerBuffer;
+  AudioStreamBasicDescription mDesc;
+  AURenderCallback mCallback;
+  void* mRefCon;
+  bool mCreated;
+  bool mInitialized;
+
+  // The output. mData points into mMemory, or at the frames of the mapped
+  // file, after its header.
+  std::vector<uint8_t> mMemory;
+  uint8_t* mMapping;
+  size_t mMappingSize;
+  uint8_t* mData;
+
+  std::thread mThread;
+  std::atomic<bool> mRunning;
+  std::mutex mMutex;
+  std::condition_variable mDoneCondition;
+  bool mDone;
+
+  // Written by the rendering thread only.
+  std::atomic<uint64_t> mCallbacks;
+  std::atomic<uint64_t> mFrames;
+  std::atomic<uint64_t> mRenderNs;
+};
+
+#endif // #ifndef OFFLINERENDERBACKEND_H
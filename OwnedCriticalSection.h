@@ -3,42 +3,123 @@
 #ifndef OWNEDCRITICALSECTION_H
 #define OWNEDCRITICALSECTION_H
 
+#include "LockOrderValidator.h"
+#include "LockProfiler.h"
+#include <cassert>
+#include <errno.h> // EBUSY, EDEADLK
+#include <memory>  // std::unique_ptr
 #include <pthread.h>
 
-/* This wraps a critical section to track the owner in ERRORCHECK mode. */
+/* This wraps a critical section to track the owner in ERRORCHECK mode.
+ * A PRIO_INHERIT lock boosts its owner to the priority of the highest
+ * priority thread waiting for it, so a low priority thread holding it can't
+ * be preempted for long by the middle priority ones while the audio thread
+ * waits. An ADAPTIVE lock spins for a bounded while before sleeping, for the
+ * very short critical sections, where the owner releases it sooner than a
+ * sleep and a wake-up would take.
+ * With VALIDATE_LOCK_ORDER, every lock is checked by the LockOrderValidator,
+ * and aName, which must outlive the lock, names it in the reports.
+ * A PROFILED lock also records its contention into a LockProfile, reported
+ * by LockProfiler::Global() under aName. */
 class OwnedCriticalSection
 {
 public:
   enum Mode
   {
     NORMAL,
-    ERRORCHECK
+    ERRORCHECK,
+    PRIO_INHERIT,
+    ADAPTIVE
   };
 
-  OwnedCriticalSection(Mode aMode = NORMAL)
+  // How many times an ADAPTIVE lock retries before sleeping. Each retry
+  // pauses the core for a few dozen cycles.
+  static const unsigned int ADAPTIVE_SPINS = 100;
+
+  enum Profiling
+  {
+    UNPROFILED,
+    PROFILED
+  };
+
+  OwnedCriticalSection(Mode aMode = NORMAL,
+                       const char* aName = nullptr,
+                       Profiling aProfiling = UNPROFILED)
     : mMode(aMode)
+    , mName(aName)
+    , mProfile(aProfiling == PROFILED ? new LockProfile(aName) : nullptr)
   {
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, mMode == NORMAL ? PTHREAD_MUTEX_NORMAL :
-                                                       PTHREAD_MUTEX_ERRORCHECK);
-    assert(!pthread_mutex_init(&mMutex, &attr));
+    pthread_mutexattr_settype(&attr, mMode == ERRORCHECK ?
+                                       PTHREAD_MUTEX_ERRORCHECK :
+                                       PTHREAD_MUTEX_NORMAL);
+    int r = 0;
+    if (mMode == PRIO_INHERIT) {
+      r = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+      assert(!r);
+    }
+    r = pthread_mutex_init(&mMutex, &attr);
+    assert(!r);
+    (void) r;
     pthread_mutexattr_destroy(&attr);
   }
 
   ~OwnedCriticalSection()
   {
-    assert(!pthread_mutex_destroy(&mMutex));
+    if (VALIDATE_LOCK_ORDER) {
+      LockOrderValidator::Global().Forget(this);
+    }
+    int r = pthread_mutex_destroy(&mMutex);
+    assert(!r);
+    (void) r;
   }
 
   void lock()
   {
-    assert(!pthread_mutex_lock(&mMutex));
+    if (VALIDATE_LOCK_ORDER) {
+      LockOrderValidator::Global().WillLock(this, mName);
+    }
+    // Not in the assert, which would compile the locking out with NDEBUG.
+    int r = mProfile ? ProfiledLock() : Lock();
+    assert(!r);
+    (void) r;
+    if (VALIDATE_LOCK_ORDER) {
+      LockOrderValidator::Global().DidLock(this);
+    }
+  }
+
+  // Take the lock only if it's free, or gets free within aSpins retries. It
+  // never sleeps, so the render thread can use it, falling back to something
+  // else when it fails, e.g. through a TryGuard. Not being able to block,
+  // it's not reported on a render thread by the LockOrderValidator.
+  bool try_lock(unsigned int aSpins = 0)
+  {
+    int r = Spin(aSpins);
+    assert(!r || r == EBUSY);
+    if (r) {
+      return false;
+    }
+    if (mProfile) {
+      mProfile->Acquired(false, 0);
+    }
+    if (VALIDATE_LOCK_ORDER) {
+      LockOrderValidator::Global().DidLock(this);
+    }
+    return true;
   }
 
   void unlock()
   {
-    assert(!pthread_mutex_unlock(&mMutex));
+    if (mProfile) {
+      mProfile->Released();
+    }
+    int r = pthread_mutex_unlock(&mMutex);
+    assert(!r);
+    (void) r;
+    if (VALIDATE_LOCK_ORDER) {
+      LockOrderValidator::Global().DidUnlock(this);
+    }
   }
 
   void assertCurrentThreadOwns()
@@ -49,9 +130,107 @@ public:
     assert(pthread_mutex_lock(&mMutex) == EDEADLK);
   }
 
+  // The contention profile of a PROFILED lock, or nullptr.
+  const LockProfile* GetProfile() const { return mProfile.get(); }
+
+  // What a TryGuard does when the lock stays busy.
+  enum Fallback
+  {
+    SKIP, // Give up: the caller does without the lock.
+    BLOCK // Wait for it, where a late result is better than none.
+  };
+
+  // Hold aLock while in scope if it can be taken within aSpins retries, or
+  // whatever aFallback says. The render thread checks OwnsLock() and, with
+  // SKIP, goes on without the shared state, e.g. rendering silence or
+  // keeping the previous parameters, rather than wait for a control thread.
+  class TryGuard
+  {
+  public:
+    explicit TryGuard(OwnedCriticalSection& aLock,
+                      Fallback aFallback = SKIP,
+                      unsigned int aSpins = ADAPTIVE_SPINS)
+      : mLock(aLock)
+      , mOwns(aLock.try_lock(aSpins))
+    {
+      if (!mOwns && aFallback == BLOCK) {
+        mLock.lock();
+        mOwns = true;
+      }
+    }
+
+    ~TryGuard()
+    {
+      if (mOwns) {
+        mLock.unlock();
+      }
+    }
+
+    bool OwnsLock() const { return mOwns; }
+
+  private:
+    OwnedCriticalSection& mLock;
+    bool mOwns;
+
+    TryGuard(const TryGuard&);
+    TryGuard& operator=(const TryGuard&);
+  };
+
 private:
+  // Retry a busy lock aSpins times before giving up with EBUSY.
+  int Spin(unsigned int aSpins)
+  {
+    int r = pthread_mutex_trylock(&mMutex);
+    for (unsigned int i = 0; r == EBUSY && i < aSpins; ++i) {
+      Pause();
+      r = pthread_mutex_trylock(&mMutex);
+    }
+    return r;
+  }
+
+  int Lock()
+  {
+    if (mMode != ADAPTIVE) {
+      return pthread_mutex_lock(&mMutex);
+    }
+    int r = Spin(ADAPTIVE_SPINS);
+    return r == EBUSY ? pthread_mutex_lock(&mMutex) : r;
+  }
+
+  // Tell the core it's in a spin-wait loop, which saves power and lets the
+  // sibling hyper-thread, maybe the owner, run.
+  static void Pause()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+  }
+
+  // Only time the wait when the lock is busy, so an uncontended lock costs a
+  // single clock read, for its hold time.
+  int ProfiledLock()
+  {
+    int r = pthread_mutex_trylock(&mMutex);
+    if (r != EBUSY) {
+      if (!r) {
+        mProfile->Acquired(false, 0);
+      }
+      return r;
+    }
+    uint64_t start = NowNs();
+    r = Lock();
+    if (!r) {
+      mProfile->Acquired(true, NowNs() - start);
+    }
+    return r;
+  }
+
   pthread_mutex_t mMutex;
   Mode mMode;
+  const char* mName;
+  std::unique_ptr<LockProfile> mProfile;
 
   // Disallow copy and assignment because pthread_mutex_t cannot be copied.
   OwnedCriticalSection(const OwnedCriticalSection&);
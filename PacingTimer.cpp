@@ -0,0 +1,154 @@
+#include "PacingTimer.h"
+#include <cassert>
+#include <cmath>    // sqrt
+#include <thread>   // std::this_thread
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#include <emmintrin.h> // _mm_pause
+#endif
+
+static uint64_t
+ElapsedNs(PacingTimer::Clock::time_point aFrom,
+          PacingTimer::Clock::time_point aTo)
+{
+  return aTo <= aFrom ? 0 :
+    std::chrono::duration_cast<std::chrono::nanoseconds>(aTo - aFrom).count();
+}
+
+// Let the other hardware thread of the core run while spinning.
+static inline void
+CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Only the waiting thread writes the stats, so a plain load/store is enough.
+template<typename T>
+static void
+Accumulate(std::atomic<T>& aTotal, T aValue)
+{
+  aTotal.store(aTotal.load(std::memory_order_relaxed) + aValue,
+               std::memory_order_relaxed);
+}
+
+PacingTimer::PacingTimer(uint64_t aSpinMarginNs)
+  : mSpinMarginNs(aSpinMarginNs)
+  , mOrigin(Clock::now())
+  , mPeriodNs(0)
+  , mTick(0)
+{
+  ResetStats();
+}
+
+uint64_t
+PacingTimer::WaitUntil(Clock::time_point aDeadline)
+{
+  Clock::time_point now = Clock::now();
+  bool overslept = false;
+  if (now < aDeadline) {
+    std::chrono::nanoseconds margin(mSpinMarginNs);
+    if (aDeadline - now > margin) {
+      std::this_thread::sleep_until(aDeadline - margin);
+      now = Clock::now();
+      overslept = now > aDeadline;
+    }
+  }
+  Clock::time_point spinStart = now;
+  while (now < aDeadline) {
+    CpuRelax();
+    now = Clock::now();
+  }
+  uint64_t lateness = ElapsedNs(aDeadline, now);
+  Record(lateness, ElapsedNs(spinStart, now), overslept);
+  return lateness;
+}
+
+uint64_t
+PacingTimer::WaitFor(uint64_t aNs)
+{
+  return WaitUntil(Clock::now() + std::chrono::nanoseconds(aNs));
+}
+
+void
+PacingTimer::StartTicks(uint64_t aPeriodNs)
+{
+  assert(aPeriodNs);
+  mPeriodNs = aPeriodNs;
+  mTick = 0;
+  mOrigin = Clock::now();
+}
+
+uint64_t
+PacingTimer::WaitForNextTick()
+{
+  assert(mPeriodNs);
+  ++mTick;
+  // Skip the ticks already over, but the last one.
+  Clock::time_point now = Clock::now();
+  while (GetTickTime(mTick + 1) <= now) {
+    ++mTick;
+    Accumulate(mSkippedTicks, uint64_t(1));
+  }
+  WaitUntil(GetTickTime(mTick));
+  return mTick;
+}
+
+PacingTimer::Clock::time_point
+PacingTimer::GetTickTime(uint64_t aTick) const
+{
+  return mOrigin + std::chrono::nanoseconds(aTick * mPeriodNs);
+}
+
+PacingTimer::Stats
+PacingTimer::GetStats() const
+{
+  Stats s;
+  s.mWaits = mWaits.load(std::memory_order_relaxed);
+  s.mOversleeps = mOversleeps.load(std::memory_order_relaxed);
+  s.mSkippedTicks = mSkippedTicks.load(std::memory_order_relaxed);
+  s.mTotalSpinNs = mTotalSpinNs.load(std::memory_order_relaxed);
+  s.mMaxLatenessNs = mMaxLatenessNs.load(std::memory_order_relaxed);
+  s.mMeanLatenessNs = 0.0;
+  s.mJitterNs = 0.0;
+  if (s.mWaits) {
+    double total = mTotalLatenessNs.load(std::memory_order_relaxed);
+    double squared = mTotalSquaredLatenessNs.load(std::memory_order_relaxed);
+    s.mMeanLatenessNs = total / s.mWaits;
+    double variance = squared / s.mWaits -
+                      s.mMeanLatenessNs * s.mMeanLatenessNs;
+    s.mJitterNs = variance > 0.0 ? sqrt(variance) : 0.0;
+  }
+  return s;
+}
+
+void
+PacingTimer::ResetStats()
+{
+  mWaits.store(0, std::memory_order_relaxed);
+  mOversleeps.store(0, std::memory_order_relaxed);
+  mSkippedTicks.store(0, std::memory_order_relaxed);
+  mTotalSpinNs.store(0, std::memory_order_relaxed);
+  mMaxLatenessNs.store(0, std::memory_order_relaxed);
+  mTotalLatenessNs.store(0.0, std::memory_order_relaxed);
+  mTotalSquaredLatenessNs.store(0.0, std::memory_order_relaxed);
+}
+
+void
+PacingTimer::Record(uint64_t aLatenessNs, uint64_t aSpinNs, bool aOverslept)
+{
+  Accumulate(mWaits, uint64_t(1));
+  if (aOverslept) {
+    Accumulate(mOversleeps, uint64_t(1));
+  }
+  Accumulate(mTotalSpinNs, aSpinNs);
+  if (aLatenessNs > mMaxLatenessNs.load(std::memory_order_relaxed)) {
+    mMaxLatenessNs.store(aLatenessNs, std::memory_order_relaxed);
+  }
+  double lateness = static_cast<double>(aLatenessNs);
+  Accumulate(mTotalLatenessNs, lateness);
+  Accumulate(mTotalSquaredLatenessNs, lateness * lateness);
+}
@@ -0,0 +1,80 @@
+#ifndef PACINGTIMER_H
+#define PACINGTIMER_H
+
+#include <atomic>   // std::atomic
+#include <chrono>   // std::chrono
+#include <stdint.h> // uint64_t
+
+// Wait for absolute deadlines on the monotonic clock, to within a few
+// microseconds, without burning a core.
+//
+// A wait sleeps until the spin margin before its deadline, which leaves
+// the scheduler that much room to wake the thread up late, then spins on
+// the clock for the rest. A wider margin trades CPU for precision. A zero
+// margin only sleeps.
+//
+// The periodic ticks are at fixed offsets from the first one, so the
+// lateness of a wait never carries over to the next ones. When a tick is
+// already over by the time it's waited for, it's skipped, like the periods a
+// late device drops.
+//
+// Only one thread waits on a timer. The stats can be read from any thread.
+class PacingTimer
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  static const uint64_t DEFAULT_SPIN_MARGIN_NS = 200000;
+
+  struct Stats
+  {
+    uint64_t mWaits;
+    uint64_t mOversleeps;     // Waits whose sleep alone overshot the deadline.
+    uint64_t mSkippedTicks;
+    uint64_t mTotalSpinNs;    // The CPU time the spins burned.
+    uint64_t mMaxLatenessNs;  // How long after their deadlines waits return.
+    double mMeanLatenessNs;
+    double mJitterNs;         // The standard deviation of the lateness.
+  };
+
+  explicit PacingTimer(uint64_t aSpinMarginNs = DEFAULT_SPIN_MARGIN_NS);
+
+  void SetSpinMargin(uint64_t aSpinMarginNs) { mSpinMarginNs = aSpinMarginNs; }
+  uint64_t GetSpinMargin() const { return mSpinMarginNs; }
+
+  // Return once aDeadline is reached, never before, with how late it is, in
+  // ns. It returns right away if aDeadline is already over.
+  uint64_t WaitUntil(Clock::time_point aDeadline);
+  uint64_t WaitFor(uint64_t aNs);
+
+  // Tick every aPeriodNs from now on. The first tick is now.
+  void StartTicks(uint64_t aPeriodNs);
+  // Wait for the next tick, and return its number. The ticks missed while
+  // the caller was busy are skipped.
+  uint64_t WaitForNextTick();
+  // When the tick aTick is due.
+  Clock::time_point GetTickTime(uint64_t aTick) const;
+
+  Stats GetStats() const;
+  void ResetStats();
+
+private:
+  void Record(uint64_t aLatenessNs, uint64_t aSpinNs, bool aOverslept);
+
+  uint64_t mSpinMarginNs;
+
+  Clock::time_point mOrigin;
+  uint64_t mPeriodNs;
+  uint64_t mTick;
+
+  // Written by the waiting thread only.
+  std::atomic<uint64_t> mWaits;
+  std::atomic<uint64_t> mOversleeps;
+  std::atomic<uint64_t> mSkippedTicks;
+  std::atomic<uint64_t> mTotalSpinNs;
+  std::atomic<uint64_t> mMaxLatenessNs;
+  std::atomic<double> mTotalLatenessNs;
+  std::atomic<double> mTotalSquaredLatenessNs;
+};
+
+#endif // #ifndef PACINGTIMER_H
@@ -0,0 +1,273 @@
+#include "RealtimeLog.h"
+#include <cassert> // assert
+#include <chrono>  // std::chrono
+#include <cstring> // strchr, strlen
+
+// The longest line written out. The longer ones are truncated.
+const size_t LINE_SIZE = 1024;
+
+RealtimeLogger::RealtimeLogger(FILE* aOutput)
+  : mOutput(aOutput)
+  , mEnqueuePosition(0)
+  , mDequeuePosition(0)
+  , mLogged(0)
+  , mDropped(0)
+  , mWritten(0)
+  , mReportedDrops(0)
+  , mDraining(false)
+{
+  static_assert(!(SLOTS & (SLOTS - 1)), "SLOTS must be a power of two!");
+  assert(aOutput);
+  for (size_t i = 0; i < SLOTS; ++i) {
+    mSlots[i].mSequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+RealtimeLogger::~RealtimeLogger()
+{
+  Stop();
+  Drain();
+}
+
+/* static */ RealtimeLogger&
+RealtimeLogger::Global()
+{
+  // Never destroyed, since the global streams may log after it would be.
+  static RealtimeLogger* logger = new RealtimeLogger();
+  return *logger;
+}
+
+void
+RealtimeLogger::Start(unsigned int aIntervalMs)
+{
+  if (mDraining) {
+    return;
+  }
+  mDraining = true;
+  mDrainThread = std::thread(&RealtimeLogger::RunDrain, this, aIntervalMs);
+}
+
+void
+RealtimeLogger::Stop()
+{
+  if (!mDraining) {
+    return;
+  }
+  mDraining = false;
+  mDrainThread.join();
+  Drain();
+}
+
+RealtimeLogger::Stats
+RealtimeLogger::GetStats() const
+{
+  Stats stats;
+  stats.mLogged = mLogged.load(std::memory_order_relaxed);
+  stats.mDropped = mDropped.load(std::memory_order_relaxed);
+  stats.mWritten = mWritten.load(std::memory_order_relaxed);
+  return stats;
+}
+
+size_t
+RealtimeLogger::Drain()
+{
+  std::lock_guard<std::mutex> guard(mDrainMutex);
+  char line[LINE_SIZE];
+  size_t written = 0;
+
+  while (true) {
+    Slot& slot = mSlots[mDequeuePosition & (SLOTS - 1)];
+    if (slot.mSequence.load(std::memory_order_acquire) !=
+        mDequeuePosition + 1) {
+      break; // Empty, or the next message is still being written.
+    }
+    size_t length = Format(slot, line, sizeof(line));
+    // Hand the slot back for the position one lap ahead.
+    slot.mSequence.store(mDequeuePosition + SLOTS, std::memory_order_release);
+    ++mDequeuePosition;
+    fwrite(line, 1, length, mOutput);
+    ++written;
+  }
+
+  uint64_t dropped = mDropped.load(std::memory_order_relaxed);
+  if (dropped != mReportedDrops) {
+    fprintf(mOutput, "[RealtimeLogger] %llu messages dropped\n",
+            static_cast<unsigned long long>(dropped - mReportedDrops));
+    mReportedDrops = dropped;
+  }
+  fflush(mOutput);
+  mWritten.fetch_add(written, std::memory_order_relaxed);
+  return written;
+}
+
+RealtimeLogger::Slot*
+RealtimeLogger::Claim()
+{
+  size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+  while (true) {
+    Slot* slot = &mSlots[position & (SLOTS - 1)];
+    size_t sequence = slot->mSequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      // Free for this position. Take it unless another thread did.
+      if (mEnqueuePosition.compare_exchange_weak(position, position + 1,
+                                                 std::memory_order_relaxed)) {
+        return slot;
+      }
+      // position has been reloaded by the failed exchange.
+    } else if (static_cast<ptrdiff_t>(sequence - position) < 0) {
+      // Still holding the message from the previous lap: the queue is full.
+      return nullptr;
+    } else {
+      position = mEnqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void
+RealtimeLogger::Publish(Slot* aSlot)
+{
+  size_t position = aSlot->mSequence.load(std::memory_order_relaxed);
+  aSlot->mSequence.store(position + 1, std::memory_order_release);
+}
+
+void
+RealtimeLogger::RunDrain(unsigned int aIntervalMs)
+{
+  // Poll rather than being woken up: a wake-up from Log would take a lock
+  // on the audio thread.
+  while (mDraining.load(std::memory_order_acquire)) {
+    Drain();
+    std::this_thread::sleep_for(std::chrono::milliseconds(aIntervalMs));
+  }
+}
+
+// Append the formatted aArg to aBuffer. aSpec is a single printf conversion
+// without its length modifier.
+static size_t
+FormatArg(char* aBuffer, size_t aSize, const char* aSpec, char aConversion,
+          int64_t aInt, uint64_t aUInt, double aDouble, const void* aPointer,
+          const char* aString)
+{
+  int n = 0;
+  switch (aConversion) {
+    case 'd': case 'i':
+      n = snprintf(aBuffer, aSize, aSpec, static_cast<long long>(aInt));
+      break;
+    case 'u': case 'o': case 'x': case 'X':
+      n = snprintf(aBuffer, aSize, aSpec,
+                   static_cast<unsigned long long>(aUInt));
+      break;
+    case 'c':
+      n = snprintf(aBuffer, aSize, aSpec, static_cast<int>(aInt));
+      break;
+    case 'e': case 'E': case 'f': case 'F':
+    case 'g': case 'G': case 'a': case 'A':
+      n = snprintf(aBuffer, aSize, aSpec, aDouble);
+      break;
+    case 's':
+      n = snprintf(aBuffer, aSize, aSpec, aString ? aString : "(null)");
+      break;
+    case 'p':
+      n = snprintf(aBuffer, aSize, aSpec, aPointer);
+      break;
+    default:
+      n = snprintf(aBuffer, aSize, "%s", "<?>");
+      break;
+  }
+  if (n < 0) {
+    return 0;
+  }
+  return static_cast<size_t>(n) < aSize ? n : aSize - 1;
+}
+
+/* static */ size_t
+RealtimeLogger::Format(const Slot& aSlot, char* aBuffer, size_t aSize)
+{
+  assert(aSize);
+  size_t length = 0;
+  size_t next = 0;
+  const char* f = aSlot.mFormat;
+
+  while (*f && length + 1 < aSize) {
+    if (*f != '%') {
+      aBuffer[length++] = *f++;
+      continue;
+    }
+    if (f[1] == '%') {
+      aBuffer[length++] = '%';
+      f += 2;
+      continue;
+    }
+
+    // Copy the flags, the width and the precision, drop the length modifier
+    // and put the one matching the captured width back.
+    char spec[32] = "%";
+    size_t s = 1;
+    ++f;
+    while (*f && strchr("-+ #0123456789.", *f) && s < sizeof(spec) - 4) {
+      spec[s++] = *f++;
+    }
+    while (*f && strchr("hlLqjzt", *f)) {
+      ++f;
+    }
+    char conversion = *f;
+    if (!conversion) {
+      break;
+    }
+    ++f;
+    if (strchr("diuoxX", conversion)) {
+      spec[s++] = 'l';
+      spec[s++] = 'l';
+    }
+    spec[s++] = conversion;
+    spec[s] = '\0';
+
+    if (next >= aSlot.mArgCount) {
+      length += FormatArg(aBuffer + length, aSize - length, "%s", 's',
+                          0, 0, 0.0, nullptr, "<missing>");
+      continue;
+    }
+
+    // Convert the captured argument to whatever the conversion expects.
+    const Arg& arg = aSlot.mArgs[next++];
+    int64_t i = 0;
+    uint64_t u = 0;
+    double d = 0.0;
+    const void* p = nullptr;
+    const char* str = nullptr;
+    switch (arg.mType) {
+      case Arg::Int:
+        i = arg.mInt;
+        u = static_cast<uint64_t>(arg.mInt);
+        d = static_cast<double>(arg.mInt);
+        break;
+      case Arg::UInt:
+        i = static_cast<int64_t>(arg.mUInt);
+        u = arg.mUInt;
+        d = static_cast<double>(arg.mUInt);
+        break;
+      case Arg::Double:
+        i = static_cast<int64_t>(arg.mDouble);
+        u = static_cast<uint64_t>(arg.mDouble);
+        d = arg.mDouble;
+        break;
+      case Arg::String:
+        p = arg.mString;
+        str = arg.mString;
+        break;
+      case Arg::Pointer:
+        p = arg.mPointer;
+        u = reinterpret_cast<uintptr_t>(arg.mPointer);
+        i = static_cast<int64_t>(u);
+        break;
+    }
+    if (conversion == 's' && arg.mType != Arg::String) {
+      str = "<?>";
+    }
+    length += FormatArg(aBuffer + length, aSize - length, spec, conversion,
+                        i, u, d, p, str);
+  }
+
+  aBuffer[length] = '\0';
+  return length;
+}
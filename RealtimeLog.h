@@ -0,0 +1,192 @@
+#ifndef REALTIMELOG_H
+#define REALTIMELOG_H
+
+#include <atomic>      // std::atomic
+#include <mutex>       // std::mutex
+#include <stddef.h>    // size_t
+#include <stdint.h>    // int64_t, uint64_t
+#include <stdio.h>     // FILE
+#include <thread>      // std::thread
+#include <type_traits> // std::enable_if, std::is_integral, ...
+
+#ifndef ENABLE_LOG
+#define ENABLE_LOG true
+#endif
+
+// Log from the audio callbacks. With ENABLE_LOG false, the calls are
+// compiled out, arguments included.
+#if ENABLE_LOG
+#define RT_LOG(...) ((void)RealtimeLogger::Global().Log(__VA_ARGS__))
+#else
+#define RT_LOG(...) ((void)0)
+#endif
+
+// A logger that is safe to call on a real-time thread. Log only copies the
+// format pointer and the raw arguments into one of the preallocated slots of
+// a lock-free queue; the formatting and the I/O happen later, on the drain
+// thread. Log never locks, allocates or waits: when the queue is full, the
+// message is dropped and counted.
+//
+// The format must be a string literal, and so must the %s arguments, or
+// anything else outliving the drain. The conversions are printf's, with the
+// length modifiers ignored since the arguments are captured at their full
+// width.
+class RealtimeLogger
+{
+public:
+  static const size_t SLOTS = 1024; // A power of two.
+  static const size_t MAX_ARGS = 8;
+
+  struct Stats
+  {
+    uint64_t mLogged;  // Messages queued.
+    uint64_t mDropped; // Messages lost to a full queue.
+    uint64_t mWritten; // Messages formatted and written out.
+  };
+
+  explicit RealtimeLogger(FILE* aOutput = stderr);
+  ~RealtimeLogger();
+
+  // The process-wide logger used by RT_LOG, writing to stderr. It's created
+  // on the first call, so make one before the audio threads start.
+  static RealtimeLogger& Global();
+
+  // Start or stop the drain thread, which writes the queued messages out
+  // every aIntervalMs ms. Stop drains what is left. Neither is real-time
+  // safe.
+  void Start(unsigned int aIntervalMs = 10);
+  void Stop();
+
+  // Format and write the queued messages out on the calling thread. Return
+  // the number of messages written. It's not real-time safe.
+  size_t Drain();
+
+  // It's safe to call this from any thread.
+  Stats GetStats() const;
+
+  // Queue a message. Return false if it's dropped. It's real-time safe and
+  // can be called from any number of threads.
+  template<typename... Args>
+  bool Log(const char* aFormat, Args... aArgs)
+  {
+    static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments to log!");
+    Slot* slot = Claim();
+    if (!slot) {
+      mDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    slot->mFormat = aFormat;
+    slot->mArgCount = sizeof...(Args);
+    Capture(slot->mArgs, aArgs...);
+    Publish(slot);
+    mLogged.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+private:
+  struct Arg
+  {
+    enum Type { Int, UInt, Double, String, Pointer } mType;
+    union
+    {
+      int64_t mInt;
+      uint64_t mUInt;
+      double mDouble;
+      const char* mString;
+      const void* mPointer;
+    };
+  };
+
+  struct Slot
+  {
+    // Equal to the queue position when the slot is free for that position,
+    // and to the position + 1 once the message at that position is written.
+    std::atomic<size_t> mSequence;
+    const char* mFormat;
+    size_t mArgCount;
+    Arg mArgs[MAX_ARGS];
+  };
+
+  template<typename T>
+  static typename std::enable_if<std::is_integral<T>::value &&
+                                 std::is_signed<T>::value, Arg>::type
+  MakeArg(T aValue)
+  {
+    Arg arg;
+    arg.mType = Arg::Int;
+    arg.mInt = aValue;
+    return arg;
+  }
+  template<typename T>
+  static typename std::enable_if<std::is_integral<T>::value &&
+                                 std::is_unsigned<T>::value, Arg>::type
+  MakeArg(T aValue)
+  {
+    Arg arg;
+    arg.mType = Arg::UInt;
+    arg.mUInt = aValue;
+    return arg;
+  }
+  template<typename T>
+  static typename std::enable_if<std::is_floating_point<T>::value, Arg>::type
+  MakeArg(T aValue)
+  {
+    Arg arg;
+    arg.mType = Arg::Double;
+    arg.mDouble = aValue;
+    return arg;
+  }
+  template<typename T>
+  static typename std::enable_if<std::is_enum<T>::value, Arg>::type
+  MakeArg(T aValue)
+  {
+    return MakeArg(static_cast<typename std::underlying_type<T>::type>(aValue));
+  }
+  static Arg MakeArg(const char* aValue)
+  {
+    Arg arg;
+    arg.mType = Arg::String;
+    arg.mString = aValue;
+    return arg;
+  }
+  static Arg MakeArg(const void* aValue)
+  {
+    Arg arg;
+    arg.mType = Arg::Pointer;
+    arg.mPointer = aValue;
+    return arg;
+  }
+
+  static void Capture(Arg* aArgs) {}
+  template<typename T, typename... Rest>
+  static void Capture(Arg* aArgs, T aFirst, Rest... aRest)
+  {
+    *aArgs = MakeArg(aFirst);
+    Capture(aArgs + 1, aRest...);
+  }
+
+  Slot* Claim();
+  void Publish(Slot* aSlot);
+  void RunDrain(unsigned int aIntervalMs);
+  // Format the message in aSlot into aBuffer. Return its length.
+  static size_t Format(const Slot& aSlot, char* aBuffer, size_t aSize);
+
+  // Not copyable: the slots are shared with the logging threads.
+  RealtimeLogger(const RealtimeLogger&);
+  RealtimeLogger& operator=(const RealtimeLogger&);
+
+  FILE* mOutput;
+  Slot mSlots[SLOTS];
+  std::atomic<size_t> mEnqueuePosition;
+  size_t mDequeuePosition; // Guarded by mDrainMutex.
+  std::mutex mDrainMutex;  // Only taken by the draining threads.
+  std::atomic<uint64_t> mLogged;
+  std::atomic<uint64_t> mDropped;
+  std::atomic<uint64_t> mWritten;
+  uint64_t mReportedDrops; // Guarded by mDrainMutex.
+
+  std::thread mDrainThread;
+  std::atomic<bool> mDraining;
+};
+
+#endif // #ifndef REALTIMELOG_H
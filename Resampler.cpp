@@ -0,0 +1,300 @@
+#include "Resampler.h"
+#include <cassert>
+#include <cmath>   // fmod, round, sin, sqrt
+#include <cstring> // memmove, memset
+
+#if defined(__AVX2__)
+#define SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+const double PI = 3.14159265358979323846;
+
+struct Tier
+{
+  size_t mTaps;     // A multiple of 16, for the vector loops.
+  double mBeta;     // The Kaiser window's shape.
+  double mPassband; // The cutoff, as a fraction of the lower Nyquist rate.
+};
+
+static const Tier TIERS[] = {
+  { 16, 5.0, 0.80 },  // LOW
+  { 32, 7.0, 0.88 },  // MEDIUM
+  { 64, 9.0, 0.94 }   // HIGH
+};
+
+static uint64_t
+Gcd(uint64_t aA, uint64_t aB)
+{
+  while (aB) {
+    uint64_t r = aA % aB;
+    aA = aB;
+    aB = r;
+  }
+  return aA;
+}
+
+// The zeroth-order modified Bessel function of the first kind.
+static double
+BesselI0(double aX)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  double quarter = aX * aX / 4.0;
+  for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+    term *= quarter / (k * k);
+    sum += term;
+  }
+  return sum;
+}
+
+static double
+Sinc(double aX)
+{
+  return aX == 0.0 ? 1.0 : sin(PI * aX) / (PI * aX);
+}
+
+#if defined(SIMD_AVX2)
+
+static inline float
+Dot(const float* aA, const float* aB, size_t aSize)
+{
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (size_t i = 0; i < aSize; i += 16) {
+    acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(aA + i),
+                                             _mm256_loadu_ps(aB + i)));
+    acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(aA + i + 8),
+                                             _mm256_loadu_ps(aB + i + 8)));
+  }
+  __m256 sum = _mm256_add_ps(acc0, acc1);
+  __m128 v = _mm_add_ps(_mm256_castps256_ps128(sum),
+                        _mm256_extractf128_ps(sum, 1));
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+#elif defined(SIMD_SSE2)
+
+static inline float
+Dot(const float* aA, const float* aB, size_t aSize)
+{
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  __m128 acc2 = _mm_setzero_ps();
+  __m128 acc3 = _mm_setzero_ps();
+  for (size_t i = 0; i < aSize; i += 16) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(aA + i),
+                                       _mm_loadu_ps(aB + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(aA + i + 4),
+                                       _mm_loadu_ps(aB + i + 4)));
+    acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_loadu_ps(aA + i + 8),
+                                       _mm_loadu_ps(aB + i + 8)));
+    acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_loadu_ps(aA + i + 12),
+                                       _mm_loadu_ps(aB + i + 12)));
+  }
+  __m128 v = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+  v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+  return _mm_cvtss_f32(v);
+}
+
+#elif defined(SIMD_NEON)
+
+static inline float
+Dot(const float* aA, const float* aB, size_t aSize)
+{
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  float32x4_t acc2 = vdupq_n_f32(0.0f);
+  float32x4_t acc3 = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < aSize; i += 16) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(aA + i), vld1q_f32(aB + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(aA + i + 4), vld1q_f32(aB + i + 4));
+    acc2 = vfmaq_f32(acc2, vld1q_f32(aA + i + 8), vld1q_f32(aB + i + 8));
+    acc3 = vfmaq_f32(acc3, vld1q_f32(aA + i + 12), vld1q_f32(aB + i + 12));
+  }
+  return vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+}
+
+#else // No SIMD.
+
+static inline float
+Dot(const float* aA, const float* aB, size_t aSize)
+{
+  float sum = 0.0f;
+  for (size_t i = 0; i < aSize; ++i) {
+    sum += aA[i] * aB[i];
+  }
+  return sum;
+}
+
+#endif
+
+Resampler::Resampler(unsigned int aChannels,
+                     double aInRate,
+                     double aOutRate,
+                     Quality aQuality,
+                     size_t aMaxFrames,
+                     Source aSource,
+                     void* aContext)
+  : mChannels(aChannels)
+  , mTaps(TIERS[aQuality].mTaps)
+  , mPhases(0)
+  , mDenominator(0)
+  , mStep(0)
+  , mMaxFrames(aMaxFrames)
+  , mMaxInputFrames(0)
+  , mSource(aSource)
+  , mContext(aContext)
+  , mHistoryFrames(0)
+  , mFilled(0)
+  , mIndex(0)
+  , mPhase(0)
+{
+  assert(aChannels && aInRate > 0.0 && aOutRate > 0.0 && aMaxFrames);
+  assert(aSource);
+  // Each output frame must still share input frames with the next one.
+  assert(aInRate / aOutRate < TIERS[aQuality].mTaps / 2);
+
+  // Every output frame moves the input position by mStep / mDenominator
+  // frames. It's exact for the integer rates whose reduced ratio has up to
+  // MAX_PHASES phases, with one filter phase per position. The others are
+  // tracked in 32.32 fixed point, each position using the phase below it.
+  bool integral = fmod(aInRate, 1.0) == 0.0 && fmod(aOutRate, 1.0) == 0.0;
+  uint64_t gcd = integral ? Gcd(static_cast<uint64_t>(aInRate),
+                                static_cast<uint64_t>(aOutRate))
+                          : 0;
+  if (gcd && aOutRate / gcd <= MAX_PHASES) {
+    mPhases = static_cast<uint32_t>(aOutRate / gcd);
+    mDenominator = mPhases;
+    mStep = static_cast<uint64_t>(aInRate / gcd);
+  } else {
+    mPhases = MAX_PHASES;
+    mDenominator = uint64_t(1) << 32;
+    mStep = static_cast<uint64_t>(round(aInRate / aOutRate * mDenominator));
+  }
+
+  // The taps of phase p weigh the input around the position p / mPhases,
+  // between the input frames mTaps / 2 - 1 and mTaps / 2 of the row.
+  const Tier& tier = TIERS[aQuality];
+  double ratio = aOutRate < aInRate ? aOutRate / aInRate : 1.0;
+  double cutoff = 0.5 * ratio * tier.mPassband; // In cycles per input frame.
+  double half = mTaps / 2.0;
+  double i0Beta = BesselI0(tier.mBeta);
+  mFilter.assign(mPhases * mTaps, 0.0f);
+  for (uint32_t p = 0; p < mPhases; ++p) {
+    double sum = 0.0;
+    std::vector<double> row(mTaps);
+    for (size_t k = 0; k < mTaps; ++k) {
+      double d = k - (half - 1.0) - static_cast<double>(p) / mPhases;
+      double x = d / half;
+      double window = x * x < 1.0 ?
+        BesselI0(tier.mBeta * sqrt(1.0 - x * x)) / i0Beta : 0.0;
+      row[k] = 2.0 * cutoff * Sinc(2.0 * cutoff * d) * window;
+      sum += row[k];
+    }
+    // A unity gain at DC for every phase.
+    for (size_t k = 0; k < mTaps; ++k) {
+      mFilter[p * mTaps + k] = static_cast<float>(row[k] / sum);
+    }
+  }
+
+  // A Process pulls the input its own output frames span, up to two frames
+  // more for the position carried over, and the latency on the first one.
+  mMaxInputFrames = static_cast<size_t>(aMaxFrames * mStep / mDenominator) +
+                    2 + GetLatencyFrames();
+  // A Process never keeps more than mTaps frames from the previous one.
+  mHistoryFrames = mTaps + mMaxInputFrames;
+  mHistory.assign(mChannels * mHistoryFrames, 0.0f);
+  mInput.assign(mChannels * mMaxInputFrames, 0.0f);
+  Reset();
+}
+
+void
+Resampler::Reset()
+{
+  memset(mHistory.data(), 0, mHistory.size() * sizeof(float));
+  // Silence before the first input frame, so the first output frame lands
+  // on it.
+  mFilled = mTaps / 2 - 1;
+  mIndex = 0;
+  mPhase = 0;
+}
+
+void
+Resampler::Pull(size_t aFrames)
+{
+  uint64_t last = mIndex + (mPhase + (aFrames - 1) * mStep) / mDenominator;
+  size_t needed = static_cast<size_t>(last) + mTaps;
+  if (needed <= mFilled) {
+    return;
+  }
+
+  // Move what's left of the history to the start of the rows.
+  if (mIndex) {
+    for (unsigned int c = 0; c < mChannels; ++c) {
+      float* row = &mHistory[c * mHistoryFrames];
+      memmove(row, row + mIndex, (mFilled - mIndex) * sizeof(float));
+    }
+    mFilled -= mIndex;
+    needed -= mIndex;
+    mIndex = 0;
+  }
+
+  size_t frames = needed - mFilled;
+  assert(frames <= mMaxInputFrames);
+  mSource(mContext, mInput.data(), frames);
+  // Deinterleave.
+  for (unsigned int c = 0; c < mChannels; ++c) {
+    float* row = &mHistory[c * mHistoryFrames + mFilled];
+    const float* in = mInput.data() + c;
+    for (size_t i = 0; i < frames; ++i) {
+      row[i] = in[i * mChannels];
+    }
+  }
+  mFilled += frames;
+}
+
+void
+Resampler::Process(float* aOut, size_t aFrames)
+{
+  assert(aFrames <= mMaxFrames);
+  if (!aFrames) {
+    return;
+  }
+  Pull(aFrames);
+  for (size_t i = 0; i < aFrames; ++i) {
+    size_t row = mDenominator == mPhases ?
+      mPhase : static_cast<size_t>(mPhase * mPhases / mDenominator);
+    const float* taps = &mFilter[row * mTaps];
+    for (unsigned int c = 0; c < mChannels; ++c) {
+      aOut[i * mChannels + c] =
+        Dot(taps, &mHistory[c * mHistoryFrames + mIndex], mTaps);
+    }
+    mPhase += mStep;
+    mIndex += mPhase / mDenominator;
+    mPhase %= mDenominator;
+  }
+}
+
+/* static */ const char*
+Resampler::SimdName()
+{
+#if defined(SIMD_AVX2)
+  return "avx2";
+#elif defined(SIMD_SSE2)
+  return "sse2";
+#elif defined(SIMD_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,95 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // uint32_t
+#include <vector>   // std::vector
+
+// A polyphase windowed-sinc sample-rate converter for interleaved float
+// frames, pulling its input from a source as the output is asked for.
+//
+// The input to output ratio is reduced to L/M, and each of the L phases of
+// the filter gets its own row of Kaiser-windowed sinc taps, computed once.
+// An output frame is then one dot product of a row with the taps' worth of
+// input per channel, done with the widest SIMD instruction set enabled at
+// compile time, like SampleConverter. The input is kept planar so those
+// dot products read contiguous samples.
+//
+// The output is aligned with the input: output frame j is the input signal
+// at input frame j * inRate / outRate. To do that, the source is pulled
+// GetLatencyFrames() input frames ahead, a fixed latency set by the quality
+// tier. Nothing is allocated after construction.
+class Resampler
+{
+public:
+  // The tiers trade the stopband rejection and the passband width for CPU.
+  enum Quality
+  {
+    LOW,    // 16 taps per phase.
+    MEDIUM, // 32 taps per phase.
+    HIGH    // 64 taps per phase.
+  };
+
+  // Fill aBuffer with aFrames interleaved input frames.
+  typedef void (* Source)(void* aContext, float* aBuffer, unsigned long aFrames);
+
+  // The most phases kept. The ratios needing more, such as the ones between
+  // non-integer rates, are followed to 1/MAX_PHASES of an input frame.
+  static const uint32_t MAX_PHASES = 1024;
+
+  // Convert from aInRate to aOutRate, for up to aMaxFrames output frames per
+  // Process. aInRate must be less than GetLatencyFrames() times aOutRate.
+  Resampler(unsigned int aChannels,
+            double aInRate,
+            double aOutRate,
+            Quality aQuality,
+            size_t aMaxFrames,
+            Source aSource,
+            void* aContext);
+
+  // Render aFrames output frames, up to aMaxFrames, into aOut.
+  void Process(float* aOut, size_t aFrames);
+  // Forget the input, as if it had been silent until now.
+  void Reset();
+
+  // How far ahead of the output the source is pulled, in input frames.
+  size_t GetLatencyFrames() const { return mTaps / 2; }
+  // The largest number of frames the source is asked for at once.
+  size_t GetMaxInputFrames() const { return mMaxInputFrames; }
+  size_t GetTaps() const { return mTaps; }
+  uint32_t GetPhases() const { return mPhases; }
+
+  // The name of the instruction set in use: "avx2", "sse2", "neon" or
+  // "scalar".
+  static const char* SimdName();
+
+private:
+  // Make room for, then pull, enough input for aFrames more output frames.
+  void Pull(size_t aFrames);
+
+  const unsigned int mChannels;
+  size_t mTaps;
+  uint32_t mPhases;      // The rows of mFilter.
+  uint64_t mDenominator; // The input position moves by mStep / mDenominator
+  uint64_t mStep;        // frames per output frame.
+  size_t mMaxFrames;
+  size_t mMaxInputFrames;
+  Source mSource;
+  void* mContext;
+
+  // mPhases rows of mTaps taps.
+  std::vector<float> mFilter;
+  // mChannels rows of mHistoryFrames input samples, and the interleaved
+  // input as the source renders it.
+  size_t mHistoryFrames;
+  std::vector<float> mHistory;
+  std::vector<float> mInput;
+
+  // The input frames held in each history row, the first one read by the
+  // next output frame, and its phase, in [0, mDenominator).
+  size_t mFilled;
+  size_t mIndex;
+  uint64_t mPhase;
+};
+
+#endif // #ifndef RESAMPLER_H
@@ -0,0 +1,146 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <atomic>   // std::atomic
+#include <cassert>  // assert
+#include <cstring>  // memcpy
+#include <stddef.h> // size_t
+#include <stdint.h> // uint8_t
+#include <vector>   // std::vector
+
+// A wait-free single-producer/single-consumer ring of audio frames. One
+// thread writes and another thread reads, and neither of them ever blocks,
+// locks or allocates after construction. The capacity is rounded up to a
+// power of two so the indexes can wrap with a mask.
+class RingBuffer
+{
+public:
+  RingBuffer(size_t aCapacityFrames, size_t aBytesPerFrame)
+    : mCapacity(RoundUpToPowerOfTwo(aCapacityFrames))
+    , mMask(mCapacity - 1)
+    , mBytesPerFrame(aBytesPerFrame)
+    , mData(mCapacity * aBytesPerFrame)
+    , mReadIndex(0)
+    , mWriteIndex(0)
+  {
+    assert(aCapacityFrames && aBytesPerFrame);
+  }
+
+  size_t Capacity() const { return mCapacity; }
+  size_t BytesPerFrame() const { return mBytesPerFrame; }
+
+  // Drop the frames not read yet. Only call this while neither side runs.
+  void Reset()
+  {
+    mReadIndex.store(0, std::memory_order_relaxed);
+    mWriteIndex.store(0, std::memory_order_relaxed);
+  }
+
+  // Consumer side.
+
+  size_t AvailableRead() const
+  {
+    return mWriteIndex.load(std::memory_order_acquire) -
+           mReadIndex.load(std::memory_order_relaxed);
+  }
+
+  // Copy up to aFrames frames into aData. Return the number of frames read.
+  size_t Read(void* aData, size_t aFrames)
+  {
+    size_t read = mReadIndex.load(std::memory_order_relaxed);
+    size_t available = mWriteIndex.load(std::memory_order_acquire) - read;
+    size_t frames = aFrames < available ? aFrames : available;
+    Copy(static_cast<uint8_t*>(aData), read, frames);
+    mReadIndex.store(read + frames, std::memory_order_release);
+    return frames;
+  }
+
+  // Producer side.
+
+  size_t AvailableWrite() const
+  {
+    return mCapacity - (mWriteIndex.load(std::memory_order_relaxed) -
+                        mReadIndex.load(std::memory_order_acquire));
+  }
+
+  // Copy up to aFrames frames from aData. Return the number of frames written.
+  size_t Write(const void* aData, size_t aFrames)
+  {
+    size_t frames = 0;
+    const uint8_t* src = static_cast<const uint8_t*>(aData);
+    while (frames < aFrames) {
+      void* region = nullptr;
+      size_t contiguous = GetWritableRegion(&region);
+      if (!contiguous) {
+        break;
+      }
+      size_t n = aFrames - frames < contiguous ? aFrames - frames : contiguous;
+      memcpy(region, src + frames * mBytesPerFrame, n * mBytesPerFrame);
+      CommitWrite(n);
+      frames += n;
+    }
+    return frames;
+  }
+
+  // Expose the contiguous free space at the write position so the producer
+  // can render into the ring directly. Return its size in frames. The frames
+  // become readable after CommitWrite.
+  size_t GetWritableRegion(void** aData)
+  {
+    size_t write = mWriteIndex.load(std::memory_order_relaxed);
+    size_t free = mCapacity -
+                  (write - mReadIndex.load(std::memory_order_acquire));
+    size_t offset = write & mMask;
+    size_t untilEnd = mCapacity - offset;
+    *aData = mData.data() + offset * mBytesPerFrame;
+    return free < untilEnd ? free : untilEnd;
+  }
+
+  void CommitWrite(size_t aFrames)
+  {
+    assert(aFrames <= AvailableWrite());
+    mWriteIndex.store(mWriteIndex.load(std::memory_order_relaxed) + aFrames,
+                      std::memory_order_release);
+  }
+
+private:
+  static size_t RoundUpToPowerOfTwo(size_t aValue)
+  {
+    size_t n = 1;
+    while (n < aValue) {
+      n <<= 1;
+    }
+    return n;
+  }
+
+  void Copy(uint8_t* aDest, size_t aIndex, size_t aFrames) const
+  {
+    size_t offset = aIndex & mMask;
+    size_t first = mCapacity - offset < aFrames ? mCapacity - offset : aFrames;
+    memcpy(aDest, mData.data() + offset * mBytesPerFrame,
+           first * mBytesPerFrame);
+    memcpy(aDest + first * mBytesPerFrame, mData.data(),
+           (aFrames - first) * mBytesPerFrame);
+  }
+
+  const size_t mCapacity;
+  const size_t mMask;
+  const size_t mBytesPerFrame;
+  std::vector<uint8_t> mData;
+
+  // The indexes grow monotonically and are only wrapped on access. Keep them
+  // on separate cache lines so the two threads don't false-share.
+  struct PaddedIndex: public std::atomic<size_t>
+  {
+    explicit PaddedIndex(size_t aValue) : std::atomic<size_t>(aValue) {}
+    char mPadding[64 - sizeof(std::atomic<size_t>)];
+  };
+  PaddedIndex mReadIndex;
+  PaddedIndex mWriteIndex;
+
+  // Disallow copy and assignment because it's shared between two threads.
+  RingBuffer(const RingBuffer&);
+  RingBuffer& operator=(const RingBuffer&);
+};
+
+#endif // #ifndef RINGBUFFER_H
@@ -0,0 +1,593 @@
+#include "SampleConverter.h"
+#include <cmath>   // lrintf
+#include <cstring> // memcpy
+
+#if defined(__AVX2__)
+#define SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// The vector loops convert blocks of this many samples, and the scalar loop
+// converts what is left.
+const size_t BLOCK = 8;
+
+// Use the same scale in both directions so a 16-bit sample survives the
+// S16 -> float -> S16 round trip.
+const float S16_SCALE = 32767.0f;
+const float S16_INVERSE_SCALE = 1.0f / S16_SCALE;
+const float S16_MIN = -32768.0f;
+const float S16_MAX = 32767.0f;
+
+// Scalar helpers. They must produce the same results as the vector loops.
+
+static inline int16_t
+ClipAndRound(float aValue)
+{
+  // Written so that NaN ends up on the lower bound, like MAXPS does.
+  float v = aValue > S16_MIN ? aValue : S16_MIN;
+  v = v < S16_MAX ? v : S16_MAX;
+  // lrintf rounds half to even under the default rounding mode, like CVTPS2DQ.
+  return static_cast<int16_t>(lrintf(v));
+}
+
+static inline uint16_t
+Swap16(uint16_t aValue)
+{
+  return static_cast<uint16_t>((aValue << 8) | (aValue >> 8));
+}
+
+static inline uint32_t
+Swap32(uint32_t aValue)
+{
+  return (aValue << 24) | ((aValue << 8) & 0x00FF0000) |
+         ((aValue >> 8) & 0x0000FF00) | (aValue >> 24);
+}
+
+static inline uint32_t
+XorShift(uint32_t& aState)
+{
+  aState ^= aState << 13;
+  aState ^= aState >> 17;
+  aState ^= aState << 5;
+  return aState;
+}
+
+// Map the top 23 bits of a random number to a float in [1.0, 2.0).
+static inline float
+ToFloatInOneToTwo(uint32_t aRandom)
+{
+  uint32_t bits = (aRandom >> 9) | 0x3F800000;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// The sum of two uniform noises is a triangular noise in (-1.0, 1.0).
+static inline float
+TriangularNoise(uint32_t& aState)
+{
+  float a = ToFloatInOneToTwo(XorShift(aState));
+  float b = ToFloatInOneToTwo(XorShift(aState));
+  return (a + b) - 3.0f;
+}
+
+SampleConverter::Dither::Dither(uint32_t aSeed)
+{
+  // Each lane gets its own xorshift generator, and none of them can be zero.
+  for (size_t i = 0; i < LANES; ++i) {
+    uint32_t x = aSeed + 0x9E3779B9 * static_cast<uint32_t>(i + 1);
+    x ^= x >> 16;
+    x *= 0x85EBCA6B;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35;
+    x ^= x >> 16;
+    mState[i] = x ? x : 0x6D2B79F5;
+  }
+}
+
+#if defined(SIMD_AVX2)
+
+static inline __m256i
+XorShift(__m256i& aState)
+{
+  aState = _mm256_xor_si256(aState, _mm256_slli_epi32(aState, 13));
+  aState = _mm256_xor_si256(aState, _mm256_srli_epi32(aState, 17));
+  aState = _mm256_xor_si256(aState, _mm256_slli_epi32(aState, 5));
+  return aState;
+}
+
+static inline __m256
+TriangularNoise(__m256i& aState)
+{
+  const __m256i one = _mm256_set1_epi32(0x3F800000);
+  __m256 a = _mm256_castsi256_ps(
+    _mm256_or_si256(_mm256_srli_epi32(XorShift(aState), 9), one));
+  __m256 b = _mm256_castsi256_ps(
+    _mm256_or_si256(_mm256_srli_epi32(XorShift(aState), 9), one));
+  return _mm256_sub_ps(_mm256_add_ps(a, b), _mm256_set1_ps(3.0f));
+}
+
+static inline __m128i
+Swap16(__m128i aValue)
+{
+  return _mm_or_si128(_mm_slli_epi16(aValue, 8), _mm_srli_epi16(aValue, 8));
+}
+
+static inline __m128i
+PackS16(__m256 aScaled)
+{
+  __m256 v = _mm256_max_ps(aScaled, _mm256_set1_ps(S16_MIN));
+  v = _mm256_min_ps(v, _mm256_set1_ps(S16_MAX));
+  __m256i i = _mm256_cvtps_epi32(v);
+  return _mm_packs_epi32(_mm256_castsi256_si128(i),
+                         _mm256_extracti128_si256(i, 1));
+}
+
+static size_t
+FloatToS16Simd(const float* aIn, int16_t* aOut, size_t aSamples,
+               uint32_t* aDither, bool aSwapBytes)
+{
+  const __m256 scale = _mm256_set1_ps(S16_SCALE);
+  __m256i state = aDither ?
+    _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aDither)) :
+    _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(aIn + i), scale);
+    if (aDither) {
+      v = _mm256_add_ps(v, TriangularNoise(state));
+    }
+    __m128i s = PackS16(v);
+    if (aSwapBytes) {
+      s = Swap16(s);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aOut + i), s);
+  }
+  if (aDither) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aDither), state);
+  }
+  return i;
+}
+
+static size_t
+S16ToFloatSimd(const int16_t* aIn, float* aOut, size_t aSamples,
+               bool aSwapBytes)
+{
+  const __m256 scale = _mm256_set1_ps(S16_INVERSE_SCALE);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aIn + i));
+    if (aSwapBytes) {
+      s = Swap16(s);
+    }
+    __m256 v = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(s));
+    _mm256_storeu_ps(aOut + i, _mm256_mul_ps(v, scale));
+  }
+  return i;
+}
+
+static size_t
+SwapBytes16Simd(const uint16_t* aIn, uint16_t* aOut, size_t aSamples)
+{
+  size_t i = 0;
+  for (; i + 16 <= aSamples; i += 16) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aIn + i));
+    v = _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aOut + i), v);
+  }
+  return i;
+}
+
+static size_t
+SwapBytes32Simd(const uint32_t* aIn, uint32_t* aOut, size_t aSamples)
+{
+  const __m256i mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                        11, 10, 9, 8, 15, 14, 13, 12,
+                                        3, 2, 1, 0, 7, 6, 5, 4,
+                                        11, 10, 9, 8, 15, 14, 13, 12);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aIn + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(aOut + i),
+                        _mm256_shuffle_epi8(v, mask));
+  }
+  return i;
+}
+
+static size_t
+MixFloatSimd(const float* aIn, float aGain, float* aOut, size_t aSamples)
+{
+  const __m256 gain = _mm256_set1_ps(aGain);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(aIn + i), gain);
+    _mm256_storeu_ps(aOut + i, _mm256_add_ps(_mm256_loadu_ps(aOut + i), v));
+  }
+  return i;
+}
+
+#elif defined(SIMD_SSE2)
+
+static inline __m128i
+XorShift(__m128i& aState)
+{
+  aState = _mm_xor_si128(aState, _mm_slli_epi32(aState, 13));
+  aState = _mm_xor_si128(aState, _mm_srli_epi32(aState, 17));
+  aState = _mm_xor_si128(aState, _mm_slli_epi32(aState, 5));
+  return aState;
+}
+
+static inline __m128
+TriangularNoise(__m128i& aState)
+{
+  const __m128i one = _mm_set1_epi32(0x3F800000);
+  __m128 a = _mm_castsi128_ps(
+    _mm_or_si128(_mm_srli_epi32(XorShift(aState), 9), one));
+  __m128 b = _mm_castsi128_ps(
+    _mm_or_si128(_mm_srli_epi32(XorShift(aState), 9), one));
+  return _mm_sub_ps(_mm_add_ps(a, b), _mm_set1_ps(3.0f));
+}
+
+static inline __m128i
+Swap16(__m128i aValue)
+{
+  return _mm_or_si128(_mm_slli_epi16(aValue, 8), _mm_srli_epi16(aValue, 8));
+}
+
+static inline __m128i
+ToS32(__m128 aScaled)
+{
+  __m128 v = _mm_max_ps(aScaled, _mm_set1_ps(S16_MIN));
+  v = _mm_min_ps(v, _mm_set1_ps(S16_MAX));
+  return _mm_cvtps_epi32(v);
+}
+
+static size_t
+FloatToS16Simd(const float* aIn, int16_t* aOut, size_t aSamples,
+               uint32_t* aDither, bool aSwapBytes)
+{
+  const __m128 scale = _mm_set1_ps(S16_SCALE);
+  // Lanes 0-3 of the dither serve the first half of a block, 4-7 the other.
+  __m128i stateLo = _mm_setzero_si128();
+  __m128i stateHi = _mm_setzero_si128();
+  if (aDither) {
+    stateLo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aDither));
+    stateHi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aDither + 4));
+  }
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(aIn + i), scale);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(aIn + i + 4), scale);
+    if (aDither) {
+      lo = _mm_add_ps(lo, TriangularNoise(stateLo));
+      hi = _mm_add_ps(hi, TriangularNoise(stateHi));
+    }
+    __m128i s = _mm_packs_epi32(ToS32(lo), ToS32(hi));
+    if (aSwapBytes) {
+      s = Swap16(s);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aOut + i), s);
+  }
+  if (aDither) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDither), stateLo);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aDither + 4), stateHi);
+  }
+  return i;
+}
+
+static size_t
+S16ToFloatSimd(const int16_t* aIn, float* aOut, size_t aSamples,
+               bool aSwapBytes)
+{
+  const __m128 scale = _mm_set1_ps(S16_INVERSE_SCALE);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aIn + i));
+    if (aSwapBytes) {
+      s = Swap16(s);
+    }
+    // Sign-extend to 32 bits by placing each sample in the upper half.
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(aOut + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(aOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  return i;
+}
+
+static size_t
+SwapBytes16Simd(const uint16_t* aIn, uint16_t* aOut, size_t aSamples)
+{
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aIn + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aOut + i), Swap16(v));
+  }
+  return i;
+}
+
+static size_t
+SwapBytes32Simd(const uint32_t* aIn, uint32_t* aOut, size_t aSamples)
+{
+  size_t i = 0;
+  for (; i + 4 <= aSamples; i += 4) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aIn + i));
+    // Swap the 16-bit halves, then the bytes within each half.
+    v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aOut + i), Swap16(v));
+  }
+  return i;
+}
+
+static size_t
+MixFloatSimd(const float* aIn, float aGain, float* aOut, size_t aSamples)
+{
+  const __m128 gain = _mm_set1_ps(aGain);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(aIn + i), gain);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(aIn + i + 4), gain);
+    _mm_storeu_ps(aOut + i, _mm_add_ps(_mm_loadu_ps(aOut + i), lo));
+    _mm_storeu_ps(aOut + i + 4, _mm_add_ps(_mm_loadu_ps(aOut + i + 4), hi));
+  }
+  return i;
+}
+
+#elif defined(SIMD_NEON)
+
+static inline uint32x4_t
+XorShift(uint32x4_t& aState)
+{
+  aState = veorq_u32(aState, vshlq_n_u32(aState, 13));
+  aState = veorq_u32(aState, vshrq_n_u32(aState, 17));
+  aState = veorq_u32(aState, vshlq_n_u32(aState, 5));
+  return aState;
+}
+
+static inline float32x4_t
+TriangularNoise(uint32x4_t& aState)
+{
+  const uint32x4_t one = vdupq_n_u32(0x3F800000);
+  float32x4_t a = vreinterpretq_f32_u32(
+    vorrq_u32(vshrq_n_u32(XorShift(aState), 9), one));
+  float32x4_t b = vreinterpretq_f32_u32(
+    vorrq_u32(vshrq_n_u32(XorShift(aState), 9), one));
+  return vsubq_f32(vaddq_f32(a, b), vdupq_n_f32(3.0f));
+}
+
+static inline int32x4_t
+ToS32(float32x4_t aScaled)
+{
+  float32x4_t v = vmaxq_f32(aScaled, vdupq_n_f32(S16_MIN));
+  v = vminq_f32(v, vdupq_n_f32(S16_MAX));
+  return vcvtnq_s32_f32(v); // Round half to even.
+}
+
+static size_t
+FloatToS16Simd(const float* aIn, int16_t* aOut, size_t aSamples,
+               uint32_t* aDither, bool aSwapBytes)
+{
+  const float32x4_t scale = vdupq_n_f32(S16_SCALE);
+  uint32x4_t stateLo = vdupq_n_u32(0);
+  uint32x4_t stateHi = vdupq_n_u32(0);
+  if (aDither) {
+    stateLo = vld1q_u32(aDither);
+    stateHi = vld1q_u32(aDither + 4);
+  }
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    float32x4_t lo = vmulq_f32(vld1q_f32(aIn + i), scale);
+    float32x4_t hi = vmulq_f32(vld1q_f32(aIn + i + 4), scale);
+    if (aDither) {
+      lo = vaddq_f32(lo, TriangularNoise(stateLo));
+      hi = vaddq_f32(hi, TriangularNoise(stateHi));
+    }
+    int16x8_t s = vcombine_s16(vqmovn_s32(ToS32(lo)), vqmovn_s32(ToS32(hi)));
+    if (aSwapBytes) {
+      s = vreinterpretq_s16_u8(vrev16q_u8(vreinterpretq_u8_s16(s)));
+    }
+    vst1q_s16(aOut + i, s);
+  }
+  if (aDither) {
+    vst1q_u32(aDither, stateLo);
+    vst1q_u32(aDither + 4, stateHi);
+  }
+  return i;
+}
+
+static size_t
+S16ToFloatSimd(const int16_t* aIn, float* aOut, size_t aSamples,
+               bool aSwapBytes)
+{
+  const float32x4_t scale = vdupq_n_f32(S16_INVERSE_SCALE);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    int16x8_t s = vld1q_s16(aIn + i);
+    if (aSwapBytes) {
+      s = vreinterpretq_s16_u8(vrev16q_u8(vreinterpretq_u8_s16(s)));
+    }
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+    vst1q_f32(aOut + i, vmulq_f32(lo, scale));
+    vst1q_f32(aOut + i + 4, vmulq_f32(hi, scale));
+  }
+  return i;
+}
+
+static size_t
+SwapBytes16Simd(const uint16_t* aIn, uint16_t* aOut, size_t aSamples)
+{
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    uint8x16_t v = vreinterpretq_u8_u16(vld1q_u16(aIn + i));
+    vst1q_u16(aOut + i, vreinterpretq_u16_u8(vrev16q_u8(v)));
+  }
+  return i;
+}
+
+static size_t
+SwapBytes32Simd(const uint32_t* aIn, uint32_t* aOut, size_t aSamples)
+{
+  size_t i = 0;
+  for (; i + 4 <= aSamples; i += 4) {
+    uint8x16_t v = vreinterpretq_u8_u32(vld1q_u32(aIn + i));
+    vst1q_u32(aOut + i, vreinterpretq_u32_u8(vrev32q_u8(v)));
+  }
+  return i;
+}
+
+static size_t
+MixFloatSimd(const float* aIn, float aGain, float* aOut, size_t aSamples)
+{
+  const float32x4_t gain = vdupq_n_f32(aGain);
+  size_t i = 0;
+  for (; i + BLOCK <= aSamples; i += BLOCK) {
+    // Multiply then add, not vmlaq/vfmaq, to round like the scalar loop.
+    float32x4_t lo = vmulq_f32(vld1q_f32(aIn + i), gain);
+    float32x4_t hi = vmulq_f32(vld1q_f32(aIn + i + 4), gain);
+    vst1q_f32(aOut + i, vaddq_f32(vld1q_f32(aOut + i), lo));
+    vst1q_f32(aOut + i + 4, vaddq_f32(vld1q_f32(aOut + i + 4), hi));
+  }
+  return i;
+}
+
+#else // No SIMD. Everything goes through the scalar loops.
+
+static size_t
+FloatToS16Simd(const float*, int16_t*, size_t, uint32_t*, bool)
+{
+  return 0;
+}
+
+static size_t
+S16ToFloatSimd(const int16_t*, float*, size_t, bool)
+{
+  return 0;
+}
+
+static size_t
+SwapBytes16Simd(const uint16_t*, uint16_t*, size_t)
+{
+  return 0;
+}
+
+static size_t
+SwapBytes32Simd(const uint32_t*, uint32_t*, size_t)
+{
+  return 0;
+}
+
+static size_t
+MixFloatSimd(const float*, float, float*, size_t)
+{
+  return 0;
+}
+
+#endif
+
+static void
+FloatToS16Impl(const float* aIn, int16_t* aOut, size_t aSamples,
+               uint32_t* aDither, bool aSwapBytes)
+{
+  size_t i = FloatToS16Simd(aIn, aOut, aSamples, aDither, aSwapBytes);
+  // The vector loops only stop on a block boundary, so sample i always uses
+  // the dither lane i % 8 whatever the instruction set is.
+  for (; i < aSamples; ++i) {
+    float v = aIn[i] * S16_SCALE;
+    if (aDither) {
+      v += TriangularNoise(aDither[i % BLOCK]);
+    }
+    int16_t s = ClipAndRound(v);
+    aOut[i] = aSwapBytes ?
+      static_cast<int16_t>(Swap16(static_cast<uint16_t>(s))) : s;
+  }
+}
+
+/* static */ void
+SampleConverter::FloatToS16(const float* aIn, int16_t* aOut, size_t aSamples,
+                            bool aSwapBytes)
+{
+  FloatToS16Impl(aIn, aOut, aSamples, nullptr, aSwapBytes);
+}
+
+/* static */ void
+SampleConverter::FloatToS16(const float* aIn, int16_t* aOut, size_t aSamples,
+                            Dither& aDither, bool aSwapBytes)
+{
+  static_assert(Dither::LANES == BLOCK, "One dither lane per block sample");
+  FloatToS16Impl(aIn, aOut, aSamples, aDither.mState, aSwapBytes);
+}
+
+/* static */ void
+SampleConverter::S16ToFloat(const int16_t* aIn, float* aOut, size_t aSamples,
+                            bool aSwapBytes)
+{
+  size_t i = S16ToFloatSimd(aIn, aOut, aSamples, aSwapBytes);
+  for (; i < aSamples; ++i) {
+    int16_t s = aSwapBytes ?
+      static_cast<int16_t>(Swap16(static_cast<uint16_t>(aIn[i]))) : aIn[i];
+    aOut[i] = static_cast<float>(s) * S16_INVERSE_SCALE;
+  }
+}
+
+/* static */ void
+SampleConverter::SwapBytes16(const void* aIn, void* aOut, size_t aSamples)
+{
+  const uint8_t* in = static_cast<const uint8_t*>(aIn);
+  uint8_t* out = static_cast<uint8_t*>(aOut);
+  size_t i = SwapBytes16Simd(reinterpret_cast<const uint16_t*>(in),
+                             reinterpret_cast<uint16_t*>(out), aSamples);
+  // Go through memcpy since the samples may not be uint16_t (e.g., int16_t).
+  for (; i < aSamples; ++i) {
+    uint16_t v;
+    memcpy(&v, in + i * sizeof(v), sizeof(v));
+    v = Swap16(v);
+    memcpy(out + i * sizeof(v), &v, sizeof(v));
+  }
+}
+
+/* static */ void
+SampleConverter::SwapBytes32(const void* aIn, void* aOut, size_t aSamples)
+{
+  const uint8_t* in = static_cast<const uint8_t*>(aIn);
+  uint8_t* out = static_cast<uint8_t*>(aOut);
+  size_t i = SwapBytes32Simd(reinterpret_cast<const uint32_t*>(in),
+                             reinterpret_cast<uint32_t*>(out), aSamples);
+  // Go through memcpy since the samples may not be uint32_t (e.g., float).
+  for (; i < aSamples; ++i) {
+    uint32_t v;
+    memcpy(&v, in + i * sizeof(v), sizeof(v));
+    v = Swap32(v);
+    memcpy(out + i * sizeof(v), &v, sizeof(v));
+  }
+}
+
+/* static */ void
+SampleConverter::MixFloat(const float* aIn, float aGain, float* aOut,
+                          size_t aSamples)
+{
+  size_t i = MixFloatSimd(aIn, aGain, aOut, aSamples);
+  for (; i < aSamples; ++i) {
+    aOut[i] += aIn[i] * aGain;
+  }
+}
+
+/* static */ const char*
+SampleConverter::SimdName()
+{
+#if defined(SIMD_AVX2)
+  return "avx2";
+#elif defined(SIMD_SSE2)
+  return "sse2";
+#elif defined(SIMD_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef SAMPLECONVERTER_H
+#define SAMPLECONVERTER_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int16_t, uint16_t, uint32_t
+
+// Vectorized conversions between the sample formats AudioStream supports.
+// The widest instruction set enabled at compile time is used (AVX2, SSE2 or
+// NEON on AArch64), with a scalar loop for the leftover samples and for the
+// other targets. All the conversions can run in place when the input and
+// output samples have the same size, and none of them allocates.
+class SampleConverter
+{
+public:
+  // The state of the TPDF dither noise. Keep one per converting thread. The
+  // noise sequence only depends on the seed and on the lengths of the
+  // converted blocks, not on the instruction set in use.
+  class Dither
+  {
+  public:
+    explicit Dither(uint32_t aSeed = 1);
+
+  private:
+    friend class SampleConverter;
+    static const size_t LANES = 8;
+    uint32_t mState[LANES];
+  };
+
+  // Float samples in [-1.0, 1.0] to signed 16-bit samples, rounded to the
+  // nearest. The out-of-range samples are clipped. The output is byte-swapped
+  // when aSwapBytes is true (e.g., for S16BE on a little-endian host).
+  static void FloatToS16(const float* aIn, int16_t* aOut, size_t aSamples,
+                         bool aSwapBytes = false);
+  // Same as above, but adds triangular (TPDF) dither of +/- 1 LSB before
+  // rounding to decorrelate the quantization error from the signal.
+  static void FloatToS16(const float* aIn, int16_t* aOut, size_t aSamples,
+                         Dither& aDither, bool aSwapBytes = false);
+  // Signed 16-bit samples to float samples in [-1.0, 1.0]. The input is
+  // byte-swapped first when aSwapBytes is true.
+  static void S16ToFloat(const int16_t* aIn, float* aOut, size_t aSamples,
+                         bool aSwapBytes = false);
+
+  // Reverse the byte order of each sample (e.g., for S16BE or F32BE).
+  static void SwapBytes16(const void* aIn, void* aOut, size_t aSamples);
+  static void SwapBytes32(const void* aIn, void* aOut, size_t aSamples);
+
+  // Add aIn scaled by aGain to aOut, for mixing float streams together. The
+  // sums aren't clipped. It can't run in place.
+  static void MixFloat(const float* aIn, float aGain, float* aOut,
+                       size_t aSamples);
+
+  // The name of the instruction set in use: "avx2", "sse2", "neon" or
+  // "scalar".
+  static const char* SimdName();
+};
+
+#endif // #ifndef SAMPLECONVERTER_H
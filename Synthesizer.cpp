@@ -0,0 +1,275 @@
+#include "Synthesizer.h"
+#include "SampleConverter.h"
+#include <cassert> // assert
+#include <chrono>  // std::chrono
+#include <cmath>   // floor, std::fabs
+#include <cstring> // memcpy
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// The frames are rendered by blocks of this many frames, small enough for
+// the rows of a few hundred channels to stay in the L2 cache.
+const size_t BLOCK_FRAMES = 256;
+
+const float TWO_PI = 6.28318530717958647692f;
+
+// The Taylor coefficients of sin(y) for y in [-pi/2, pi/2]. The 9th-degree
+// polynomial is within 4e-6 of sin(y) over that range.
+const float SIN_C3 = -1.0f / 6.0f;
+const float SIN_C5 = 1.0f / 120.0f;
+const float SIN_C7 = -1.0f / 5040.0f;
+const float SIN_C9 = 1.0f / 362880.0f;
+
+// sin(2 * pi * aPhase) for aPhase in [0, 1). With x = aPhase - 0.5 in
+// [-0.5, 0.5), sin(2 * pi * aPhase) = -sin(2 * pi * x), and since
+// sin(2 * pi * x) is symmetric around x = +-0.25, it's computed on
+// m = min(|x|, 0.5 - |x|) in [0, 0.25] with the sign of x put back.
+// The vector loops below do the same operations in the same order.
+static inline float
+Sine(float aPhase)
+{
+  float x = aPhase - 0.5f;
+  float a = std::fabs(x);
+  float m = a < 0.5f - a ? a : 0.5f - a;
+  float y = m * TWO_PI;
+  float y2 = y * y;
+  float s = y * (1.0f + y2 * (SIN_C3 + y2 * (SIN_C5 + y2 * (SIN_C7 +
+                                                            y2 * SIN_C9))));
+  return x < 0.0f ? s : -s;
+}
+
+// Write aFrames samples of a sine starting at aPhase and advancing by
+// aIncrement cycles per frame, scaled by aGain. The phase offsets are
+// computed from the block start so no error accumulates within a block.
+static void
+RenderSineScalar(float aPhase, float aIncrement, float aGain, float* aOut,
+                 size_t aStart, size_t aFrames)
+{
+  for (size_t i = aStart; i < aFrames; ++i) {
+    float t = aPhase + static_cast<float>(i) * aIncrement;
+    t -= static_cast<float>(static_cast<int32_t>(t)); // t >= 0: trunc = floor
+    aOut[i] = Sine(t) * aGain;
+  }
+}
+
+#if defined(SIMD_SSE2)
+
+static void
+RenderSine(float aPhase, float aIncrement, float aGain, float* aOut,
+           size_t aFrames)
+{
+  const __m128 phase = _mm_set1_ps(aPhase);
+  const __m128 increment = _mm_set1_ps(aIncrement);
+  const __m128 gain = _mm_set1_ps(aGain);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 twoPi = _mm_set1_ps(TWO_PI);
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  const __m128 c3 = _mm_set1_ps(SIN_C3);
+  const __m128 c5 = _mm_set1_ps(SIN_C5);
+  const __m128 c7 = _mm_set1_ps(SIN_C7);
+  const __m128 c9 = _mm_set1_ps(SIN_C9);
+  __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const __m128 step = _mm_set1_ps(4.0f);
+
+  size_t i = 0;
+  for (; i + 4 <= aFrames; i += 4) {
+    __m128 t = _mm_add_ps(phase, _mm_mul_ps(index, increment));
+    t = _mm_sub_ps(t, _mm_cvtepi32_ps(_mm_cvttps_epi32(t)));
+    __m128 x = _mm_sub_ps(t, half);
+    __m128 a = _mm_andnot_ps(signMask, x);
+    __m128 m = _mm_min_ps(a, _mm_sub_ps(half, a));
+    __m128 y = _mm_mul_ps(m, twoPi);
+    __m128 y2 = _mm_mul_ps(y, y);
+    __m128 p = _mm_add_ps(c7, _mm_mul_ps(y2, c9));
+    p = _mm_add_ps(c5, _mm_mul_ps(y2, p));
+    p = _mm_add_ps(c3, _mm_mul_ps(y2, p));
+    p = _mm_add_ps(one, _mm_mul_ps(y2, p));
+    __m128 s = _mm_mul_ps(y, p);
+    // Negate s where x >= 0: flip the sign bit of s unless x's is set.
+    s = _mm_xor_ps(s, _mm_andnot_ps(x, signMask));
+    _mm_storeu_ps(aOut + i, _mm_mul_ps(s, gain));
+    index = _mm_add_ps(index, step);
+  }
+  RenderSineScalar(aPhase, aIncrement, aGain, aOut, i, aFrames);
+}
+
+#elif defined(SIMD_NEON)
+
+static void
+RenderSine(float aPhase, float aIncrement, float aGain, float* aOut,
+           size_t aFrames)
+{
+  const float32x4_t phase = vdupq_n_f32(aPhase);
+  const float32x4_t increment = vdupq_n_f32(aIncrement);
+  const float32x4_t gain = vdupq_n_f32(aGain);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  const float32x4_t twoPi = vdupq_n_f32(TWO_PI);
+  const float32x4_t c3 = vdupq_n_f32(SIN_C3);
+  const float32x4_t c5 = vdupq_n_f32(SIN_C5);
+  const float32x4_t c7 = vdupq_n_f32(SIN_C7);
+  const float32x4_t c9 = vdupq_n_f32(SIN_C9);
+  const float indexes[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+  float32x4_t index = vld1q_f32(indexes);
+  const float32x4_t step = vdupq_n_f32(4.0f);
+
+  size_t i = 0;
+  for (; i + 4 <= aFrames; i += 4) {
+    // Separate multiplies and adds, no FMA, to match the scalar loop.
+    float32x4_t t = vaddq_f32(phase, vmulq_f32(index, increment));
+    t = vsubq_f32(t, vcvtq_f32_s32(vcvtq_s32_f32(t)));
+    float32x4_t x = vsubq_f32(t, half);
+    float32x4_t a = vabsq_f32(x);
+    float32x4_t m = vminq_f32(a, vsubq_f32(half, a));
+    float32x4_t y = vmulq_f32(m, twoPi);
+    float32x4_t y2 = vmulq_f32(y, y);
+    float32x4_t p = vaddq_f32(c7, vmulq_f32(y2, c9));
+    p = vaddq_f32(c5, vmulq_f32(y2, p));
+    p = vaddq_f32(c3, vmulq_f32(y2, p));
+    p = vaddq_f32(one, vmulq_f32(y2, p));
+    float32x4_t s = vmulq_f32(y, p);
+    uint32x4_t negative = vcltq_f32(x, vdupq_n_f32(0.0f));
+    s = vbslq_f32(negative, s, vnegq_f32(s));
+    vst1q_f32(aOut + i, vmulq_f32(s, gain));
+    index = vaddq_f32(index, step);
+  }
+  RenderSineScalar(aPhase, aIncrement, aGain, aOut, i, aFrames);
+}
+
+#else
+
+static void
+RenderSine(float aPhase, float aIncrement, float aGain, float* aOut,
+           size_t aFrames)
+{
+  RenderSineScalar(aPhase, aIncrement, aGain, aOut, 0, aFrames);
+}
+
+#endif
+
+Synthesizer::Synthesizer(unsigned int aChannels, float aRate, double aVolume)
+  : mChannels(aChannels)
+  , mRate(aRate)
+  , mVolume(static_cast<float>(aVolume))
+  , mPhase(aChannels, 0.0)
+  , mIncrement(aChannels, 0.0)
+  , mBlock(aChannels * BLOCK_FRAMES, 0.0f)
+  , mInterleaved(aChannels * BLOCK_FRAMES, 0.0f)
+  , mFrames(0)
+  , mNs(0)
+{
+  assert(aChannels && aRate > 0.0f);
+  for (unsigned int i = 0; i < mChannels; ++i) {
+    SetFrequency(i, 220.0 * (i + 1));
+  }
+}
+
+void
+Synthesizer::Run(float* aBuffer, long aFrames)
+{
+  Clock::time_point start = Clock::now();
+  for (long done = 0; done < aFrames; ) {
+    size_t frames = static_cast<size_t>(aFrames - done);
+    if (frames > BLOCK_FRAMES) {
+      frames = BLOCK_FRAMES;
+    }
+    RenderBlock(frames);
+    Interleave(aBuffer + done * mChannels, frames);
+    done += frames;
+  }
+  mNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+           Clock::now() - start).count();
+  mFrames += aFrames;
+}
+
+void
+Synthesizer::Run(int16_t* aBuffer, long aFrames)
+{
+  Clock::time_point start = Clock::now();
+  for (long done = 0; done < aFrames; ) {
+    size_t frames = static_cast<size_t>(aFrames - done);
+    if (frames > BLOCK_FRAMES) {
+      frames = BLOCK_FRAMES;
+    }
+    RenderBlock(frames);
+    Interleave(mInterleaved.data(), frames);
+    SampleConverter::FloatToS16(mInterleaved.data(),
+                                aBuffer + done * mChannels,
+                                frames * mChannels);
+    done += frames;
+  }
+  mNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+           Clock::now() - start).count();
+  mFrames += aFrames;
+}
+
+void
+Synthesizer::SetFrequency(unsigned int aChannel, double aFrequency)
+{
+  assert(aChannel < mChannels && aFrequency >= 0.0);
+  // Fold the frequency into [0, rate) so the increment stays in [0, 1).
+  double increment = aFrequency / mRate;
+  mIncrement[aChannel] = increment - floor(increment);
+}
+
+double
+Synthesizer::GetFrequency(unsigned int aChannel) const
+{
+  assert(aChannel < mChannels);
+  return mIncrement[aChannel] * mRate;
+}
+
+double
+Synthesizer::GetNsPerFrame() const
+{
+  return mFrames ? static_cast<double>(mNs) / mFrames : 0.0;
+}
+
+void
+Synthesizer::ResetStats()
+{
+  mFrames = 0;
+  mNs = 0;
+}
+
+void
+Synthesizer::RenderBlock(size_t aFrames)
+{
+  assert(aFrames <= BLOCK_FRAMES);
+  for (unsigned int c = 0; c < mChannels; ++c) {
+    RenderSine(static_cast<float>(mPhase[c]),
+               static_cast<float>(mIncrement[c]),
+               mVolume,
+               &mBlock[c * BLOCK_FRAMES],
+               aFrames);
+    // Advance and wrap the phase in double precision.
+    double phase = mPhase[c] + mIncrement[c] * aFrames;
+    mPhase[c] = phase - floor(phase);
+  }
+}
+
+void
+Synthesizer::Interleave(float* aBuffer, size_t aFrames) const
+{
+  if (mChannels == 1) {
+    memcpy(aBuffer, mBlock.data(), aFrames * sizeof(float));
+    return;
+  }
+  // The output is written sequentially; each frame reads one sample from
+  // every row, and the rows stay in cache since a block is small.
+  const float* block = mBlock.data();
+  for (size_t i = 0; i < aFrames; ++i) {
+    for (unsigned int c = 0; c < mChannels; ++c) {
+      *aBuffer++ = block[c * BLOCK_FRAMES + i];
+    }
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef SYNTHESIZER_H
+#define SYNTHESIZER_H
+
+#include <stddef.h> // size_t
+#include <stdint.h> // int16_t, uint64_t
+#include <vector>   // std::vector
+
+// A multichannel sine tone generator used as a load source. Channel i plays
+// 220 * (i + 1) Hz by default.
+//
+// The frames are rendered by blocks: each channel fills a contiguous block
+// with a vectorized polynomial sine, then the blocks are interleaved into the
+// output with sequential writes. The phases are kept in double precision and
+// wrapped into [0, 1) after every block, so they never lose precision however
+// long the tone plays. Nothing is allocated after construction.
+class Synthesizer
+{
+public:
+  Synthesizer(unsigned int aChannels, float aRate, double aVolume = 0.5);
+
+  // Render aFrames interleaved frames.
+  void Run(float* aBuffer, long aFrames);
+  void Run(int16_t* aBuffer, long aFrames);
+
+  // The frequencies at or above the rate are folded back into [0, rate).
+  void SetFrequency(unsigned int aChannel, double aFrequency);
+  double GetFrequency(unsigned int aChannel) const;
+
+  // The average rendering cost so far, in nanoseconds per (multichannel)
+  // frame.
+  double GetNsPerFrame() const;
+  void ResetStats();
+
+private:
+  // Render the next aFrames (up to a block) frames of every channel into
+  // mBlock, one contiguous row per channel.
+  void RenderBlock(size_t aFrames);
+  // Transpose the rows of mBlock into aFrames interleaved frames.
+  void Interleave(float* aBuffer, size_t aFrames) const;
+
+  unsigned int mChannels;
+  float mRate;
+  float mVolume;
+  std::vector<double> mPhase;      // In cycles, within [0, 1).
+  std::vector<double> mIncrement;  // In cycles per frame.
+  std::vector<float> mBlock;       // mChannels rows of a block of samples.
+  std::vector<float> mInterleaved; // Scratch for the 16-bit output.
+
+  uint64_t mFrames;
+  uint64_t mNs;
+};
+
+#endif // #ifndef SYNTHESIZER_H
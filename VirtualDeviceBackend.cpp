@@ -0,0 +1,294 @@
+#include "VirtualDeviceBackend.h"
+#include <cassert>
+#include <chrono>     // std::chrono
+#include <cmath>      // llround
+#include <cstddef>    // offsetof
+#include <cstring>    // memset
+#include <pthread.h>  // pthread_setschedparam
+#include <sched.h>    // sched_get_priority_max
+
+using Clock = std::chrono::steady_clock;
+
+static uint64_t
+ElapsedNs(Clock::time_point aFrom, Clock::time_point aTo)
+{
+  return aTo <= aFrom ? 0 :
+    std::chrono::duration_cast<std::chrono::nanoseconds>(aTo - aFrom).count();
+}
+
+static void
+UpdateMax(std::atomic<uint64_t>& aMax, uint64_t aValue)
+{
+  // Only the rendering thread writes aMax, so a plain load/store is enough.
+  if (aValue > aMax.load(std::memory_order_relaxed)) {
+    aMax.store(aValue, std::memory_order_relaxed);
+  }
+}
+
+static void
+Accumulate(std::atomic<uint64_t>& aTotal, uint64_t aValue)
+{
+  aTotal.store(aTotal.load(std::memory_order_relaxed) + aValue,
+               std::memory_order_relaxed);
+}
+
+VirtualDeviceBackend::VirtualDeviceBackend(UInt32 aFramesPerBuffer)
+  : mFramesPerBuffer(aFramesPerBuffer)
+  , mCallback(nullptr)
+  , mRefCon(nullptr)
+  , mCreated(false)
+  , mInitialized(false)
+  , mInputEnabled(false)
+  , mBufferList(nullptr)
+  , mRunning(false)
+  , mCallbacks(0)
+  , mMissedDeadlines(0)
+  , mSkippedPeriods(0)
+  , mTotalCallbackNs(0)
+  , mMaxCallbackNs(0)
+  , mTotalLatenessNs(0)
+  , mMaxLatenessNs(0)
+  , mRealtime(false)
+{
+  assert(mFramesPerBuffer);
+  memset(&mDesc, 0, sizeof(mDesc));
+  memset(&mInputDesc, 0, sizeof(mInputDesc));
+}
+
+VirtualDeviceBackend::~VirtualDeviceBackend()
+{
+  assert(!mRunning);
+}
+
+bool
+VirtualDeviceBackend::EnableInput(const AudioStreamBasicDescription& aDesc)
+{
+  assert(!mCreated);
+  if (aDesc.mFormatID != kAudioFormatLinearPCM ||
+      (aDesc.mFormatFlags & kAudioFormatFlagIsNonInterleaved) ||
+      !aDesc.mChannelsPerFrame || !aDesc.mBitsPerChannel) {
+    return false;
+  }
+  mInputEnabled = true;
+  mInputDesc = aDesc;
+  return true;
+}
+
+OSStatus
+VirtualDeviceBackend::RenderInput(AudioUnitRenderActionFlags* aActionFlags,
+                                  const AudioTimeStamp* aTimeStamp,
+                                  UInt32 aNumFrames,
+                                  AudioBufferList* aData)
+{
+  assert(mInputEnabled);
+  if (aNumFrames > mFramesPerBuffer || aData->mNumberBuffers != 1) {
+    return -1;
+  }
+
+  // Called at the beginning of the render callback, so mBuffer still holds
+  // the output of the previous cycle.
+  const uint8_t* output = mBuffer.data();
+  uint8_t* input = static_cast<uint8_t*>(aData->mBuffers[0].mData);
+  UInt32 sampleBytes = mInputDesc.mBitsPerChannel / 8;
+  UInt32 outputChannels = mDesc.mChannelsPerFrame;
+  for (UInt32 i = 0; i < aNumFrames; ++i) {
+    for (UInt32 c = 0; c < mInputDesc.mChannelsPerFrame; ++c) {
+      memcpy(input, output + (c % outputChannels) * sampleBytes, sampleBytes);
+      input += sampleBytes;
+    }
+    output += mDesc.mBytesPerFrame;
+  }
+  aData->mBuffers[0].mDataByteSize = aNumFrames * mInputDesc.mBytesPerFrame;
+  return noErr;
+}
+
+bool
+VirtualDeviceBackend::Create()
+{
+  assert(!mCreated);
+  mCreated = true;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::Destroy()
+{
+  assert(mCreated && !mInitialized);
+  mCreated = false;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::Init()
+{
+  assert(mCreated && !mInitialized);
+  if (!mDesc.mBytesPerFrame || !mCallback) {
+    return false;
+  }
+  bool nonInterleaved = mDesc.mFormatFlags & kAudioFormatFlagIsNonInterleaved;
+  if (mInputEnabled &&
+      (nonInterleaved || mInputDesc.mBitsPerChannel != mDesc.mBitsPerChannel)) {
+    return false; // Can't be looped back.
+  }
+
+  UInt32 buffers = nonInterleaved ? mDesc.mChannelsPerFrame : 1;
+  UInt32 bufferBytes = mDesc.mBytesPerFrame * mFramesPerBuffer;
+
+  mBuffer.assign(buffers * bufferBytes, 0);
+  mBufferListStorage.assign(offsetof(AudioBufferList, mBuffers) +
+                            buffers * sizeof(AudioBuffer), 0);
+  mBufferList = reinterpret_cast<AudioBufferList*>(mBufferListStorage.data());
+  mBufferList->mNumberBuffers = buffers;
+  for (UInt32 i = 0; i < buffers; ++i) {
+    AudioBuffer& buffer = mBufferList->mBuffers[i];
+    buffer.mNumberChannels = nonInterleaved ? 1 : mDesc.mChannelsPerFrame;
+    buffer.mDataByteSize = bufferBytes;
+    buffer.mData = mBuffer.data() + i * bufferBytes;
+  }
+
+  mInitialized = true;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::Uninit()
+{
+  assert(mInitialized && !mRunning);
+  mInitialized = false;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::SetStreamFormat(const AudioStreamBasicDescription& aDesc)
+{
+  assert(mCreated && !mInitialized);
+  if (aDesc.mFormatID != kAudioFormatLinearPCM ||
+      !aDesc.mSampleRate || !aDesc.mBytesPerFrame) {
+    return false;
+  }
+  mDesc = aDesc;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::SetCallback(AURenderCallback aCallback, void* aRefCon)
+{
+  assert(mCreated && !mRunning);
+  mCallback = aCallback;
+  mRefCon = aRefCon;
+  return true;
+}
+
+bool
+VirtualDeviceBackend::Start()
+{
+  assert(mInitialized);
+  if (mRunning) {
+    return true; // Same as AudioOutputUnitStart on a running unit.
+  }
+  mRunning = true;
+  mThread = std::thread(&VirtualDeviceBackend::Run, this);
+  return true;
+}
+
+bool
+VirtualDeviceBackend::Stop()
+{
+  if (!mRunning) {
+    return true; // Same as AudioOutputUnitStop on a stopped unit.
+  }
+  // This must not be called on the rendering thread, or it will wait forever.
+  assert(mThread.get_id() != std::this_thread::get_id());
+  mRunning = false;
+  mThread.join();
+  return true;
+}
+
+void
+VirtualDeviceBackend::SetSpinMargin(uint64_t aSpinMarginNs)
+{
+  assert(!mRunning);
+  mTimer.SetSpinMargin(aSpinMarginNs);
+}
+
+VirtualDeviceBackend::Stats
+VirtualDeviceBackend::GetStats() const
+{
+  Stats s;
+  s.mCallbacks = mCallbacks.load(std::memory_order_relaxed);
+  s.mMissedDeadlines = mMissedDeadlines.load(std::memory_order_relaxed);
+  s.mSkippedPeriods = mSkippedPeriods.load(std::memory_order_relaxed);
+  s.mTotalCallbackNs = mTotalCallbackNs.load(std::memory_order_relaxed);
+  s.mMaxCallbackNs = mMaxCallbackNs.load(std::memory_order_relaxed);
+  s.mTotalLatenessNs = mTotalLatenessNs.load(std::memory_order_relaxed);
+  s.mMaxLatenessNs = mMaxLatenessNs.load(std::memory_order_relaxed);
+  s.mRealtime = mRealtime.load(std::memory_order_relaxed);
+  return s;
+}
+
+/* static */ bool
+VirtualDeviceBackend::PromoteToRealtime()
+{
+  // This usually needs CAP_SYS_NICE (or an rtprio limit) on Linux. The device
+  // keeps running at normal priority when it's not granted.
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 10;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+void
+VirtualDeviceBackend::Run()
+{
+  mRealtime.store(PromoteToRealtime(), std::memory_order_relaxed);
+
+  // The ticks are at fixed offsets from the first one, so the wake-up
+  // lateness never accumulates into a clock drift.
+  const uint64_t periodNs = static_cast<uint64_t>(
+    llround(mFramesPerBuffer * 1e9 / mDesc.mSampleRate));
+  mTimer.StartTicks(periodNs);
+  uint64_t period = 0;
+  bool first = true;
+
+  while (mRunning.load(std::memory_order_acquire)) {
+    // The first tick is now. The ticks the timer skips are the periods the
+    // device dropped.
+    if (!first) {
+      uint64_t next = mTimer.WaitForNextTick();
+      Accumulate(mSkippedPeriods, next - period - 1);
+      period = next;
+    }
+    first = false;
+
+    const Clock::time_point begin = Clock::now();
+    uint64_t lateness = ElapsedNs(mTimer.GetTickTime(period), begin);
+
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    timeStamp.mSampleTime = static_cast<Float64>(period) * mFramesPerBuffer;
+    timeStamp.mHostTime = period * periodNs;
+    timeStamp.mRateScalar = 1.0;
+    timeStamp.mFlags = kAudioTimeStampSampleHostTimeValid |
+                       kAudioTimeStampRateScalarValid;
+
+    AudioUnitRenderActionFlags flags = 0;
+    mCallback(mRefCon, &flags, &timeStamp, 0, mFramesPerBuffer, mBufferList);
+
+    const Clock::time_point end = Clock::now();
+    uint64_t cost = ElapsedNs(begin, end);
+
+    Accumulate(mTotalCallbackNs, cost);
+    UpdateMax(mMaxCallbackNs, cost);
+    Accumulate(mTotalLatenessNs, lateness);
+    UpdateMax(mMaxLatenessNs, lateness);
+    mCallbacks.fetch_add(1, std::memory_order_relaxed);
+
+    // The rendered buffer is played out at the next tick. If it's not ready
+    // by then, the device glitches and moves on without waiting: the timer
+    // skips the ticks that have completely elapsed, so their periods are
+    // never requested.
+    if (end > mTimer.GetTickTime(period + 1)) {
+      mMissedDeadlines.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
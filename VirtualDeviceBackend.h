@@ -0,0 +1,99 @@
+#ifndef VIRTUALDEVICEBACKEND_H
+#define VIRTUALDEVICEBACKEND_H
+
+#include "AudioBackend.h"
+#include "PacingTimer.h"
+#include <atomic>   // std::atomic
+#include <stdint.h> // uint64_t
+#include <thread>   // std::thread
+#include <vector>   // std::vector
+
+// A deterministic virtual output device. Its rendering thread requests one
+// buffer per period of a simulated hardware clock, the ticks of a
+// PacingTimer: the N-th callback is scheduled N periods of aFramesPerBuffer /
+// rate seconds, rounded to the ns, after Start(), and carries a sample time
+// of N * aFramesPerBuffer. The thread asks for real-time priority, and it
+// records the callback cost, the wake-up jitter and the deadlines missed so
+// the same AudioCallback code can be measured on any platform.
+//
+// With input enabled, the device loops its output back: the input of a
+// render cycle is the output rendered in the previous cycle, and input
+// channel i carries output channel i % output channels. Both sides must use
+// interleaved samples of the same size.
+class VirtualDeviceBackend: public AudioBackend
+{
+public:
+  struct Stats
+  {
+    uint64_t mCallbacks;        // Number of fired render callbacks.
+    uint64_t mMissedDeadlines;  // Buffers not ready by the next period.
+    uint64_t mSkippedPeriods;   // Periods dropped by the device after misses.
+    uint64_t mTotalCallbackNs;  // Time spent in the render callbacks.
+    uint64_t mMaxCallbackNs;
+    uint64_t mTotalLatenessNs;  // Wake-up lateness against the device clock.
+    uint64_t mMaxLatenessNs;
+    bool mRealtime;             // Whether real-time priority was granted.
+  };
+
+  explicit VirtualDeviceBackend(UInt32 aFramesPerBuffer = 512);
+  ~VirtualDeviceBackend();
+
+  bool EnableInput(const AudioStreamBasicDescription& aDesc) override;
+  OSStatus RenderInput(AudioUnitRenderActionFlags* aActionFlags,
+                       const AudioTimeStamp* aTimeStamp,
+                       UInt32 aNumFrames,
+                       AudioBufferList* aData) override;
+  UInt32 GetMaxFramesPerBuffer() const override { return mFramesPerBuffer; }
+
+  bool Create() override;
+  bool Destroy() override;
+  bool Init() override;
+  bool Uninit() override;
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override;
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override;
+  bool Start() override;
+  bool Stop() override;
+
+  UInt32 GetFramesPerBuffer() const { return mFramesPerBuffer; }
+  // How long before a period boundary the device stops sleeping and spins.
+  // Only call this while the device is stopped.
+  void SetSpinMargin(uint64_t aSpinMarginNs);
+  // It's safe to call these from any thread while the device is running.
+  Stats GetStats() const;
+  PacingTimer::Stats GetPacingStats() const { return mTimer.GetStats(); }
+
+private:
+  void Run();
+  static bool PromoteToRealtime();
+
+  const UInt32 mFramesPerBuffer;
+  AudioStreamBasicDescription mDesc;
+  AURenderCallback mCallback;
+  void* mRefCon;
+  bool mCreated;
+  bool mInitialized;
+  bool mInputEnabled;
+  AudioStreamBasicDescription mInputDesc;
+
+  // Preallocated in Init() so nothing is allocated on the rendering thread.
+  // A non-interleaved stream gets one buffer per channel in the list.
+  std::vector<uint8_t> mBuffer;
+  std::vector<uint8_t> mBufferListStorage;
+  AudioBufferList* mBufferList;
+
+  std::thread mThread;
+  std::atomic<bool> mRunning;
+  PacingTimer mTimer;
+
+  // Written by the rendering thread only.
+  std::atomic<uint64_t> mCallbacks;
+  std::atomic<uint64_t> mMissedDeadlines;
+  std::atomic<uint64_t> mSkippedPeriods;
+  std::atomic<uint64_t> mTotalCallbackNs;
+  std::atomic<uint64_t> mMaxCallbackNs;
+  std::atomic<uint64_t> mTotalLatenessNs;
+  std::atomic<uint64_t> mMaxLatenessNs;
+  std::atomic<bool> mRealtime;
+};
+
+#endif // #ifndef VIRTUALDEVICEBACKEND_H
@@ -0,0 +1,86 @@
+#include "WakeSignal.h"
+#include <cassert>
+
+#if defined(__APPLE__)
+#include <mach/mach_init.h> // mach_task_self
+#include <mach/task.h>      // semaphore_create, semaphore_destroy
+#else
+#include <linux/futex.h>    // FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#include <sys/syscall.h>    // SYS_futex
+#include <unistd.h>         // syscall
+#endif
+
+WakeSignal::WakeSignal()
+  : mWord(IDLE)
+{
+#if defined(__APPLE__)
+  kern_return_t r = semaphore_create(mach_task_self(), &mSemaphore,
+                                     SYNC_POLICY_FIFO, 0);
+  assert(r == KERN_SUCCESS);
+  (void) r;
+#endif
+}
+
+WakeSignal::~WakeSignal()
+{
+  assert(mWord != WAITING);
+#if defined(__APPLE__)
+  semaphore_destroy(mach_task_self(), mSemaphore);
+#endif
+}
+
+void
+WakeSignal::Post()
+{
+  if (mWord.exchange(POSTED, std::memory_order_release) == WAITING) {
+    Wake();
+  }
+}
+
+void
+WakeSignal::Wait()
+{
+  uint32_t word = mWord.exchange(IDLE, std::memory_order_acquire);
+  while (word != POSTED) {
+    // Announce the sleep, unless a post came in since. Each wake made for it
+    // is then consumed by a single Sleep.
+    uint32_t expected = IDLE;
+    if (mWord.compare_exchange_strong(expected, WAITING,
+                                      std::memory_order_acquire)) {
+      Sleep();
+    }
+    word = mWord.exchange(IDLE, std::memory_order_acquire);
+  }
+}
+
+#if defined(__APPLE__)
+
+void
+WakeSignal::Sleep()
+{
+  // Only KERN_ABORTED comes back early, and Wait checks the word again.
+  semaphore_wait(mSemaphore);
+}
+
+void
+WakeSignal::Wake()
+{
+  semaphore_signal(mSemaphore);
+}
+
+#else // #if defined(__APPLE__)
+
+void
+WakeSignal::Sleep()
+{
+  // Returns right away if a post already moved the word off WAITING.
+  syscall(SYS_futex, &mWord, FUTEX_WAIT_PRIVATE, WAITING, nullptr, nullptr, 0);
+}
+
+void
+WakeSignal::Wake()
+{
+  syscall(SYS_futex, &mWord, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+#endif // #if defined(__APPLE__)
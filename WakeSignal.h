@@ -0,0 +1,51 @@
+#ifndef WAKESIGNAL_H
+#define WAKESIGNAL_H
+
+#include <atomic>   // std::atomic
+#include <stdint.h> // uint32_t
+
+#if defined(__APPLE__)
+#include <mach/semaphore.h>
+#endif
+
+// Wake a single waiting thread up from any thread, the render thread
+// included.
+//
+// Post never locks, allocates or waits: it's an exchange on the signal's
+// word, plus a futex wake (a Mach semaphore signal on macOS) only when the
+// waiter is asleep, a system call that never blocks. The posts made before
+// the waiter gets to run are coalesced into one wake-up.
+class WakeSignal
+{
+public:
+  WakeSignal();
+  ~WakeSignal();
+
+  // It's safe to call this from any thread.
+  void Post();
+  // Sleep until a post, unless one came since the last wait. Only one thread
+  // may wait on the signal.
+  void Wait();
+
+private:
+  enum Word : uint32_t
+  {
+    IDLE,
+    POSTED,
+    WAITING // The waiter is asleep, or about to be.
+  };
+
+  // Not copyable: the waiter sleeps on mWord's address.
+  WakeSignal(const WakeSignal&);
+  WakeSignal& operator=(const WakeSignal&);
+
+  void Sleep();
+  void Wake();
+
+  std::atomic<uint32_t> mWord;
+#if defined(__APPLE__)
+  semaphore_t mSemaphore;
+#endif
+};
+
+#endif // #ifndef WAKESIGNAL_H
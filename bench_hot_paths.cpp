@@ -0,0 +1,272 @@
+#include "AudioDeviceListener.h"
+#include "AudioObjectUtils.h"
+#include "AudioStream.h"
+#include "BenchReport.h"
+#include "CallableStream.h"
+#include "CoalescingDispatcher.h"
+#include "OwnedCriticalSection.h"
+#include <cstdio>   // for fopen, fprintf, snprintf
+#include <cstring>  // for memset
+#include <memory>   // for std::unique_ptr
+#include <vector>   // for std::vector
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const size_t kSamples = 5000;
+
+float gSink = 0.0f;
+
+/* AudioCallback */
+void touch(void* aBuffer, unsigned long aFrames)
+{
+  // As little as possible, so only the dispatch is measured.
+  float* data = static_cast<float*>(aBuffer);
+  data[0] = gSink;
+  data[aFrames * kChannels - 1] = gSink;
+}
+
+// A backend whose render callback is fired by the benchmark, on its own
+// thread, into a preallocated buffer.
+class ManualBackend: public AudioBackend
+{
+public:
+  explicit ManualBackend(UInt32 aFrames) : mFrames(aFrames) {}
+
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mBuffer.assign(mFrames * aDesc.mBytesPerFrame, 0);
+    mList.mNumberBuffers = 1;
+    mList.mBuffers[0].mNumberChannels = aDesc.mChannelsPerFrame;
+    mList.mBuffers[0].mDataByteSize = mBuffer.size();
+    mList.mBuffers[0].mData = mBuffer.data();
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  void Render()
+  {
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    mCallback(mRefCon, &flags, &timeStamp, 0, mFrames, &mList);
+  }
+
+private:
+  const UInt32 mFrames;
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  std::vector<uint8_t> mBuffer;
+  AudioBufferList mList;
+};
+
+/* ContextAudioCallback */
+void touchContext(void* aContext, void* aBuffer, unsigned long aFrames)
+{
+  touch(aBuffer, aFrames);
+}
+
+void measureRender(BenchReport& aReport, UInt32 aFrames, const char* aKind,
+                   AudioStream& aStream, ManualBackend* aDevice)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "render_dispatch/f32le_%uch_%u%s",
+           kChannels, aFrames, aKind);
+  aStream.Start();
+  aReport.Measure(name, kSamples * 4, 1, [aDevice] { aDevice->Render(); });
+  aStream.Stop();
+}
+
+// DataCallback -> Render -> the callback, one render per sample: an
+// AudioCallback, a ContextAudioCallback, and a lambda inlined into the
+// DataCallback of a CallableStream.
+void renderDispatch(BenchReport& aReport, UInt32 aFrames)
+{
+  ManualBackend* device = new ManualBackend(aFrames);
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, touch,
+                 std::unique_ptr<AudioBackend>(device));
+  measureRender(aReport, aFrames, "", as, device);
+
+  device = new ManualBackend(aFrames);
+  AudioStream context(AudioStream::F32LE, kChannels, kRate, touchContext,
+                      nullptr, std::unique_ptr<AudioBackend>(device));
+  measureRender(aReport, aFrames, "/context", context, device);
+
+  device = new ManualBackend(aFrames);
+  auto callable = MakeCallableStream(
+    AudioStream::F32LE, kChannels, kRate,
+    [](void* aBuffer, unsigned long aFrames) { touch(aBuffer, aFrames); },
+    std::unique_ptr<AudioBackend>(device));
+  measureRender(aReport, aFrames, "/callable", callable->GetStream(), device);
+}
+
+void lockUnlock(BenchReport& aReport)
+{
+  struct ModeName
+  {
+    OwnedCriticalSection::Mode mMode;
+    const char* mName;
+  };
+  const ModeName modes[] = {
+    { OwnedCriticalSection::NORMAL, "normal" },
+    { OwnedCriticalSection::ERRORCHECK, "errorcheck" },
+    { OwnedCriticalSection::PRIO_INHERIT, "prio_inherit" },
+    { OwnedCriticalSection::ADAPTIVE, "adaptive" }
+  };
+  for (const ModeName& m : modes) {
+    OwnedCriticalSection mutex(m.mMode);
+    std::string name = std::string("owned_critical_section/") + m.mName +
+                       "/lock_unlock";
+    aReport.Measure(name, kSamples, 1000, [&mutex] {
+      mutex.lock();
+      mutex.unlock();
+    });
+  }
+}
+
+/* CoalescingDispatcher::Callback */
+void ignore(uint32_t aChanges, void* aContext)
+{
+}
+
+/* DeviceChangeSetCallback */
+void ignoreChanges(DeviceChangeSet aChanges)
+{
+}
+
+// The Notify of the dispatcher behind AudioDeviceListener, on its own. Past
+// the first call of a burst, it's a single atomic OR.
+void dispatcherNotify(BenchReport& aReport)
+{
+  CoalescingDispatcher dispatcher(ignore, nullptr, 1);
+  aReport.Measure("coalescing_dispatcher/notify", kSamples, 1000,
+                  [&dispatcher] { dispatcher.Notify(1); });
+}
+
+// What a HAL notification costs its thread: AudioDeviceListener::OnEvent,
+// called as the HAL calls it, matching the addresses against its listener's
+// and mapping a match to its DeviceChange for the dispatcher. The listener
+// is the one the stub HAL keeps, so it only runs outside macOS.
+void listenerEvent(BenchReport& aReport)
+{
+#if !defined(__APPLE__)
+  AudioDeviceListener listener(ignoreChanges, 1);
+  AudioObjectPropertyListenerProc onEvent = nullptr;
+  void* data = nullptr;
+  if (!AudioHardwareStubFindListener(kAudioObjectSystemObject,
+                                     &DefaultOutputDeviceProperty::kAddress,
+                                     &onEvent, &data)) {
+    return;
+  }
+  // A HAL notification can carry several addresses. The match comes last.
+  const AudioObjectPropertyAddress addresses[] = {
+    DevicesProperty::kAddress,
+    DefaultInputDeviceProperty::kAddress,
+    { kAudioHardwarePropertyDefaultOutputDevice,
+      kAudioObjectPropertyScopeOutput,
+      kAudioObjectPropertyElementMaster },
+    DefaultOutputDeviceProperty::kAddress
+  };
+  const UInt32 count = sizeof(addresses) / sizeof(addresses[0]);
+  aReport.Measure("device_listener/on_event/match", kSamples, 1000,
+                  [onEvent, data, &addresses] {
+                    onEvent(kAudioObjectSystemObject, 1, &addresses[count - 1],
+                            data);
+                  });
+  aReport.Measure("device_listener/on_event/match_last", kSamples, 1000,
+                  [onEvent, data, &addresses] {
+                    onEvent(kAudioObjectSystemObject, count, addresses, data);
+                  });
+  aReport.Measure("device_listener/on_event/miss", kSamples, 1000,
+                  [onEvent, data, &addresses] {
+                    onEvent(kAudioObjectSystemObject, count - 1, addresses,
+                            data);
+                  });
+#endif
+}
+
+// The device queries, served by the property cache, and from the HAL after
+// the cache is cleared. The HAL is the stub of AudioHardwareStub.cpp but on
+// macOS. The names are read by CFStringRefToUTF8, also timed on its own.
+void deviceEnumeration(BenchReport& aReport)
+{
+  typedef AudioObjectUtils U;
+  aReport.Measure("devices/get_all_device_ids/cached", kSamples, 10, [] {
+    U::GetAllDeviceIds();
+  });
+  aReport.Measure("devices/get_all_device_ids/cold", kSamples / 10, 1, [] {
+    U::ClearCache();
+    U::GetAllDeviceIds();
+  });
+  vector<AudioObjectID> storage;
+  aReport.Measure("devices/get_all_device_ids/reused", kSamples, 10,
+                  [&storage] { U::GetAllDeviceIds(&storage); });
+  aReport.Measure("devices/get_device_ids_output/cached", kSamples, 10, [] {
+    U::GetDeviceIds(U::Output);
+  });
+  aReport.Measure("devices/get_device_ids_output/cold", kSamples / 10, 1, [] {
+    U::ClearCache();
+    U::GetDeviceIds(U::Output);
+  });
+  aReport.Measure("devices/get_device_ids_output/reused", kSamples, 10,
+                  [&storage] { U::GetDeviceIds(U::Output, &storage); });
+  vector<AudioObjectID> ids = U::GetDeviceIds(U::Output);
+  if (ids.empty()) {
+    return;
+  }
+  AudioObjectID id = ids[0];
+  aReport.Measure("devices/get_device_label/cached", kSamples, 10, [id] {
+    U::GetDeviceLabel(id, U::Output);
+  });
+  aReport.Measure("devices/get_device_label/cold", kSamples / 10, 1, [id] {
+    U::ClearCache();
+    U::GetDeviceLabel(id, U::Output);
+  });
+
+  CFStringRef name = nullptr;
+  if (GetProperty<DeviceNameProperty>(id, &name) != kAudioHardwareNoError ||
+      !name) {
+    return;
+  }
+  aReport.Measure("devices/cfstring_to_utf8", kSamples, 100, [name] {
+    U::CFStringRefToUTF8(name);
+  });
+  CFRelease(name);
+}
+
+// Write the results to the file named by the first argument, or stdout.
+int main(int argc, char** argv)
+{
+  BenchReport report;
+  renderDispatch(report, 64);
+  renderDispatch(report, 512);
+  lockUnlock(report);
+  dispatcherNotify(report);
+  listenerEvent(report);
+  deviceEnumeration(report);
+
+  for (const BenchReport::Result& r : report.GetResults()) {
+    fprintf(stderr, "%-48s p50 %10.1f ns  p99 %10.1f ns  max %10.1f ns\n",
+            r.mName.c_str(), r.mP50Ns, r.mP99Ns, r.mMaxNs);
+  }
+  FILE* out = argc > 1 ? fopen(argv[1], "w") : stdout;
+  if (!out) {
+    perror(argv[1]);
+    return 1;
+  }
+  report.Write(out);
+  if (out != stdout) {
+    fclose(out);
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+#include "OwnedCriticalSection.h"
+#include <atomic>    // for std::atomic
+#include <chrono>    // for std::chrono
+#include <cstdio>    // for printf
+#include <pthread.h> // for pthread_setschedparam
+#include <sched.h>   // for SCHED_FIFO
+#include <thread>    // for std::thread
+#include <time.h>    // for clock_gettime
+#include <vector>    // for std::vector
+
+using Clock = std::chrono::steady_clock;
+
+const int kIterations = 1000000;
+const int kContendedThreads = 4;
+const int kContendedIterations = 200000;
+
+// The inversion: a low priority thread holds the lock for kHoldMs of CPU
+// time while a middle priority one burns kBusyMs, and a high priority one
+// waits for the lock, all on one CPU.
+const double kHoldMs = 20.0;
+const double kBusyMs = 50.0;
+
+struct ModeName
+{
+  OwnedCriticalSection::Mode mMode;
+  const char* mName;
+};
+
+const ModeName kModes[] = {
+  { OwnedCriticalSection::NORMAL, "normal" },
+  { OwnedCriticalSection::ERRORCHECK, "errorcheck" },
+  { OwnedCriticalSection::PRIO_INHERIT, "prio_inherit" },
+  { OwnedCriticalSection::ADAPTIVE, "adaptive" }
+};
+
+double nsSince(Clock::time_point aStart)
+{
+  return std::chrono::duration<double, std::nano>(Clock::now() - aStart)
+    .count();
+}
+
+// The CPU time of the calling thread, which doesn't advance while it's
+// preempted.
+double threadCpuMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+void burnCpuMs(double aMs)
+{
+  double end = threadCpuMs() + aMs;
+  while (threadCpuMs() < end) {
+  }
+}
+
+double uncontendedNs(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode);
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    mutex.lock();
+    mutex.unlock();
+  }
+  return nsSince(start) / kIterations;
+}
+
+double tryLockNs(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode);
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kIterations; ++i) {
+    if (mutex.try_lock()) {
+      mutex.unlock();
+    }
+  }
+  return nsSince(start) / kIterations;
+}
+
+// The time per lock and unlock of a very short critical section, with
+// kContendedThreads threads taking turns.
+double contendedNs(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode);
+  volatile unsigned long counter = 0;
+  std::vector<std::thread> threads;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kContendedThreads; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < kContendedIterations; ++j) {
+        mutex.lock();
+        counter = counter + 1;
+        mutex.unlock();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return nsSince(start) / (kContendedThreads * kContendedIterations);
+}
+
+bool setPriority(int aPriority)
+{
+  struct sched_param param;
+  param.sched_priority = aPriority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+}
+
+// How long the high priority thread waits for the lock, in ms, or a negative
+// value if the real-time priorities aren't available.
+double inversionWaitMs(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode);
+  std::atomic<bool> failed(false);
+  std::atomic<bool> held(false);
+  double waitMs = 0;
+
+  // The main thread has the highest priority, to start the others while
+  // they run.
+  int base = sched_get_priority_min(SCHED_FIFO);
+  if (!setPriority(base + 40)) {
+    return -1;
+  }
+  std::thread low([&] {
+    failed = failed || !setPriority(base + 10);
+    mutex.lock();
+    held = true;
+    burnCpuMs(kHoldMs);
+    mutex.unlock();
+  });
+  while (!held) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::thread high([&] {
+    failed = failed || !setPriority(base + 30);
+    Clock::time_point start = Clock::now();
+    mutex.lock();
+    waitMs = nsSince(start) / 1e6;
+    mutex.unlock();
+  });
+  std::thread middle([&] {
+    failed = failed || !setPriority(base + 20);
+    burnCpuMs(kBusyMs);
+  });
+  low.join();
+  high.join();
+  middle.join();
+
+  struct sched_param param;
+  param.sched_priority = 0;
+  pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+  return failed ? -1 : waitMs;
+}
+
+// Run the inversion on a single CPU, where the priorities decide who runs.
+bool pinToOneCpu()
+{
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(0, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+  return false;
+#endif
+}
+
+int main()
+{
+  printf("%-12s %14s %14s %14s\n", "mode", "lock+unlock", "try_lock",
+         "contended");
+  for (const ModeName& mode : kModes) {
+    uncontendedNs(mode.mMode); // Warm up.
+    printf("%-12s %11.1f ns %11.1f ns %11.1f ns\n", mode.mName,
+           uncontendedNs(mode.mMode), tryLockNs(mode.mMode),
+           contendedNs(mode.mMode));
+  }
+
+  // The threads inherit the affinity of the main thread.
+  if (!pinToOneCpu()) {
+    printf("The priority inversion needs a single CPU: skipped.\n");
+    return 0;
+  }
+  printf("\nHigh priority wait for a %.0f ms low priority hold, "
+         "with %.0f ms of middle priority work:\n",
+         kHoldMs, kBusyMs);
+  for (const ModeName& mode : kModes) {
+    double waitMs = inversionWaitMs(mode.mMode);
+    if (waitMs < 0) {
+      printf("The real-time priorities aren't permitted: skipped.\n");
+      break;
+    }
+    printf("%-12s %11.1f ms\n", mode.mName, waitMs);
+  }
+  return 0;
+}
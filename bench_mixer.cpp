@@ -0,0 +1,165 @@
+#include "AudioMixer.h"
+#include "AudioStream.h"
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for printf
+#include <cstring>  // for memset
+#include <memory>   // for std::unique_ptr
+#include <vector>   // for std::vector
+
+using Clock = std::chrono::steady_clock;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 512;
+const double kSecondsPerRun = 0.2;
+const size_t kInputCounts[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+/* AudioCallback */
+void floatInput(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.01f;
+  }
+}
+
+/* AudioCallback */
+void shortInput(void* aBuffer, unsigned long aFrames)
+{
+  int16_t* data = static_cast<int16_t*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 300;
+  }
+}
+
+// A backend whose render callback is fired by the benchmark, on its own
+// thread, into a preallocated buffer.
+class ManualBackend: public AudioBackend
+{
+public:
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mBuffer.assign(kFrames * aDesc.mBytesPerFrame, 0);
+    mList.mNumberBuffers = 1;
+    mList.mBuffers[0].mNumberChannels = aDesc.mChannelsPerFrame;
+    mList.mBuffers[0].mDataByteSize = mBuffer.size();
+    mList.mBuffers[0].mData = mBuffer.data();
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  void Render()
+  {
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    mCallback(mRefCon, &flags, &timeStamp, 0, kFrames, &mList);
+  }
+
+private:
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  std::vector<uint8_t> mBuffer;
+  AudioBufferList mList;
+};
+
+// The ns it takes aRender to render kFrames frames.
+template<typename F>
+double measure(F aRender)
+{
+  // Warm up the caches and the branch predictors.
+  for (int i = 0; i < 100; ++i) {
+    aRender();
+  }
+  unsigned long cycles = 0;
+  Clock::time_point start = Clock::now();
+  std::chrono::duration<double, std::nano> elapsed(0);
+  while (elapsed.count() < kSecondsPerRun * 1e9) {
+    for (int i = 0; i < 10; ++i) {
+      aRender();
+    }
+    cycles += 10;
+    elapsed = Clock::now() - start;
+  }
+  return elapsed.count() / cycles;
+}
+
+// One mixer, rendering aInputs inputs of aFormat.
+double mixerNs(AudioStream::Format aFormat, size_t aInputs)
+{
+  ManualBackend* device = new ManualBackend();
+  AudioMixer mixer(AudioStream::S16LE, kChannels, kRate, aInputs,
+                   std::unique_ptr<AudioBackend>(device));
+  AudioCallback callback =
+    aFormat == AudioStream::F32LE ? floatInput : shortInput;
+  for (size_t i = 0; i < aInputs; ++i) {
+    mixer.Add(aFormat, callback, 0.5f);
+  }
+  return measure([device] { device->Render(); });
+}
+
+// aStreams AudioStreams, each on its own backend, as the inputs would be
+// without the mixer. Their render threads are all run on this thread.
+double streamsNs(size_t aStreams)
+{
+  std::vector<std::unique_ptr<AudioStream>> streams;
+  std::vector<ManualBackend*> devices;
+  for (size_t i = 0; i < aStreams; ++i) {
+    ManualBackend* device = new ManualBackend();
+    devices.push_back(device);
+    streams.emplace_back(new AudioStream(
+      AudioStream::S16LE, kChannels, kRate, shortInput,
+      std::unique_ptr<AudioBackend>(device)));
+  }
+  return measure([&devices] {
+    for (ManualBackend* device : devices) {
+      device->Render();
+    }
+  });
+}
+
+void report(const char* aName, double (*aMeasure)(size_t))
+{
+  double first = 0.0;
+  double last = 0.0;
+  size_t firstInputs = 0;
+  size_t lastInputs = 0;
+  for (size_t inputs : kInputCounts) {
+    double ns = aMeasure(inputs);
+    printf("%-14s %3zu inputs %10.0f ns/callback %8.1f ns/frame\n", aName,
+           inputs, ns, ns / kFrames);
+    if (!firstInputs) {
+      first = ns;
+      firstInputs = inputs;
+    }
+    last = ns;
+    lastInputs = inputs;
+  }
+  printf("%-14s %10.0f ns per additional input per callback\n\n", aName,
+         (last - first) / (lastInputs - firstInputs));
+}
+
+int main()
+{
+  printf("%u frames of %u channels per callback, %.0f ns of audio\n\n",
+         kFrames, kChannels, kFrames * 1e9 / kRate);
+  report("mixer f32le", [](size_t aInputs) {
+    return mixerNs(AudioStream::F32LE, aInputs);
+  });
+  report("mixer s16le", [](size_t aInputs) {
+    return mixerNs(AudioStream::S16LE, aInputs);
+  });
+  report("streams s16le", streamsNs);
+  return 0;
+}
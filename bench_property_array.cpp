@@ -0,0 +1,103 @@
+#include "AudioObjectProperties.h"
+#include "AudioObjectUtils.h"
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for printf
+#include <cstdlib>  // for malloc, free
+#include <new>      // for std::bad_alloc
+#include <vector>   // for std::vector
+
+using Clock = std::chrono::steady_clock;
+
+const int kCalls = 10000;
+
+// Count the heap allocations of the whole process.
+static unsigned long sAllocations = 0;
+
+void* operator new(size_t aSize)
+{
+  ++sAllocations;
+  void* p = malloc(aSize ? aSize : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* aPointer) noexcept
+{
+  free(aPointer);
+}
+
+// How the arrays were read before: into a temporary vector, then copied out.
+template<typename T>
+OSStatus readWithCopy(AudioObjectID aId,
+                      const AudioObjectPropertyAddress* aAddress,
+                      std::vector<T>* aArray)
+{
+  UInt32 size = 0;
+  OSStatus r = AudioObjectGetPropertyDataSize(aId, aAddress, 0, nullptr, &size);
+  if (r != kAudioHardwareNoError || !size) {
+    return r;
+  }
+  std::vector<T> data(size / sizeof(T));
+  r = AudioObjectGetPropertyData(aId, aAddress, 0, nullptr, &size,
+                                 static_cast<void*>(data.data()));
+  if (r == kAudioHardwareNoError) {
+    *aArray = data;
+  }
+  return r;
+}
+
+template<typename Read>
+void measure(const char* aName, Read aRead)
+{
+  // Warm up, so the reused buffers are already large enough.
+  for (int i = 0; i < 10; ++i) {
+    aRead();
+  }
+  unsigned long allocations = sAllocations;
+  Clock::time_point start = Clock::now();
+  for (int i = 0; i < kCalls; ++i) {
+    aRead();
+  }
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  printf("%-28s %8.2f allocations/call %10.0f ns/call\n", aName,
+         double(sAllocations - allocations) / kCalls,
+         elapsed.count() / kCalls);
+}
+
+int main()
+{
+  std::vector<AudioObjectID> devices;
+  AudioObjectID buffer[64];
+  UInt32 count = 0;
+
+  measure("devices, copied", [&] {
+    std::vector<AudioObjectID> ids;
+    readWithCopy(kAudioObjectSystemObject, &DevicesProperty::kAddress, &ids);
+  });
+  measure("devices, reused vector", [&] {
+    GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, &devices);
+  });
+  measure("devices, caller's buffer", [&] {
+    GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, buffer, 64,
+                                      &count);
+  });
+
+  AudioObjectID output =
+    AudioObjectUtils::GetDefaultDeviceId(AudioObjectUtils::Output);
+  if (output == kAudioObjectUnknown) {
+    printf("No output device: skip the streams.\n");
+    return 0;
+  }
+  typedef StreamsProperty<kAudioObjectPropertyScopeOutput> OutputStreams;
+  std::vector<AudioStreamID> streams;
+  measure("streams, copied", [&] {
+    std::vector<AudioStreamID> ids;
+    readWithCopy(output, &OutputStreams::kAddress, &ids);
+  });
+  measure("streams, reused vector", [&] {
+    GetPropertyArray<OutputStreams>(output, &streams);
+  });
+  return 0;
+}
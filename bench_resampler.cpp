@@ -0,0 +1,100 @@
+#include "Resampler.h"
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for printf
+#include <cstring>  // for memcpy
+#include <vector>   // for std::vector
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // for __rdtsc
+#define HAVE_TSC
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kFrames = 512;
+const double kSecondsPerRun = 0.2;
+const unsigned int kChannelCounts[] = { 1, 2, 6, 8 };
+
+struct Tier
+{
+  Resampler::Quality mQuality;
+  const char* mName;
+};
+
+const Tier kTiers[] = {
+  { Resampler::LOW, "low" },
+  { Resampler::MEDIUM, "medium" },
+  { Resampler::HIGH, "high" }
+};
+
+// Rendered once, so the source costs a copy.
+std::vector<float> gInput;
+
+/* Resampler::Source */
+void source(void* aContext, float* aBuffer, unsigned long aFrames)
+{
+  unsigned int channels = *static_cast<unsigned int*>(aContext);
+  memcpy(aBuffer, gInput.data(), aFrames * channels * sizeof(float));
+}
+
+uint64_t ticks()
+{
+#if defined(HAVE_TSC)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+void measure(const Tier& aTier, unsigned int aChannels, double aInRate,
+             double aOutRate)
+{
+  Resampler resampler(aChannels, aInRate, aOutRate, aTier.mQuality, kFrames,
+                      source, &aChannels);
+  gInput.resize(resampler.GetMaxInputFrames() * aChannels);
+  for (size_t i = 0; i < gInput.size(); ++i) {
+    gInput[i] = (i % 64) / 64.0f - 0.5f;
+  }
+  std::vector<float> out(kFrames * aChannels);
+
+  // Warm up the caches and the branch predictors.
+  for (int i = 0; i < 100; ++i) {
+    resampler.Process(out.data(), kFrames);
+  }
+
+  uint64_t frames = 0;
+  uint64_t startTicks = ticks();
+  Clock::time_point start = Clock::now();
+  std::chrono::duration<double, std::nano> elapsed(0);
+  while (elapsed.count() < kSecondsPerRun * 1e9) {
+    for (int i = 0; i < 10; ++i) {
+      resampler.Process(out.data(), kFrames);
+    }
+    frames += 10 * kFrames;
+    elapsed = Clock::now() - start;
+  }
+  double cycles = static_cast<double>(ticks() - startTicks) / frames;
+  double ns = elapsed.count() / frames;
+  // How many channels one core could resample in real time.
+  double channels = 1e9 / (ns / aChannels * aOutRate);
+  printf("%-6s %2u ch %6.0f->%-6.0f %8.1f cycles/frame %8.2f ns/frame "
+         "%8.0f channels/core\n",
+         aTier.mName, aChannels, aInRate, aOutRate, cycles, ns, channels);
+}
+
+int main()
+{
+  printf("SIMD: %s, %zu frames per call", Resampler::SimdName(), kFrames);
+#if defined(HAVE_TSC)
+  printf(", cycles counted by the TSC\n");
+#else
+  printf(", no cycle counter\n");
+#endif
+  for (const Tier& tier : kTiers) {
+    for (unsigned int channels : kChannelCounts) {
+      measure(tier, channels, 44100.0, 48000.0);
+      measure(tier, channels, 48000.0, 44100.0);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,84 @@
+#include "SampleConverter.h"
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for printf
+#include <vector>   // for std::vector
+
+using Clock = std::chrono::steady_clock;
+
+const size_t kSamples = 4096;
+const double kSecondsPerPath = 0.2;
+
+std::vector<float> gFloats(kSamples);
+std::vector<int16_t> gShorts(kSamples);
+SampleConverter::Dither gDither;
+
+// The per-sample conversion done by test_audio.cpp's ConvertSample<short>.
+void naiveFloatToS16(const float* aIn, int16_t* aOut, size_t aSamples)
+{
+  for (size_t i = 0; i < aSamples; ++i) {
+    aOut[i] = short(aIn[i] * 32767.0f);
+  }
+}
+
+template<typename Function>
+void measure(const char* aName, Function aFunction)
+{
+  // Warm up the caches and the branch predictors.
+  for (int i = 0; i < 100; ++i) {
+    aFunction();
+  }
+
+  unsigned long long samples = 0;
+  Clock::time_point start = Clock::now();
+  std::chrono::duration<double> elapsed(0);
+  while (elapsed.count() < kSecondsPerPath) {
+    for (int i = 0; i < 100; ++i) {
+      aFunction();
+    }
+    samples += 100 * kSamples;
+    elapsed = Clock::now() - start;
+  }
+  printf("%-24s %10.1f Msamples/s\n", aName,
+         samples / elapsed.count() / 1e6);
+}
+
+int main()
+{
+  for (size_t i = 0; i < kSamples; ++i) {
+    gFloats[i] = (static_cast<float>(i % 256) / 128.0f) - 1.0f;
+    gShorts[i] = static_cast<int16_t>(i * 31);
+  }
+
+  printf("SIMD: %s, %zu samples per call\n", SampleConverter::SimdName(),
+         kSamples);
+
+  measure("naive float->s16", [] {
+    naiveFloatToS16(gFloats.data(), gShorts.data(), kSamples);
+  });
+  measure("float->s16le", [] {
+    SampleConverter::FloatToS16(gFloats.data(), gShorts.data(), kSamples);
+  });
+  measure("float->s16le dither", [] {
+    SampleConverter::FloatToS16(gFloats.data(), gShorts.data(), kSamples,
+                                gDither);
+  });
+  measure("float->s16be", [] {
+    SampleConverter::FloatToS16(gFloats.data(), gShorts.data(), kSamples,
+                                true);
+  });
+  measure("s16le->float", [] {
+    SampleConverter::S16ToFloat(gShorts.data(), gFloats.data(), kSamples);
+  });
+  measure("s16be->float", [] {
+    SampleConverter::S16ToFloat(gShorts.data(), gFloats.data(), kSamples,
+                                true);
+  });
+  measure("swap16 (s16be)", [] {
+    SampleConverter::SwapBytes16(gShorts.data(), gShorts.data(), kSamples);
+  });
+  measure("swap32 (f32be)", [] {
+    SampleConverter::SwapBytes32(gFloats.data(), gFloats.data(), kSamples);
+  });
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include "Synthesizer.h"
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for printf
+#include <vector>   // for std::vector
+
+using Clock = std::chrono::steady_clock;
+
+const float kRate = 48000.0f;
+const long kFrames = 512;
+const double kSecondsPerRun = 0.2;
+
+// How many channels one core could render in real time at a given cost.
+double channelsPerCore(unsigned int aChannels, double aNsPerFrame)
+{
+  double nsPerChannelFrame = aNsPerFrame / aChannels;
+  return 1e9 / (nsPerChannelFrame * kRate);
+}
+
+template<typename T>
+void measure(const char* aName, unsigned int aChannels)
+{
+  Synthesizer synth(aChannels, kRate);
+  std::vector<T> buffer(kFrames * aChannels);
+
+  // Warm up the caches and the branch predictors.
+  for (int i = 0; i < 100; ++i) {
+    synth.Run(buffer.data(), kFrames);
+  }
+  synth.ResetStats();
+
+  Clock::time_point start = Clock::now();
+  std::chrono::duration<double> elapsed(0);
+  while (elapsed.count() < kSecondsPerRun) {
+    for (int i = 0; i < 10; ++i) {
+      synth.Run(buffer.data(), kFrames);
+    }
+    elapsed = Clock::now() - start;
+  }
+  double ns = synth.GetNsPerFrame();
+  printf("%-6s %4u channels %10.1f ns/frame %10.0f channels/core\n", aName,
+         aChannels, ns, channelsPerCore(aChannels, ns));
+}
+
+int main()
+{
+  printf("%ld frames per call at %.0f Hz\n", kFrames, kRate);
+  const unsigned int channels[] = { 1, 2, 8, 64, 256 };
+  for (unsigned int c : channels) {
+    measure<float>("f32", c);
+  }
+  for (unsigned int c : channels) {
+    measure<int16_t>("s16", c);
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+#include "AudioObject.h"
+#include "AudioObjectUtils.h"
+#include <cassert>  // for assert
+#include <iostream> // for std::cout, std::endl
+
+using std::cout;
+using std::endl;
+
+void testSystemObject()
+{
+  AudioObject system(kAudioObjectSystemObject, kAudioSystemObjectClassID);
+  vector<AudioObjectID> ids;
+  assert(system.GetArray<DevicesProperty>(&ids) == kAudioHardwareNoError);
+  assert(ids == AudioObjectUtils::GetAllDeviceIds());
+  cout << "devices: " << ids.size() << endl;
+
+  AudioObjectID output = kAudioObjectUnknown;
+  assert(system.Get<DefaultOutputDeviceProperty>(&output) ==
+         kAudioHardwareNoError);
+  assert(output ==
+         AudioObjectUtils::GetDefaultDeviceId(AudioObjectUtils::Output));
+}
+
+void testDevice()
+{
+  AudioObjectID id =
+    AudioObjectUtils::GetDefaultDeviceId(AudioObjectUtils::Output);
+  if (id == kAudioObjectUnknown) {
+    cout << "No output device." << endl;
+    return;
+  }
+  AudioObject device(id, kAudioDeviceClassID);
+  typedef StreamsProperty<kAudioObjectPropertyScopeOutput> OutputStreams;
+  vector<AudioStreamID> streams;
+  assert(device.GetArray<OutputStreams>(&streams) == kAudioHardwareNoError);
+  assert(!streams.empty());
+  // The same array, read through the address.
+  vector<AudioStreamID> again;
+  assert(device.GetPropertyArray(&OutputStreams::kAddress, &again) ==
+         kAudioHardwareNoError);
+  assert(again == streams);
+}
+
+int main()
+{
+  testSystemObject();
+  testDevice();
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "CallableStream.h"
+#include "OfflineRenderBackend.h"
+#include <cassert>  // for assert
+#include <cstring>  // for memcpy
+#include <iostream> // for std::cout, std::endl
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const uint64_t kFrames = 48000;
+
+// A functor with its own state: a ramp, going on from one call to the next.
+struct Ramp
+{
+  int16_t mStep;
+  uint64_t mFrames = 0;
+  unsigned long mCalls = 0;
+
+  void operator()(void* aBuffer, unsigned long aFrames)
+  {
+    int16_t* data = static_cast<int16_t*>(aBuffer);
+    for (unsigned long i = 0; i < aFrames; ++i, ++mFrames) {
+      int16_t v = static_cast<int16_t>(mFrames * mStep);
+      for (unsigned int c = 0; c < kChannels; ++c) {
+        data[i * kChannels + c] = v;
+      }
+    }
+    ++mCalls;
+  }
+};
+
+template<typename T>
+T sampleAt(const uint8_t* aData, size_t aIndex)
+{
+  T v;
+  memcpy(&v, aData + aIndex * sizeof(T), sizeof(T));
+  return v;
+}
+
+void testFunctors()
+{
+  // Two streams rendering at once, each with its own state.
+  OfflineRenderBackend* first = new OfflineRenderBackend(kFrames, 256);
+  OfflineRenderBackend* second = new OfflineRenderBackend(kFrames, 441);
+  CallableStream<Ramp> a(AudioStream::S16LE, kChannels, kRate, Ramp{ 1 },
+                         std::unique_ptr<AudioBackend>(first));
+  CallableStream<Ramp> b(AudioStream::S16LE, kChannels, kRate, Ramp{ 3 },
+                         std::unique_ptr<AudioBackend>(second));
+  assert(a->Start() && b->Start());
+  assert(first->WaitUntilDone(10000) && second->WaitUntilDone(10000));
+  // Called straight from the render callback, with the state and the timing
+  // still kept as for any other stream.
+  assert(a->GetState() == AudioStream::STARTED);
+  assert(a->GetCallbackTiming().mCallbacks == a.GetCallable().mCalls);
+  assert(a->Stop() && b->Stop());
+
+  assert(a.GetCallable().mFrames == kFrames);
+  assert(b.GetCallable().mFrames == kFrames);
+  assert(a.GetCallable().mCalls == (kFrames + 255) / 256);
+  for (size_t i = 0; i < kFrames * kChannels; ++i) {
+    uint64_t frame = i / kChannels;
+    assert(sampleAt<int16_t>(first->GetData(), i) ==
+           static_cast<int16_t>(frame));
+    assert(sampleAt<int16_t>(second->GetData(), i) ==
+           static_cast<int16_t>(frame * 3));
+  }
+}
+
+void testLambdas()
+{
+  // A capturing lambda, as the float source of a 16-bit stream.
+  float level = 0.5f;
+  unsigned long frames = 0;
+  OfflineRenderBackend* device = new OfflineRenderBackend(kFrames);
+  auto stream = MakeCallableStream(
+    AudioStream::S16LE, kChannels, kRate,
+    [&level, &frames](void* aBuffer, unsigned long aFrames) {
+      float* data = static_cast<float*>(aBuffer);
+      for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+        data[i] = level;
+      }
+      frames += aFrames;
+    },
+    std::unique_ptr<AudioBackend>(device));
+  assert((*stream)->SetFloatSource());
+  assert((*stream)->Start());
+  assert(device->WaitUntilDone(10000));
+  assert((*stream)->Stop());
+  assert(frames == kFrames);
+  for (size_t i = 0; i < kFrames * kChannels; ++i) {
+    assert(sampleAt<int16_t>(device->GetData(), i) == 16384);
+  }
+}
+
+struct Tone
+{
+  float mLevel;
+  unsigned long mFrames;
+};
+
+/* ContextAudioCallback */
+void constant(void* aContext, void* aBuffer, unsigned long aFrames)
+{
+  Tone* tone = static_cast<Tone*>(aContext);
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = tone->mLevel;
+  }
+  tone->mFrames += aFrames;
+}
+
+void testContext()
+{
+  // The type-erased callback, through the resampler and the ring.
+  Tone tone = { 0.25f, 0 };
+  OfflineRenderBackend* device = new OfflineRenderBackend(kFrames);
+  AudioStream as(AudioStream::F32LE, kChannels, 44100.0, constant, &tone,
+                 std::unique_ptr<AudioBackend>(device));
+  assert(as.SetResampler(kRate));
+  assert(as.Start());
+  assert(device->WaitUntilDone(10000));
+  assert(as.Stop());
+  // A second at either rate, plus the frames rendered ahead.
+  size_t latency = as.GetResamplerLatencyFrames();
+  assert(tone.mFrames >= 44100 && tone.mFrames <= 44100 + latency + 1);
+  // A constant stays constant once the filter is past the silence before it.
+  for (size_t i = 2 * latency * kChannels; i < kFrames * kChannels; ++i) {
+    float s = sampleAt<float>(device->GetData(), i);
+    assert(s > 0.2499f && s < 0.2501f);
+  }
+
+  Tone ringTone = { 0.0f, 0 };
+  AudioStream ring(AudioStream::F32LE, kChannels, kRate, constant, &ringTone,
+                   std::unique_ptr<AudioBackend>(
+                     new OfflineRenderBackend(kFrames)));
+  assert(ring.SetRingBuffer(1024));
+}
+
+int main()
+{
+  testFunctors();
+  testLambdas();
+  testContext();
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "AudioStream.h"
+#include "CallbackTiming.h"
+#include "VirtualDeviceBackend.h"
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256; // About 5.3 ms.
+
+unsigned long gCallbacks = 0;
+unsigned long gSlowEvery = 0;
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.0f;
+  }
+  ++gCallbacks;
+  if (gSlowEvery && gCallbacks % gSlowEvery == 0) {
+    // Longer than the period of the buffer.
+    std::this_thread::sleep_for(std::chrono::milliseconds(8));
+  }
+}
+
+uint64_t sum(const uint64_t* aBuckets)
+{
+  uint64_t total = 0;
+  for (size_t i = 0; i < CallbackTiming::BUCKETS; ++i) {
+    total += aBuckets[i];
+  }
+  return total;
+}
+
+void testBuckets()
+{
+  assert(CallbackTiming::Bucket(0) == 0);
+  assert(CallbackTiming::Bucket(1) == 0);
+  assert(CallbackTiming::Bucket(2) == 1);
+  assert(CallbackTiming::Bucket(3) == 1);
+  assert(CallbackTiming::Bucket(1024) == 10);
+  assert(CallbackTiming::Bucket(2047) == 10);
+  assert(CallbackTiming::Bucket(~uint64_t(0)) == CallbackTiming::BUCKETS - 1);
+  for (size_t i = 1; i < CallbackTiming::BUCKETS; ++i) {
+    uint64_t bound = CallbackTiming::Snapshot::BucketLowerBoundNs(i);
+    assert(CallbackTiming::Bucket(bound) == i);
+    assert(CallbackTiming::Bucket(bound - 1) == i - 1);
+  }
+}
+
+void testRecord()
+{
+  CallbackTiming timing;
+  timing.Record(1000, 1500, 1000);  // 500 ns
+  timing.Record(2000, 4000, 1000);  // 2000 ns: overrun, 1000 ns interval
+  timing.Record(4000, 4100, 1000);  // 100 ns, 2000 ns interval
+
+  CallbackTiming::Snapshot s = timing.GetSnapshot();
+  assert(s.mCallbacks == 3);
+  assert(s.mOverruns == 1);
+  assert(s.mTotalDurationNs == 2600);
+  assert(s.mMaxDurationNs == 2000);
+  assert(s.mMaxIntervalNs == 2000);
+  assert(s.mDuration[CallbackTiming::Bucket(500)] == 1);
+  assert(s.mDuration[CallbackTiming::Bucket(2000)] == 1);
+  assert(s.mDuration[CallbackTiming::Bucket(100)] == 1);
+  assert(sum(s.mInterval) == 2);
+
+  // No interval across a restart.
+  timing.Restart();
+  timing.Record(1000000, 1000100, 1000);
+  s = timing.GetSnapshot();
+  assert(sum(s.mInterval) == 2 && s.mMaxIntervalNs == 2000);
+
+  timing.Reset();
+  s = timing.GetSnapshot();
+  assert(s.mCallbacks == 0 && sum(s.mDuration) == 0);
+}
+
+void testStream()
+{
+  std::unique_ptr<AudioBackend> backend(new VirtualDeviceBackend(kFrames));
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::move(backend));
+
+  gSlowEvery = 10;
+  assert(as.Start());
+  // Read the snapshots while the render thread writes.
+  for (int i = 0; i < 20; ++i) {
+    CallbackTiming::Snapshot s = as.GetCallbackTiming();
+    assert(sum(s.mDuration) == s.mCallbacks);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  assert(!as.ResetCallbackTiming()); // Not while running.
+  assert(as.Stop());
+
+  CallbackTiming::Snapshot s = as.GetCallbackTiming();
+  cout << "callbacks: " << s.mCallbacks
+       << ", overruns: " << s.mOverruns
+       << ", max duration: " << s.mMaxDurationNs << " ns"
+       << ", max interval: " << s.mMaxIntervalNs << " ns" << endl;
+  assert(s.mCallbacks == gCallbacks);
+  assert(sum(s.mDuration) == s.mCallbacks);
+  assert(sum(s.mInterval) == s.mCallbacks - 1);
+  assert(s.mOverruns > 0 && s.mOverruns <= s.mCallbacks / gSlowEvery + 1);
+  assert(s.mMaxDurationNs >= 8000000);
+
+  assert(as.ResetCallbackTiming());
+  assert(as.GetCallbackTiming().mCallbacks == 0);
+}
+
+int main()
+{
+  testBuckets();
+  testRecord();
+  testStream();
+  return 0;
+}
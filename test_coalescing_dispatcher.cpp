@@ -0,0 +1,102 @@
+#include "CoalescingDispatcher.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+
+const unsigned int kWindowMs = 50;
+
+struct Received
+{
+  std::atomic<int> mCallbacks;
+  std::atomic<uint32_t> mChanges;
+  std::atomic<bool> mOnCallerThread;
+  std::thread::id mCaller;
+};
+
+/* CoalescingDispatcher::Callback */
+void onChanges(uint32_t aChanges, void* aContext)
+{
+  Received* received = static_cast<Received*>(aContext);
+  received->mChanges |= aChanges;
+  ++received->mCallbacks;
+  if (std::this_thread::get_id() == received->mCaller) {
+    received->mOnCallerThread = true;
+  }
+}
+
+void sleepMs(unsigned int aMs)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(aMs));
+}
+
+void testBurstIsCoalesced()
+{
+  Received received;
+  received.mCallbacks = 0;
+  received.mChanges = 0;
+  received.mOnCallerThread = false;
+  received.mCaller = std::this_thread::get_id();
+
+  CoalescingDispatcher dispatcher(onChanges, &received, kWindowMs);
+  // A burst of notifications from several threads, like the HAL's.
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 3; ++t) {
+    threads.emplace_back([&dispatcher, t] {
+      for (int i = 0; i < 100; ++i) {
+        dispatcher.Notify(1u << t);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  sleepMs(4 * kWindowMs);
+
+  CoalescingDispatcher::Stats stats = dispatcher.GetStats();
+  cout << "notifications: " << stats.mNotifications
+       << ", callbacks: " << stats.mDispatches << endl;
+  assert(stats.mNotifications == 300);
+  assert(received.mChanges == 0x7);
+  // The burst took much less than a window, so it's delivered at once, or
+  // twice if the window ran out in the middle of it.
+  assert(received.mCallbacks >= 1 && received.mCallbacks <= 2);
+  assert(stats.mDispatches == static_cast<uint64_t>(received.mCallbacks));
+  assert(!received.mOnCallerThread);
+
+  // A change after the burst is delivered on its own.
+  received.mChanges = 0;
+  int callbacks = received.mCallbacks;
+  dispatcher.Notify(0x8);
+  sleepMs(4 * kWindowMs);
+  assert(received.mCallbacks == callbacks + 1);
+  assert(received.mChanges == 0x8);
+}
+
+void testDestroyWithPendingChanges()
+{
+  Received received;
+  received.mCallbacks = 0;
+  received.mChanges = 0;
+  received.mOnCallerThread = false;
+  received.mCaller = std::this_thread::get_id();
+  {
+    // Destroyed within the window: it shouldn't wait for it.
+    CoalescingDispatcher dispatcher(onChanges, &received, 10000);
+    dispatcher.Notify(0x1);
+    sleepMs(10);
+  }
+  assert(received.mCallbacks == 0);
+}
+
+int main()
+{
+  testBurstIsCoalesced();
+  testDestroyWithPendingChanges();
+  return 0;
+}
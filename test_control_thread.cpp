@@ -0,0 +1,233 @@
+#include "AudioControlThread.h"
+#include "AudioStream.h"
+#include "OwnedCriticalSection.h"
+#include "VirtualDeviceBackend.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstring>  // for memset
+#include <iostream> // for std::cout, std::endl
+#include <mutex>    // for std::lock_guard
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using Clock = std::chrono::steady_clock;
+using locker = std::lock_guard<OwnedCriticalSection>;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+// How long each backend operation of the SlowBackend takes.
+const unsigned int kSlowMs = 30;
+
+AudioControlThread* gControl = nullptr;
+std::atomic<unsigned long> gCallbacks(0);
+OwnedCriticalSection gMutex(OwnedCriticalSection::NORMAL, "gMutex");
+bool gLockInCallback = false;
+
+double msSince(Clock::time_point aStart)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - aStart)
+    .count();
+}
+
+/* LockOrderValidator::Reporter */
+void ignore(const LockOrderValidator::Violation& aViolation)
+{
+  // The lock in the callback is intended here.
+  assert(aViolation.mKind == LockOrderValidator::LockOnRenderThread);
+}
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  if (gLockInCallback) {
+    // What test_deadlock.cpp does: a lock another thread may hold while it
+    // changes the stream.
+    locker guard(gMutex);
+  }
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+  ++gCallbacks;
+}
+
+// A VirtualDeviceBackend taking as long as an AudioUnit stuck behind its
+// internal lock, which checks it's only driven by the control thread.
+class SlowBackend: public VirtualDeviceBackend
+{
+public:
+  SlowBackend()
+    : VirtualDeviceBackend(kFrames)
+  {}
+
+  bool Create() override { Wait(); return VirtualDeviceBackend::Create(); }
+  bool Init() override { Wait(); return VirtualDeviceBackend::Init(); }
+  bool Start() override { Wait(); return VirtualDeviceBackend::Start(); }
+  bool Stop() override { Wait(); return VirtualDeviceBackend::Stop(); }
+
+private:
+  static void Wait()
+  {
+    assert(gControl->IsCurrentThread());
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSlowMs));
+  }
+};
+
+struct Completed
+{
+  std::atomic<int> mCount;
+  std::atomic<bool> mOnControlThread;
+};
+
+/* AudioControlThread::Completion */
+void onCompleted(bool aSucceeded, void* aContext)
+{
+  Completed* completed = static_cast<Completed*>(aContext);
+  assert(aSucceeded);
+  completed->mOnControlThread = gControl->IsCurrentThread();
+  ++completed->mCount;
+}
+
+void testSerialOrder()
+{
+  const int kThreads = 4;
+  const int kCommands = 100;
+  std::atomic<int> running(0);
+  std::atomic<bool> overlapped(false);
+  std::vector<int> last(kThreads, -1);
+  bool ordered = true;
+
+  std::vector<std::thread> posters;
+  std::vector<std::future<bool>> results[kThreads];
+  for (int t = 0; t < kThreads; ++t) {
+    posters.emplace_back([&, t] {
+      for (int i = 0; i < kCommands; ++i) {
+        results[t].push_back(gControl->Post([&, t, i] {
+          overlapped = overlapped || ++running > 1;
+          // Each poster's commands run in the order they were posted.
+          ordered = ordered && last[t] == i - 1;
+          last[t] = i;
+          --running;
+          return gControl->IsCurrentThread();
+        }));
+      }
+    });
+  }
+  for (std::thread& poster : posters) {
+    poster.join();
+  }
+  for (int t = 0; t < kThreads; ++t) {
+    for (std::future<bool>& result : results[t]) {
+      assert(result.get());
+    }
+  }
+  assert(!overlapped);
+  assert(ordered);
+  AudioControlThread::Stats stats = gControl->GetStats();
+  assert(stats.mPosted == stats.mExecuted);
+}
+
+void testNonBlockingControl()
+{
+  Clock::time_point start = Clock::now();
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::unique_ptr<AudioBackend>(new SlowBackend()), gControl);
+  Completed started = { { 0 }, { false } };
+  std::future<bool> startResult = as.StartAsync(onCompleted, &started);
+  double postedMs = msSince(start);
+
+  // Created, initialized and started later, on the control thread.
+  assert(postedMs < kSlowMs);
+  assert(as.GetSetupResult().get());
+  assert(startResult.get());
+  assert(started.mCount == 1);
+  assert(started.mOnControlThread);
+  while (!gCallbacks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  start = Clock::now();
+  std::future<bool> stopResult = as.StopAsync();
+  assert(msSince(start) < kSlowMs);
+  assert(stopResult.get());
+  cout << "posted the creation and the start in " << postedMs << " ms"
+       << endl;
+}
+
+void testNoDeadlock()
+{
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::unique_ptr<AudioBackend>(
+                   new VirtualDeviceBackend(kFrames)), gControl);
+  gCallbacks = 0;
+  gLockInCallback = true;
+  assert(as.Start());
+  while (!gCallbacks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::future<bool> stopped;
+  {
+    locker guard(gMutex);
+    // Stop would wait for the callback, waiting for gMutex, forever. Posting
+    // it doesn't.
+    stopped = as.StopAsync();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(stopped.wait_for(std::chrono::seconds(0)) !=
+           std::future_status::ready);
+  }
+  assert(stopped.get());
+  gLockInCallback = false;
+}
+
+void testSetFormat()
+{
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::unique_ptr<AudioBackend>(
+                   new VirtualDeviceBackend(kFrames)), gControl);
+  assert(as.SetFloatSource());
+  assert(as.SetFormatAsync(AudioStream::S16LE, 44100.0).get());
+
+  gCallbacks = 0;
+  std::future<bool> started = as.StartAsync();
+  // Only while stopped.
+  std::future<bool> rejected = as.SetFormatAsync(AudioStream::F32LE, kRate);
+  assert(started.get());
+  assert(!rejected.get());
+  while (!gCallbacks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(as.Stop());
+  assert(as.SetFormat(AudioStream::F32LE, kRate));
+}
+
+void testWithoutControlThread()
+{
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::unique_ptr<AudioBackend>(
+                   new VirtualDeviceBackend(kFrames)));
+  Completed completed = { { 0 }, { false } };
+  std::future<bool> started = as.StartAsync(onCompleted, &completed);
+  // Already run.
+  assert(started.wait_for(std::chrono::seconds(0)) ==
+         std::future_status::ready);
+  assert(completed.mCount == 1);
+  assert(started.get());
+  assert(as.StopAsync().get());
+}
+
+int main()
+{
+  LockOrderValidator::Global().SetReporter(ignore);
+
+  AudioControlThread control;
+  gControl = &control;
+
+  testSerialOrder();
+  testNonBlockingControl();
+  testNoDeadlock();
+  testSetFormat();
+  testWithoutControlThread();
+  return 0;
+}
@@ -17,8 +17,9 @@
 //   mutex_M -------------------> Thread B
 #include "AudioStream.h"          // for AudioStream
 #include "OwnedCriticalSection.h" // for OwnedCriticalSection
-#include "utils.h"                // for LOG
+#include "utils.h"                // for RT_LOG
 #include <assert.h>               // for assert
+#include <atomic>                 // for std::atomic
 #include <pthread.h>              // for pthread
 #include <signal.h>               // for signal
 #include <unistd.h>               // for sleep, usleep
@@ -32,7 +33,7 @@ const unsigned int kChannels = 2;
 // If we apply ERRORCHECK mode, then we can't unlock a mutex locked by a
 // different thread.
 // OwnedCriticalSection gMutex(OwnedCriticalSection::Mode::ERRORCHECK);
-OwnedCriticalSection gMutex;
+OwnedCriticalSection gMutex(OwnedCriticalSection::NORMAL, "gMutex");
 using locker = std::lock_guard<OwnedCriticalSection>;
 
 // Indicating whether the test is passed.
@@ -50,10 +51,23 @@ bool gTaskDone = false;
 // Indicating whether our pending task thread is killed by ourselves.
 bool gKilled = false;
 
+// Indicating whether the LockOrderValidator flagged the lock taken in the
+// callback. It does on the first callback, without waiting for the deadlock.
+std::atomic<bool> gFlagged(false);
+
+/* LockOrderValidator::Reporter */
+void onViolation(const LockOrderValidator::Violation& aViolation)
+{
+  // The deadlock is intended here, so record the report instead of aborting.
+  if (aViolation.mKind == LockOrderValidator::LockOnRenderThread) {
+    gFlagged = true;
+  }
+}
+
 void killer(int aSignal)
 {
   assert(aSignal == CALL_THREAD_KILLER);
-  LOG("pending task thread is killed!\n");
+  RT_LOG("pending task thread is killed!\n");
   gKilled = true;
 }
 
@@ -74,21 +88,23 @@ void callback(void* aBuffer, unsigned long aFrames)
   gCalling = true;
 
   uint64_t id = getThreadId();
-  !gCalled && LOG("Output callback is on thread %llu, holding mutex_AU\n", id);
+  if (!gCalled) {
+    RT_LOG("Output callback is on thread %llu, holding mutex_AU\n", id);
+  }
   gCalled = true;
 
   if (!gTaskDone) {
     // Force to switch threads by sleeping 10 ms. Notice that anything over
     // 10ms would produce a glitch. It's intended for testing deadlock,
     // so we ignore the fault here.
-    LOG("[%llu] Force to switch threads\n", id);
+    RT_LOG("[%llu] Force to switch threads\n", id);
     usleep(10000);
   }
 
-  LOG("[%llu] Try getting another mutex: gMutex...\n", id);
+  RT_LOG("[%llu] Try getting another mutex: gMutex...\n", id);
   locker guard(gMutex);
 
-  LOG("[%llu] Got mutex finally!\n", id);
+  RT_LOG("[%llu] Got mutex finally!\n", id);
 
   gCalling = false;
 }
@@ -99,18 +115,18 @@ void* task(void*)
   locker guard(gMutex);
 
   uint64_t id = getThreadId();
-  LOG("Task thread: %llu, holding gMutex, is created\n", id);
+  RT_LOG("Task thread: %llu, holding gMutex, is created\n", id);
 
   while(!gCalling) {
-    LOG("[%llu] waiting for output callback before running task\n", id);
+    RT_LOG("[%llu] waiting for output callback before running task\n", id);
     usleep(1000); // Force to switch threads by sleeping 1 ms.
   }
 
   // Creating another AudioUnit when we already had one will cause a deadlock!
-  LOG("[%llu] Try creating another AudioUnit (getting mutex_AU)...\n", id);
+  RT_LOG("[%llu] Try creating another AudioUnit (getting mutex_AU)...\n", id);
   AudioStream as(AudioStream::F32LE, kChannels, kFequency, callback);
 
-  LOG("[%llu] Another AudioUnit is created!\n", id);
+  RT_LOG("[%llu] Another AudioUnit is created!\n", id);
   gTaskDone = true;
 
   return NULL;
@@ -120,24 +136,24 @@ void* task(void*)
 // void* task(void*)
 // {
 //   uint64_t id = getThreadId();
-//   LOG("Task thread: %llu is created\n", id);
+//   RT_LOG("Task thread: %llu is created\n", id);
 //
 //   while(!gCalling) {
-//     LOG("[%llu] waiting for output callback before running task\n", id);
+//     RT_LOG("[%llu] waiting for output callback before running task\n", id);
 //     usleep(1000); // Force to switch threads by sleeping 1 ms.
 //   }
 //
 //   // Creating another AudioUnit when we already had one will cause a deadlock!
-//   LOG("[%llu] Try creating another AudioUnit (getting mutex_AU)...\n", id);
+//   RT_LOG("[%llu] Try creating another AudioUnit (getting mutex_AU)...\n", id);
 //   AudioStream as(AudioStream::Format::F32LE, kFequency, kChannels, callback);
 //
-//   LOG("[%llu] Another AudioUnit is created!\n", id);
+//   RT_LOG("[%llu] Another AudioUnit is created!\n", id);
 //
 //   // Hold the mutex.
-//   LOG("[%llu] Try getting another mutex: gMutex...\n", id);
+//   RT_LOG("[%llu] Try getting another mutex: gMutex...\n", id);
 //   locker guard(gMutex);
 //
-//   LOG("[%llu] Got mutex finally!\n", id);
+//   RT_LOG("[%llu] Got mutex finally!\n", id);
 //
 //   gTaskDone = true;
 //
@@ -151,14 +167,14 @@ void* watchdog(void* aSubject)
   pthread_t subject = *((pthread_t *) aSubject);
   uint64_t sid = getThreadId(subject);
 
-  LOG("Monitor thread %llu on thread %llu\n", sid, id);
+  RT_LOG("Monitor thread %llu on thread %llu\n", sid, id);
 
   unsigned int sec = 1;
-  LOG("[%llu] sleep %d seconds before checking task for thread %llu\n", id, sec, sid);
+  RT_LOG("[%llu] sleep %d seconds before checking task for thread %llu\n", id, sec, sid);
   sleep(sec); // Force to switch threads.
 
   if (!gTaskDone) {
-    LOG("[%llu] Kill the task thread %llu!\n", id, sid);
+    RT_LOG("[%llu] Kill the task thread %llu!\n", id, sid);
     assert(!pthread_kill(subject, CALL_THREAD_KILLER));
     assert(!pthread_detach(subject));
     // The mutex held by the killed thread(subject) won't be released,
@@ -167,7 +183,7 @@ void* watchdog(void* aSubject)
     gMutex.unlock();
   }
 
-  LOG("\n[%llu] Task is %sdone\n\n", id, gTaskDone ? "": "NOT ");
+  RT_LOG("\n[%llu] Task is %sdone\n\n", id, gTaskDone ? "": "NOT ");
   gPass = gTaskDone;
 
   return NULL;
@@ -175,6 +191,13 @@ void* watchdog(void* aSubject)
 
 int main()
 {
+  // Write the logs out from a separate thread, so the callback never blocks
+  // on the stdio lock.
+  if (ENABLE_LOG) {
+    RealtimeLogger::Global().Start();
+  }
+  LockOrderValidator::Global().SetReporter(onViolation);
+
   AudioStream as(AudioStream::F32LE, kChannels, kFequency, callback);
 
   // Install signal handler.
@@ -195,6 +218,9 @@ int main()
   // No need to keep checking in this case.
   assert(gCalled && "Callback should be fired!");
 
+  assert((!VALIDATE_LOCK_ORDER || gFlagged) &&
+         "The lock in the callback should be flagged!");
+
   // The task thread might keep running after the deadlock is freed, so we use
   // gPass instead of gTaskDone.
   assert(gPass && "Deadlock detected!");
@@ -204,5 +230,6 @@ int main()
   // True gPass means there is no deadlock and no need to kill any thread.
   assert(gPass != gKilled && "Killer is out of control!");
 
+  RealtimeLogger::Global().Stop();
   return 0;
 }
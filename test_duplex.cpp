@@ -0,0 +1,75 @@
+#include "AudioStream.h"
+#include "VirtualDeviceBackend.h"
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kInputChannels = 1;
+const unsigned int kOutputChannels = 2;
+const UInt32 kFrames = 256;
+
+unsigned long gCallbacks = 0;
+unsigned long gMismatches = 0;
+const void* gInputBuffer = nullptr;
+bool gSameInputBuffer = true;
+// The output of the previous cycle, which the virtual device loops back.
+std::vector<float> gPrevious(kFrames * kOutputChannels, 0.0f);
+
+/* DuplexAudioCallback */
+void callback(const void* aInput, void* aOutput, unsigned long aFrames)
+{
+  assert(aFrames == kFrames);
+  const float* input = static_cast<const float*>(aInput);
+  float* output = static_cast<float*>(aOutput);
+
+  // The input is captured into the same preallocated buffer every time.
+  gSameInputBuffer = gSameInputBuffer &&
+                     (!gInputBuffer || gInputBuffer == aInput);
+  gInputBuffer = aInput;
+
+  for (unsigned long i = 0; i < aFrames; ++i) {
+    // Input channel 0 is output channel 0 of the previous cycle.
+    if (input[i * kInputChannels] != gPrevious[i * kOutputChannels]) {
+      ++gMismatches;
+    }
+    for (unsigned int c = 0; c < kOutputChannels; ++c) {
+      float value = static_cast<float>(gCallbacks * aFrames + i) +
+                    (c ? 0.5f : 0.0f);
+      output[i * kOutputChannels + c] = value;
+      gPrevious[i * kOutputChannels + c] = value;
+    }
+  }
+  ++gCallbacks;
+}
+
+void testDuplex()
+{
+  std::unique_ptr<AudioBackend> backend(new VirtualDeviceBackend(kFrames));
+  AudioStream as(AudioStream::F32LE, kInputChannels, kOutputChannels, kRate,
+                 callback, std::move(backend));
+  // The duplex callback renders in place, so the other modes don't apply.
+  assert(!as.SetRingBuffer(kFrames));
+  assert(!as.SetFloatSource());
+
+  assert(as.Start());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(as.Stop());
+
+  cout << "duplex callbacks: " << gCallbacks
+       << ", mismatches: " << gMismatches << endl;
+  assert(gCallbacks > 0 && "Callback should be fired!");
+  assert(!gMismatches && "Input should be the looped-back output!");
+  assert(gSameInputBuffer);
+}
+
+int main()
+{
+  testDuplex();
+  return 0;
+}
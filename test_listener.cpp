@@ -1,5 +1,6 @@
 #include "AudioDeviceListener.h"
 #include "AudioObjectUtils.h"
+#include <atomic>     // for std::atomic
 #include <cassert>    // for assert
 #include <iostream>   // for std::cout, std::endl
 #include <pthread.h>  // for pthread_self()
@@ -26,7 +27,7 @@ bool changeDefaultDevice(AudioObjectUtils::Scope aScope)
 
   AudioObjectID currentId = AudioObjectUtils::GetDefaultDeviceId(aScope);
   // Get next available device.
-  AudioObjectID newId;
+  AudioObjectID newId = kAudioObjectUnknown;
   for (AudioObjectID id: ids) {
     if (id != currentId) {
       newId = id;
@@ -37,10 +38,13 @@ bool changeDefaultDevice(AudioObjectUtils::Scope aScope)
   return AudioObjectUtils::SetDefaultDevice(newId, aScope);
 }
 
-bool gDeviceChanged = false;
-/* DeviceChangeCallback */
-void OnDeviceChanged() {
-  cout << "(thread " << pthread_self() << ") Device Changed!" << endl;
+std::atomic<bool> gDeviceChanged(false);
+/* DeviceChangeSetCallback */
+void OnDeviceChanged(DeviceChangeSet aChanges) {
+  cout << "(thread " << pthread_self() << ") Device Changed:"
+       << (aChanges & DefaultInputChanged ? " default input" : "")
+       << (aChanges & DefaultOutputChanged ? " default output" : "")
+       << (aChanges & DevicesChanged ? " device list" : "") << endl;
   gDeviceChanged = true;
 }
 
@@ -70,5 +74,9 @@ int main()
   testChangeDefaultDevice(Input);
   testChangeDefaultDevice(Output);
 
+  CoalescingDispatcher::Stats stats = adl.GetStats();
+  cout << "notifications: " << stats.mNotifications
+       << ", callbacks: " << stats.mDispatches << endl;
+
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "OwnedCriticalSection.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <mutex>    // for std::lock_guard
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using locker = std::lock_guard<OwnedCriticalSection>;
+using TryGuard = OwnedCriticalSection::TryGuard;
+
+const OwnedCriticalSection::Mode kModes[] = {
+  OwnedCriticalSection::NORMAL,
+  OwnedCriticalSection::ERRORCHECK,
+  OwnedCriticalSection::PRIO_INHERIT,
+  OwnedCriticalSection::ADAPTIVE
+};
+
+std::atomic<uint64_t> gReports(0);
+
+/* LockOrderValidator::Reporter */
+void record(const LockOrderValidator::Violation& aViolation)
+{
+  cout << "reported: " << aViolation.mMessage << endl;
+  ++gReports;
+}
+
+// Run aFunction while another thread holds aMutex.
+template<typename Function>
+void whileHeld(OwnedCriticalSection& aMutex, Function aFunction)
+{
+  std::atomic<bool> held(false);
+  std::atomic<bool> done(false);
+  std::thread holder([&] {
+    locker guard(aMutex);
+    held = true;
+    while (!done) {
+      std::this_thread::yield();
+    }
+  });
+  while (!held) {
+    std::this_thread::yield();
+  }
+  aFunction();
+  done = true;
+  holder.join();
+}
+
+// Every mode excludes the other threads.
+void testMutualExclusion(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode, "counter");
+  const int kThreads = 4;
+  const int kIncrements = 10000;
+  int counter = 0;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < kIncrements; ++j) {
+        locker guard(mutex);
+        ++counter;
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  assert(counter == kThreads * kIncrements);
+}
+
+void testTryLock(OwnedCriticalSection::Mode aMode)
+{
+  OwnedCriticalSection mutex(aMode, "try");
+  assert(mutex.try_lock());
+  mutex.unlock();
+
+  whileHeld(mutex, [&] {
+    assert(!mutex.try_lock());
+    assert(!mutex.try_lock(OwnedCriticalSection::ADAPTIVE_SPINS));
+  });
+
+  // Usable by the std wrappers as well.
+  std::unique_lock<OwnedCriticalSection> lock(mutex, std::try_to_lock);
+  assert(lock.owns_lock());
+}
+
+void testTryGuard()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "guarded");
+  {
+    TryGuard guard(mutex);
+    assert(guard.OwnsLock());
+  }
+
+  whileHeld(mutex, [&] {
+    TryGuard guard(mutex, OwnedCriticalSection::SKIP);
+    assert(!guard.OwnsLock());
+  });
+
+  // BLOCK waits for the holder to be done.
+  std::atomic<bool> held(false);
+  std::atomic<bool> released(false);
+  std::thread holder([&] {
+    locker guard(mutex);
+    held = true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    released = true;
+  });
+  while (!held) {
+    std::this_thread::yield();
+  }
+  {
+    TryGuard guard(mutex, OwnedCriticalSection::BLOCK);
+    assert(guard.OwnsLock());
+    assert(released);
+  }
+  holder.join();
+}
+
+// A try_lock can't block, so the render thread may use it.
+void testTryLockOnRenderThread()
+{
+  if (!VALIDATE_LOCK_ORDER) {
+    return;
+  }
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "render");
+  LockOrderValidator::RenderThreadScope render;
+  {
+    TryGuard guard(mutex);
+    assert(guard.OwnsLock());
+  }
+  assert(gReports == 0);
+  {
+    locker guard(mutex);
+  }
+  assert(gReports == 1);
+}
+
+int main()
+{
+  LockOrderValidator::Global().SetReporter(record);
+
+  for (OwnedCriticalSection::Mode mode : kModes) {
+    testMutualExclusion(mode);
+    testTryLock(mode);
+  }
+  testTryGuard();
+  testTryLockOnRenderThread();
+  return 0;
+}
@@ -0,0 +1,225 @@
+#include "AudioStream.h"
+#include "OwnedCriticalSection.h"
+#include <algorithm> // for std::all_of
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <mutex>    // for std::lock_guard
+#include <string>   // for std::string
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using locker = std::lock_guard<OwnedCriticalSection>;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+
+std::mutex gReportsMutex;
+std::vector<LockOrderValidator::Violation> gReports;
+
+/* LockOrderValidator::Reporter */
+void record(const LockOrderValidator::Violation& aViolation)
+{
+  std::lock_guard<std::mutex> guard(gReportsMutex);
+  cout << "reported: " << aViolation.mMessage << endl;
+  gReports.push_back(aViolation);
+}
+
+// Take the reports so far.
+std::vector<LockOrderValidator::Violation> takeReports()
+{
+  std::lock_guard<std::mutex> guard(gReportsMutex);
+  std::vector<LockOrderValidator::Violation> reports;
+  reports.swap(gReports);
+  return reports;
+}
+
+void testConsistentOrder()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+  for (int i = 0; i < 3; ++i) {
+    locker guardA(a);
+    locker guardB(b);
+  }
+  // Taking them one at a time doesn't order them.
+  {
+    locker guardB(b);
+  }
+  {
+    locker guardA(a);
+  }
+  assert(takeReports().empty());
+}
+
+void testInvertedOrder()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+  {
+    locker guardA(a);
+    locker guardB(b);
+  }
+  // Never deadlocks here, on a single thread, yet two threads running these
+  // two blocks could. It's caught right away.
+  {
+    locker guardB(b);
+    locker guardA(a);
+  }
+  std::vector<LockOrderValidator::Violation> reports = takeReports();
+  assert(reports.size() == 1);
+  assert(reports[0].mKind == LockOrderValidator::LockOrderCycle);
+  assert(reports[0].mMessage == "Lock order cycle: a -> b -> a");
+
+  // The same cycle isn't reported twice.
+  {
+    locker guardB(b);
+    locker guardA(a);
+  }
+  assert(takeReports().empty());
+}
+
+void testCycleAcrossThreads()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+  OwnedCriticalSection c(OwnedCriticalSection::NORMAL, "c");
+  // Each thread runs alone, so none of them can block, but the three orders
+  // together close a cycle.
+  std::thread([&] { locker guardA(a); locker guardB(b); }).join();
+  std::thread([&] { locker guardB(b); locker guardC(c); }).join();
+  assert(takeReports().empty());
+  std::thread([&] { locker guardC(c); locker guardA(a); }).join();
+
+  std::vector<LockOrderValidator::Violation> reports = takeReports();
+  assert(reports.size() == 1);
+  assert(reports[0].mKind == LockOrderValidator::LockOrderCycle);
+  assert(reports[0].mMessage == "Lock order cycle: a -> b -> c -> a");
+}
+
+void testOutOfOrderUnlock()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+  OwnedCriticalSection c(OwnedCriticalSection::NORMAL, "c");
+  a.lock();
+  b.lock();
+  a.unlock();
+  // Only b is held now: c is ordered after b, not a.
+  c.lock();
+  c.unlock();
+  b.unlock();
+  assert(takeReports().empty());
+
+  {
+    locker guardC(c);
+    locker guardA(a);
+  }
+  // A three-thread cycle, found through b only.
+  std::vector<LockOrderValidator::Violation> reports = takeReports();
+  assert(reports.size() == 1);
+  assert(reports[0].mMessage == "Lock order cycle: a -> b -> c -> a");
+}
+
+void testForgottenLock()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  {
+    OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+    locker guardA(a);
+    locker guardB(b);
+  }
+  // A new lock, maybe at the same address, doesn't inherit b's order.
+  OwnedCriticalSection b(OwnedCriticalSection::NORMAL, "b");
+  {
+    locker guardB(b);
+    locker guardA(a);
+  }
+  assert(takeReports().empty());
+}
+
+void testRenderThreadScope()
+{
+  OwnedCriticalSection a(OwnedCriticalSection::NORMAL, "a");
+  assert(!LockOrderValidator::IsRenderThread());
+  {
+    LockOrderValidator::RenderThreadScope render;
+    assert(LockOrderValidator::IsRenderThread());
+    locker guard(a);
+  }
+  assert(!LockOrderValidator::IsRenderThread());
+  {
+    locker guard(a);
+  }
+
+  std::vector<LockOrderValidator::Violation> reports = takeReports();
+  assert(reports.size() == 1);
+  assert(reports[0].mKind == LockOrderValidator::LockOnRenderThread);
+  assert(reports[0].mMessage == "a is taken on a render thread");
+}
+
+OwnedCriticalSection gCallbackMutex(OwnedCriticalSection::NORMAL,
+                                    "gCallbackMutex");
+std::atomic<int> gCallbacks(0);
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  // What test_deadlock.cpp does: a lock another thread may hold while it
+  // waits for the AudioUnit.
+  locker guard(gCallbackMutex);
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.0f;
+  }
+  ++gCallbacks;
+}
+
+void testLockInRenderCallback()
+{
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback);
+  auto start = std::chrono::steady_clock::now();
+  assert(as.Start());
+  while (!gCallbacks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  assert(as.Stop());
+
+  // Flagged by the first callback, with no deadlock or timeout to wait for.
+  std::vector<LockOrderValidator::Violation> reports = takeReports();
+  assert(!reports.empty());
+  assert(std::all_of(reports.begin(), reports.end(),
+                     [](const LockOrderValidator::Violation& aReport) {
+                       return aReport.mKind ==
+                              LockOrderValidator::LockOnRenderThread;
+                     }));
+  cout << "caught after "
+       << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count()
+       << " ms" << endl;
+}
+
+int main()
+{
+  if (!VALIDATE_LOCK_ORDER) {
+    cout << "The lock order validation is compiled out." << endl;
+    return 0;
+  }
+
+  LockOrderValidator& validator = LockOrderValidator::Global();
+  validator.SetReporter(record);
+
+  testConsistentOrder();
+  testInvertedOrder();
+  testCycleAcrossThreads();
+  testOutOfOrderUnlock();
+  testForgottenLock();
+  testRenderThreadScope();
+  testLockInRenderCallback();
+
+  cout << validator.GetViolationCount() << " violations" << endl;
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include "Host.h"
+#include "LockProfiler.h"
+#include "OwnedCriticalSection.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstdio>   // for tmpfile, fread
+#include <cstring>  // for strstr, strcmp
+#include <iostream> // for std::cout, std::endl
+#include <mutex>    // for std::lock_guard
+#include <string>   // for std::string
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using locker = std::lock_guard<OwnedCriticalSection>;
+
+void sleepMs(unsigned int aMs)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(aMs));
+}
+
+// Read what was written into aFile.
+std::string readAll(FILE* aFile)
+{
+  std::string content;
+  rewind(aFile);
+  char buffer[256];
+  size_t read = 0;
+  while ((read = fread(buffer, 1, sizeof(buffer), aFile)) > 0) {
+    content.append(buffer, read);
+  }
+  return content;
+}
+
+void testUnprofiled()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "unprofiled");
+  assert(!mutex.GetProfile());
+  locker guard(mutex);
+}
+
+void testUncontended()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "uncontended",
+                             OwnedCriticalSection::PROFILED);
+  for (int i = 0; i < 100; ++i) {
+    locker guard(mutex);
+  }
+
+  LockProfile::Snapshot snapshot = mutex.GetProfile()->GetSnapshot();
+  assert(!strcmp(snapshot.mName, "uncontended"));
+  assert(snapshot.mAcquisitions == 100);
+  assert(snapshot.mContended == 0);
+  assert(snapshot.mTotalWaitNs == 0);
+  uint64_t holds = 0;
+  for (uint64_t count : snapshot.mHold) {
+    holds += count;
+  }
+  assert(holds == 100);
+  assert(snapshot.mHolderCount == 1);
+  assert(!strcmp(snapshot.mHolders[0].mName, "main"));
+  assert(snapshot.mHolders[0].mAcquisitions == 100);
+  assert(snapshot.mHolders[0].mHoldNs == snapshot.mTotalHoldNs);
+}
+
+void testContended()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "contended",
+                             OwnedCriticalSection::PROFILED);
+  std::atomic<bool> held(false);
+  std::thread holder([&] {
+    LockProfiler::SetThreadName("holder");
+    locker guard(mutex);
+    held = true;
+    sleepMs(20);
+  });
+  while (!held) {
+    std::this_thread::yield();
+  }
+  {
+    // Waits for the holder's 20 ms.
+    locker guard(mutex);
+  }
+  holder.join();
+
+  LockProfile::Snapshot snapshot = mutex.GetProfile()->GetSnapshot();
+  assert(snapshot.mAcquisitions == 2);
+  assert(snapshot.mContended == 1);
+  assert(snapshot.mMaxWaitNs >= 10000000);
+  assert(snapshot.mMaxHoldNs >= 20000000);
+  // The longest holder first.
+  assert(snapshot.mHolderCount == 2);
+  assert(!strcmp(snapshot.mHolders[0].mName, "holder"));
+  assert(!strcmp(snapshot.mHolders[1].mName, "main"));
+  cout << "waited " << snapshot.mMaxWaitNs / 1000 << " us for a "
+       << snapshot.mMaxHoldNs / 1000 << " us hold" << endl;
+}
+
+void testTopHolders()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "many holders",
+                             OwnedCriticalSection::PROFILED);
+  // A long holder, then more threads than the table has room for.
+  std::thread([&] {
+    LockProfiler::SetThreadName("long");
+    locker guard(mutex);
+    sleepMs(5);
+  }).join();
+  // They stay alive until all of them are done, so none reuses the id of
+  // another.
+  const size_t threads = 2 * LockProfile::HOLDERS;
+  std::atomic<size_t> done(0);
+  std::vector<std::thread> others;
+  for (size_t i = 0; i < threads; ++i) {
+    others.emplace_back([&] {
+      {
+        locker guard(mutex);
+      }
+      ++done;
+      while (done < threads) {
+        std::this_thread::yield();
+      }
+    });
+  }
+  for (std::thread& thread : others) {
+    thread.join();
+  }
+
+  LockProfile::Snapshot snapshot = mutex.GetProfile()->GetSnapshot();
+  assert(snapshot.mAcquisitions == 2 * LockProfile::HOLDERS + 1);
+  assert(snapshot.mHolderCount == LockProfile::HOLDERS);
+  assert(!strcmp(snapshot.mHolders[0].mName, "long"));
+}
+
+void testReport()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "reported",
+                             OwnedCriticalSection::PROFILED);
+  {
+    locker guard(mutex);
+  }
+  FILE* file = tmpfile();
+  assert(file);
+  LockProfiler::Global().Report(file);
+  std::string report = readAll(file);
+  fclose(file);
+  assert(report.find("reported: 1 acquisitions, 0 contended") !=
+         std::string::npos);
+  assert(report.find("holder main: 1 acquisitions") != std::string::npos);
+}
+
+void testPeriodicReport()
+{
+  OwnedCriticalSection mutex(OwnedCriticalSection::NORMAL, "periodic",
+                             OwnedCriticalSection::PROFILED);
+  FILE* file = tmpfile();
+  assert(file);
+  LockProfiler::Global().Start(file, 10);
+  for (int i = 0; i < 10; ++i) {
+    locker guard(mutex);
+    sleepMs(5);
+  }
+  LockProfiler::Global().Stop();
+  std::string report = readAll(file);
+  fclose(file);
+  assert(report.find("periodic: ") != std::string::npos);
+}
+
+// The cost of an uncontended lock and unlock, in ns.
+double measure(OwnedCriticalSection& aMutex)
+{
+  const int kIterations = 200000;
+  uint64_t start = NowNs();
+  for (int i = 0; i < kIterations; ++i) {
+    locker guard(aMutex);
+  }
+  return double(NowNs() - start) / kIterations;
+}
+
+void testOverhead()
+{
+  OwnedCriticalSection plain(OwnedCriticalSection::NORMAL, "plain");
+  OwnedCriticalSection profiled(OwnedCriticalSection::NORMAL, "profiled",
+                                OwnedCriticalSection::PROFILED);
+  measure(plain);
+  measure(profiled);
+  cout << "uncontended lock and unlock: " << measure(plain) << " ns plain, "
+       << measure(profiled) << " ns profiled" << endl;
+}
+
+int main()
+{
+  LockProfiler::SetThreadName("main");
+
+  testUnprofiled();
+  testUncontended();
+  testContended();
+  testTopHolders();
+  testReport();
+  testPeriodicReport();
+  testOverhead();
+  return 0;
+}
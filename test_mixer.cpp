@@ -0,0 +1,346 @@
+#include "AudioMixer.h"
+#include "VirtualDeviceBackend.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstring>  // for memcpy, memset
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+
+std::atomic<unsigned long> gFloatCallbacks(0);
+std::atomic<unsigned long> gShortCallbacks(0);
+std::atomic<unsigned long> gSwappedCallbacks(0);
+AudioMixer* gMixer = nullptr;
+std::atomic<unsigned long> gRenderThreadAdds(0);
+
+/* AudioCallback */
+void floatInput(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.25f;
+  }
+  ++gFloatCallbacks;
+}
+
+/* AudioCallback */
+void shortBigEndianInput(void* aBuffer, unsigned long aFrames)
+{
+  // 8192 (0x2000) in big-endian.
+  uint8_t* data = static_cast<uint8_t*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[2 * i] = 0x20;
+    data[2 * i + 1] = 0x00;
+  }
+  ++gShortCallbacks;
+}
+
+/* AudioCallback */
+void floatBigEndianInput(void* aBuffer, unsigned long aFrames)
+{
+  // -0.125f (0xBE000000) in big-endian.
+  uint8_t* data = static_cast<uint8_t*>(aBuffer);
+  memset(data, 0, aFrames * kChannels * sizeof(float));
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[4 * i] = 0xBE;
+  }
+  ++gSwappedCallbacks;
+}
+
+/* AudioCallback */
+void silentInput(void* aBuffer, unsigned long aFrames)
+{
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+}
+
+/* AudioCallback */
+void addingInput(void* aBuffer, unsigned long aFrames)
+{
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+  // Add and remove from the render thread.
+  AudioMixer::InputId id = gMixer->Add(AudioStream::F32LE, silentInput);
+  if (id != AudioMixer::INVALID_INPUT) {
+    assert(gMixer->Remove(id));
+    ++gRenderThreadAdds;
+  }
+}
+
+// The state of an input, handed to its ContextAudioCallback.
+struct Level
+{
+  float mValue;
+  std::atomic<unsigned long> mCallbacks;
+};
+
+/* ContextAudioCallback */
+void levelInput(void* aContext, void* aBuffer, unsigned long aFrames)
+{
+  Level* level = static_cast<Level*>(aContext);
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = level->mValue;
+  }
+  ++level->mCallbacks;
+}
+
+// A backend rendering one buffer whenever it's asked to, on the caller's
+// thread, so the mixed samples can be checked.
+class ManualBackend: public AudioBackend
+{
+public:
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mDesc = aDesc;
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  const vector<uint8_t>& Render(UInt32 aFrames)
+  {
+    mBuffer.assign(aFrames * mDesc.mBytesPerFrame, 0xFF);
+    AudioBufferList list;
+    list.mNumberBuffers = 1;
+    list.mBuffers[0].mNumberChannels = mDesc.mChannelsPerFrame;
+    list.mBuffers[0].mDataByteSize = mBuffer.size();
+    list.mBuffers[0].mData = mBuffer.data();
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    assert(mCallback(mRefCon, &flags, &timeStamp, 0, aFrames, &list) == noErr);
+    return mBuffer;
+  }
+
+private:
+  AudioStreamBasicDescription mDesc;
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  vector<uint8_t> mBuffer;
+};
+
+// Check every sample of a 16-bit buffer is aExpected.
+void checkS16(const vector<uint8_t>& aBytes, int16_t aExpected)
+{
+  assert(aBytes.size() == kFrames * kChannels * sizeof(int16_t));
+  for (size_t i = 0; i < kFrames * kChannels; ++i) {
+    int16_t s;
+    memcpy(&s, &aBytes[2 * i], sizeof(s));
+    assert(s == aExpected);
+  }
+}
+
+void testMix()
+{
+  ManualBackend* device = new ManualBackend();
+  AudioMixer mixer(AudioStream::S16LE, kChannels, kRate, 8,
+                   std::unique_ptr<AudioBackend>(device));
+  assert(mixer.IsReady());
+
+  // Silence without inputs.
+  checkS16(device->Render(kFrames), 0);
+
+  AudioMixer::InputId f = mixer.Add(AudioStream::F32LE, floatInput);
+  AudioMixer::InputId s = mixer.Add(AudioStream::S16BE, shortBigEndianInput);
+  AudioMixer::InputId b = mixer.Add(AudioStream::F32BE, floatBigEndianInput,
+                                    2.0f);
+  assert(f != AudioMixer::INVALID_INPUT && s != AudioMixer::INVALID_INPUT &&
+         b != AudioMixer::INVALID_INPUT);
+  assert(mixer.GetInputCount() == 3);
+  // 0.25 + 8192 / 32767 - 2 * 0.125.
+  checkS16(device->Render(kFrames), 8192);
+
+  assert(mixer.SetGain(b, 0.0f));
+  // 0.25 + 0.25, rounded.
+  checkS16(device->Render(kFrames), 16384);
+
+  // Clipped.
+  assert(mixer.SetGain(f, 8.0f));
+  checkS16(device->Render(kFrames), 32767);
+
+  unsigned long floatCallbacks = gFloatCallbacks;
+  assert(mixer.Remove(f));
+  assert(!mixer.Remove(f));
+  assert(!mixer.SetGain(f, 1.0f));
+  assert(mixer.GetInputCount() == 2);
+  checkS16(device->Render(kFrames), 8192);
+  assert(gFloatCallbacks == floatCallbacks);
+}
+
+void testNativeFloat()
+{
+  ManualBackend* device = new ManualBackend();
+  AudioMixer mixer(AudioStream::F32LE, kChannels, kRate, 8,
+                   std::unique_ptr<AudioBackend>(device));
+  mixer.Add(AudioStream::F32LE, floatInput, 0.5f);
+  mixer.Add(AudioStream::S16BE, shortBigEndianInput);
+  // More frames than the backend's maximum are mixed in chunks.
+  const UInt32 frames = AudioBackend::DEFAULT_MAX_FRAMES + 100;
+  const vector<uint8_t>& bytes = device->Render(frames);
+  for (size_t i = 0; i < frames * kChannels; ++i) {
+    float v;
+    memcpy(&v, &bytes[4 * i], sizeof(v));
+    assert(v == 0.125f + 8192.0f / 32767.0f);
+  }
+}
+
+void testSlots()
+{
+  ManualBackend* device = new ManualBackend();
+  AudioMixer mixer(AudioStream::F32LE, kChannels, kRate, 2,
+                   std::unique_ptr<AudioBackend>(device));
+  AudioMixer::InputId a = mixer.Add(AudioStream::F32LE, silentInput);
+  AudioMixer::InputId b = mixer.Add(AudioStream::F32LE, silentInput);
+  // Full.
+  assert(mixer.Add(AudioStream::F32LE, silentInput) ==
+         AudioMixer::INVALID_INPUT);
+  assert(!mixer.Remove(AudioMixer::INVALID_INPUT));
+
+  assert(mixer.Remove(a));
+  // Not reclaimed until the next render cycle.
+  assert(mixer.Add(AudioStream::F32LE, silentInput) ==
+         AudioMixer::INVALID_INPUT);
+  device->Render(kFrames);
+  AudioMixer::InputId c = mixer.Add(AudioStream::F32LE, silentInput);
+  // The slot is reused, under another id, so the stale one is rejected.
+  assert(c != AudioMixer::INVALID_INPUT && c != a);
+  assert(!mixer.Remove(a));
+  assert(mixer.Remove(b) && mixer.Remove(c));
+
+  // Stop reclaims the slots too.
+  assert(mixer.Stop());
+  assert(mixer.Add(AudioStream::F32LE, silentInput) !=
+         AudioMixer::INVALID_INPUT);
+}
+
+void testContexts()
+{
+  // The same callback for every input, each with its own state.
+  ManualBackend* device = new ManualBackend();
+  AudioMixer mixer(AudioStream::S16LE, kChannels, kRate, 8,
+                   std::unique_ptr<AudioBackend>(device));
+  Level levels[3];
+  const float values[3] = { 0.125f, 0.25f, -0.125f };
+  AudioMixer::InputId ids[3];
+  for (int i = 0; i < 3; ++i) {
+    levels[i].mValue = values[i];
+    levels[i].mCallbacks = 0;
+    ids[i] = mixer.Add(AudioStream::F32LE, levelInput, &levels[i]);
+    assert(ids[i] != AudioMixer::INVALID_INPUT);
+  }
+  // 0.125 + 0.25 - 0.125.
+  checkS16(device->Render(kFrames), 8192);
+  assert(mixer.Remove(ids[2]));
+  // 0.125 + 0.25, rounded.
+  checkS16(device->Render(kFrames), 12288);
+  assert(levels[0].mCallbacks == 2 && levels[2].mCallbacks == 1);
+}
+
+void testRemoveAndWait()
+{
+  AudioMixer mixer(AudioStream::F32LE, kChannels, kRate, 4,
+                   std::unique_ptr<AudioBackend>(
+                     new VirtualDeviceBackend(kFrames)));
+  assert(mixer.Start());
+  // Once it returns, the input's state can be freed while the mixer plays.
+  for (int i = 0; i < 20; ++i) {
+    Level* level = new Level();
+    level->mValue = 0.5f;
+    level->mCallbacks = 0;
+    AudioMixer::InputId id = mixer.Add(AudioStream::F32LE, levelInput, level);
+    while (!level->mCallbacks) {
+      std::this_thread::yield();
+    }
+    assert(mixer.RemoveAndWait(id));
+    assert(!mixer.RemoveAndWait(id));
+    unsigned long callbacks = level->mCallbacks;
+    // A couple of render cycles.
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    assert(level->mCallbacks == callbacks);
+    delete level;
+  }
+  assert(mixer.Stop());
+
+  // Stopped, it's reclaimed right away.
+  AudioMixer::InputId id = mixer.Add(AudioStream::F32LE, silentInput);
+  assert(mixer.RemoveAndWait(id));
+  assert(mixer.GetInputCount() == 0);
+}
+
+void testConcurrentChanges()
+{
+  const int kThreads = 4;
+  const int kChanges = 2000;
+  // Keep changing the inputs across this many render cycles at least.
+  const uint64_t kCycles = 20;
+  AudioMixer mixer(AudioStream::F32LE, kChannels, kRate, 16,
+                   std::unique_ptr<AudioBackend>(
+                     new VirtualDeviceBackend(kFrames)));
+  gMixer = &mixer;
+  assert(mixer.Start());
+  AudioMixer::InputId adding = mixer.Add(AudioStream::F32LE, addingInput);
+  assert(adding != AudioMixer::INVALID_INPUT);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&mixer] {
+      for (int i = 0;
+           i < kChanges || mixer.GetCallbackTiming().mCallbacks < kCycles;
+           ++i) {
+        AudioMixer::InputId id = mixer.Add(AudioStream::S16LE, silentInput);
+        if (id == AudioMixer::INVALID_INPUT) {
+          continue;
+        }
+        mixer.SetGain(id, 0.5f);
+        if (i % 64 == 0) {
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        assert(mixer.Remove(id));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  while (!gRenderThreadAdds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(mixer.Remove(adding));
+  assert(mixer.Stop());
+  assert(mixer.GetInputCount() == 0);
+
+  CallbackTiming::Snapshot timing = mixer.GetCallbackTiming();
+  cout << timing.mCallbacks << " mix callbacks, "
+       << gRenderThreadAdds << " inputs added on the render thread" << endl;
+  assert(timing.mCallbacks > 0);
+  gMixer = nullptr;
+}
+
+int main()
+{
+  testMix();
+  testNativeFloat();
+  testSlots();
+  testContexts();
+  testRemoveAndWait();
+  testConcurrentChanges();
+  return 0;
+}
@@ -0,0 +1,149 @@
+#include "NotifierThread.h"
+#include "WakeSignal.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+
+typedef std::chrono::steady_clock Clock;
+
+void sleepMs(unsigned int aMs)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(aMs));
+}
+
+void testWakeSignal()
+{
+  WakeSignal signal;
+  // A post made before the wait isn't lost.
+  signal.Post();
+  signal.Post();
+  signal.Wait();
+
+  std::atomic<bool> posted(false);
+  std::thread poster([&signal, &posted] {
+    sleepMs(20);
+    posted = true;
+    signal.Post();
+  });
+  signal.Wait();
+  assert(posted);
+  poster.join();
+}
+
+struct Counter
+{
+  std::atomic<int> mCalls;
+  std::thread::id mThread;
+};
+
+/* NotifierThread::Callback */
+void count(void* aContext)
+{
+  Counter* counter = static_cast<Counter*>(aContext);
+  counter->mThread = std::this_thread::get_id();
+  ++counter->mCalls;
+}
+
+void testSharedThread()
+{
+  // The clients all run on the notifier's thread, woken up by their posts.
+  NotifierThread notifier;
+  const int kClients = 50;
+  std::vector<Counter> counters(kClients);
+  std::vector<NotifierThread::Client*> clients;
+  for (Counter& c : counters) {
+    c.mCalls = 0;
+    clients.push_back(notifier.Add(count, &c));
+  }
+  for (NotifierThread::Client* client : clients) {
+    notifier.Post(client);
+  }
+  Clock::time_point start = Clock::now();
+  for (Counter& c : counters) {
+    while (!c.mCalls) {
+      std::this_thread::yield();
+    }
+  }
+  cout << "all the clients notified in "
+       << std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - start).count() << " us" << endl;
+  for (Counter& c : counters) {
+    assert(c.mThread == counters[0].mThread);
+    assert(c.mThread != std::this_thread::get_id());
+  }
+  for (NotifierThread::Client* client : clients) {
+    notifier.Remove(client);
+  }
+}
+
+void testCoalescing()
+{
+  // A burst of posts from several threads, like the render threads', runs
+  // the callback at most once per post, and at least once after the last.
+  NotifierThread notifier;
+  Counter counter;
+  counter.mCalls = 0;
+  NotifierThread::Client* client = notifier.Add(count, &counter);
+  const int kThreads = 4;
+  const int kPosts = 1000;
+  std::vector<std::thread> posters;
+  for (int t = 0; t < kThreads; ++t) {
+    posters.emplace_back([&notifier, client] {
+      for (int i = 0; i < kPosts; ++i) {
+        notifier.Post(client);
+      }
+    });
+  }
+  for (std::thread& poster : posters) {
+    poster.join();
+  }
+  sleepMs(50);
+  cout << kThreads * kPosts << " posts, " << counter.mCalls << " callbacks"
+       << endl;
+  assert(counter.mCalls >= 1 && counter.mCalls <= kThreads * kPosts);
+  // Nothing is polled: no post, no callback.
+  int calls = counter.mCalls;
+  sleepMs(50);
+  assert(counter.mCalls == calls);
+  notifier.Remove(client);
+}
+
+std::atomic<bool> gInSlow(false);
+
+/* NotifierThread::Callback */
+void slow(void* aContext)
+{
+  gInSlow = true;
+  sleepMs(20);
+  count(aContext);
+}
+
+void testRemove()
+{
+  // Remove runs the callback a last time, and waits for it.
+  NotifierThread notifier;
+  Counter counter;
+  counter.mCalls = 0;
+  NotifierThread::Client* client = notifier.Add(slow, &counter);
+  notifier.Post(client);
+  while (!gInSlow) {
+    std::this_thread::yield();
+  }
+  notifier.Remove(client);
+  assert(counter.mCalls == 2);
+}
+
+int main()
+{
+  testWakeSignal();
+  testSharedThread();
+  testCoalescing();
+  testRemove();
+  return 0;
+}
@@ -0,0 +1,252 @@
+#include "AudioStream.h"
+#include "OfflineRenderBackend.h"
+#include "Synthesizer.h"
+#include <cassert>  // for assert
+#include <cstdio>   // for fopen, fread, remove
+#include <cstring>  // for memcmp, memcpy
+#include <iostream> // for std::cout, std::endl
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const char* kPath = "/tmp/test_offline_render.wav";
+
+vector<Float64> gSampleTimes;
+vector<UInt64> gHostTimes;
+vector<UInt32> gFrames;
+
+/* AURenderCallback */
+OSStatus record(void* aRefCon,
+                AudioUnitRenderActionFlags* aActionFlags,
+                const AudioTimeStamp* aTimeStamp,
+                UInt32 aBusNumber,
+                UInt32 aNumFrames,
+                AudioBufferList* aData)
+{
+  assert(aTimeStamp->mFlags & kAudioTimeStampSampleTimeValid);
+  gSampleTimes.push_back(aTimeStamp->mSampleTime);
+  gHostTimes.push_back(aTimeStamp->mHostTime);
+  gFrames.push_back(aNumFrames);
+  assert(aData->mBuffers[0].mDataByteSize == aNumFrames * sizeof(float));
+  float* data = static_cast<float*>(aData->mBuffers[0].mData);
+  for (UInt32 i = 0; i < aNumFrames; ++i) {
+    data[i] = static_cast<float>(aTimeStamp->mSampleTime + i);
+  }
+  return noErr;
+}
+
+void testTimeStamps()
+{
+  // Not a multiple of the buffer size: the last callback is shorter.
+  const uint64_t total = 10 * 256 + 100;
+  OfflineRenderBackend backend(total, 256);
+  AudioStreamBasicDescription desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.mFormatID = kAudioFormatLinearPCM;
+  desc.mFormatFlags = kAudioFormatFlagIsFloat;
+  desc.mSampleRate = kRate;
+  desc.mChannelsPerFrame = 1;
+  desc.mBitsPerChannel = 32;
+  desc.mBytesPerFrame = desc.mBytesPerPacket = sizeof(float);
+  desc.mFramesPerPacket = 1;
+
+  assert(backend.Create());
+  assert(!backend.Init()); // Without a format and a callback.
+  assert(backend.SetStreamFormat(desc));
+  assert(backend.SetCallback(record, nullptr));
+  assert(backend.Init());
+  assert(backend.Start());
+  assert(backend.WaitUntilDone(1000));
+  assert(backend.Stop());
+
+  assert(gSampleTimes.size() == 11);
+  for (size_t i = 0; i < gSampleTimes.size(); ++i) {
+    assert(gSampleTimes[i] == i * 256.0);
+    assert(gHostTimes[i] == static_cast<UInt64>(i * 256 * 1e9 / kRate));
+    assert(gFrames[i] == (i < 10 ? 256u : 100u));
+  }
+  OfflineRenderBackend::Stats stats = backend.GetStats();
+  assert(stats.mCallbacks == 11 && stats.mFrames == total);
+  assert(backend.GetDataSize() == total * sizeof(float));
+  // Rendered in place, frame after frame.
+  const float* data = reinterpret_cast<const float*>(backend.GetData());
+  for (uint64_t i = 0; i < total; ++i) {
+    assert(data[i] == static_cast<float>(i));
+  }
+
+  // Nothing more to render.
+  assert(backend.Start());
+  assert(backend.WaitUntilDone(0));
+  assert(backend.Stop());
+  assert(backend.GetStats().mCallbacks == 11);
+  assert(backend.Uninit());
+  assert(backend.Destroy());
+}
+
+Synthesizer* gSynthesizer = nullptr;
+
+/* AudioCallback */
+template<typename T>
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  gSynthesizer->Run(static_cast<T*>(aBuffer), aFrames);
+}
+
+// Render aSeconds of a chord through an AudioStream on aBackend, and return
+// the bytes rendered.
+template<typename T>
+vector<uint8_t> render(AudioStream::Format aFormat, double aSeconds,
+                       OfflineRenderBackend* aBackend)
+{
+  Synthesizer synthesizer(kChannels, kRate);
+  synthesizer.SetFrequency(0, 440.0);
+  synthesizer.SetFrequency(1, 660.0);
+  gSynthesizer = &synthesizer;
+
+  AudioStream as(aFormat, kChannels, kRate, callback<T>,
+                 std::unique_ptr<AudioBackend>(aBackend));
+  assert(as.Start());
+  assert(aBackend->WaitUntilDone(60000));
+  assert(as.Stop());
+
+  OfflineRenderBackend::Stats stats = aBackend->GetStats();
+  assert(stats.mFrames == static_cast<uint64_t>(aSeconds * kRate));
+  double speed = aSeconds * 1e9 / stats.mRenderNs;
+  cout << aSeconds << " s rendered in " << stats.mRenderNs / 1e6 << " ms ("
+       << speed << "x real time)" << endl;
+  // Far from being paced by a clock.
+  assert(speed > 10.0);
+
+  const uint8_t* data = aBackend->GetData();
+  return vector<uint8_t>(data, data + aBackend->GetDataSize());
+}
+
+void testBitExact()
+{
+  // Two minutes of audio, twice: the same bytes, whatever the wall clock did.
+  const double seconds = 120.0;
+  const uint64_t frames = static_cast<uint64_t>(seconds * kRate);
+  vector<uint8_t> first = render<float>(
+    AudioStream::F32LE, seconds, new OfflineRenderBackend(frames, 512));
+  vector<uint8_t> second = render<float>(
+    AudioStream::F32LE, seconds, new OfflineRenderBackend(frames, 512));
+  assert(first.size() == frames * kChannels * sizeof(float));
+  assert(first == second);
+}
+
+uint32_t readLE(const uint8_t* aIn, size_t aBytes)
+{
+  uint32_t v = 0;
+  for (size_t i = 0; i < aBytes; ++i) {
+    v |= static_cast<uint32_t>(aIn[i]) << (8 * i);
+  }
+  return v;
+}
+
+vector<uint8_t> readFile(const char* aPath)
+{
+  vector<uint8_t> bytes;
+  FILE* f = fopen(aPath, "rb");
+  assert(f);
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+    bytes.insert(bytes.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  return bytes;
+}
+
+void testWavFile()
+{
+  const double seconds = 60.0;
+  const uint64_t frames = static_cast<uint64_t>(seconds * kRate);
+  const size_t dataBytes = frames * kChannels * sizeof(int16_t);
+  vector<uint8_t> memory = render<int16_t>(
+    AudioStream::S16LE, seconds, new OfflineRenderBackend(frames));
+  // The file is completed once the stream is gone.
+  render<int16_t>(AudioStream::S16LE, seconds,
+                  new OfflineRenderBackend(kPath, frames));
+
+  vector<uint8_t> file = readFile(kPath);
+  assert(file.size() == 44 + dataBytes);
+  const uint8_t* h = file.data();
+  assert(!memcmp(h, "RIFF", 4) && readLE(h + 4, 4) == 36 + dataBytes);
+  assert(!memcmp(h + 8, "WAVEfmt ", 8) && readLE(h + 16, 4) == 16);
+  assert(readLE(h + 20, 2) == 1);         // PCM
+  assert(readLE(h + 22, 2) == kChannels);
+  assert(readLE(h + 24, 4) == kRate);
+  assert(readLE(h + 28, 4) == kRate * kChannels * sizeof(int16_t));
+  assert(readLE(h + 32, 2) == kChannels * sizeof(int16_t));
+  assert(readLE(h + 34, 2) == 16);
+  assert(!memcmp(h + 36, "data", 4) && readLE(h + 40, 4) == dataBytes);
+  // The same samples as in memory.
+  assert(!memcmp(h + 44, memory.data(), dataBytes));
+
+  // The big-endian formats aren't WAV ones.
+  OfflineRenderBackend backend(kPath, frames);
+  AudioStreamBasicDescription desc;
+  memset(&desc, 0, sizeof(desc));
+  desc.mFormatID = kAudioFormatLinearPCM;
+  desc.mFormatFlags = kAudioFormatFlagIsSignedInteger |
+                      kAudioFormatFlagIsBigEndian;
+  desc.mSampleRate = kRate;
+  desc.mChannelsPerFrame = kChannels;
+  desc.mBitsPerChannel = 16;
+  desc.mBytesPerFrame = desc.mBytesPerPacket = kChannels * sizeof(int16_t);
+  desc.mFramesPerPacket = 1;
+  assert(backend.Create());
+  assert(!backend.SetStreamFormat(desc));
+  desc.mFormatFlags &= ~kAudioFormatFlagIsBigEndian;
+  assert(backend.SetStreamFormat(desc));
+  assert(backend.Destroy());
+  remove(kPath);
+
+  // Past the 4 GiB a WAV file can hold: refused before the file is made.
+  OfflineRenderBackend huge(kPath, (uint64_t(1) << 32) / desc.mBytesPerFrame);
+  assert(huge.Create());
+  assert(huge.SetStreamFormat(desc));
+  assert(huge.SetCallback(record, nullptr));
+  assert(!huge.Init());
+  assert(!fopen(kPath, "rb"));
+  assert(huge.Destroy());
+}
+
+void testStoppedEarly()
+{
+  // An hour, cut short: the file keeps the frames rendered so far.
+  const uint64_t frames = static_cast<uint64_t>(3600 * kRate);
+  OfflineRenderBackend* backend = new OfflineRenderBackend(kPath, frames);
+  uint64_t rendered = 0;
+  {
+    Synthesizer synthesizer(kChannels, kRate);
+    gSynthesizer = &synthesizer;
+    AudioStream as(AudioStream::F32LE, kChannels, kRate, callback<float>,
+                   std::unique_ptr<AudioBackend>(backend));
+    assert(as.Start());
+    assert(!backend->WaitUntilDone(10));
+    assert(as.Stop());
+    rendered = backend->GetStats().mFrames;
+    assert(rendered > 0 && rendered < frames);
+  }
+
+  vector<uint8_t> file = readFile(kPath);
+  size_t dataBytes = rendered * kChannels * sizeof(float);
+  assert(file.size() == 44 + dataBytes);
+  assert(readLE(&file[20], 2) == 3); // IEEE float
+  assert(readLE(&file[40], 4) == dataBytes);
+  remove(kPath);
+}
+
+int main()
+{
+  testTimeStamps();
+  testBitExact();
+  testWavFile();
+  testStoppedEarly();
+  return 0;
+}
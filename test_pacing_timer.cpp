@@ -0,0 +1,142 @@
+#include "PacingTimer.h"
+#include "utils.h"  // for delay
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+#include <time.h>   // for clock_gettime
+
+using std::cout;
+using std::endl;
+using Clock = PacingTimer::Clock;
+
+// The CPU time of the calling thread, in ms.
+double threadCpuMs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+double msSince(Clock::time_point aStart)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - aStart)
+    .count();
+}
+
+void print(const char* aName, const PacingTimer::Stats& aStats)
+{
+  cout << aName << ": " << aStats.mWaits << " waits, mean lateness "
+       << aStats.mMeanLatenessNs << " ns, jitter " << aStats.mJitterNs
+       << " ns, max " << aStats.mMaxLatenessNs << " ns, "
+       << aStats.mOversleeps << " oversleeps, " << aStats.mTotalSpinNs / 1000
+       << " us spun" << endl;
+}
+
+void testDeadlines()
+{
+  PacingTimer timer;
+  for (int i = 0; i < 50; ++i) {
+    Clock::time_point deadline = Clock::now() + std::chrono::microseconds(1500);
+    uint64_t lateness = timer.WaitUntil(deadline);
+    // Never early, and the lateness is what it says.
+    Clock::time_point now = Clock::now();
+    assert(now >= deadline);
+    assert(now - deadline >= std::chrono::nanoseconds(lateness));
+  }
+  PacingTimer::Stats spinning = timer.GetStats();
+  print("spin margin 200 us", spinning);
+  assert(spinning.mWaits == 50);
+  assert(spinning.mTotalSpinNs > 0);
+
+  // Sleeping only: no spin, and usually later.
+  PacingTimer sleeper(0);
+  for (int i = 0; i < 50; ++i) {
+    sleeper.WaitFor(1500000);
+  }
+  PacingTimer::Stats sleeping = sleeper.GetStats();
+  print("sleep only", sleeping);
+  assert(sleeping.mTotalSpinNs == 0);
+
+  // A deadline already over returns right away.
+  timer.ResetStats();
+  Clock::time_point past = Clock::now() - std::chrono::milliseconds(1);
+  assert(timer.WaitUntil(past) >= 1000000);
+  assert(timer.GetStats().mWaits == 1);
+  assert(timer.GetStats().mTotalSpinNs == 0);
+}
+
+void testTicks()
+{
+  // 200 ticks of 1 ms: the lateness of each wait never adds up. Under load,
+  // the ticks over are skipped rather than returned late, one after another,
+  // so the ticks keep up with the clock.
+  const uint64_t kTicks = 200;
+  const std::chrono::milliseconds kPeriod(1);
+  PacingTimer timer;
+  Clock::time_point start = Clock::now();
+  timer.StartTicks(1000000);
+  uint64_t tick = 0;
+  uint64_t returned = 0;
+  auto periods = [&timer, kPeriod](Clock::time_point aTime) {
+    return static_cast<uint64_t>((aTime - timer.GetTickTime(0)) / kPeriod);
+  };
+  while (tick < kTicks) {
+    Clock::time_point called = Clock::now();
+    uint64_t next = timer.WaitForNextTick();
+    Clock::time_point now = Clock::now();
+    assert(next > tick);
+    tick = next;
+    ++returned;
+    // The tick is the periods elapsed: never early, and never behind the
+    // periods elapsed when it was waited for.
+    assert(now >= timer.GetTickTime(tick));
+    assert(tick <= periods(now) && tick >= periods(called));
+  }
+  double elapsed = msSince(start);
+  PacingTimer::Stats stats = timer.GetStats();
+  print("1 ms ticks", stats);
+  cout << kTicks << " ticks in " << elapsed << " ms, "
+       << stats.mSkippedTicks << " skipped" << endl;
+  assert(elapsed >= kTicks);
+  // A sanity bound: a drifting timer would be late by its lateness, times
+  // the number of ticks.
+  assert(elapsed < 2 * kTicks);
+  assert(stats.mSkippedTicks == tick - returned);
+
+  // Busy for 3.5 ticks of 10 ms: the ticks over are skipped, but the last
+  // one, which is returned late.
+  PacingTimer slow;
+  slow.StartTicks(10000000);
+  assert(slow.WaitForNextTick() == 1);
+  std::this_thread::sleep_until(slow.GetTickTime(1) +
+                                std::chrono::milliseconds(35));
+  // 4, unless the sleep itself overran.
+  uint64_t late = slow.WaitForNextTick();
+  assert(late >= 4);
+  assert(slow.GetStats().mSkippedTicks == late - 2);
+  // Back on schedule.
+  assert(slow.WaitForNextTick() >= late + 1);
+  assert(Clock::now() >= slow.GetTickTime(late + 1));
+}
+
+void testDelay()
+{
+  // A wall-clock wait, mostly asleep, rather than a spin on the CPU time.
+  Clock::time_point start = Clock::now();
+  double cpu = threadCpuMs();
+  delay(100);
+  double elapsed = msSince(start);
+  cpu = threadCpuMs() - cpu;
+  cout << "delay(100): " << elapsed << " ms, " << cpu << " ms of CPU" << endl;
+  assert(elapsed >= 100.0);
+  assert(cpu < 20.0);
+}
+
+int main()
+{
+  testDeadlines();
+  testTicks();
+  testDelay();
+  return 0;
+}
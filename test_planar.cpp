@@ -0,0 +1,77 @@
+#include "AudioStream.h"
+#include "VirtualDeviceBackend.h"
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 16;
+const UInt32 kFrames = 256;
+
+unsigned long gCallbacks = 0;
+bool gDistinct = true;
+
+void testFormatDescription()
+{
+  AudioStream::Parameters interleaved = { AudioStream::S16LE, kChannels,
+                                          kRate, false };
+  AudioStreamBasicDescription desc = interleaved.GetFormatDescription();
+  assert(!(desc.mFormatFlags & kAudioFormatFlagIsNonInterleaved));
+  assert(desc.mBytesPerFrame == sizeof(short) * kChannels);
+
+  AudioStream::Parameters planar = { AudioStream::F32LE, kChannels,
+                                     kRate, true };
+  desc = planar.GetFormatDescription();
+  assert(desc.mFormatFlags & kAudioFormatFlagIsNonInterleaved);
+  assert(desc.mChannelsPerFrame == kChannels);
+  assert(desc.mBytesPerFrame == sizeof(float));
+  assert(desc.mBytesPerPacket == sizeof(float));
+}
+
+/* PlanarAudioCallback */
+void callback(void** aChannels, unsigned long aFrames)
+{
+  assert(aFrames == kFrames);
+  for (unsigned int i = 0; i < kChannels; ++i) {
+    float* data = static_cast<float*>(aChannels[i]);
+    assert(data);
+    // Each channel gets its own buffer of aFrames samples.
+    if (i > 0) {
+      float* previous = static_cast<float*>(aChannels[i - 1]);
+      gDistinct = gDistinct && (data >= previous + aFrames ||
+                                data + aFrames <= previous);
+    }
+    for (unsigned long j = 0; j < aFrames; ++j) {
+      data[j] = static_cast<float>(i) / kChannels;
+    }
+  }
+  ++gCallbacks;
+}
+
+void testPlanarStream()
+{
+  std::unique_ptr<AudioBackend> backend(new VirtualDeviceBackend(kFrames));
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::move(backend));
+  // The planar streams can't be fed by a ring of interleaved frames.
+  assert(!as.SetRingBuffer(kFrames));
+
+  assert(as.Start());
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(as.Stop());
+
+  cout << "planar callbacks: " << gCallbacks << endl;
+  assert(gCallbacks > 0 && "Callback should be fired!");
+  assert(gDistinct && "Channel buffers should not overlap!");
+}
+
+int main()
+{
+  testFormatDescription();
+  testPlanarStream();
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "RealtimeLog.h"
+#include <cassert>  // for assert
+#include <cstdio>   // for tmpfile, fread, rewind
+#include <cstring>  // for strcmp, strstr
+#include <iostream> // for std::cout, std::endl
+#include <string>   // for std::string
+#include <thread>   // for std::thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::string;
+
+string readAll(FILE* aFile)
+{
+  string content;
+  rewind(aFile);
+  char buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), aFile)) > 0) {
+    content.append(buffer, n);
+  }
+  return content;
+}
+
+void testFormat()
+{
+  FILE* file = tmpfile();
+  assert(file);
+  {
+    RealtimeLogger logger(file);
+    int negative = -42;
+    unsigned long long big = 18446744073709551615ULL;
+    short small = 7;
+    assert(logger.Log("plain\n"));
+    assert(logger.Log("%d %u %llu %hd\n", negative, 3u, big, small));
+    assert(logger.Log("%5.2f|%-4s|%c|%x|%%\n", 3.14159, "ab", 'z', 255));
+    assert(logger.Log("%s\n", 12)); // Mismatched: never reads garbage.
+    assert(logger.Log("%d %d\n", 1)); // Missing argument.
+    assert(logger.Drain() == 5);
+
+    RealtimeLogger::Stats stats = logger.GetStats();
+    assert(stats.mLogged == 5 && stats.mWritten == 5 && !stats.mDropped);
+  }
+
+  string expected = "plain\n"
+                    "-42 3 18446744073709551615 7\n"
+                    " 3.14|ab  |z|ff|%\n"
+                    "<?>\n"
+                    "1 <missing>\n";
+  string output = readAll(file);
+  cout << output;
+  assert(output == expected);
+  fclose(file);
+}
+
+void testDrops()
+{
+  FILE* file = tmpfile();
+  assert(file);
+  RealtimeLogger logger(file);
+  for (size_t i = 0; i < RealtimeLogger::SLOTS; ++i) {
+    assert(logger.Log("%zu\n", i));
+  }
+  // Full: dropped rather than waiting.
+  assert(!logger.Log("lost\n"));
+  assert(!logger.Log("lost\n"));
+  assert(logger.GetStats().mDropped == 2);
+
+  assert(logger.Drain() == RealtimeLogger::SLOTS);
+  // The slots are reused after a drain.
+  assert(logger.Log("again\n"));
+  assert(logger.Drain() == 1);
+
+  string output = readAll(file);
+  assert(output.find("2 messages dropped") != string::npos);
+  assert(output.find("lost") == string::npos);
+  fclose(file);
+}
+
+void testConcurrentProducers()
+{
+  FILE* file = tmpfile();
+  assert(file);
+  const int kThreads = 4;
+  const int kMessages = 20000;
+  {
+    RealtimeLogger logger(file);
+    logger.Start(1);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+      threads.emplace_back([&logger, t] {
+        for (int i = 0; i < kMessages; ++i) {
+          logger.Log("%d %d\n", t, i);
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    logger.Stop();
+
+    RealtimeLogger::Stats stats = logger.GetStats();
+    cout << "logged: " << stats.mLogged << ", dropped: " << stats.mDropped
+         << ", written: " << stats.mWritten << endl;
+    assert(stats.mLogged + stats.mDropped == kThreads * kMessages);
+    assert(stats.mWritten == stats.mLogged);
+  }
+
+  // Each producer's messages come out in order, and none is corrupted.
+  string output = readAll(file);
+  std::vector<int> last(kThreads, -1);
+  size_t start = 0;
+  while (start < output.size()) {
+    size_t end = output.find('\n', start);
+    assert(end != string::npos);
+    string line = output.substr(start, end - start);
+    start = end + 1;
+    if (line.find("dropped") != string::npos) {
+      continue;
+    }
+    int t = -1, i = -1;
+    assert(sscanf(line.c_str(), "%d %d", &t, &i) == 2);
+    assert(t >= 0 && t < kThreads && i > last[t]);
+    last[t] = i;
+  }
+  fclose(file);
+}
+
+int main()
+{
+  testFormat();
+  testDrops();
+  testConcurrentProducers();
+  return 0;
+}
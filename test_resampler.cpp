@@ -0,0 +1,218 @@
+#include "AudioStream.h"
+#include "Resampler.h"
+#include <cassert>  // for assert
+#include <cmath>    // for log10, sin, sqrt
+#include <cstring>  // for memcpy, memset
+#include <iostream> // for std::cout, std::endl
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const double PI = 3.14159265358979323846;
+const unsigned int kChannels = 2;
+
+// A sine tone source, counting the frames it renders.
+struct Tone
+{
+  double mRate;
+  double mFrequency;
+  unsigned long mFrames = 0;
+
+  double At(double aFrame) const
+  {
+    return 0.5 * sin(2.0 * PI * mFrequency * aFrame / mRate);
+  }
+};
+
+/* Resampler::Source */
+void tone(void* aContext, float* aBuffer, unsigned long aFrames)
+{
+  Tone* t = static_cast<Tone*>(aContext);
+  for (unsigned long i = 0; i < aFrames; ++i, ++t->mFrames) {
+    float v = static_cast<float>(t->At(t->mFrames));
+    for (unsigned int c = 0; c < kChannels; ++c) {
+      aBuffer[i * kChannels + c] = v;
+    }
+  }
+}
+
+// The error of the output against the ideal tone at the output rate, or
+// the output level when aExpectSilence, in dB relative to the tone.
+double measure(Resampler::Quality aQuality, double aInRate, double aOutRate,
+               double aFrequency, bool aExpectSilence = false)
+{
+  Tone t;
+  t.mRate = aInRate;
+  t.mFrequency = aFrequency;
+  const size_t maxFrames = 512;
+  Resampler resampler(kChannels, aInRate, aOutRate, aQuality, maxFrames, tone,
+                      &t);
+  vector<float> out(maxFrames * kChannels);
+  double error = 0.0;
+  size_t counted = 0;
+  size_t frame = 0;
+  for (size_t cycle = 0; cycle < 200; ++cycle) {
+    // Uneven cycles, as a device may ask for.
+    size_t frames = 300 + (cycle * 37) % (maxFrames - 299);
+    resampler.Process(out.data(), frames);
+    for (size_t i = 0; i < frames; ++i, ++frame) {
+      // The channels are resampled alike.
+      assert(out[i * kChannels] == out[i * kChannels + 1]);
+      // Skip the start, which is filtered along with the silence before it.
+      if (frame < resampler.GetTaps() * 2) {
+        continue;
+      }
+      double expected = aExpectSilence ?
+        0.0 : 0.5 * sin(2.0 * PI * aFrequency * frame / aOutRate);
+      double e = out[i * kChannels] - expected;
+      error += e * e;
+      ++counted;
+    }
+  }
+  // The source is never pulled further than the latency ahead.
+  double consumed = frame * aInRate / aOutRate;
+  assert(t.mFrames <= consumed + resampler.GetLatencyFrames() + 1);
+  // Relative to the power of the tone: 0.5^2 / 2.
+  return 10.0 * log10(error / counted / 0.125);
+}
+
+void testQuality()
+{
+  const double limits[] = { -55.0, -70.0, -95.0 }; // LOW, MEDIUM, HIGH
+  const Resampler::Quality tiers[] = { Resampler::LOW, Resampler::MEDIUM,
+                                       Resampler::HIGH };
+  for (size_t i = 0; i < 3; ++i) {
+    double up = measure(tiers[i], 44100.0, 48000.0, 1000.0);
+    double down = measure(tiers[i], 48000.0, 44100.0, 1000.0);
+    cout << "tier " << i << ": " << up << " dB up, " << down << " dB down"
+         << endl;
+    assert(up < limits[i] && down < limits[i]);
+  }
+  // Better and better in the upper passband.
+  double low = measure(Resampler::LOW, 44100.0, 48000.0, 15000.0);
+  double high = measure(Resampler::HIGH, 44100.0, 48000.0, 15000.0);
+  assert(high < low - 40.0);
+}
+
+void testAntiAliasing()
+{
+  // Above the Nyquist rate of the output: it must not fold back.
+  double level = measure(Resampler::HIGH, 48000.0, 44100.0, 23000.0, true);
+  cout << "23 kHz at 44.1 kHz: " << level << " dB" << endl;
+  assert(level < -60.0);
+}
+
+void testUnusualRates()
+{
+  // No reduced ratio with up to MAX_PHASES phases.
+  double error = measure(Resampler::MEDIUM, 44100.5, 48000.0, 1000.0);
+  assert(error < -70.0);
+  assert(Resampler(kChannels, 44100.5, 48000.0, Resampler::MEDIUM, 64, tone,
+                   nullptr).GetPhases() == Resampler::MAX_PHASES);
+  assert(Resampler(kChannels, 44100.0, 48000.0, Resampler::MEDIUM, 64, tone,
+                   nullptr).GetPhases() == 160);
+}
+
+// A backend rendering one buffer whenever it's asked to, on the caller's
+// thread, so the rendered frames can be checked.
+class ManualBackend: public AudioBackend
+{
+public:
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mDesc = aDesc;
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  const vector<uint8_t>& Render(UInt32 aFrames)
+  {
+    mBuffer.assign(aFrames * mDesc.mBytesPerFrame, 0);
+    AudioBufferList list;
+    list.mNumberBuffers = 1;
+    list.mBuffers[0].mNumberChannels = mDesc.mChannelsPerFrame;
+    list.mBuffers[0].mDataByteSize = mBuffer.size();
+    list.mBuffers[0].mData = mBuffer.data();
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    assert(mCallback(mRefCon, &flags, &timeStamp, 0, aFrames, &list) == noErr);
+    return mBuffer;
+  }
+
+  AudioStreamBasicDescription mDesc;
+
+private:
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  vector<uint8_t> mBuffer;
+};
+
+unsigned long gFrames = 0;
+
+/* AudioCallback */
+void constant(void* aBuffer, unsigned long aFrames)
+{
+  int16_t* data = static_cast<int16_t*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 8192;
+  }
+  gFrames += aFrames;
+}
+
+void testStream()
+{
+  ManualBackend* device = new ManualBackend();
+  AudioStream as(AudioStream::S16LE, kChannels, 44100.0, constant,
+                 std::unique_ptr<AudioBackend>(device));
+  assert(device->mDesc.mSampleRate == 44100.0);
+  assert(as.SetResampler(48000.0, Resampler::HIGH));
+  assert(device->mDesc.mSampleRate == 48000.0);
+  size_t latency = as.GetResamplerLatencyFrames();
+  assert(latency == 32);
+
+  // More frames than the stream resamples at once.
+  const UInt32 frames = 4800;
+  gFrames = 0;
+  const vector<uint8_t>& bytes = device->Render(frames);
+  assert(bytes.size() == frames * kChannels * sizeof(int16_t));
+  // 100 ms at either rate, plus the frames rendered ahead.
+  assert(gFrames >= 4410 && gFrames <= 4410 + latency + 1);
+  // A constant stays constant once the filter is past the silence before it.
+  for (size_t i = 2 * latency * kChannels; i < frames * kChannels; ++i) {
+    int16_t s;
+    memcpy(&s, &bytes[2 * i], sizeof(s));
+    assert(s >= 8191 && s <= 8193);
+  }
+
+  // Kept across a format change, and turned off by the stream's rate.
+  assert(as.SetFormat(AudioStream::S16LE, 22050.0));
+  assert(device->mDesc.mSampleRate == 48000.0);
+  assert(as.SetResampler(22050.0));
+  assert(device->mDesc.mSampleRate == 22050.0);
+  assert(as.GetResamplerLatencyFrames() == 0);
+  assert(!as.SetResampler(0.0));
+}
+
+int main()
+{
+  cout << "SIMD: " << Resampler::SimdName() << endl;
+  testQuality();
+  testAntiAliasing();
+  testUnusualRates();
+  testStream();
+  return 0;
+}
@@ -0,0 +1,235 @@
+#include "AudioStream.h"
+#include "RingBuffer.h"
+#include "VirtualDeviceBackend.h"
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstring>  // for memset
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::thread, std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+
+void testCapacity()
+{
+  RingBuffer ring(100, sizeof(int));
+  assert(ring.Capacity() == 128);
+  assert(ring.AvailableRead() == 0);
+  assert(ring.AvailableWrite() == 128);
+}
+
+void testReadWriteAcrossTheEnd()
+{
+  RingBuffer ring(8, sizeof(int));
+  int data[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  int out[8] = { 0 };
+
+  // Move the indexes close to the end so the next write wraps.
+  assert(ring.Write(data, 6) == 6);
+  assert(ring.Read(out, 6) == 6);
+
+  assert(ring.Write(data, 8) == 8);
+  assert(ring.Write(data, 1) == 0); // Full.
+  assert(ring.AvailableRead() == 8);
+  assert(ring.Read(out, 10) == 8);
+  for (int i = 0; i < 8; ++i) {
+    assert(out[i] == data[i]);
+  }
+  assert(ring.Read(out, 1) == 0); // Empty.
+}
+
+void testWritableRegion()
+{
+  RingBuffer ring(8, sizeof(int));
+  int data[5] = { 0 };
+  assert(ring.Write(data, 5) == 5);
+  assert(ring.Read(data, 3) == 3);
+
+  // Only the frames before the end of the storage are contiguous.
+  void* region = nullptr;
+  assert(ring.GetWritableRegion(&region) == 3);
+  int* frames = static_cast<int*>(region);
+  frames[0] = 42;
+  ring.CommitWrite(1);
+  assert(ring.AvailableRead() == 3);
+}
+
+void testConcurrentProducerConsumer()
+{
+  const unsigned int total = 1 << 20;
+  RingBuffer ring(1000, sizeof(unsigned int));
+
+  std::thread producer([&ring, total] {
+    unsigned int next = 0;
+    unsigned int chunk[97];
+    while (next < total) {
+      unsigned int n = 0;
+      while (n < 97 && next + n < total) {
+        chunk[n] = next + n;
+        ++n;
+      }
+      next += ring.Write(chunk, n);
+    }
+  });
+
+  unsigned int expected = 0;
+  unsigned int chunk[61];
+  while (expected < total) {
+    size_t read = ring.Read(chunk, 61);
+    for (size_t i = 0; i < read; ++i) {
+      assert(chunk[i] == expected++);
+    }
+  }
+  producer.join();
+  assert(ring.AvailableRead() == 0);
+}
+
+unsigned int gSleepMs = 0;
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.5f;
+  }
+  if (gSleepMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(gSleepMs));
+  }
+}
+
+AudioStream::RingStats play(unsigned long aPrefill)
+{
+  std::unique_ptr<AudioBackend> backend(new VirtualDeviceBackend(kFrames));
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::move(backend));
+  assert(as.SetRingBuffer(aPrefill));
+
+  assert(as.Start());
+  assert(!as.SetRingBuffer(aPrefill)); // Not allowed while running.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  AudioStream::RingStats running = as.GetRingStats();
+  assert(running.mBufferedFrames <= running.mCapacityFrames);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(as.Stop());
+
+  AudioStream::RingStats stats = as.GetRingStats();
+  cout << "prefill: " << stats.mPrefillFrames
+       << ", capacity: " << stats.mCapacityFrames
+       << ", underruns: " << stats.mUnderruns
+       << " (" << stats.mUnderrunFrames << " frames)" << endl;
+  assert(stats.mPrefillFrames == aPrefill);
+  assert(stats.mCapacityFrames >= 2 * aPrefill);
+  return stats;
+}
+
+void testPullFromRing()
+{
+  gSleepMs = 0;
+  AudioStream::RingStats stats = play(4096);
+  assert(!stats.mUnderruns && !stats.mUnderrunFrames);
+}
+
+void testUnderruns()
+{
+  // The producer is much slower than the device consuming the ring.
+  gSleepMs = 50;
+  AudioStream::RingStats stats = play(kFrames);
+  assert(stats.mUnderruns > 0);
+  assert(stats.mUnderrunFrames >= stats.mUnderruns);
+}
+
+float gLevel = 0.0f;
+
+/* AudioCallback */
+void level(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = gLevel;
+  }
+}
+
+// A backend rendering one buffer whenever it's asked to, on the caller's
+// thread, so the rendered frames can be checked.
+class ManualBackend: public AudioBackend
+{
+public:
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mBuffer.assign(kFrames * aDesc.mBytesPerFrame / sizeof(float), 0.0f);
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  const std::vector<float>& Render()
+  {
+    AudioBufferList list;
+    list.mNumberBuffers = 1;
+    list.mBuffers[0].mNumberChannels = kChannels;
+    list.mBuffers[0].mDataByteSize = mBuffer.size() * sizeof(float);
+    list.mBuffers[0].mData = mBuffer.data();
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    assert(mCallback(mRefCon, &flags, &timeStamp, 0, kFrames, &list) == noErr);
+    return mBuffer;
+  }
+
+private:
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  std::vector<float> mBuffer;
+};
+
+void testRestart()
+{
+  ManualBackend* device = new ManualBackend();
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, level,
+                 std::unique_ptr<AudioBackend>(device));
+  // A ring can't be swapped in under the render thread.
+  assert(as.Start());
+  assert(!as.SetRingBuffer(4 * kFrames));
+  assert(as.Stop());
+
+  assert(as.SetRingBuffer(4 * kFrames));
+  gLevel = 0.25f;
+  assert(as.Start());
+  assert(device->Render()[0] == 0.25f);
+  assert(as.Stop());
+  // The frames left from the last run are dropped, not played first.
+  gLevel = 0.75f;
+  assert(as.Start());
+  for (float s : device->Render()) {
+    assert(s == 0.75f);
+  }
+  assert(as.Stop());
+}
+
+int main()
+{
+  testCapacity();
+  testReadWriteAcrossTheEnd();
+  testWritableRegion();
+  testConcurrentProducerConsumer();
+  testPullFromRing();
+  testUnderruns();
+  testRestart();
+  return 0;
+}
@@ -0,0 +1,251 @@
+#include "AudioStream.h"
+#include "SampleConverter.h"
+#include <cassert>  // for assert
+#include <cmath>    // for fabs
+#include <cstring>  // for memcpy, memset
+#include <iostream> // for std::cout, std::endl
+#include <limits>   // for std::numeric_limits
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+// Odd sizes so both the vector loops and the scalar loops are covered.
+const size_t kSamples = 1037;
+
+int16_t swapS16(int16_t aValue)
+{
+  uint16_t v = static_cast<uint16_t>(aValue);
+  return static_cast<int16_t>((v << 8) | (v >> 8));
+}
+
+void testFloatToS16()
+{
+  vector<float> in(kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    in[i] = -1.5f + 3.0f * i / kSamples; // Some are out of range.
+  }
+  in[3] = 0.5f;
+  in[4] = -0.5f;
+  in[5] = std::numeric_limits<float>::quiet_NaN();
+  in[kSamples - 1] = 1.0f;
+
+  vector<int16_t> out(kSamples);
+  SampleConverter::FloatToS16(in.data(), out.data(), kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    if (i == 5) {
+      continue;
+    }
+    float expected = in[i] * 32767.0f;
+    expected = expected < -32768.0f ? -32768.0f :
+               expected > 32767.0f ? 32767.0f : expected;
+    assert(fabs(out[i] - expected) <= 0.5f);
+  }
+  assert(out[0] == -32768);
+  assert(out[3] == 16384);  // 16383.5 rounds half to even.
+  assert(out[4] == -16384);
+  assert(out[kSamples - 1] == 32767);
+
+  vector<int16_t> swapped(kSamples);
+  SampleConverter::FloatToS16(in.data(), swapped.data(), kSamples, true);
+  for (size_t i = 0; i < kSamples; ++i) {
+    assert(swapped[i] == swapS16(out[i]));
+  }
+}
+
+void testDither()
+{
+  vector<float> in(kSamples, 0.25f);
+  vector<int16_t> a(kSamples);
+  vector<int16_t> b(kSamples);
+
+  SampleConverter::Dither ditherA(7);
+  SampleConverter::Dither ditherB(7);
+  SampleConverter::FloatToS16(in.data(), a.data(), kSamples, ditherA);
+  SampleConverter::FloatToS16(in.data(), b.data(), kSamples, ditherB);
+
+  // The TPDF noise stays within +/- 1 LSB, is reproducible from the seed,
+  // and is not a constant offset.
+  double sum = 0.0;
+  bool varies = false;
+  for (size_t i = 0; i < kSamples; ++i) {
+    assert(a[i] == b[i]);
+    assert(a[i] >= 8190 && a[i] <= 8193);
+    varies = varies || a[i] != a[0];
+    sum += a[i];
+  }
+  assert(varies);
+  assert(fabs(sum / kSamples - 0.25 * 32767.0) < 0.2);
+
+  // The generator keeps going across calls.
+  SampleConverter::FloatToS16(in.data(), b.data(), kSamples, ditherB);
+  assert(memcmp(a.data(), b.data(), kSamples * sizeof(int16_t)));
+}
+
+void testS16ToFloat()
+{
+  vector<int16_t> in(kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    in[i] = static_cast<int16_t>(-32768 + 63 * i);
+  }
+  vector<float> out(kSamples);
+  SampleConverter::S16ToFloat(in.data(), out.data(), kSamples);
+
+  vector<int16_t> roundTrip(kSamples);
+  SampleConverter::FloatToS16(out.data(), roundTrip.data(), kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    assert(fabs(out[i] - in[i] / 32767.0f) < 1e-6f);
+    assert(roundTrip[i] == in[i]);
+  }
+
+  vector<int16_t> swapped(kSamples);
+  SampleConverter::SwapBytes16(in.data(), swapped.data(), kSamples);
+  vector<float> fromSwapped(kSamples);
+  SampleConverter::S16ToFloat(swapped.data(), fromSwapped.data(), kSamples,
+                              true);
+  assert(!memcmp(out.data(), fromSwapped.data(), kSamples * sizeof(float)));
+}
+
+void testSwapBytes()
+{
+  vector<float> in(kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    in[i] = i * 0.001f - 0.3f;
+  }
+  vector<float> out(in);
+  // In place.
+  SampleConverter::SwapBytes32(out.data(), out.data(), kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    uint8_t a[4];
+    uint8_t b[4];
+    memcpy(a, &in[i], 4);
+    memcpy(b, &out[i], 4);
+    assert(a[0] == b[3] && a[1] == b[2] && a[2] == b[1] && a[3] == b[0]);
+  }
+  SampleConverter::SwapBytes32(out.data(), out.data(), kSamples);
+  assert(!memcmp(in.data(), out.data(), kSamples * sizeof(float)));
+}
+
+void testMixFloat()
+{
+  vector<float> in(kSamples);
+  vector<float> out(kSamples);
+  for (size_t i = 0; i < kSamples; ++i) {
+    in[i] = i * 0.001f - 0.5f;
+    out[i] = 0.25f - i * 0.0005f;
+  }
+  vector<float> expected(out);
+  for (size_t i = 0; i < kSamples; ++i) {
+    expected[i] += in[i] * 0.3f;
+  }
+  SampleConverter::MixFloat(in.data(), 0.3f, out.data(), kSamples);
+  // The vector loops round like the scalar one.
+  assert(!memcmp(out.data(), expected.data(), kSamples * sizeof(float)));
+}
+
+// A backend rendering one buffer whenever it's asked to, on the caller's
+// thread, so the rendered bytes can be checked.
+class ManualBackend: public AudioBackend
+{
+public:
+  bool Create() override { return true; }
+  bool Destroy() override { return true; }
+  bool Init() override { return true; }
+  bool Uninit() override { return true; }
+  bool SetStreamFormat(const AudioStreamBasicDescription& aDesc) override
+  {
+    mDesc = aDesc;
+    return true;
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    mCallback = aCallback;
+    mRefCon = aRefCon;
+    return true;
+  }
+  bool Start() override { return true; }
+  bool Stop() override { return true; }
+
+  const vector<uint8_t>& Render(UInt32 aFrames)
+  {
+    mBuffer.assign(aFrames * mDesc.mBytesPerFrame, 0);
+    AudioBufferList list;
+    list.mNumberBuffers = 1;
+    list.mBuffers[0].mNumberChannels = mDesc.mChannelsPerFrame;
+    list.mBuffers[0].mDataByteSize = mBuffer.size();
+    list.mBuffers[0].mData = mBuffer.data();
+    AudioTimeStamp timeStamp;
+    memset(&timeStamp, 0, sizeof(timeStamp));
+    AudioUnitRenderActionFlags flags = 0;
+    assert(mCallback(mRefCon, &flags, &timeStamp, 0, aFrames, &list) == noErr);
+    return mBuffer;
+  }
+
+private:
+  AudioStreamBasicDescription mDesc;
+  AURenderCallback mCallback = nullptr;
+  void* mRefCon = nullptr;
+  vector<uint8_t> mBuffer;
+};
+
+const unsigned int kChannels = 2;
+
+/* AudioCallback */
+void floatCallback(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = (i % 2) ? -0.5f : 0.5f;
+  }
+}
+
+void testFloatSource()
+{
+  // More frames than the stream converts at once.
+  const UInt32 frames = 3000;
+
+  ManualBackend* device = new ManualBackend();
+  AudioStream s16be(AudioStream::S16BE, kChannels, 48000.0, floatCallback,
+                    std::unique_ptr<AudioBackend>(device));
+  assert(s16be.SetFloatSource());
+  const vector<uint8_t>& bytes = device->Render(frames);
+  assert(bytes.size() == frames * kChannels * sizeof(int16_t));
+  for (size_t i = 0; i < frames * kChannels; ++i) {
+    // Big-endian 16384 and -16384.
+    assert(bytes[2 * i] == ((i % 2) ? 0xC0 : 0x40));
+    assert(bytes[2 * i + 1] == 0x00);
+  }
+
+  device = new ManualBackend();
+  AudioStream f32be(AudioStream::F32BE, kChannels, 48000.0, floatCallback,
+                    std::unique_ptr<AudioBackend>(device));
+  assert(f32be.SetFloatSource());
+  const vector<uint8_t>& floats = device->Render(frames);
+  for (size_t i = 0; i < frames * kChannels; ++i) {
+    // Big-endian 0.5f (0x3F000000) and -0.5f (0xBF000000).
+    assert(floats[4 * i] == ((i % 2) ? 0xBF : 0x3F));
+    assert(!floats[4 * i + 1] && !floats[4 * i + 2] && !floats[4 * i + 3]);
+  }
+
+  // The float buffer can't be swapped in under the render thread.
+  device = new ManualBackend();
+  AudioStream started(AudioStream::S16LE, kChannels, 48000.0, floatCallback,
+                      std::unique_ptr<AudioBackend>(device));
+  assert(started.Start());
+  assert(!started.SetFloatSource());
+  assert(started.Stop());
+  assert(started.SetFloatSource());
+}
+
+int main()
+{
+  cout << "SIMD: " << SampleConverter::SimdName() << endl;
+  testFloatToS16();
+  testDither();
+  testS16ToFloat();
+  testSwapBytes();
+  testMixFloat();
+  testFloatSource();
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include "AudioStreamPool.h"
+#include "VirtualDeviceBackend.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstring>  // for memset
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+// How long the SlowBackend takes to create and to initialize a unit.
+const unsigned int kSetupMs = 5;
+
+std::atomic<int> gCreated(0);
+std::atomic<int> gDestroyed(0);
+std::atomic<unsigned long> gFirstCallbacks(0);
+std::atomic<unsigned long> gSecondCallbacks(0);
+void* gRefCon = nullptr; // The last one a SlowBackend was given.
+
+/* AudioCallback */
+void first(void* aBuffer, unsigned long aFrames)
+{
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+  ++gFirstCallbacks;
+}
+
+/* AudioCallback */
+void second(void* aBuffer, unsigned long aFrames)
+{
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+  ++gSecondCallbacks;
+}
+
+// A VirtualDeviceBackend as slow to set up as an AudioUnit, counting the
+// units created and destroyed.
+class SlowBackend: public VirtualDeviceBackend
+{
+public:
+  SlowBackend()
+    : VirtualDeviceBackend(kFrames)
+  {}
+
+  bool Create() override
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSetupMs));
+    ++gCreated;
+    return VirtualDeviceBackend::Create();
+  }
+  bool Init() override
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(kSetupMs));
+    return VirtualDeviceBackend::Init();
+  }
+  bool SetCallback(AURenderCallback aCallback, void* aRefCon) override
+  {
+    gRefCon = aRefCon;
+    return VirtualDeviceBackend::SetCallback(aCallback, aRefCon);
+  }
+  bool Destroy() override
+  {
+    ++gDestroyed;
+    return VirtualDeviceBackend::Destroy();
+  }
+};
+
+/* AudioStreamPool::BackendFactory */
+std::unique_ptr<AudioBackend> slowBackend()
+{
+  return std::unique_ptr<AudioBackend>(new SlowBackend());
+}
+
+void play(AudioStream& aStream, std::atomic<unsigned long>& aCallbacks)
+{
+  aCallbacks = 0;
+  assert(aStream.Start());
+  while (!aCallbacks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  assert(aStream.Stop());
+}
+
+void testReuse()
+{
+  AudioStreamPool pool(4, slowBackend);
+  gCreated = 0;
+  {
+    AudioStreamPool::Stream stream =
+      pool.Open(AudioStream::F32LE, kChannels, kRate, first);
+    play(*stream, gFirstCallbacks);
+    assert(gRefCon == stream.get());
+  }
+  assert(pool.GetStats().mIdle == 1);
+  // Kept without the callback of the deleted stream.
+  assert(!gRefCon);
+
+  // The same unit, now firing the second callback.
+  AudioStreamPool::Stream stream =
+    pool.Open(AudioStream::F32LE, kChannels, kRate, second);
+  assert(gCreated == 1);
+  assert(pool.GetStats().mIdle == 0);
+  gFirstCallbacks = 0;
+  play(*stream, gSecondCallbacks);
+  assert(gFirstCallbacks == 0);
+
+  // Another format can't use it.
+  AudioStreamPool::Stream other =
+    pool.Open(AudioStream::S16LE, kChannels, kRate, second);
+  assert(gCreated == 2);
+
+  AudioStreamPool::Stats stats = pool.GetStats();
+  assert(stats.mPooled.mOpens == 1);
+  assert(stats.mCold.mOpens == 2);
+}
+
+void testPrewarm()
+{
+  const size_t kStreams = 8;
+  AudioStreamPool pool(kStreams, slowBackend);
+  assert(pool.Prewarm(AudioStream::F32LE, kChannels, kRate, kStreams) ==
+         kStreams);
+  assert(pool.GetStats().mIdle == kStreams);
+
+  gCreated = 0;
+  std::vector<AudioStreamPool::Stream> streams;
+  for (size_t i = 0; i < kStreams; ++i) {
+    streams.push_back(pool.Open(AudioStream::F32LE, kChannels, kRate, first));
+  }
+  assert(gCreated == 0);
+  streams.push_back(pool.Open(AudioStream::F32LE, kChannels, kRate, first));
+  assert(gCreated == 1);
+  play(*streams.back(), gFirstCallbacks);
+
+  // Back into the pool, but only as many as it keeps.
+  gDestroyed = 0;
+  streams.clear();
+  assert(pool.GetStats().mIdle == kStreams);
+  assert(gDestroyed == 1);
+}
+
+void testLatency()
+{
+  AudioStreamPool pool(1, slowBackend);
+  for (int i = 0; i < 20; ++i) {
+    // Cold when the other one holds the only unit.
+    AudioStreamPool::Stream stream =
+      pool.Open(AudioStream::F32LE, kChannels, kRate, first);
+    AudioStreamPool::Stream other =
+      pool.Open(AudioStream::F32LE, kChannels, kRate, first);
+  }
+
+  AudioStreamPool::Stats stats = pool.GetStats();
+  assert(stats.mPooled.mOpens == 19);
+  assert(stats.mCold.mOpens == 21);
+  assert(stats.mPooled.mP50Ns < stats.mCold.mP50Ns);
+  // Two setups, rounded down to a power of two.
+  assert(stats.mCold.mP50Ns >= kSetupMs * 1000000);
+  assert(stats.mCold.mMaxNs >= 2 * kSetupMs * 1000000);
+  cout << "open latency p50/p90/p99: pooled " << stats.mPooled.mP50Ns / 1000
+       << "/" << stats.mPooled.mP90Ns / 1000 << "/"
+       << stats.mPooled.mP99Ns / 1000 << " us, cold "
+       << stats.mCold.mP50Ns / 1000 << "/" << stats.mCold.mP90Ns / 1000 << "/"
+       << stats.mCold.mP99Ns / 1000 << " us" << endl;
+}
+
+int main()
+{
+  testReuse();
+  testPrewarm();
+  testLatency();
+  return 0;
+}
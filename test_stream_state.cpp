@@ -0,0 +1,209 @@
+#include "AudioStream.h"
+#include "LockOrderValidator.h"
+#include "VirtualDeviceBackend.h"
+#include <atomic>   // for std::atomic
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <cstring>  // for memset
+#include <iostream> // for std::cout, std::endl
+#include <mutex>    // for std::lock_guard
+#include <thread>   // for std::thread
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using State = AudioStream::State;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+const unsigned int kTimeoutMs = 2000;
+
+std::atomic<unsigned long> gCallbacks(0);
+std::atomic<unsigned long> gDrainAfter(0); // Drain from the callback.
+AudioStream* gStream = nullptr;
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  memset(aBuffer, 0, aFrames * kChannels * sizeof(float));
+  unsigned long callbacks = ++gCallbacks;
+  if (gDrainAfter && callbacks == gDrainAfter) {
+    assert(gStream->Drain());
+  }
+}
+
+// Record the notified states.
+struct States
+{
+  std::mutex mMutex;
+  std::vector<State> mStates;
+  bool mOffRenderThread = true;
+  bool mOffCallerThread = true;
+  std::thread::id mCaller = std::this_thread::get_id();
+
+  // Wait for aCount states to be delivered.
+  void WaitFor(size_t aCount)
+  {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> guard(mMutex);
+        if (mStates.size() >= aCount) {
+          return;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::vector<State> Take()
+  {
+    std::lock_guard<std::mutex> guard(mMutex);
+    std::vector<State> states;
+    states.swap(mStates);
+    return states;
+  }
+};
+
+/* AudioStream::StateCallback */
+void onState(State aState, void* aContext)
+{
+  States* states = static_cast<States*>(aContext);
+  std::lock_guard<std::mutex> guard(states->mMutex);
+  states->mStates.push_back(aState);
+  states->mOffRenderThread = states->mOffRenderThread &&
+                             !LockOrderValidator::IsRenderThread();
+  states->mOffCallerThread = states->mOffCallerThread &&
+                             states->mCaller != std::this_thread::get_id();
+}
+
+std::unique_ptr<AudioBackend> device()
+{
+  return std::unique_ptr<AudioBackend>(new VirtualDeviceBackend(kFrames));
+}
+
+void testStartStop()
+{
+  States states;
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback, device());
+  as.SetStateCallback(onState, &states);
+  assert(as.GetState() == AudioStream::CREATED);
+
+  assert(as.Start());
+  // STARTING until the first callback.
+  assert(as.WaitForState(AudioStream::STARTED, kTimeoutMs));
+  assert(as.Stop());
+  assert(as.GetState() == AudioStream::STOPPED);
+  assert(as.WaitForState(AudioStream::STOPPED, kTimeoutMs));
+  // Stopping a stopped stream isn't a transition.
+  assert(as.Stop());
+
+  states.WaitFor(3);
+  std::vector<State> delivered = states.Take();
+  assert(delivered.size() == 3);
+  assert(delivered[0] == AudioStream::STARTING);
+  assert(delivered[1] == AudioStream::STARTED);
+  assert(delivered[2] == AudioStream::STOPPED);
+  assert(states.mOffRenderThread && states.mOffCallerThread);
+}
+
+void testDrainRing()
+{
+  States states;
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback, device());
+  as.SetStateCallback(onState, &states);
+  const unsigned long kPrefill = 8 * kFrames;
+  assert(as.SetRingBuffer(kPrefill));
+
+  assert(as.Start());
+  assert(as.WaitForState(AudioStream::STARTED, kTimeoutMs));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  auto start = std::chrono::steady_clock::now();
+  assert(as.Drain());
+  assert(as.GetState() == AudioStream::DRAINING);
+  // Not twice.
+  assert(!as.Drain());
+  assert(as.WaitForState(AudioStream::STOPPED, kTimeoutMs));
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  // The buffered frames were played out, not dropped.
+  AudioStream::RingStats stats = as.GetRingStats();
+  assert(stats.mBufferedFrames == 0);
+  double msPlayed =
+    std::chrono::duration<double, std::milli>(elapsed).count();
+  cout << "drained in " << msPlayed << " ms" << endl;
+  assert(msPlayed >= (kPrefill - 2 * kFrames) * 1000.0 / kRate);
+
+  states.WaitFor(4);
+  std::vector<State> delivered = states.Take();
+  assert(delivered.size() == 4);
+  assert(delivered[2] == AudioStream::DRAINING);
+  assert(delivered[3] == AudioStream::STOPPED);
+
+  // Drained streams can be started again.
+  assert(as.Start());
+  assert(as.WaitForState(AudioStream::STARTED, kTimeoutMs));
+  assert(as.Stop());
+}
+
+void testDrainFromCallback()
+{
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback, device());
+  gStream = &as;
+  gCallbacks = 0;
+  gDrainAfter = 5;
+  assert(as.Start());
+  assert(as.WaitForState(AudioStream::STOPPED, kTimeoutMs));
+  // The callback isn't fired once draining.
+  assert(gCallbacks == gDrainAfter);
+  gDrainAfter = 0;
+  gStream = nullptr;
+}
+
+// A device that can't start.
+class BrokenBackend: public VirtualDeviceBackend
+{
+public:
+  BrokenBackend()
+    : VirtualDeviceBackend(kFrames)
+  {}
+
+  bool Start() override { return false; }
+};
+
+void testError()
+{
+  States states;
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::unique_ptr<AudioBackend>(new BrokenBackend()));
+  as.SetStateCallback(onState, &states);
+  assert(!as.Start());
+  assert(as.GetState() == AudioStream::ERROR);
+  assert(as.WaitForState(AudioStream::ERROR, kTimeoutMs));
+  states.WaitFor(2);
+  std::vector<State> delivered = states.Take();
+  assert(delivered[0] == AudioStream::STARTING);
+  assert(delivered[1] == AudioStream::ERROR);
+}
+
+void testControlThread()
+{
+  AudioControlThread control;
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback, device(),
+                 &control);
+  as.StartAsync();
+  assert(as.WaitForState(AudioStream::STARTED, kTimeoutMs));
+  assert(as.Drain());
+  assert(as.WaitForState(AudioStream::STOPPED, kTimeoutMs));
+}
+
+int main()
+{
+  testStartStop();
+  testDrainRing();
+  testDrainFromCallback();
+  testError();
+  testControlThread();
+  return 0;
+}
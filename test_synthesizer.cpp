@@ -0,0 +1,105 @@
+#include "Synthesizer.h"
+#include <cassert>  // for assert
+#include <cmath>    // for fabs, sin, M_PI
+#include <iostream> // for std::cout, std::endl
+#include <vector>   // for std::vector
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const float kRate = 48000.0f;
+const double kVolume = 0.5;
+// Not a multiple of the block size nor of the vector width.
+const long kFrames = 1037;
+
+// The expected sample of aChannel at aFrame, computed in double precision.
+double expected(const Synthesizer& aSynth, unsigned int aChannel, long aFrame)
+{
+  double cycles = aSynth.GetFrequency(aChannel) * aFrame / kRate;
+  return sin(2.0 * M_PI * (cycles - floor(cycles))) * kVolume;
+}
+
+void testFloat()
+{
+  const unsigned int channels = 5;
+  Synthesizer synth(channels, kRate, kVolume);
+  for (unsigned int c = 0; c < channels; ++c) {
+    assert(synth.GetFrequency(c) == 220.0 * (c + 1));
+  }
+
+  // Render in uneven chunks to cover the phase carried across calls.
+  vector<float> buffer(kFrames * channels);
+  const long chunks[] = { 1, 3, 255, 256, 257, 265 };
+  long done = 0;
+  for (long chunk : chunks) {
+    synth.Run(buffer.data() + done * channels, chunk);
+    done += chunk;
+  }
+  assert(done == kFrames);
+
+  double maxError = 0.0;
+  for (long i = 0; i < kFrames; ++i) {
+    for (unsigned int c = 0; c < channels; ++c) {
+      double error = fabs(buffer[i * channels + c] - expected(synth, c, i));
+      maxError = error > maxError ? error : maxError;
+    }
+  }
+  cout << "float max error: " << maxError << endl;
+  assert(maxError < 1e-4);
+  assert(synth.GetNsPerFrame() > 0.0);
+
+  synth.ResetStats();
+  assert(synth.GetNsPerFrame() == 0.0);
+}
+
+void testS16()
+{
+  const unsigned int channels = 2;
+  Synthesizer synth(channels, kRate, kVolume);
+  vector<int16_t> buffer(kFrames * channels);
+  synth.Run(buffer.data(), kFrames);
+
+  for (long i = 0; i < kFrames; ++i) {
+    for (unsigned int c = 0; c < channels; ++c) {
+      double value = expected(synth, c, i) * 32767.0;
+      assert(fabs(buffer[i * channels + c] - value) <= 1.0);
+    }
+  }
+}
+
+void testLongRunPhase()
+{
+  // A phase accumulated in float drifts audibly after minutes of playback.
+  // The double phase is wrapped every block, so it stays exact enough.
+  const unsigned int channels = 1;
+  Synthesizer synth(channels, kRate, kVolume);
+  synth.SetFrequency(0, 1000.1);
+  vector<float> buffer(4096);
+  const long total = 48000 * 60; // One minute.
+  long done = 0;
+  while (done + 4096 <= total) {
+    synth.Run(buffer.data(), 4096);
+    done += 4096;
+  }
+  synth.Run(buffer.data(), 1);
+  double error = fabs(buffer[0] - expected(synth, 0, done));
+  cout << "phase error after " << done << " frames: " << error << endl;
+  assert(error < 1e-4);
+}
+
+void testFrequencyFolding()
+{
+  Synthesizer synth(1, kRate, kVolume);
+  synth.SetFrequency(0, kRate + 100.0);
+  assert(fabs(synth.GetFrequency(0) - 100.0) < 1e-6);
+}
+
+int main()
+{
+  testFloat();
+  testS16();
+  testLongRunPhase();
+  testFrequencyFolding();
+  return 0;
+}
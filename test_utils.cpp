@@ -1,6 +1,8 @@
 #include "AudioObjectUtils.h"
-#include <cassert>  // for assert
-#include <iostream> // for std::cout, std::endl
+#include "DeviceSnapshot.h"
+#include <cassert>     // for assert
+#include <iostream>    // for std::cout, std::endl
+#include <type_traits> // for std::is_same
 
 using std::cout;
 using std::endl;
@@ -303,6 +305,16 @@ void testGetAllDeviceIds()
   // If we have at least one device, the device id list must not be empty.
   bool atLeastOneDevice = validId(inId) || validId(outId);
   assert(atLeastOneDevice == !ids.empty());
+
+  // The same lists, into storage reused from one query to the next.
+  vector<AudioObjectID> storage;
+  assert(AudioObjectUtils::GetAllDeviceIds(&storage));
+  assert(storage == ids);
+  const AudioObjectID* data = storage.data();
+  assert(AudioObjectUtils::GetDeviceIds(Output, &storage));
+  assert(storage == AudioObjectUtils::GetDeviceIds(Output));
+  assert(AudioObjectUtils::GetAllDeviceIds(&storage));
+  assert(storage == ids && storage.data() == data);
 }
 
 void testSetDefaultDeviceWithInvalidId()
@@ -378,6 +390,142 @@ void testSetDefaultDevice()
   testSetDefaultDeviceWithValidParameters();
 }
 
+void testPropertyCache()
+{
+  AudioObjectUtils::ClearCache();
+  AudioObjectUtils::ResetCacheStats();
+
+  AudioObjectID outId = AudioObjectUtils::GetDefaultDeviceId(Output);
+  vector<AudioObjectID> ids = AudioObjectUtils::GetDeviceIds(Output);
+  string label = AudioObjectUtils::GetDeviceLabel(outId, Output);
+  AudioPropertyCache::Stats first = AudioObjectUtils::GetCacheStats();
+
+  // Nothing has changed, so the same queries are all served by the cache.
+  assert(outId == AudioObjectUtils::GetDefaultDeviceId(Output));
+  assert(ids == AudioObjectUtils::GetDeviceIds(Output));
+  assert(label == AudioObjectUtils::GetDeviceLabel(outId, Output));
+  AudioPropertyCache::Stats second = AudioObjectUtils::GetCacheStats();
+
+  cout << "cache hits: " << second.mHits << ", misses: " << second.mMisses
+       << ", entries: " << second.mEntries
+       << ", listeners: " << second.mListeners << endl;
+  if (validId(outId)) {
+    // Only the failed queries, e.g. a device without data source, aren't
+    // cached.
+    assert(second.mHits > first.mHits);
+    assert(second.mMisses - first.mMisses < first.mMisses);
+  }
+
+  // The cleared cache goes to the HAL again.
+  AudioObjectUtils::ClearCache();
+  assert(!AudioObjectUtils::GetCacheStats().mEntries);
+  assert(outId == AudioObjectUtils::GetDefaultDeviceId(Output));
+  assert(AudioObjectUtils::GetCacheStats().mMisses == second.mMisses + 1);
+}
+
+void testDeviceSnapshot()
+{
+  DeviceSnapshot snapshot;
+  assert(snapshot.Update());
+
+  // The snapshot matches what the per-device queries return.
+  vector<AudioObjectID> ids = AudioObjectUtils::GetAllDeviceIds();
+  assert(snapshot.Count() == ids.size());
+  for (AudioObjectID id : ids) {
+    const DeviceSnapshot::Device* device = snapshot.Find(id);
+    assert(device);
+    assert(AudioObjectUtils::GetDeviceName(id) == snapshot.GetName(*device));
+    for (auto scope : { Input, Output }) {
+      UInt32 streams = scope == Input ? device->mInputStreams
+                                      : device->mOutputStreams;
+      assert(AudioObjectUtils::InScope(id, scope) == !!streams);
+      assert(AudioObjectUtils::GetDeviceLabel(id, scope) ==
+             snapshot.GetLabel(*device, scope));
+      bool isDefault = scope == Input ? device->mDefaultInput
+                                      : device->mDefaultOutput;
+      assert(isDefault ==
+             (id == AudioObjectUtils::GetDefaultDeviceId(scope)));
+    }
+  }
+  assert(snapshot.GetDefaultDeviceId(Input) ==
+         AudioObjectUtils::GetDefaultDeviceId(Input));
+  assert(snapshot.GetDefaultDeviceId(Output) ==
+         AudioObjectUtils::GetDefaultDeviceId(Output));
+
+  for (const DeviceSnapshot::Device& device : snapshot) {
+    cout << "Device " << device.mId << ": " << snapshot.GetName(device)
+         << ", " << device.mInputStreams << " input streams ("
+         << snapshot.GetLabel(device, Input) << "), "
+         << device.mOutputStreams << " output streams ("
+         << snapshot.GetLabel(device, Output) << ")" << endl;
+  }
+
+  // Refreshing it reuses the same buffers.
+  const DeviceSnapshot::Device* records = snapshot.begin();
+  assert(snapshot.Update());
+  assert(snapshot.Count() != ids.size() || snapshot.begin() == records);
+}
+
+// The descriptors are checked at compile time.
+static_assert(std::is_same<DefaultOutputDeviceProperty::Type,
+                           AudioObjectID>::value, "");
+static_assert(DevicesProperty::kVariableSize &&
+              !DeviceNameProperty::kVariableSize, "");
+static_assert(DataSourceProperty<kAudioObjectPropertyScopeInput>::kAddress
+                .mScope == kAudioObjectPropertyScopeInput, "");
+static_assert(StreamsProperty<kAudioObjectPropertyScopeOutput>::kSelector ==
+              kAudioDevicePropertyStreams, "");
+
+void testPropertyDescriptors()
+{
+  // The typed accessors read the same values as AudioObjectUtils.
+  AudioObjectID outId = kAudioObjectUnknown;
+  OSStatus r = GetProperty<DefaultOutputDeviceProperty>(
+    kAudioObjectSystemObject, &outId);
+  assert(r == kAudioHardwareNoError || !validId(outId));
+  assert(outId == AudioObjectUtils::GetDefaultDeviceId(Output));
+
+  vector<AudioObjectID> ids;
+  r = GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, &ids);
+  assert(r == kAudioHardwareNoError);
+  assert(ids == AudioObjectUtils::GetAllDeviceIds());
+
+  // Reading into a caller's buffer reports the size it needs when it's too
+  // small, and fills it otherwise.
+  AudioObjectID buffer[1];
+  UInt32 read = 0;
+  r = GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, buffer, 1,
+                                        &read);
+  if (ids.size() > 1) {
+    assert(r == kAudioHardwareBadPropertySizeError);
+    assert(read == ids.size());
+  } else {
+    assert(r == kAudioHardwareNoError);
+    assert(read == ids.size());
+    assert(!read || buffer[0] == ids[0]);
+  }
+
+  // Reading again into the same vector reuses its storage.
+  const AudioObjectID* data = ids.data();
+  r = GetPropertyArray<DevicesProperty>(kAudioObjectSystemObject, &ids);
+  assert(r == kAudioHardwareNoError);
+  assert(ids.empty() || ids.data() == data);
+
+  for (AudioObjectID id : ids) {
+    UInt32 count = 0;
+    r = GetPropertyCount<StreamsProperty<kAudioObjectPropertyScopeInput>>(
+      id, &count);
+    assert(r == kAudioHardwareNoError);
+    assert(!!count == AudioObjectUtils::InScope(id, Input));
+  }
+
+  // Uncommenting any of these must fail to compile:
+  // GetProperty<DevicesProperty>(kAudioObjectSystemObject, &outId);
+  // UInt32 source; GetProperty<DeviceNameProperty>(outId, &source);
+  // GetPropertyCount<DefaultOutputDeviceProperty>(kAudioObjectSystemObject,
+  //                                               &count);
+}
+
 int main()
 {
   testGetDefaultDeviceId();
@@ -388,5 +536,8 @@ int main()
   testGetDeviceLabel();
   testGetAllDeviceIds();
   testSetDefaultDevice();
+  testPropertyCache();
+  testDeviceSnapshot();
+  testPropertyDescriptors();
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "AudioStream.h"
+#include "VirtualDeviceBackend.h"
+#include <cassert>  // for assert
+#include <chrono>   // for std::chrono
+#include <iostream> // for std::cout, std::endl
+#include <thread>   // for std::this_thread
+
+using std::cout;
+using std::endl;
+
+const double kRate = 48000.0;
+const unsigned int kChannels = 2;
+const UInt32 kFrames = 256;
+
+unsigned long gCallbacks = 0;
+unsigned long gFrames = 0;
+unsigned int gSleepMs = 0;
+
+/* AudioCallback */
+void callback(void* aBuffer, unsigned long aFrames)
+{
+  float* data = static_cast<float*>(aBuffer);
+  for (unsigned long i = 0; i < aFrames * kChannels; ++i) {
+    data[i] = 0.0f;
+  }
+  gFrames = aFrames;
+  ++gCallbacks;
+  if (gSleepMs) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(gSleepMs));
+  }
+}
+
+VirtualDeviceBackend::Stats run(unsigned int aMs)
+{
+  std::unique_ptr<VirtualDeviceBackend> backend(new VirtualDeviceBackend(kFrames));
+  VirtualDeviceBackend* device = backend.get();
+  AudioStream as(AudioStream::F32LE, kChannels, kRate, callback,
+                 std::move(backend));
+
+  auto start = std::chrono::steady_clock::now();
+  assert(as.Start());
+  std::this_thread::sleep_for(std::chrono::milliseconds(aMs));
+  assert(as.Stop());
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  VirtualDeviceBackend::Stats stats = device->GetStats();
+  cout << "callbacks: " << stats.mCallbacks
+       << ", missed: " << stats.mMissedDeadlines
+       << ", skipped: " << stats.mSkippedPeriods
+       << ", max cost: " << stats.mMaxCallbackNs << " ns"
+       << ", max lateness: " << stats.mMaxLatenessNs << " ns"
+       << ", realtime: " << (stats.mRealtime ? "yes" : "no") << endl;
+
+  // The device clock can never run faster than the simulated hardware.
+  double periods = std::chrono::duration<double>(elapsed).count() *
+                   kRate / kFrames;
+  assert(stats.mCallbacks + stats.mSkippedPeriods <= periods + 1);
+  assert(stats.mCallbacks == gCallbacks);
+  return stats;
+}
+
+void testPacing()
+{
+  gCallbacks = 0;
+  gSleepMs = 0;
+  run(200);
+  assert(gCallbacks > 0 && "Callback should be fired!");
+  assert(gFrames == kFrames);
+}
+
+void testMissedDeadlines()
+{
+  // Sleeping over the period (256 / 48000 ~= 5.3 ms) must miss deadlines.
+  gCallbacks = 0;
+  gSleepMs = 12;
+  VirtualDeviceBackend::Stats stats = run(200);
+  assert(stats.mMissedDeadlines > 0);
+  assert(stats.mMissedDeadlines == stats.mCallbacks);
+  assert(stats.mSkippedPeriods > 0);
+  assert(stats.mMaxCallbackNs >= 12000000);
+}
+
+int main()
+{
+  testPacing();
+  testMissedDeadlines();
+  return 0;
+}
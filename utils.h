@@ -1,17 +1,21 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include <ctime>		// for clock(), CLOCKS_PER_SEC
 #include <iostream>	// for fprintf
+#include "PacingTimer.h" // for PacingTimer
 
+#ifndef ENABLE_LOG
 #define ENABLE_LOG true
+#endif
+#include "RealtimeLog.h" // for RT_LOG
+
+// LOG may block on the stdio lock, so use RT_LOG on the audio threads.
 #define LOG(...) ENABLE_LOG && fprintf(stderr, __VA_ARGS__)
 
-void delay(unsigned int ms)
+// Wait for ms ms of wall-clock time, mostly asleep.
+inline void delay(unsigned int ms)
 {
-	clock_t end;
-	end = clock() + ms * (CLOCKS_PER_SEC/1000);
-	while (clock() < end) {}
+	PacingTimer().WaitFor(ms * 1000000ull);
 }
 
 #endif // #ifndef UTILS_H